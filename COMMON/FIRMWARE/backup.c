@@ -0,0 +1,417 @@
+/*
+* backup.c
+*
+* Backups of the chips in the internal EEPROM, compiled only with CHIP_BACKUP defined.
+* Packed data: a byte below 0x80 is followed by that many plus one literal bytes, a byte from 0x80 is followed by one byte
+* that is repeated its value minus 0x80 plus minRun times. A record is its head unit (packed size, chip type, CRC16 of the chip)
+* and the packed data in the next units. The head and the tail of the ring are unit numbers, the head is written first when
+* records are dropped and the tail last, so a power loss between the writes only loses the new record.
+* The dump and the restore unpack a record byte after byte with one cursor, so they need no buffer of the chip.
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#include <stddef.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include "backup.h"
+#include "uart.h"
+
+#define minRun 3 //shorter runs are cheaper as literals
+#define maxRun (0x7F + minRun)
+#define maxLiterals 0x80
+#define stepHead 0 //steps of writing a record: the head of the ring, the record and the tail
+#define stepRecord 1
+#define hexLine 16 //bytes in one line of the dump
+
+_Static_assert(backupStoreUnits < 256, "units of the ring are numbered with one byte");
+
+static uint8_t store[backupStoreUnits][backupUnit] EEMEM;
+static uint8_t ringHead EEMEM; //oldest record
+static uint8_t ringTail EEMEM; //first free unit, the ring is empty if it is the head
+static backupGolden golden = NULL;
+static uint8_t packed[backupMaxData];
+static uint8_t packedCount = 0;
+static uint8_t literalsHeader = 0; //position of the size of the last literals in packed
+static uint8_t literalsCount = 0; //0 if the last packed bytes are not literals
+static uint8_t runValue = 0;
+static uint8_t runCount = 0;
+static uint16_t chipCrc = 0; //CRC16 of the whole chip given to backupEnd()
+static uint8_t chipType = 0;
+static bool packing = false;
+static bool tooLarge = false;
+static uint8_t header[backupUnit]; //head unit of the waiting record
+static uint8_t newHead = 0;
+static uint8_t newTail = 0;
+static uint8_t recordAt = 0; //first unit of the waiting record
+static uint8_t step = 0; //next byte of the waiting record to write
+static uint8_t stepsCount = 0; //0 if no record waits
+static uint8_t cursorAt = 0; //head unit of the record being unpacked
+static uint8_t cursorType = 0;
+static backupGolden cursorGolden = NULL;
+static uint8_t cursorSize = 0; //packed bytes of the record
+static uint8_t cursorIndex = 0; //next packed byte
+static uint8_t cursorCode = 0; //code of the run or the literals being unpacked
+static uint8_t cursorLeft = 0; //chip bytes of the code that are not unpacked yet
+static uint8_t cursorValue = 0; //packed value of the last chip byte
+static uint8_t cursorByte = 0; //last chip byte
+static uint16_t cursorAddress = 0; //address of the next chip byte
+
+static void putPacked(uint8_t); //adds one byte to the packed data, sets tooLarge if it doesn't fit
+static void putLiteral(uint8_t);
+static void endRun(void); //packs the run of the same bytes as a run or as literals
+static bool readRing(uint8_t *, uint8_t *, bool); //reads the head and the tail, checks all records, returns true if a record of chipType with chipCrc is found if the last argument is true
+static uint8_t recordUnits(uint8_t); //returns units of the record that starts in the given unit
+static uint8_t usedUnits(uint8_t, uint8_t); //returns units between head and tail
+static uint8_t *dataByte(uint8_t, uint8_t); //returns EEPROM address of the given byte of the packed data of the record that starts in the given unit
+static void writeStep(void); //writes one byte of the waiting record
+static void dumpStore(void); //prints all records unpacked
+static void dumpRecord(uint8_t); //prints the chip of the record that starts in the given unit
+static void openRecord(uint8_t, backupGolden); //starts unpacking the record that starts in the given unit with the golden image
+static bool nextByte(void); //unpacks the next chip byte to cursorByte, returns false at the end of the record
+
+void backupInit(backupGolden goldenByte)
+{
+    golden = goldenByte;
+}
+
+void backupBegin(uint8_t type)
+{
+    backupFlush(); //packed holds the waiting record
+    chipType = type;
+    packedCount = 0;
+    literalsCount = 0;
+    runCount = 0;
+    tooLarge = false;
+    packing = true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Called for every byte of the chip while it is read, so it only adds the byte to the run and packs the run when it ends.
+//////////////////////////////////////////////////////////////////////////
+void backupByte(uint8_t readByte, uint8_t goldenByte)
+{
+    uint8_t delta = readByte ^ goldenByte;
+
+    if (runCount != 0 && (delta != runValue || runCount == maxRun))
+    {
+        endRun();
+    }
+    runValue = delta;
+    runCount++;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The CRC16 of the chip is the fingerprint already computed by the caller while reading.
+//Drops the oldest records until the new one fits, nothing is written to the EEPROM yet.
+//////////////////////////////////////////////////////////////////////////
+void backupEnd(bool wholeChip, uint16_t crc)
+{
+    uint8_t head = 0;
+    uint8_t tail = 0;
+
+    if (packing == false)
+    {
+        return;
+    }
+    packing = false;
+    chipCrc = crc;
+    endRun();
+    if (wholeChip == false || tooLarge == true || packedCount == 0 || readRing(&head, &tail, true) == true) //the chip is already stored
+    {
+        return;
+    }
+
+    uint8_t units = 1 + (packedCount + backupUnit - 1) / backupUnit;
+    while (backupStoreUnits - 1 - usedUnits(head, tail) < units) //one unit stays free, otherwise a full ring would look empty
+    {
+        head = (head + recordUnits(head)) % backupStoreUnits;
+    }
+    header[0] = packedCount;
+    header[1] = chipType;
+    header[2] = (uint8_t)chipCrc;
+    header[3] = (uint8_t)(chipCrc >> 8);
+    newHead = head;
+    recordAt = tail;
+    newTail = (tail + units) % backupStoreUnits;
+    step = stepHead;
+    stepsCount = stepRecord + backupUnit + packedCount + 1;
+}
+
+void backupPoll(char command)
+{
+    if (stepsCount != 0 && eeprom_is_ready())
+    {
+        writeStep();
+    }
+    if (command == backupCommand)
+    {
+        backupFlush();
+        dumpStore();
+    }
+}
+
+void backupFlush(void)
+{
+    while (stepsCount != 0)
+    {
+        eeprom_busy_wait();
+        writeStep();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Every record of the type is unpacked and checked with its CRC16, a record damaged by a power loss is never written to a chip.
+//The records are in order of age, so the last one that matches is the chip before its last reset.
+//////////////////////////////////////////////////////////////////////////
+bool backupFind(uint8_t type, uint16_t keptCrc, backupGolden goldenByte, backupKept kept, uint16_t *crc)
+{
+    uint8_t head = 0;
+    uint8_t tail = 0;
+    uint8_t found = backupStoreUnits; //no record
+
+    backupFlush(); //the record of the last reset may still wait
+    readRing(&head, &tail, false);
+    for (uint8_t at = head; at != tail; at = (at + recordUnits(at)) % backupStoreUnits)
+    {
+        uint16_t storedCrc = eeprom_read_byte(&store[at][2]) | (uint16_t)eeprom_read_byte(&store[at][3]) << 8;
+        uint16_t readCrc = 0xFFFF;
+        uint16_t readKept = 0xFFFF;
+
+        if (eeprom_read_byte(&store[at][1]) != type)
+        {
+            continue;
+        }
+        openRecord(at, goldenByte);
+        for (uint16_t address = 0; nextByte() == true; address++)
+        {
+            readCrc = _crc_ccitt_update(readCrc, cursorByte);
+            if (kept(type, (uint8_t)address) == true)
+            {
+                readKept = _crc_ccitt_update(readKept, cursorByte);
+            }
+        }
+        if (readCrc == storedCrc && readKept == keptCrc)
+        {
+            found = at;
+            *crc = storedCrc;
+        }
+    }
+    if (found == backupStoreUnits)
+    {
+        return false;
+    }
+    openRecord(found, goldenByte);
+    return true;
+}
+
+uint8_t backupRestoreByte(uint8_t address)
+{
+    while (cursorAddress <= address && nextByte() == true);
+    return cursorByte;
+}
+
+static void putPacked(uint8_t value)
+{
+    if (packedCount == backupMaxData)
+    {
+        tooLarge = true;
+        return;
+    }
+    packed[packedCount++] = value;
+}
+
+static void putLiteral(uint8_t value)
+{
+    if (literalsCount == 0 || literalsCount == maxLiterals)
+    {
+        literalsHeader = packedCount;
+        literalsCount = 0;
+        putPacked(0);
+    }
+    putPacked(value);
+    if (tooLarge == false)
+    {
+        packed[literalsHeader] = literalsCount++;
+    }
+}
+
+static void endRun(void)
+{
+    if (runCount >= minRun)
+    {
+        putPacked(0x80 + runCount - minRun);
+        putPacked(runValue);
+        literalsCount = 0;
+    }
+    else
+    {
+        for (uint8_t i = 0; i < runCount; i++)
+        {
+            putLiteral(runValue);
+        }
+    }
+    runCount = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//An erased EEPROM has 0xFF in the head and the tail, a record that doesn't fit between the head and the tail
+//means that the ring is damaged, then the ring is treated as empty and the next record starts it again.
+//////////////////////////////////////////////////////////////////////////
+static bool readRing(uint8_t *head, uint8_t *tail, bool find)
+{
+    uint8_t at = eeprom_read_byte(&ringHead);
+
+    *tail = eeprom_read_byte(&ringTail);
+    if (at >= backupStoreUnits || *tail >= backupStoreUnits)
+    {
+        *head = 0;
+        *tail = 0;
+        return false;
+    }
+    *head = at;
+    while (at != *tail)
+    {
+        uint8_t size = eeprom_read_byte(&store[at][0]);
+        if (size == 0 || size > backupMaxData || recordUnits(at) > usedUnits(at, *tail))
+        {
+            *head = *tail;
+            return false;
+        }
+        if (find == true && size == packedCount && eeprom_read_byte(&store[at][1]) == chipType
+            && eeprom_read_byte(&store[at][2]) == (uint8_t)chipCrc && eeprom_read_byte(&store[at][3]) == (uint8_t)(chipCrc >> 8))
+        {
+            return true;
+        }
+        at = (at + recordUnits(at)) % backupStoreUnits;
+    }
+    return false;
+}
+
+static uint8_t recordUnits(uint8_t at)
+{
+    return 1 + (eeprom_read_byte(&store[at][0]) + backupUnit - 1) / backupUnit;
+}
+
+static uint8_t usedUnits(uint8_t head, uint8_t tail)
+{
+    return (tail + backupStoreUnits - head) % backupStoreUnits;
+}
+
+static uint8_t *dataByte(uint8_t at, uint8_t i)
+{
+    return &store[(at + 1 + i / backupUnit) % backupStoreUnits][i % backupUnit];
+}
+
+static void writeStep(void)
+{
+    uint8_t i = step - stepRecord;
+
+    if (step == stepHead)
+    {
+        eeprom_update_byte(&ringHead, newHead);
+    }
+    else if (i < backupUnit)
+    {
+        eeprom_update_byte(&store[recordAt][i], header[i]);
+    }
+    else if (i < backupUnit + packedCount)
+    {
+        eeprom_update_byte(dataByte(recordAt, i - backupUnit), packed[i - backupUnit]);
+    }
+    else
+    {
+        eeprom_update_byte(&ringTail, newTail);
+    }
+    if (++step == stepsCount)
+    {
+        stepsCount = 0;
+    }
+}
+
+static void dumpStore(void)
+{
+    uint8_t head = 0;
+    uint8_t tail = 0;
+
+    readRing(&head, &tail, false);
+    uartPutString("\r\nbackups, units used ");
+    uartPutNumber(usedUnits(head, tail));
+    uartPutString(" of ");
+    uartPutNumber(backupStoreUnits - 1);
+    uartPutString("\r\n");
+    for (uint8_t at = head; at != tail; at = (at + recordUnits(at)) % backupStoreUnits)
+    {
+        dumpRecord(at);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The chip is checked with its CRC16.
+//////////////////////////////////////////////////////////////////////////
+static void dumpRecord(uint8_t at)
+{
+    uint8_t size = eeprom_read_byte(&store[at][0]);
+    uint8_t type = eeprom_read_byte(&store[at][1]);
+    uint16_t crc = eeprom_read_byte(&store[at][2]) | (uint16_t)eeprom_read_byte(&store[at][3]) << 8;
+    uint16_t readCrc = 0xFFFF;
+
+    uartPutString("type ");
+    uartPutNumber(type);
+    uartPutString(", packed ");
+    uartPutNumber(size);
+    uartPutString(" bytes, crc ");
+    uartPutHex(crc >> 8);
+    uartPutHex((uint8_t)crc);
+    openRecord(at, golden);
+    for (uint16_t address = 0; nextByte() == true; address++)
+    {
+        if (address % hexLine == 0)
+        {
+            uartPutString("\r\n");
+        }
+        uartPutHex(cursorByte);
+        readCrc = _crc_ccitt_update(readCrc, cursorByte);
+    }
+    uartPutString(readCrc == crc ? "\r\ncrc ok\r\n" : "\r\ncrc wrong\r\n");
+}
+
+static void openRecord(uint8_t at, backupGolden goldenByte)
+{
+    cursorAt = at;
+    cursorType = eeprom_read_byte(&store[at][1]);
+    cursorGolden = goldenByte;
+    cursorSize = eeprom_read_byte(&store[at][0]);
+    cursorIndex = 0;
+    cursorLeft = 0;
+    cursorAddress = 0;
+}
+
+static bool nextByte(void)
+{
+    bool newCode = false;
+
+    if (cursorLeft == 0)
+    {
+        if (cursorIndex == cursorSize)
+        {
+            return false;
+        }
+        cursorCode = eeprom_read_byte(dataByte(cursorAt, cursorIndex++));
+        cursorLeft = cursorCode < 0x80 ? cursorCode + 1 : cursorCode - 0x80 + minRun;
+        newCode = true;
+    }
+    if (newCode == true || cursorCode < 0x80) //a run has one value, literals have their own
+    {
+        if (cursorIndex == cursorSize)
+        {
+            cursorLeft = 0;
+            return false;
+        }
+        cursorValue = eeprom_read_byte(dataByte(cursorAt, cursorIndex++));
+    }
+    cursorLeft--;
+    cursorByte = cursorValue ^ (cursorGolden != NULL ? cursorGolden(cursorType, (uint8_t)cursorAddress) : 0);
+    cursorAddress++;
+    return true;
+}
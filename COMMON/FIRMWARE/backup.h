@@ -0,0 +1,42 @@
+/*
+* backup.h
+*
+* Backups of the chips in the internal EEPROM, compiled only with CHIP_BACKUP defined. The first read of a reset reads
+* the whole chip, every byte is XORed with the golden image of its profile (the reset data, 0 where the reset doesn't write)
+* and packed with run-length coding, so a chip that differs from the reset data only in its counters takes a few dozen bytes.
+* Records are kept in a ring and found by chip type and CRC16, a chip that is already stored is not stored again
+* and the oldest records are dropped to make room. The reset only packs the bytes it reads, the record is written
+* by backupPoll() in the main loop after the reset. The store is printed on the UART (250000 baud) for 'b'.
+* For 'u' the board writes the newest record of the chip in its socket back to it (backupFind() and backupRestoreByte()).
+* The chip is found by the bytes the reset doesn't write, so it is the state of the chip before its last reset.
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef BACKUP_H
+#define BACKUP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define backupCommand 'b' //UART command of the dump
+#define backupRestore 'u' //UART command of the restore, the board answers "chip N restored", "chip N no backup" or "chip N failed" for every chip
+#define backupUnit 4 //bytes of a unit of the ring, the head of a record is one unit
+#ifndef backupStoreUnits
+#define backupStoreUnits 192 //768 bytes of the EEPROM, with one byte positions the head and the tail are always written whole
+#endif
+#define backupMaxData 64 //packed bytes of one record, a chip that doesn't pack smaller is not stored
+
+typedef uint8_t (*backupGolden)(uint8_t, uint8_t); //returns the golden byte, arguments are chip type and address
+typedef bool (*backupKept)(uint8_t, uint8_t); //returns true if the reset doesn't write the byte, arguments are chip type and address
+
+void backupInit(backupGolden); //sets the golden image used by the dump
+void backupBegin(uint8_t); //starts the backup of a chip of the given type, a record still waiting is written first
+void backupByte(uint8_t, uint8_t); //packs the next byte of the chip, arguments are the read byte and its golden byte
+void backupEnd(bool, uint16_t); //arguments are true if the whole chip was read and the CRC16 of the chip, then the record waits for backupPoll()
+void backupPoll(char); //writes the next byte of the waiting record if the EEPROM is ready, prints the store if the argument is backupCommand
+void backupFlush(void); //writes the waiting record at once
+bool backupFind(uint8_t, uint16_t, backupGolden, backupKept, uint16_t *); //finds the newest record of the chip, arguments are chip type, CRC16 of the bytes the reset doesn't write, the golden image and the kept bytes of the type and the CRC16 of the stored chip, returns false if there is none
+uint8_t backupRestoreByte(uint8_t); //returns the byte of the chip found by backupFind() at the address, the addresses must grow
+
+#endif
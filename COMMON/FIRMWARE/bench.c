@@ -0,0 +1,166 @@
+/*
+* bench.c
+*
+* Self-benchmark of the reset engine, compiled only with SELF_BENCHMARK defined.
+* Phases are timed with Timer1, a phase longer than one overflow of the timer is counted as the longest time it can measure.
+* The results are blinked as digits, every digit is a number of short blinks and zero is one long blink.
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef F_CPU
+#define F_CPU 8000000UL //8MHz internal RC, a crystal clocked board can be built with 16MHz or 20MHz
+#endif
+
+#include <avr/io.h>
+#include <util/delay.h>
+#include "bench.h"
+#include "uart.h"
+#ifdef SRAM_REPORT
+#include "sram.h"
+#endif
+
+#define ticksToUs(ticks) ((uint32_t)(ticks) * 256UL / (F_CPU / 1000000UL)) //Timer1 with prescaler 256, 32us at 8MHz, overflows after 2s
+#define digitPause 800 //milliseconds between digits of one number
+#define numberPause 1500 //between min, mean and max
+#define phasePause 3000 //between phases
+
+typedef struct
+{
+    uint16_t min; //Timer1 ticks
+    uint16_t max;
+    uint32_t sum;
+    uint8_t count; //number of times the phase was timed
+} benchPhase;
+
+static benchPhase phases[benchMaxPhases];
+
+static void printTime(uint32_t); //prints microseconds in milliseconds
+static void blinkNumber(uint32_t, void (*)(bool)); //blinks microseconds as digits of rounded milliseconds
+
+bool benchLongPress(void)
+{
+    for (uint16_t i = 0; i < benchPressTime / 10; i++)
+    {
+        if (bit_is_set(PIND, PIND2)) //released before, a normal reset
+        {
+            return false;
+        }
+        _delay_ms(10);
+    }
+    while (bit_is_clear(PIND, PIND2)); //the chip is not touched while the button is held
+    _delay_ms(50); //let the contacts of the button settle
+    return true;
+}
+
+void benchStart(void)
+{
+    for (uint8_t i = 0; i < benchMaxPhases; i++)
+    {
+        phases[i].min = 0xFFFF;
+        phases[i].max = 0;
+        phases[i].sum = 0;
+        phases[i].count = 0;
+    }
+    TCCR1A = 0;
+    TCCR1B = (1 << CS12); //prescaler 256
+    TCNT1 = 0;
+    TIFR1 = (1 << TOV1); //clear the overflow flag
+}
+
+void benchMark(uint8_t phase)
+{
+    uint16_t ticks = TCNT1;
+
+    TCNT1 = 0;
+    if (TIFR1 & (1 << TOV1)) //the phase was longer than the timer can measure
+    {
+        ticks = 0xFFFF;
+        TIFR1 = (1 << TOV1);
+    }
+    if (ticks < phases[phase].min)
+    {
+        phases[phase].min = ticks;
+    }
+    if (ticks > phases[phase].max)
+    {
+        phases[phase].max = ticks;
+    }
+    phases[phase].sum += ticks;
+    phases[phase].count++;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Prints one line for every phase on the UART, then blinks min, mean and max of every phase in the same order.
+//Without a connected UART the text is simply lost, so it is always sent.
+//////////////////////////////////////////////////////////////////////////
+void benchReport(const char *const names[], uint8_t phasesCount, void (*led)(bool))
+{
+    uartInit();
+    uartPutString("\r\nbenchmark, F_CPU ");
+    uartPutNumber(F_CPU);
+    uartPutString(", ");
+    uartPutNumber(phases[0].count);
+    uartPutString(" cycles\r\nphase: min mean max\r\n");
+    for (uint8_t i = 0; i < phasesCount; i++)
+    {
+        uartPutString(names[i]);
+        uartPutString(": ");
+        printTime(ticksToUs(phases[i].min));
+        uartPutChar(' ');
+        printTime(ticksToUs(phases[i].sum / phases[i].count));
+        uartPutChar(' ');
+        printTime(ticksToUs(phases[i].max));
+        uartPutString("\r\n");
+    }
+
+    for (uint8_t i = 0; i < phasesCount; i++)
+    {
+        blinkNumber(ticksToUs(phases[i].min), led);
+        _delay_ms(numberPause);
+        blinkNumber(ticksToUs(phases[i].sum / phases[i].count), led);
+        _delay_ms(numberPause);
+        blinkNumber(ticksToUs(phases[i].max), led);
+        _delay_ms(phasePause);
+    }
+#ifdef SRAM_REPORT
+    sramReport(); //the benchmark went through all reset code, so the stack peak is known
+#endif
+}
+
+static void printTime(uint32_t us)
+{
+    uartPutNumber(us / 1000);
+    uartPutChar('.');
+    uartPutChar('0' + (us / 100) % 10);
+    uartPutString("ms");
+}
+
+static void blinkNumber(uint32_t us, void (*led)(bool))
+{
+    uint32_t ms = (us + 500) / 1000;
+    uint32_t divider = 1;
+
+    while (divider * 10 <= ms)
+    {
+        divider *= 10;
+    }
+    for (; divider > 0; divider /= 10)
+    {
+        uint8_t digit = (ms / divider) % 10;
+        if (digit == 0)
+        {
+            led(true);
+            _delay_ms(1000);
+            led(false);
+        }
+        for (uint8_t i = 0; i < digit; i++)
+        {
+            led(true);
+            _delay_ms(200);
+            led(false);
+            _delay_ms(300);
+        }
+        _delay_ms(digitPause);
+    }
+}
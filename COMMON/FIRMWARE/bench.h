@@ -0,0 +1,28 @@
+/*
+* bench.h
+*
+* Self-benchmark of the reset engine, compiled only with SELF_BENCHMARK defined.
+* A long press of the button runs benchCycles read/reset/verify cycles on the connected chip, every phase is timed with Timer1.
+* Min, mean and max of every phase are blinked on the LED in milliseconds and printed on the UART (250000 baud) if it is connected.
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef benchCycles
+#define benchCycles 10 //timed cycles of one benchmark, every cycle writes the chip EEPROM once
+#endif
+#define benchPressTime 2000 //milliseconds the button must be held to start the benchmark instead of a reset
+#define benchMaxPhases 3
+
+bool benchLongPress(void); //called after the button was pressed, returns true after it was held for benchPressTime and released
+void benchStart(void); //clears the results and starts the time of the first phase
+void benchMark(uint8_t); //ends the given phase, the next phase starts at once
+void benchReport(const char *const[], uint8_t, void (*)(bool)); //prints and blinks the results, arguments are phase names, number of phases and LED switch
+
+#endif
@@ -0,0 +1,98 @@
+/*
+* control.c
+*
+* Control of the board over the UART, compiled only with SERIAL_CONTROL defined.
+* The reports of SRAM_REPORT, CHIP_BACKUP and CHIP_HEALTH are sent by their modules in the same pass of the main loop, before the "ok".
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#include "control.h"
+#include "uart.h"
+#ifdef SRAM_REPORT
+#include "sram.h"
+#endif
+#ifdef CHIP_BACKUP
+#include "backup.h"
+#endif
+#ifdef CHIP_HEALTH
+#include "health.h"
+#endif
+
+static uint16_t chipCrcs[controlChips];
+static uint8_t chipsRead = 0; //bit for every chip with a fingerprint in chipCrcs
+
+bool controlCommand(char command, uint16_t resets, uint16_t retries, uint16_t fingerprint)
+{
+    switch (command)
+    {
+        case 0: //nothing received
+        case '\r': //line ends of a terminal
+        case '\n':
+            return false;
+
+        case controlReset:
+            return true;
+
+        case controlStats:
+            uartPutString("resets ");
+            uartPutNumber(resets);
+            uartPutString(" retries ");
+            uartPutNumber(retries);
+            uartPutString(" crc ");
+            uartPutHex(fingerprint >> 8);
+            uartPutHex((uint8_t)fingerprint);
+            uartPutString("\r\n");
+            break;
+
+#ifdef SRAM_REPORT
+        case sramCommand:
+            break;
+#endif
+#ifdef CHIP_BACKUP
+        case backupCommand:
+        case backupRestore: //the board restores its chips in the same pass
+            break;
+#endif
+#ifdef CHIP_HEALTH
+        case healthCommand:
+            break;
+#endif
+
+        default:
+            uartPutString("?\r\n");
+            return false;
+    }
+    uartPutString("ok\r\n");
+    return false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Called during the reset, so nothing is sent until controlDone(). A chip read again (the self-benchmark) keeps its last CRC.
+//////////////////////////////////////////////////////////////////////////
+void controlChip(uint8_t chip, uint16_t crc)
+{
+    if (chip < controlChips)
+    {
+        chipCrcs[chip] = crc;
+        chipsRead |= 1 << chip;
+    }
+}
+
+void controlDone(void)
+{
+    for (uint8_t chip = 0; chip < controlChips; chip++)
+    {
+        if (chipsRead & (1 << chip))
+        {
+            uartPutString("chip ");
+            uartPutNumber(chip);
+            uartPutString(" crc ");
+            uartPutHex(chipCrcs[chip] >> 8);
+            uartPutHex((uint8_t)chipCrcs[chip]);
+            uartPutString("\r\n");
+        }
+    }
+    chipsRead = 0;
+    uartPutString("done\r\n");
+}
@@ -0,0 +1,27 @@
+/*
+* control.h
+*
+* Control of the board over the UART (250000 baud), compiled only with SERIAL_CONTROL defined, so a host can drive
+* many boards at once (TOOLS/FLEET). Every command is one char, every answer ends with one line: "done" after a reset,
+* "ok" after the other commands and "?" for a command this build doesn't know. A reset started by the button
+* ends with "done" too. Before "done" every chip read by the reset is sent as "chip N crc XXXX", the CRC16
+* (_crc_ccitt_update from 0xFFFF) of the bytes read before the reset, so the host knows chips it has seen already.
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define controlReset 'r' //starts a reset like the button
+#define controlStats 's' //sends "resets N retries N" since power on and "crc XXXX" of the last chip
+#define controlChips 8 //chips of one reset with a fingerprint, the sockets of the SP112 resetter
+
+bool controlCommand(char, uint16_t, uint16_t, uint16_t); //answers the received char, returns true if it starts a reset, arguments are the char and the statistics of the board
+void controlChip(uint8_t, uint16_t); //keeps the fingerprint of the chip until the end of the reset, arguments are the chip number and the CRC16
+void controlDone(void); //sends the fingerprints and the end of a reset
+
+#endif
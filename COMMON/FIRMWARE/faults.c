@@ -0,0 +1,273 @@
+/*
+* faults.c
+*
+* Fault injection for bench tests of the firmware, compiled only with FAULT_INJECTION defined.
+* The first byte on the bus after the start of a scenario is byte 0, faults start at the selected byte.
+* Times are measured with Timer1 from the first faulty byte to the result shown by the firmware.
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef F_CPU
+#define F_CPU 8000000UL //8MHz internal RC, a crystal clocked board can be built with 16MHz or 20MHz
+#endif
+
+#include <avr/io.h>
+#include <avr/wdt.h>
+#include <util/delay.h>
+#include <util/twi.h>
+#include "faults.h"
+#include "uart.h"
+
+#define noResult 0xFF
+#define hangTimeout WDTO_2S //much longer than the longest reset with all retries
+#define tickUs (1024000000UL / F_CPU) //Timer1 with prescaler 1024, 128us at 8MHz, overflows after 8s
+
+typedef struct
+{
+    uint8_t kind;
+    uint16_t position; //byte at which the fault starts, extra busy polls of every write for faultLongWrite
+} faultScenario;
+
+static const faultScenario scenarios[] = {{faultNone, 0},
+                                          {faultNack, 0}, {faultNack, 5}, {faultNack, 40},
+                                          {faultStuckData, 0}, {faultStuckData, 40},
+                                          {faultBitFlip, 3}, {faultBitFlip, 40},
+                                          {faultLongWrite, 20}, {faultLongWrite, 300},
+                                          {faultRemoval, 5}, {faultRemoval, 40}, {faultRemoval, 150}};
+static const char *const kindNames[faultKinds] = {"none", "nack", "stuck", "bitflip", "longwrite", "removal"};
+#define scenariosCount (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static uint8_t kind = faultNone;
+static uint16_t position = 0;
+static uint16_t byteCount = 0; //bytes on the bus since the start of the scenario
+static bool triggered = false; //the fault started
+static uint16_t triggerTicks = 0;
+static uint8_t dataBytes = 0; //bytes written after the address in the current transaction
+static bool writeCycle = false; //the last transaction started a write cycle
+static uint16_t busyPolls = 0; //extra busy answers given in the current write cycle
+static uint8_t result = noResult;
+static uint16_t resultTicks = 0;
+static uint8_t lastScenario __attribute__((section(".noinit"))); //survives the watchdog reset
+static uint8_t resetCause __attribute__((section(".noinit")));
+
+void faultInit(void) __attribute__((naked, used, section(".init3")));
+
+static uint8_t countByte(void); //counts one byte on the bus, returns the fault that applies to it
+static void trigger(void); //notes the time of the first faulty byte
+static void printTime(uint16_t); //prints ticks of Timer1 in milliseconds
+
+//////////////////////////////////////////////////////////////////////////
+//The watchdog stays on with the shortest timeout after it reset the board, so it is stopped before main.
+//////////////////////////////////////////////////////////////////////////
+void faultInit(void)
+{
+    resetCause = MCUSR;
+    MCUSR = 0;
+    wdt_disable();
+}
+
+static uint8_t countByte(void)
+{
+    uint16_t current = byteCount++;
+
+    if (kind == faultNone || kind == faultLongWrite || current < position)
+    {
+        return faultNone;
+    }
+    if (current == position)
+    {
+        trigger();
+        return kind;
+    }
+    return (kind == faultStuckData || kind == faultRemoval) ? kind : faultNone; //other faults hit only the selected byte
+}
+
+static void trigger(void)
+{
+    if (triggered == false)
+    {
+        triggered = true;
+        triggerTicks = TCNT1;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Called for the status of every address and written byte. A missing acknowledge is shown as NACK,
+//a long write cycle as busy answers to the address after a transaction that wrote data.
+//////////////////////////////////////////////////////////////////////////
+uint8_t faultI2cStatus(uint8_t status)
+{
+    if (status == TW_START || status == TW_REP_START)
+    {
+        return status;
+    }
+    uint8_t fault = countByte();
+    bool address = (status == TW_MT_SLA_ACK || status == TW_MR_SLA_ACK);
+
+    if (address)
+    {
+        writeCycle = writeCycle || dataBytes > 1; //word address and at least one data byte
+        dataBytes = 0;
+    }
+    else if (status == TW_MT_DATA_ACK)
+    {
+        dataBytes++;
+    }
+    if (fault == faultNack || fault == faultRemoval)
+    {
+        return address ? (status == TW_MT_SLA_ACK ? TW_MT_SLA_NACK : TW_MR_SLA_NACK) : (status == TW_MT_DATA_ACK ? TW_MT_DATA_NACK : status);
+    }
+    if (kind == faultLongWrite && address && writeCycle)
+    {
+        if (busyPolls < position)
+        {
+            trigger();
+            busyPolls++;
+            return status == TW_MT_SLA_ACK ? TW_MT_SLA_NACK : TW_MR_SLA_NACK;
+        }
+        writeCycle = false;
+        busyPolls = 0;
+    }
+    return status;
+}
+
+uint8_t faultI2cData(uint8_t data)
+{
+    switch (countByte())
+    {
+        case faultStuckData:
+            return 0x00;
+
+        case faultBitFlip:
+            return data ^ 0x01;
+
+        case faultRemoval:
+            return 0xFF; //nothing drives SDA, the pull-up keeps it high
+    }
+    return data;
+}
+
+bool faultI2cStuck(void)
+{
+    if (kind == faultStuckData && byteCount >= position)
+    {
+        trigger();
+        return true;
+    }
+    return false;
+}
+
+uint8_t faultEpsonData(uint8_t data)
+{
+    switch (countByte())
+    {
+        case faultNack:
+            return data & 0xF0; //no "ACK" in the low nibble
+
+        case faultStuckData:
+        case faultRemoval:
+            return 0x00;
+
+        case faultBitFlip:
+            return data ^ 0x01;
+    }
+    return data;
+}
+
+bool faultRemoved(void)
+{
+    return kind == faultRemoval && triggered == true;
+}
+
+void faultResult(uint8_t code)
+{
+    if (result == noResult) //with many chips only the first result is kept
+    {
+        result = code;
+        resultTicks = TCNT1;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Prints one line for every scenario: fault, byte, result of the firmware, time from the first faulty byte to the result
+//and time of the whole reset. A scenario that didn't finish before the watchdog timeout is printed as a hang after the reset.
+//////////////////////////////////////////////////////////////////////////
+void faultRun(void (*reset)(void))
+{
+    uint8_t first = 0;
+
+    uartInit();
+    TCCR1A = 0;
+    TCCR1B = (1 << CS12) | (1 << CS10); //prescaler 1024
+    if ((resetCause & (1 << WDRF)) && lastScenario < scenariosCount)
+    {
+        uartPutString("hang\r\n"); //the line of the scenario was printed before the reset
+        first = lastScenario + 1;
+    }
+    else
+    {
+        uartPutString("\r\nfault injection, F_CPU ");
+        uartPutNumber(F_CPU);
+        uartPutString("\r\nfault byte: result detected total\r\n");
+    }
+
+    for (uint8_t i = first; i < scenariosCount; i++)
+    {
+        lastScenario = i;
+        kind = scenarios[i].kind;
+        position = scenarios[i].position;
+        byteCount = 0;
+        triggered = false;
+        dataBytes = 0;
+        writeCycle = false;
+        busyPolls = 0;
+        result = noResult;
+        uartPutString(kindNames[kind]);
+        uartPutChar(' ');
+        uartPutNumber(position);
+        uartPutString(": ");
+
+        TCNT1 = 0;
+        wdt_enable(hangTimeout);
+        reset();
+        wdt_disable();
+        uint16_t endTicks = TCNT1;
+
+        if (result == noResult)
+        {
+            uartPutString("no result");
+        }
+        else
+        {
+            uartPutNumber(result);
+            uartPutChar(' ');
+            if (triggered == true)
+            {
+                printTime(resultTicks - triggerTicks);
+            }
+            else
+            {
+                uartPutString("-"); //the reset ended before the fault started
+            }
+        }
+        uartPutChar(' ');
+        printTime(endTicks);
+        uartPutString("\r\n");
+        _delay_ms(100); //let the chip finish its last write cycle
+    }
+    kind = faultNone;
+    lastScenario = 0xFF;
+    uartPutString("done\r\n");
+    while (1);
+}
+
+static void printTime(uint16_t ticks)
+{
+    uint32_t us = (uint32_t)ticks * tickUs;
+
+    uartPutNumber(us / 1000);
+    uartPutChar('.');
+    uartPutChar('0' + (us / 100) % 10);
+    uartPutString("ms");
+}
@@ -0,0 +1,34 @@
+/*
+* faults.h
+*
+* Fault injection for bench tests of the firmware, compiled only with FAULT_INJECTION defined.
+* Every byte on the chip bus passes through the fault hooks, faultRun() resets the connected chip once
+* for every scenario and reports over the UART which result the firmware showed, how long it needed
+* to notice the fault and whether it hung (the watchdog resets the board then and the next scenario follows).
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef FAULTS_H
+#define FAULTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define faultNone 0
+#define faultNack 1 //the selected byte is not acknowledged, on the Epson bus the "ACK" nibble is missing
+#define faultStuckData 2 //the data line is held low from the selected byte on
+#define faultBitFlip 3 //bit 0 of the selected byte read from the chip is flipped
+#define faultLongWrite 4 //every write cycle is longer, the chip answers busy to the given number of extra polls
+#define faultRemoval 5 //the chip is removed at the selected byte
+#define faultKinds 6
+
+uint8_t faultI2cStatus(uint8_t); //returns the TWI status seen by the firmware for the real one
+uint8_t faultI2cData(uint8_t); //returns the byte seen by the firmware for the byte read from the chip
+bool faultI2cStuck(void); //returns true if the data line is stuck, the TWI doesn't finish then
+uint8_t faultEpsonData(uint8_t); //returns the byte seen by the DX4050 engine for the byte read from the chip
+bool faultRemoved(void); //returns true after the chip was removed
+void faultResult(uint8_t); //result shown by the firmware, 0 - reset successful, other values are the error blinks of the board
+void faultRun(void (*)(void)); //runs the reset function for every scenario, never returns
+
+#endif
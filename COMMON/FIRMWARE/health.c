@@ -0,0 +1,149 @@
+/*
+* health.c
+*
+* Health of the chips, compiled only with CHIP_HEALTH defined.
+* The write load is the mean time of one page write in 1/256 of 20ms (i2c_wait_load()),
+* so it is the same unit for every SCL clock and board. A record is found by chip type and identity, a new chip takes
+* the record after the one taken last. Records are written with eeprom_update_block(), only bytes that change are written.
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#include <stddef.h>
+#include <avr/eeprom.h>
+#include "health.h"
+#include "uart.h"
+
+#define noChip 0xFF //type of an empty record, the erased EEPROM
+#define wornFlag 0x01
+
+typedef struct
+{
+    uint16_t id; //identity of the chip given by the board
+    uint8_t resets; //resets of the chip, stops at 255
+    uint8_t lowLoad; //lowest write load of a reset, 0 if no write was timed yet
+    uint8_t lastLoad; //write load of the last reset with timed writes
+    uint8_t retried; //resets that needed retries, stops at 255
+    uint8_t flags;
+    uint8_t type; //noChip in an empty record, written last
+} chipHealth;
+
+static chipHealth table[healthRecords] EEMEM;
+static uint8_t nextRecord EEMEM; //record taken by the next new chip, 0xFF of the erased EEPROM is a record number too
+
+static uint8_t findRecord(uint8_t, uint16_t); //returns the record of the chip, healthRecords if it is not in the table
+static bool isWorn(const chipHealth *, uint8_t); //arguments are the updated record and the write load of the reset
+static void dumpTable(void);
+
+//////////////////////////////////////////////////////////////////////////
+//Called at the end of the reset, before the result is shown. The record is written at once, it is one 3.4ms write
+//of every changed byte, usually the resets, the last load and the flags.
+//////////////////////////////////////////////////////////////////////////
+bool healthCheck(uint8_t type, uint16_t id, uint8_t load, uint8_t retries)
+{
+    chipHealth chip = {id, 0, 0, 0, 0, 0, type};
+    uint8_t at = findRecord(type, id);
+
+    if (at == healthRecords) //the record stays empty until it is written whole, a power loss can't give the new chip the data of the old one
+    {
+        at = eeprom_read_byte(&nextRecord) % healthRecords;
+        eeprom_update_byte(&nextRecord, (at + 1) % healthRecords);
+        eeprom_update_byte(&table[at].type, noChip);
+    }
+    else
+    {
+        eeprom_read_block(&chip, &table[at], sizeof(chipHealth));
+    }
+    if (chip.resets < 255)
+    {
+        chip.resets++;
+    }
+    if (retries != 0 && chip.retried < 255)
+    {
+        chip.retried++;
+    }
+    if (load != 0)
+    {
+        chip.lastLoad = load;
+        if (chip.lowLoad == 0 || load < chip.lowLoad)
+        {
+            chip.lowLoad = load;
+        }
+    }
+    if (isWorn(&chip, load) == true)
+    {
+        chip.flags |= wornFlag;
+    }
+    eeprom_update_block(&chip, &table[at], offsetof(chipHealth, type));
+    eeprom_update_byte(&table[at].type, type);
+    return (chip.flags & wornFlag) != 0;
+}
+
+void healthPoll(char command)
+{
+    if (command == healthCommand)
+    {
+        dumpTable();
+    }
+}
+
+static uint8_t findRecord(uint8_t type, uint16_t id)
+{
+    chipHealth chip;
+
+    for (uint8_t at = 0; at < healthRecords; at++)
+    {
+        eeprom_read_block(&chip, &table[at], sizeof(chipHealth));
+        if (chip.type == type && chip.id == id)
+        {
+            return at;
+        }
+    }
+    return healthRecords;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//A slow write is worn at once. Growth over the lowest load is only counted after the first reset, which gave
+//the lowest load, and retries only when they are not a single bad contact.
+//////////////////////////////////////////////////////////////////////////
+static bool isWorn(const chipHealth *chip, uint8_t load)
+{
+    if (load >= healthSlowLoad)
+    {
+        return true;
+    }
+    if (load != 0 && chip->resets > 1 && load - chip->lowLoad > chip->lowLoad / 2 + healthLoadNoise)
+    {
+        return true;
+    }
+    return chip->retried >= healthMinRetried && (uint16_t)chip->retried * healthRetryShare >= chip->resets;
+}
+
+static void dumpTable(void)
+{
+    chipHealth chip;
+
+    uartPutString("\r\nchip health\r\n");
+    for (uint8_t at = 0; at < healthRecords; at++)
+    {
+        eeprom_read_block(&chip, &table[at], sizeof(chipHealth));
+        if (chip.type == noChip)
+        {
+            continue;
+        }
+        uartPutString("type ");
+        uartPutHex(chip.type);
+        uartPutString(" id ");
+        uartPutHex(chip.id >> 8);
+        uartPutHex((uint8_t)chip.id);
+        uartPutString(" resets ");
+        uartPutNumber(chip.resets);
+        uartPutString(" load ");
+        uartPutNumber(chip.lowLoad);
+        uartPutString(" last ");
+        uartPutNumber(chip.lastLoad);
+        uartPutString(" retried ");
+        uartPutNumber(chip.retried);
+        uartPutString((chip.flags & wornFlag) != 0 ? " worn\r\n" : "\r\n");
+    }
+}
@@ -0,0 +1,36 @@
+/*
+* health.h
+*
+* Health of the chips, compiled only with CHIP_HEALTH defined. After every reset the board gives the chip type, the identity
+* of the chip (the ID bytes of the Epson chip, the CRC16 of the serial number of the RICOH chips, see serial in their data maps), the write
+* load of its page writes and its verify retries. A table in the internal EEPROM keeps every chip seen: its resets, the lowest
+* and the last write load and the resets that needed retries. A chip is worn when its writes are slow, when they became much
+* slower than its own lowest load or when too many of its resets need retries, a worn chip stays worn. The board then shows
+* the worn code (5 blinks) instead of the reset, so the chip can be thrown out before it fails in the printer.
+* The table is printed on the UART (250000 baud) for 'h'.
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define healthCommand 'h' //UART command of the dump
+#ifndef healthRecords
+#define healthRecords 16 //chips in the table, a new chip takes the record of the chip seen longest ago
+#endif
+#define healthDx4050 0x10 //chip types of the boards, plus the color of the Epson chip from 0 to 3
+#define healthSp112 0x20
+#define healthSg2100n 0x30 //plus journalId of the profile
+#define healthSlowLoad 128 //write load of a slow chip, about 10ms a page, twice the write cycle of the datasheets
+#define healthLoadNoise 8 //growth of the load over the lowest one that is never counted, a poll more or less
+#define healthRetryShare 4 //a chip is worn when one of this many resets needs retries
+#define healthMinRetried 2 //but not before this many resets needed them
+
+bool healthCheck(uint8_t, uint16_t, uint8_t, uint8_t); //records the reset of the chip, returns true if it is worn, arguments are type, identity, write load (0 if no write was timed) and retries of the reset
+void healthPoll(char); //prints the table if the argument is healthCommand
+
+#endif
@@ -0,0 +1,447 @@
+/*************************************************************************
+* Title:    I2C master library using hardware TWI interface
+* Author:   Peter Fleury <pfleury@gmx.ch>  http://jump.to/fleury
+* File:     $Id: twimaster.c,v 1.3 2005/07/02 11:14:21 Peter Exp $
+* Software: AVR-GCC 3.4.3 / avr-libc 1.2.3
+* Target:   any AVR device with hardware TWI 
+* Usage:    API compatible with I2C Software Library i2cmaster.h
+**************************************************************************/
+#include <inttypes.h>
+#include <avr/io.h>
+#include <util/twi.h>
+
+#include "i2cmaster.h"
+
+
+/* define CPU frequency in Mhz here if not defined in Makefile */
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+#include <util/delay.h>
+
+/* I2C clock in Hz, 400kHz when F_CPU is high enough for it (16MHz or more), else 100kHz */
+#ifndef SCL_CLOCK
+#if (F_CPU/400000L) >= 36
+#define SCL_CLOCK  400000L
+#else
+#define SCL_CLOCK  100000L
+#endif
+#endif
+
+/*compute TWBR value for given SCL_CLOCK and F_CPU frequency*/
+#ifndef TWBR_VALUE
+#define TWBR_VALUE ((F_CPU/SCL_CLOCK)-16)/2
+#endif
+
+/* ack polling of i2c_start_wait, one poll takes at least 11 SCL periods: start, address with acknowledge and stop */
+#define I2C_POLL_PERIODS 11
+#define I2C_MS_POLLS(ms) ((uint32_t)(ms)*SCL_CLOCK/1000/I2C_POLL_PERIODS)
+#define I2C_LOAD_POLLS   I2C_MS_POLLS(20)    /* polls of a write load of 256 */
+#define I2C_WRITE_CYCLE  5                   /* ms, write cycle of the device until i2c_write_cycle is called */
+
+/* pins of the TWI, used to recover the bus */
+#define I2C_PIN  PINC
+#define I2C_DDR  DDRC
+#define I2C_PORT PORTC
+#define SDA_PIN  PC4
+#define SCL_PIN  PC5
+
+/* status and read data pass through the fault hooks in bench builds */
+#ifdef FAULT_INJECTION
+#include "faults.h"
+#define I2C_STATUS()  faultI2cStatus(TW_STATUS & 0xF8)
+#define I2C_DATA()    faultI2cData(TWDR)
+#define I2C_STUCK()   faultI2cStuck()
+#else
+#define I2C_STATUS()  (TW_STATUS & 0xF8)
+#define I2C_DATA()    TWDR
+#define I2C_STUCK()   0
+#endif
+
+/* timing probes, the gap of a byte is from the end of the previous operation to the command for the byte */
+#ifdef TIMING_PROBE
+#include "timing.h"
+#define I2C_BUS_START()  timingBusStart()
+#define I2C_OP_DONE()    timingStamp(timingStart)
+#define I2C_NEXT_BYTE()  timingStamp(timingTwiGap)
+#define I2C_BUS_END()    timingFlush()
+#else
+#define I2C_BUS_START()
+#define I2C_OP_DONE()
+#define I2C_NEXT_BYTE()
+#define I2C_BUS_END()
+#endif
+
+_Static_assert(TWBR_VALUE >= 10 && TWBR_VALUE <= 255, "SCL_CLOCK can't be generated at this F_CPU, TWBR must be from 10 to 255");
+
+static uint16_t busy_polls = 0;      /* busy answers of the device in the last i2c_start_wait */
+static uint16_t wait_polls = I2C_MS_POLLS(I2C_WRITE_CYCLE*I2C_WAIT_MARGIN);  /* polls after which i2c_start_wait gives up */
+static uint8_t bus_error = 0;        /* set by an operation that timed out, cleared by i2c_init and i2c_recover */
+static uint32_t bus_periods = 0;     /* SCL periods of all operations and idle polls, the clock of i2c_bus_polls */
+
+
+/*************************************************************************
+ Waits until the current operation is done. If SCL is held low for far
+ longer than one byte (about 50ms at 8MHz), the TWI is disabled and
+ every next operation fails at once, without enabling it again, until
+ the bus is recovered.
+ Input:   SCL periods of the operation, 1 for a start, 9 for a byte
+ return 0 = done, 1 = bus stuck
+*************************************************************************/
+static unsigned char i2c_wait(unsigned char periods)
+{
+    uint16_t loops = 0;
+
+	while(!(TWCR & (1<<TWINT)) || I2C_STUCK())
+	{
+	    if (++loops == 0)
+	    {
+	        TWCR = 0;                   /* release the bus, i2c_recover() brings it back */
+	        bus_error = 1;
+	        return 1;
+	    }
+	}
+	I2C_OP_DONE();
+	bus_periods += periods;
+	return 0;
+
+}/* i2c_wait */
+
+
+/*************************************************************************
+ Sends a stop condition and waits until it is executed, as long as
+ i2c_wait waits for an operation.
+ return 0 = bus released, 1 = bus stuck
+*************************************************************************/
+static unsigned char i2c_send_stop(void)
+{
+    uint16_t loops = 0;
+
+	if (bus_error) return 1;
+	TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWSTO);
+
+	// wait until stop condition is executed and bus released
+	while(TWCR & (1<<TWSTO))
+	{
+	    if (++loops == 0)
+	    {
+	        TWCR = 0;
+	        bus_error = 1;
+	        return 1;
+	    }
+	}
+	I2C_BUS_END();
+	bus_periods++;
+	return 0;
+
+}/* i2c_send_stop */
+
+
+/*************************************************************************
+ Initialization of the I2C bus interface. Need to be called only once
+*************************************************************************/
+void i2c_init(void)
+{
+  /* initialize TWI clock: SCL_CLOCK, TWPS = 0 => prescaler = 1 */
+  
+  TWSR = 0;                         /* no prescaler */
+  TWBR = TWBR_VALUE;  /* must be > 10 for stable operation */
+  bus_error = 0;
+
+}/* i2c_init */
+
+
+/*************************************************************************	
+  Issues a start condition and sends address and transfer direction.
+  return 0 = device accessible, 1= failed to access device
+*************************************************************************/
+unsigned char i2c_start(unsigned char address)
+{
+    uint8_t   twst;
+
+	if (bus_error) return 1;
+	I2C_BUS_START();
+	// send START condition
+	TWCR = (1<<TWINT) | (1<<TWSTA) | (1<<TWEN);
+
+	// wait until transmission completed
+	if (i2c_wait(1)) return 1;
+
+	// check value of TWI Status Register. Mask prescaler bits.
+	twst = I2C_STATUS();
+	if ( (twst != TW_START) && (twst != TW_REP_START)) return 1;
+
+	// send device address
+	TWDR = address;
+	I2C_NEXT_BYTE();
+	TWCR = (1<<TWINT) | (1<<TWEN);
+
+	// wail until transmission completed and ACK/NACK has been received
+	if (i2c_wait(9)) return 1;
+
+	// check value of TWI Status Register. Mask prescaler bits.
+	twst = I2C_STATUS();
+	if ( (twst != TW_MT_SLA_ACK) && (twst != TW_MR_SLA_ACK) ) return 1;
+
+	return 0;
+
+}/* i2c_start */
+
+
+/*************************************************************************
+ Issues a start condition and sends address and transfer direction.
+ If device is busy, use ack polling to wait until device is ready
+ 
+ Input:   address and transfer direction of I2C device
+
+ Return:  0 device accessible
+          1 device didn't answer within I2C_WAIT_MARGIN write cycles or bus is stuck
+*************************************************************************/
+unsigned char i2c_start_wait(unsigned char address)
+{
+    uint8_t   twst;
+
+
+    if (bus_error) return 1;
+    I2C_BUS_START();
+    for ( uint16_t polls = 0; polls < wait_polls; polls++ )
+    {
+	    // send START condition
+	    TWCR = (1<<TWINT) | (1<<TWSTA) | (1<<TWEN);
+    
+    	// wait until transmission completed
+    	if (i2c_wait(1)) return 1;
+    
+    	// check value of TWI Status Register. Mask prescaler bits.
+    	twst = I2C_STATUS();
+    	if ( (twst != TW_START) && (twst != TW_REP_START)) continue;
+    
+    	// send device address
+    	TWDR = address;
+    	I2C_NEXT_BYTE();
+    	TWCR = (1<<TWINT) | (1<<TWEN);
+    
+    	// wail until transmission completed
+    	if (i2c_wait(9)) return 1;
+    
+    	// check value of TWI Status Register. Mask prescaler bits.
+    	twst = I2C_STATUS();
+    	if ( (twst == TW_MT_SLA_NACK )||(twst ==TW_MR_DATA_NACK) ) 
+    	{    	    
+    	    /* device busy, send stop condition to terminate write operation */
+	        if (i2c_send_stop()) return 1;
+	        
+    	    continue;
+    	}
+    	if ( twst == TW_MT_ARB_LOST ) continue;   /* bus was busy, try again */
+    	busy_polls = polls;
+    	return 0;
+     }
+     return 1;
+
+}/* i2c_start_wait */
+
+
+/*************************************************************************
+ Sets the polls of i2c_start_wait to I2C_WAIT_MARGIN write cycles of the
+ device, so a slow device is waited for and a removed one is found soon
+
+ Input:   write cycle of the device in ms
+*************************************************************************/
+void i2c_write_cycle(unsigned char ms)
+{
+    uint32_t polls = I2C_MS_POLLS((uint16_t)ms*I2C_WAIT_MARGIN);
+
+    wait_polls = polls > 0xFFFF ? 0xFFFF : polls;
+
+}/* i2c_write_cycle */
+
+
+/*************************************************************************
+ Returns the polls after which i2c_start_wait gives up
+*************************************************************************/
+unsigned int i2c_wait_polls(void)
+{
+    return wait_polls;
+
+}/* i2c_wait_polls */
+
+
+/*************************************************************************
+ Returns the busy answers of the device in the last i2c_start_wait that
+ reached it, for an EEPROM this is its write cycle time in polls
+*************************************************************************/
+unsigned int i2c_busy_polls(void)
+{
+    return busy_polls;
+
+}/* i2c_busy_polls */
+
+
+/*************************************************************************
+ Returns the time of the bus in polls of i2c_start_wait, counted from the
+ SCL periods of all operations and the idle polls, it wraps around
+*************************************************************************/
+unsigned int i2c_bus_polls(void)
+{
+    return (uint16_t)(bus_periods / I2C_POLL_PERIODS);
+
+}/* i2c_bus_polls */
+
+
+/*************************************************************************
+ Waits for the time of one poll without using the bus, so a wait for
+ something else is counted by i2c_bus_polls too
+*************************************************************************/
+void i2c_idle_poll(void)
+{
+    _delay_us(I2C_POLL_PERIODS*1000000.0/SCL_CLOCK);
+    bus_periods += I2C_POLL_PERIODS;
+
+}/* i2c_idle_poll */
+
+
+/*************************************************************************
+ Converts polls of i2c_start_wait to 1/256 of I2C_LOAD_POLLS (20ms), so
+ the result doesn't depend on SCL_CLOCK and the write cycle
+ 
+ Return:  0 to 255, 255 if the polls reach I2C_LOAD_POLLS
+*************************************************************************/
+unsigned char i2c_wait_load(unsigned int polls)
+{
+    return polls >= I2C_LOAD_POLLS ? 255 : (uint32_t)polls * 256 / I2C_LOAD_POLLS;
+
+}/* i2c_wait_load */
+
+
+/*************************************************************************
+ Issues a repeated start condition and sends address and transfer direction 
+
+ Input:   address and transfer direction of I2C device
+ 
+ Return:  0 device accessible
+          1 failed to access device
+*************************************************************************/
+unsigned char i2c_rep_start(unsigned char address)
+{
+    return i2c_start( address );
+
+}/* i2c_rep_start */
+
+
+/*************************************************************************
+ Terminates the data transfer and releases the I2C bus
+*************************************************************************/
+void i2c_stop(void)
+{
+    i2c_send_stop();
+
+}/* i2c_stop */
+
+
+/*************************************************************************
+ Returns 1 if an operation timed out since the bus was recovered, the
+ bytes of i2c_readAck and i2c_readNak are not valid then
+*************************************************************************/
+unsigned char i2c_error(void)
+{
+    return bus_error;
+
+}/* i2c_error */
+
+
+/*************************************************************************
+  Send one byte to I2C device
+  
+  Input:    byte to be transfered
+  Return:   0 write successful 
+            1 write failed
+*************************************************************************/
+unsigned char i2c_write( unsigned char data )
+{	
+    uint8_t   twst;
+    
+	if (bus_error) return 1;
+	// send data to the previously addressed device
+	TWDR = data;
+	I2C_NEXT_BYTE();
+	TWCR = (1<<TWINT) | (1<<TWEN);
+
+	// wait until transmission completed
+	if (i2c_wait(9)) return 1;
+
+	// check value of TWI Status Register. Mask prescaler bits
+	twst = I2C_STATUS();
+	if( twst != TW_MT_DATA_ACK) return 1;
+	return 0;
+
+}/* i2c_write */
+
+
+/*************************************************************************
+ Read one byte from the I2C device, request more data from device 
+ 
+ Return:  byte read from I2C device, 0xFF if the bus is stuck
+*************************************************************************/
+unsigned char i2c_readAck(void)
+{
+	if (bus_error) return 0xFF;
+	I2C_NEXT_BYTE();
+	TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWEA);
+	i2c_wait(9);
+
+    return I2C_DATA();
+
+}/* i2c_readAck */
+
+
+/*************************************************************************
+ Read one byte from the I2C device, read is followed by a stop condition 
+ 
+ Return:  byte read from I2C device, 0xFF if the bus is stuck
+*************************************************************************/
+unsigned char i2c_readNak(void)
+{
+	if (bus_error) return 0xFF;
+	I2C_NEXT_BYTE();
+	TWCR = (1<<TWINT) | (1<<TWEN);
+	i2c_wait(9);
+	
+    return I2C_DATA();
+
+}/* i2c_readNak */
+
+
+/*************************************************************************
+ Brings the bus back to idle state after an interrupted transfer.
+ A slave that was cut off in the middle of a byte may hold SDA low,
+ so SCL is clocked until SDA is released, then a stop condition is sent.
+*************************************************************************/
+void i2c_recover(void)
+{
+    TWCR = 0;                               /* disconnect the TWI from the pins */
+    I2C_DDR &= ~((1<<SDA_PIN) | (1<<SCL_PIN));  /* both lines are released, pull-ups keep them high */
+    I2C_PORT |= (1<<SDA_PIN) | (1<<SCL_PIN);
+
+    for ( uint8_t i = 0; i < 9 && !(I2C_PIN & (1<<SDA_PIN)); i++ )
+    {
+        I2C_PORT &= ~(1<<SCL_PIN);          /* SCL low */
+        I2C_DDR |= (1<<SCL_PIN);
+        _delay_us(5);
+        I2C_DDR &= ~(1<<SCL_PIN);           /* SCL released */
+        I2C_PORT |= (1<<SCL_PIN);
+        _delay_us(5);
+    }
+
+    I2C_PORT &= ~(1<<SDA_PIN);              /* stop condition, SDA goes high while SCL is high */
+    I2C_DDR |= (1<<SDA_PIN);
+    _delay_us(5);
+    I2C_DDR &= ~(1<<SDA_PIN);
+    I2C_PORT |= (1<<SDA_PIN);
+    _delay_us(5);
+
+    i2c_init();
+    TWCR = (1<<TWEN);
+    I2C_BUS_END();                          /* the stamps of the broken transaction are counted too */
+
+}/* i2c_recover */
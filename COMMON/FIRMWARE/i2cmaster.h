@@ -93,6 +93,11 @@
 /** defines the data direction (writing to I2C device) in i2c_start(),i2c_rep_start() */
 #define I2C_WRITE   0
 
+/** write cycles of a busy device after which i2c_start_wait() gives up, a slow EEPROM is still waited for */
+#ifndef I2C_WAIT_MARGIN
+#define I2C_WAIT_MARGIN 10
+#endif
+
 
 /**
  @brief initialize the I2C master interace. Need to be called only once 
@@ -104,12 +109,27 @@ extern void i2c_init(void);
 
 /** 
  @brief Terminates the data transfer and releases the I2C bus 
+
+ Gives up like the other operations if the stop condition is never executed
  @param void
  @return none
  */
 extern void i2c_stop(void);
 
 
+/**
+ @brief Returns the error of the bus
+
+ An operation that times out disables the TWI, every next operation then
+ fails at once and the read functions return no valid data, so a reset
+ checks this after reading and calls i2c_recover
+ @param    void
+ @retval   0 no operation timed out since i2c_init or i2c_recover
+ @retval   1 bus is stuck
+ */
+extern unsigned char i2c_error(void);
+
+
 /** 
  @brief Issues a start condition and sends address and transfer direction 
   
@@ -133,11 +153,84 @@ extern unsigned char i2c_rep_start(unsigned char addr);
 /**
  @brief Issues a start condition and sends address and transfer direction 
    
- If device is busy, use ack polling to wait until device ready 
+ If device is busy, use ack polling to wait until device ready, gives up
+ after I2C_WAIT_MARGIN write cycles set by i2c_write_cycle
  @param    addr address and transfer direction of I2C device
+ @retval   0   device accessible
+ @retval   1   device didn't answer (removed) or bus is stuck
+ */
+extern unsigned char i2c_start_wait(unsigned char addr);
+
+
+/**
+ @brief Sets the write cycle of the device polled by i2c_start_wait
+
+ The write cycle is 5ms until this is called, a device that is busy for
+ I2C_WAIT_MARGIN write cycles is treated as not answering
+ @param    ms write cycle of the device in milliseconds
+ @return   none
+ */
+extern void i2c_write_cycle(unsigned char ms);
+
+
+/**
+ @brief Returns the polls after which i2c_start_wait gives up
+ @param    void
+ @return   polls of I2C_WAIT_MARGIN write cycles
+ */
+extern unsigned int i2c_wait_polls(void);
+
+
+/**
+ @brief Returns the busy answers of the device in the last successful i2c_start_wait
+
+ After a write to an EEPROM this is its write cycle time in polls
+ @param    void
+ @return   polls answered busy before the device answered
+ */
+extern unsigned int i2c_busy_polls(void);
+
+
+/**
+ @brief Returns the time of the bus in polls of i2c_start_wait
+
+ Counted from the SCL periods of all operations and the idle polls, the
+ difference of two calls is the time between them if the code in between
+ only uses the bus or waits with i2c_idle_poll
+ @param    void
+ @return   polls since power on, wraps around
+ */
+extern unsigned int i2c_bus_polls(void);
+
+
+/**
+ @brief Waits for the time of one poll without using the bus
+
+ A wait for something else, like the internal EEPROM, is counted by i2c_bus_polls
+ @param    void
+ @return   none
+ */
+extern void i2c_idle_poll(void);
+
+
+/**
+ @brief Converts polls of i2c_start_wait to 1/256 of 20ms
+
+ The result doesn't depend on SCL_CLOCK and the write cycle, 128 is about 10ms
+ @param    polls busy answers of one or more writes
+ @retval   0-255 255 from 20ms
+ */
+extern unsigned char i2c_wait_load(unsigned int polls);
+
+/**
+ @brief Brings the bus back to idle state after an interrupted transfer
+
+ Clocks SCL until the slave releases SDA, sends a stop condition
+ and enables the TWI again, clears the error of the bus
+ @param    void
  @return   none
  */
-extern void i2c_start_wait(unsigned char addr);
+extern void i2c_recover(void);
 
  
 /**
@@ -151,13 +244,13 @@ extern unsigned char i2c_write(unsigned char data);
 
 /**
  @brief    read one byte from the I2C device, request more data from device 
- @return   byte read from I2C device
+ @return   byte read from I2C device, not valid if i2c_error() returns 1
  */
 extern unsigned char i2c_readAck(void);
 
 /**
  @brief    read one byte from the I2C device, read is followed by a stop condition 
- @return   byte read from I2C device
+ @return   byte read from I2C device, not valid if i2c_error() returns 1
  */
 extern unsigned char i2c_readNak(void);
 
@@ -0,0 +1,90 @@
+/*************************************************************************
+* Title:    I2C slave, emulation of a serial EEPROM chip
+* File:     i2cslave.c
+* Software: AVR-GCC
+* Target:   any AVR device with hardware TWI 
+* Usage:    the resetter answers at the chip address instead of the chip
+**************************************************************************/
+#include <inttypes.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/twi.h>
+
+#include "i2cslave.h"
+
+/* TWI control value that acknowledges the next byte and keeps the interrupt enabled */
+#define TWCR_ACK ((1<<TWINT) | (1<<TWEN) | (1<<TWEA) | (1<<TWIE))
+
+volatile unsigned char i2c_slave_image[I2C_SLAVE_IMAGE_SIZE];
+
+static volatile uint8_t word_address;     /* wraps after the size of the chip */
+static volatile uint8_t address_mask;     /* size of the chip - 1 */
+static volatile uint8_t address_next;     /* 1 if the next received byte is the word address */
+
+
+/*************************************************************************
+ Starts answering at the given address
+*************************************************************************/
+void i2c_slave_init(unsigned char address, unsigned int size)
+{
+    address_mask = size - 1;
+    word_address = 0;
+    TWAR = address & 0xFE;                /* no general call */
+    TWCR = TWCR_ACK;
+
+}/* i2c_slave_init */
+
+
+/*************************************************************************
+ Stops answering, the TWI is disabled
+*************************************************************************/
+void i2c_slave_stop(void)
+{
+    TWCR = 0;
+
+}/* i2c_slave_stop */
+
+
+/*************************************************************************
+ One byte of the transfer, SCL is held low until TWINT is cleared
+*************************************************************************/
+ISR(TWI_vect)
+{
+    switch (TW_STATUS)
+    {
+        case TW_SR_SLA_ACK:               /* own address and write, the word address comes first */
+        case TW_SR_ARB_LOST_SLA_ACK:
+            address_next = 1;
+            break;
+
+        case TW_SR_DATA_ACK:
+            if (address_next)
+            {
+                word_address = TWDR & address_mask;
+                address_next = 0;
+            }
+            else
+            {
+                i2c_slave_image[word_address] = TWDR;
+                /* page write wraps inside the page */
+                word_address = (word_address & ~(I2C_SLAVE_PAGE_SIZE-1)) | ((word_address+1) & (I2C_SLAVE_PAGE_SIZE-1));
+            }
+            break;
+
+        case TW_ST_SLA_ACK:               /* own address and read, or the master wants the next byte */
+        case TW_ST_ARB_LOST_SLA_ACK:
+        case TW_ST_DATA_ACK:
+            TWDR = i2c_slave_image[word_address];
+            word_address = (word_address + 1) & address_mask;
+            break;
+
+        case TW_BUS_ERROR:                /* release the bus, the TWI does not send a real stop */
+            TWCR = TWCR_ACK | (1<<TWSTO);
+            return;
+
+        default:                          /* stop, repeated start, NACK of the last read byte */
+            break;
+    }
+    TWCR = TWCR_ACK;
+
+}/* ISR(TWI_vect) */
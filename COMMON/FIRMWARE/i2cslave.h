@@ -0,0 +1,47 @@
+#ifndef _I2CSLAVE_H
+#define _I2CSLAVE_H   1
+/************************************************************************* 
+* Title:    I2C slave, emulation of a serial EEPROM chip
+* File:     i2cslave.h
+* Software: AVR-GCC
+* Target:   any AVR device with hardware TWI 
+* Usage:    the resetter answers at the chip address instead of the chip
+**************************************************************************/
+
+/**
+ @brief Emulation of a 24C02 like EEPROM chip with the TWI in slave mode
+
+ The first byte written by the master sets the word address, next bytes
+ are stored in the image and the address wraps inside the page, like in
+ the chip. Reads return the image from the word address, which wraps
+ after the size of the emulated chip. The ISR only moves one byte, so the
+ TWI holds SCL low for a few microseconds at most.
+ Compiled only with CHIP_EMULATION defined.
+*/
+
+/** size of the image, the largest chip, the word address is 8 bit */
+#define I2C_SLAVE_IMAGE_SIZE 256
+
+/** size of the page, a write wraps at the page boundary */
+#define I2C_SLAVE_PAGE_SIZE  8
+
+/** memory of the emulated chip, fill the first size bytes before calling i2c_slave_init() */
+extern volatile unsigned char i2c_slave_image[I2C_SLAVE_IMAGE_SIZE];
+
+/**
+ @brief Starts answering at the given address, interrupts must be enabled
+ @param    addr address of the emulated chip, the same as used in i2c_start()
+ @param    size bytes of the emulated chip, a power of two up to I2C_SLAVE_IMAGE_SIZE,
+           the word address wraps after it and its higher bits are ignored like in the chip
+ @return   none
+ */
+extern void i2c_slave_init(unsigned char addr, unsigned int size);
+
+/**
+ @brief Stops answering, the TWI is disabled
+ @param    void
+ @return   none
+ */
+extern void i2c_slave_stop(void);
+
+#endif
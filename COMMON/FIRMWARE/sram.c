@@ -0,0 +1,92 @@
+/*
+* sram.c
+*
+* SRAM budget of the firmware, compiled only with SRAM_REPORT defined.
+* The paint runs in .init1, before the stack pointer is set and before r1 is cleared, so it is written in assembler
+* and uses no stack. It fills everything from the end of the statics to RAMEND, .noinit keeps its content.
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#include <avr/io.h>
+#include "sram.h"
+#include "uart.h"
+
+#define paintValue 0xC5 //the stack rarely holds this value, a byte of it is counted as never used
+
+extern uint8_t __data_start;
+extern uint8_t __data_end;
+extern uint8_t __bss_start;
+extern uint8_t __bss_end;
+extern uint8_t __noinit_start;
+extern uint8_t __noinit_end;
+extern uint8_t __heap_start; //end of all statics
+
+void sramPaint(void) __attribute__((naked, used, section(".init1")));
+
+static void printLine(const char *, uint16_t); //prints a name and a number of bytes
+
+void sramPaint(void)
+{
+    __asm__ volatile ("    ldi r30, lo8(__heap_start)\n"
+                      "    ldi r31, hi8(__heap_start)\n"
+                      "    ldi r24, %0\n"
+                      "    ldi r25, hi8(%1)\n"
+                      "1:  st Z+, r24\n"
+                      "    cpi r30, lo8(%1)\n"
+                      "    cpc r31, r25\n"
+                      "    brne 1b\n"
+                      :: "M" (paintValue), "i" (RAMEND + 1) : "r24", "r25", "r30", "r31", "memory");
+}
+
+uint16_t sramStatic(void)
+{
+    return (uint16_t)(&__heap_start - &__data_start);
+}
+
+uint16_t sramStackPeak(void)
+{
+    return (uint16_t)((const uint8_t *)RAMEND + 1 - &__heap_start) - sramHeadroom();
+}
+
+uint16_t sramHeadroom(void)
+{
+    const uint8_t *byte = &__heap_start;
+
+    while (byte <= (const uint8_t *)RAMEND && *byte == paintValue)
+    {
+        byte++;
+    }
+    return (uint16_t)(byte - &__heap_start);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The stack of the report itself is counted too, it is not deeper than the stack of a reset.
+//////////////////////////////////////////////////////////////////////////
+void sramReport(void)
+{
+    uartPutString("\r\nsram, bytes of ");
+    uartPutNumber((uint16_t)((const uint8_t *)RAMEND + 1 - &__data_start));
+    uartPutString("\r\n");
+    printLine("data", &__data_end - &__data_start);
+    printLine("bss", &__bss_end - &__bss_start);
+    printLine("noinit", &__noinit_end - &__noinit_start);
+    printLine("stack peak", sramStackPeak());
+    printLine("headroom", sramHeadroom());
+}
+
+void sramPoll(char command)
+{
+    if (command == sramCommand)
+    {
+        sramReport();
+    }
+}
+
+static void printLine(const char *name, uint16_t bytes)
+{
+    uartPutString(name);
+    uartPutString(": ");
+    uartPutNumber(bytes);
+    uartPutString("\r\n");
+}
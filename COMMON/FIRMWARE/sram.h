@@ -0,0 +1,25 @@
+/*
+* sram.h
+*
+* SRAM budget of the firmware, compiled only with SRAM_REPORT defined. The free SRAM is painted before main,
+* the stack overwrites the paint, so the lowest byte it ever reached is found later by the first changed byte.
+* The report on the UART (250000 baud) is sent for 'm' received by the main loop and after the self-benchmark.
+* TOOLS/SRAMMAP splits the static part per module from the map file of the linker.
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef SRAM_H
+#define SRAM_H
+
+#include <stdint.h>
+
+#define sramCommand 'm' //UART command of the report
+
+uint16_t sramStatic(void); //returns bytes of .data, .bss and .noinit
+uint16_t sramStackPeak(void); //returns the deepest stack since power on in bytes
+uint16_t sramHeadroom(void); //returns bytes between the statics and the deepest stack that were never used
+void sramReport(void); //prints the sizes of the sections, the deepest stack and the headroom
+void sramPoll(char); //sends the report if the argument is sramCommand, called by the main loop with the received char
+
+#endif
@@ -0,0 +1,174 @@
+/*
+* timing.c
+*
+* Timing probes of the firmware, compiled only with TIMING_PROBE defined.
+* Every kind has a histogram of 32 bins placed around its first interval, intervals outside of them go to the first
+* or the last bin. Min and max are exact, percentiles are the upper edge of their bin, so they are never too low.
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef F_CPU
+#define F_CPU 8000000UL //8MHz internal RC, a crystal clocked board can be built with 16MHz or 20MHz
+#endif
+
+#include <avr/io.h>
+#include "timing.h"
+#include "uart.h"
+
+#define timingBins 32
+#define ticksToTenthsUs(ticks) ((uint32_t)(ticks) * 10UL / (F_CPU / 1000000UL)) //Timer1 without prescaler, overflows after 8ms at 8MHz
+
+typedef struct
+{
+    uint16_t base; //ticks at the start of the first bin
+    uint16_t min;
+    uint16_t max;
+    uint16_t count; //stops at 0xFFFF
+    uint16_t bins[timingBins];
+} timingHistogram;
+
+uint16_t timingStamps[timingStampsSize];
+uint8_t timingStampKinds[timingStampsSize];
+uint8_t timingStampsCount = 0;
+volatile uint16_t timingPressTicks = 0;
+volatile bool timingPressed = false;
+
+static const uint8_t binShifts[timingKinds] = {5, 1, 1, 1, 2}; //bin width is 1 << shift ticks, 0.25us for CLK at 8MHz
+static const char *const kindNames[timingKinds] = {"latency", "clk high", "clk low", "clk low write", "twi gap"};
+static const uint8_t percentiles[] = {50, 90, 99};
+static timingHistogram histograms[timingKinds];
+
+static void addInterval(uint8_t, uint16_t); //counts an interval in the histogram of the given kind
+static uint16_t percentile(const timingHistogram *, uint8_t, uint8_t); //returns ticks of the given percentile, arguments are histogram, kind and percent
+static void printTicks(uint16_t); //prints ticks in microseconds
+
+void timingInit(void)
+{
+    TCCR1A = 0;
+    TCCR1B = (1 << CS10); //no prescaler
+    uartInit();
+    for (uint8_t kind = 0; kind < timingKinds; kind++)
+    {
+        histograms[kind].count = 0;
+    }
+    timingStampsCount = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Every stamp ends the interval of its kind that started at the previous stamp, the first stamp of a frame only starts one.
+//////////////////////////////////////////////////////////////////////////
+void timingFlush(void)
+{
+    for (uint8_t i = 1; i < timingStampsCount; i++)
+    {
+        if (timingStampKinds[i] != timingStart)
+        {
+            addInterval(timingStampKinds[i], timingStamps[i] - timingStamps[i - 1]);
+        }
+    }
+    timingStampsCount = 0;
+}
+
+void timingBusStart(void)
+{
+    uint16_t ticks = TCNT1;
+
+    if (timingPressed == true)
+    {
+        timingPressed = false;
+        addInterval(timingLatency, ticks - timingPressTicks);
+    }
+}
+
+void timingReport(void)
+{
+    uartPutString("\r\ntiming, F_CPU ");
+    uartPutNumber(F_CPU);
+    uartPutString("\r\nkind: count min p50 p90 p99 max\r\n");
+    for (uint8_t kind = 0; kind < timingKinds; kind++)
+    {
+        const timingHistogram *histogram = &histograms[kind];
+
+        if (histogram->count == 0)
+        {
+            continue;
+        }
+        uartPutString(kindNames[kind]);
+        uartPutString(": ");
+        uartPutNumber(histogram->count);
+        uartPutChar(' ');
+        printTicks(histogram->min);
+        for (uint8_t i = 0; i < sizeof(percentiles); i++)
+        {
+            uartPutChar(' ');
+            printTicks(percentile(histogram, kind, percentiles[i]));
+        }
+        uartPutChar(' ');
+        printTicks(histogram->max);
+        uartPutString("\r\n");
+    }
+    for (uint8_t kind = 0; kind < timingKinds; kind++)
+    {
+        histograms[kind].count = 0;
+    }
+}
+
+static void addInterval(uint8_t kind, uint16_t ticks)
+{
+    timingHistogram *histogram = &histograms[kind];
+    uint16_t half = (timingBins / 2) << binShifts[kind];
+
+    if (histogram->count == 0xFFFF)
+    {
+        return;
+    }
+    if (histogram->count == 0) //the bins are placed around the first interval
+    {
+        histogram->base = ticks > half ? ticks - half : 0;
+        histogram->min = ticks;
+        histogram->max = ticks;
+        for (uint8_t i = 0; i < timingBins; i++)
+        {
+            histogram->bins[i] = 0;
+        }
+    }
+    uint16_t bin = ticks < histogram->base ? 0 : (ticks - histogram->base) >> binShifts[kind];
+    histogram->bins[bin < timingBins ? bin : timingBins - 1]++;
+    histogram->min = ticks < histogram->min ? ticks : histogram->min;
+    histogram->max = ticks > histogram->max ? ticks : histogram->max;
+    histogram->count++;
+}
+
+static uint16_t percentile(const timingHistogram *histogram, uint8_t kind, uint8_t percent)
+{
+    uint16_t target = ((uint32_t)histogram->count * percent + 99) / 100;
+    uint16_t seen = 0;
+    uint8_t bin = 0;
+
+    for (; bin < timingBins - 1; bin++)
+    {
+        seen += histogram->bins[bin];
+        if (seen >= target)
+        {
+            break;
+        }
+    }
+    if (bin == timingBins - 1) //the last bin has no upper edge
+    {
+        return histogram->max;
+    }
+
+    uint32_t edge = histogram->base + ((uint32_t)(bin + 1) << binShifts[kind]) - 1;
+    return edge < histogram->max ? edge : histogram->max;
+}
+
+static void printTicks(uint16_t ticks)
+{
+    uint32_t tenths = ticksToTenthsUs(ticks);
+
+    uartPutNumber(tenths / 10);
+    uartPutChar('.');
+    uartPutChar('0' + tenths % 10);
+    uartPutString("us");
+}
@@ -0,0 +1,64 @@
+/*
+* timing.h
+*
+* Timing probes of the firmware, compiled only with TIMING_PROBE defined. Timer1 runs without prescaler, a probe stores
+* TCNT1 and the kind of the interval it ends, so it takes only a few cycles in the bit loops. Stamps of one frame or I2C
+* transaction are turned into intervals by timingFlush() after it ended, outside of the timed code.
+* Intervals are counted in histograms and timingReport() prints their percentiles on the UART (250000 baud).
+* The soak harness builds the engines with the probes too, on the simulated time.
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+
+#if defined(FAULT_INJECTION) || defined(SELF_BENCHMARK)
+#error "TIMING_PROBE needs Timer1, which is used by FAULT_INJECTION and SELF_BENCHMARK builds too"
+#endif
+
+#define timingLatency 0 //INT0 edge to the first activity on the chip bus
+#define timingClkHigh 1 //CLK high half-periods of the DX4050 bit loops
+#define timingClkLow 2 //CLK low half-periods when reading and sending packets
+#define timingClkLowWrite 3 //CLK low half-periods when writing the ink counter
+#define timingTwiGap 4 //from the end of one TWI byte to the command for the next one
+#define timingKinds 5
+#define timingStart 0xFF //stamp that only starts the next interval
+#define timingStampsSize 128 //stamps kept of one frame, later ones are not timed
+#define timingStampCycles 28 //estimated CPU cycles of one timingStamp(), they are taken from the CLK delays
+
+extern uint16_t timingStamps[timingStampsSize];
+extern uint8_t timingStampKinds[timingStampsSize];
+extern uint8_t timingStampsCount;
+extern volatile uint16_t timingPressTicks;
+extern volatile bool timingPressed;
+
+void timingInit(void); //starts Timer1 and the UART, clears the results
+void timingFlush(void); //counts the intervals between the stamps of the frame that ended and starts a new frame
+void timingBusStart(void); //the reset started to use the chip bus, ends the latency interval of a press of the button
+void timingReport(void); //prints count, min, percentiles and max of every kind with intervals and clears the results
+
+//inline, a call would take longer than the stamp itself
+static inline void timingStamp(uint8_t kind)
+{
+    uint8_t count = timingStampsCount;
+
+    if (count < timingStampsSize)
+    {
+        timingStamps[count] = TCNT1;
+        timingStampKinds[count] = kind;
+        timingStampsCount = count + 1;
+    }
+}
+
+static inline void timingButton(void) //called first in the INT0 interrupt
+{
+    timingPressTicks = TCNT1;
+    timingPressed = true;
+}
+
+#endif
@@ -0,0 +1,79 @@
+/*
+* uart.c
+*
+* Blocking UART driver, 8 data bits, no parity, 1 stop bit
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef F_CPU
+#define F_CPU 8000000UL //8MHz internal RC, a crystal clocked board can be built with 16MHz or 20MHz
+#endif
+
+#include <avr/io.h>
+#include "uart.h"
+
+#ifndef uartBaud
+#define uartBaud 250000UL //exact at 8, 16 and 20MHz in double speed mode
+#endif
+#define ubrrValue ((F_CPU + uartBaud * 4) / (uartBaud * 8) - 1) //rounded, double speed mode divides by 8
+#define realBaud (F_CPU / (8 * (ubrrValue + 1)))
+_Static_assert(realBaud * 100 / uartBaud >= 98 && realBaud * 100 / uartBaud <= 102, "uartBaud can't be generated at this F_CPU with error below 2%");
+
+void uartInit(void)
+{
+    UBRR0H = (uint8_t)(ubrrValue >> 8);
+    UBRR0L = (uint8_t)ubrrValue;
+    UCSR0A = (1 << U2X0); //double speed
+    UCSR0B = (1 << RXEN0) | (1 << TXEN0);
+    UCSR0C = (1 << UCSZ01) | (1 << UCSZ00); //8N1
+}
+
+void uartPutChar(char c)
+{
+    while (!(UCSR0A & (1 << UDRE0))); //wait for the empty transmit buffer
+    UDR0 = c;
+}
+
+void uartPutString(const char *str)
+{
+    while (*str != '\0')
+    {
+        uartPutChar(*str++);
+    }
+}
+
+void uartPutHex(uint8_t value)
+{
+    const char digits[] = "0123456789ABCDEF";
+
+    uartPutChar(digits[value >> 4]);
+    uartPutChar(digits[value & 0x0F]);
+}
+
+void uartPutNumber(uint32_t value)
+{
+    char digits[10]; //enough for 32 bits
+    uint8_t count = 0;
+
+    do
+    {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    while (count > 0)
+    {
+        uartPutChar(digits[--count]);
+    }
+}
+
+uint8_t uartCharReady(void)
+{
+    return (UCSR0A & (1 << RXC0)) ? 1 : 0;
+}
+
+char uartGetChar(void)
+{
+    while (!(UCSR0A & (1 << RXC0)));
+    return UDR0;
+}
@@ -0,0 +1,22 @@
+/*
+* uart.h
+*
+* Blocking UART driver, 8 data bits, no parity, 1 stop bit
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef UART_H
+#define UART_H
+
+#include <stdint.h>
+
+void uartInit(void); //sets the baud rate to uartBaud and enables the transmitter and the receiver
+void uartPutChar(char); //waits until the transmit buffer is empty and sends one char
+void uartPutString(const char *); //sends a string from SRAM
+void uartPutHex(uint8_t); //sends a byte as two hex digits
+void uartPutNumber(uint32_t); //sends a number in decimal
+uint8_t uartCharReady(void); //returns 1 if a received char is waiting, 0 if not
+char uartGetChar(void); //waits for a char and returns it
+
+#endif
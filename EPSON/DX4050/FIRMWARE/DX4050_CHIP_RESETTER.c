@@ -7,13 +7,46 @@
 *
 */
 
-#define F_CPU 8000000UL //8MHz
+#ifndef F_CPU
+#define F_CPU 8000000UL //8MHz internal RC, a crystal clocked board can be built with 16MHz or 20MHz
+#endif
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <util/delay.h>
 #include <avr/sfr_defs.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include "DX4050_CHIP_RESETTER.h"
+#include "DX4050_SNIFFER.h"
+#ifdef FAULT_INJECTION
+#include "../../../COMMON/FIRMWARE/faults.h"
+#endif
+#ifdef SELF_BENCHMARK
+#include "../../../COMMON/FIRMWARE/bench.h"
+#endif
+#ifdef SRAM_REPORT
+#include "../../../COMMON/FIRMWARE/sram.h"
+#endif
+#ifdef SERIAL_CONTROL
+#include "../../../COMMON/FIRMWARE/control.h"
+#endif
+#ifdef CHIP_HEALTH
+#include "../../../COMMON/FIRMWARE/health.h"
+#endif
+#if defined(SRAM_REPORT) || defined(SERIAL_CONTROL) || defined(CHIP_HEALTH)
+#include "../../../COMMON/FIRMWARE/uart.h"
+#endif
+#ifdef TIMING_PROBE
+#include "../../../COMMON/FIRMWARE/timing.h"
+#define clkStamp(kind) timingStamp(kind) //after every rising edge and before every falling edge of CLK
+#define probeCycles (2 * timingStampCycles)
+#else
+#define clkStamp(kind)
+#define probeCycles 0
+#endif
 
 #define blackChipReadAddr 0x27 //4 bit ID, 4 bit "NACK"
 #define magentaChipReadAddr 0xA7
@@ -28,6 +61,11 @@
 #define dataWriteSize 4
 #define dataReadSize 32
 #define startEndSize 10
+#define chipsCount 4
+#ifndef maxRetries
+#define maxRetries 3 //how many times the ink counter is written again when verification fails
+#endif
+#define retryDelay 2 //delay in milliseconds before the first retry, doubled before every next one
 //----------------------
 #define redLed 4
 #define greenLed 1
@@ -36,9 +74,20 @@
 #define whiteLed 7
 #define offLed 0
 //----------------------
-#define delay100khz 0x0A
-#define delay40khz 0x19
-#define delay10khz 0x64
+//protocol timing in microseconds, delay loops are computed from F_CPU at compile time
+#define clkHighTime 10 //CLK high time (100kHz)
+#define clkLowTime 25 //CLK low time when reading and sending packets (40kHz)
+#define clkLowWriteTime 100 //CLK low time when writing to the chip (10kHz)
+#define enPulseTime 60 //EN pulse before a transmission
+#define enLowTime 5 //EN low time after the pulse
+#define byteWriteTime 6 //time in milliseconds needed by the chip to write one byte
+#define bitLoopCycles (16 + probeCycles) //CPU cycles of the code around the delays of one bit, half of it is taken from each delay
+#define bitLoopTime (bitLoopCycles * 1000000.0 / F_CPU)
+#define clkHighDelay (clkHighTime - bitLoopTime / 2)
+#define clkLowDelay (clkLowTime - bitLoopTime / 2)
+#define clkLowWriteDelay (clkLowWriteTime - bitLoopTime / 2)
+_Static_assert(F_CPU <= 20000000UL, "F_CPU above 20MHz is not supported");
+_Static_assert(bitLoopCycles * 1000000UL < clkHighTime * F_CPU, "F_CPU is too low to meet the CLK timing");
 //----------------------
 #define chipPrt PORTC
 #define gndDet PINC0
@@ -46,30 +95,76 @@
 #define clk PINC2
 #define data PINC3
 //----------------------
-const uint8_t startData[] = {6, 0, 17, 96, 1, 6, 0, 17, 96, 0}; //header packet
-const uint8_t endData[] = {6, 0, 1, 96, 1, 6, 0, 17, 96, 0}; //trailer packet
+static const uint8_t startData[] = {6, 0, 17, 96, 1, 6, 0, 17, 96, 0}; //header packet
+static const uint8_t endData[] = {6, 0, 1, 96, 1, 6, 0, 17, 96, 0}; //trailer packet
 //4 bit adresses of black, magenta, yellow, cyan chips and 4 bit "ACK", then first byte values for each color, second byte value and 3 byte trailer
-const uint8_t dataToCheck[] = {44, 172, 236, 108, 195, 67, 131, 3, 101, 103, 102, 104, 12, 98, 39};
+static const uint8_t dataToCheck[] = {44, 172, 236, 108, 195, 67, 131, 3, 101, 103, 102, 104, 12, 98, 39};
+static const uint8_t chipLeds[chipsCount] = {whiteLed, redLed, yellowLed, blueLed}; //LED colors of black, magenta, yellow, cyan chips
+//----------------------
+typedef struct
+{
+    uint16_t resets; //number of chips resetted since power on
+    uint16_t retries; //number of writes repeated after failed verification
+    uint16_t fingerprint; //CRC16 of the data of the last chip read before its reset
+} resetStatistics;
+
+typedef struct
+{
+    uint16_t chipId; //CRC16 of the bytes the reset doesn't write, the identity of the chip
+    uint8_t idBytes[dataWriteSize - 1]; //ID bytes read before the first write
+    uint8_t color; //chip of the unfinished reset (1-4), 0 or 0xFF (erased EEPROM) if the last reset of this color was verified, written last
+} resetJournal;
+#ifndef UNIVERSAL_RESETTER //the universal resetter has its own main loop
 volatile bool startResetting = false; //if true then user pressed the button
-volatile uint8_t cartridgeChipData[dataReadSize] = {0};
-volatile uint8_t resetChipData[dataWriteSize] = {0}; //this array will hold information for writing to the connected chip
+#endif
+static volatile uint8_t cartridgeChipData[dataReadSize] = {0};
+static volatile uint8_t resetChipData[dataWriteSize] = {0}; //this array will hold information for writing to the connected chip
+static resetStatistics stats = {0};
+static resetJournal journal[chipsCount] EEMEM; //ID bytes of every color while they are written, kept in the internal EEPROM so they survive a power loss
+static volatile bool chipRemoved = false; //set by the pin change interrupt when gndDet goes high during the reset
+#ifdef CHIP_HEALTH
+static uint16_t chipId = 0; //CRC16 of the ID bytes of the last chip read, the bytes the reset writes back unchanged
+#endif
 //----------------------
-uint8_t findConnectedChip(void); //0 - nothing connected, 1 - black, 2 - magenta, 3 - yellow, 4 - cyan
-uint8_t readDataFromChip(uint8_t); //argument value 1-4 depends on found chip, returns 1 if the read data is wrong, 0 if all is ok
-uint8_t resetInkCounter(uint8_t); //argument value 1-4 depends on found chip, returns 1 if resetting was not ok, 0 if all is ok
-void sendData(const uint8_t[], uint8_t); //sends array of data, args are array and array size
-void clearArray(volatile uint8_t[], uint8_t); //clears given array, arguments are array and array size
-void blinkLed(uint8_t, uint8_t); //arguments are blink type and error mode, 0 - error(error mode can be set from 1 to 3), 1 - black resetted, 2 - magenta, 3 - yellow, 4 - cyan
-void pulseAndSetEn(void); //pulses and leaves the EN pin in high state
+static uint8_t findConnectedChips(void); //returns bits of all connected chips, bit 0 - black, 1 - magenta, 2 - yellow, 3 - cyan
+static uint8_t resetChip(uint8_t); //argument value 1-4 depends on found chip, returns 1 if resetted, 2 if wrong data was read, 3 if ink counter was not resetted, 4 if chip was removed, 5 if resetted but worn
+static uint8_t readDataFromChip(uint8_t); //argument value 1-4 depends on found chip, returns 1 if the read data is wrong, 0 if all is ok
+static uint8_t confirmIdBytes(uint8_t); //argument value 1-4 depends on found chip, reads the ID bytes again, returns 1 if they differ from the first read, 0 if they are the same
+static uint8_t startReading(uint8_t); //sends the read address of the chip, returns the first byte with chip ID and "ACK"
+static uint8_t checkReadByte(uint8_t, uint8_t); //checks the byte read at the given position against the expected data, returns 1 if it is wrong, 0 if it is ok
+static uint8_t receiveByte(void); //reads one byte from the chip
+static void endTransmission(void); //ends the transmission, leaves the data line as output in low state
+static uint8_t resetInkCounter(uint8_t); //argument value 1-4 depends on found chip, returns 1 if resetting was not ok, 0 if all is ok
+static void startJournal(uint8_t); //argument value 1-4 depends on found chip, takes the ID bytes of an unfinished reset of the same chip or saves the read ones
+static void writeInkCounter(uint8_t, uint8_t); //arguments are the found chip 1-4 and the retry, sends the prepared counter bytes to the chip
+static uint8_t verifyInkCounter(uint8_t); //argument value 1-4 depends on found chip, returns 1 if the written data is wrong, 0 if all is ok
+static void retryWait(uint8_t); //waits before the given retry, every next retry waits twice as long
+static void sendData(const uint8_t[], uint8_t); //sends array of data, args are array and array size
+static void clearArray(volatile uint8_t[], uint8_t); //clears given array, arguments are array and array size
+static void blinkLed(uint8_t, uint8_t); //arguments are blink type and error mode, 0 - error(error mode can be set from 1 to 4), 1 - black resetted, 2 - magenta, 3 - yellow, 4 - cyan
+static void showResults(const uint8_t[], uint8_t); //shows reset results of all found chips, arguments are results array and found chips bits
+static void pulseAndSetEn(void); //pulses and leaves the EN pin in high state
+
+#ifndef UNIVERSAL_RESETTER
+static void findAndResetChips(void); //resets all connected chips or blinks the error if there is none
+#ifdef SELF_BENCHMARK
+static void benchmarkChip(void); //times read and reset of the first connected chip, then resets all chips as usual
+static void benchLed(bool);
+#endif
 
 int main(void)
 {
+    DDRD = 0x0; //set input type for the button, the rest of pins are also inputs
+    PORTD = 0xFB;
+    _delay_ms(10); //wait for the pull-up of the button
+    if (bit_is_clear(PIND, PIND2)) //button held at power-on starts the sniffer, chip lines are not driven yet
+    {
+        dx4050Sniff(); //never returns
+    }
     DDRB = 0x7; //pins 1, 2, 3 are outputs, the rest are inputs
     DDRC = 0xE; //pins 2, 3, 4 are outputs
-    DDRD = 0x0; //set input type for the button, the rest of pins are also inputs
     PORTB = 0xF8;
     PORTC = 0x30;
-    PORTD = 0xFB;
     //----------------------------------------------
     EICRA |= (1 << ISC01); //INT0 on falling edge
     EIMSK |= (1 << INT0); //enable INT0
@@ -78,42 +173,51 @@ int main(void)
     chipPrt &= ~(1 << clk);
     chipPrt &= ~(1 << data);
     //----------------------------------------------
+#ifdef TIMING_PROBE
+    timingInit();
+#endif
+#if defined(SRAM_REPORT) || defined(SERIAL_CONTROL) || defined(CHIP_HEALTH)
+    uartInit(); //for the commands of the reports
+#endif
     sei(); //enable interrupts
+#ifdef FAULT_INJECTION
+    faultRun(findAndResetChips); //bench build, resets the chips once for every fault and never returns
+#endif
 
     while (1)
     {
+#if defined(SRAM_REPORT) || defined(SERIAL_CONTROL) || defined(CHIP_HEALTH)
+        char command = uartCharReady() == 1 ? uartGetChar() : 0; //one received char is read for all reports
+#endif
+#ifdef SRAM_REPORT
+        sramPoll(command);
+#endif
+#ifdef CHIP_HEALTH
+        healthPoll(command);
+#endif
+#ifdef SERIAL_CONTROL
+        if (controlCommand(command, stats.resets, stats.retries, stats.fingerprint) == true)
+        {
+            startResetting = true; //the same as a press of the button
+        }
+#endif
         if (startResetting == true)
         {
             EIMSK &= ~(1 << INT0); //disable INT0 for the time of resetting
-            sendData(startData, startEndSize);
-            uint8_t foundChip = findConnectedChip();
-            if (foundChip == 0) //if nothing was found
+#ifdef SELF_BENCHMARK
+            if (benchLongPress() == true)
             {
-                blinkLed(0, 1); //indicate that chip was not found
+                benchmarkChip();
             }
-            else //if some chip was found
-            {
-                uint8_t readingResult = readDataFromChip(foundChip);
-                if (readingResult == 1)
-                {
-                    blinkLed(0, 2); //indicate that wrong data was read
-                }
-                else
-                {
-                    uint8_t resetResult = resetInkCounter(foundChip);
-                    if (resetResult == 1)
-                    {
-                        blinkLed(0, 3);
-                    }
-                    else
-                    {
-                        blinkLed(foundChip, 0); //if reset was ok then indicate it
-                    }
-                }
-            }
-            sendData(endData, startEndSize);
-            clearArray(cartridgeChipData, dataReadSize);
-            clearArray(resetChipData, dataWriteSize);
+            else
+#endif
+            findAndResetChips();
+#ifdef TIMING_PROBE
+            timingReport();
+#endif
+#ifdef SERIAL_CONTROL
+            controlDone();
+#endif
             EIMSK |= (1 << INT0); //enable INT0 again
             EIFR |= (1 << INTF0); //clear INT0 flag, this will eliminate additional reading after release of button
             startResetting = false; //end resetting
@@ -121,72 +225,220 @@ int main(void)
     }
 }
 
-uint8_t findConnectedChip(void) //0 - nothing connected, 1 - black, 2 - magenta, 3 - yellow, 4 - cyan
+static void findAndResetChips(void)
 {
-    uint8_t chipAddresses[] = {blackChipReadAddr, magentaChipReadAddr, yellowChipReadAddr, cyanChipReadAddr};
-    uint8_t actualAddress = 0;
-    uint8_t chipResponse = 0;
+    uint8_t foundChips = dx4050FindChips();
+    if (foundChips == 0) //if nothing was found
+    {
+        blinkLed(0, 1); //indicate that chip was not found
+    }
+    else
+    {
+        dx4050ResetChips(foundChips);
+    }
+}
+
+#ifdef SELF_BENCHMARK
+//////////////////////////////////////////////////////////////////////////
+//Every cycle reads the chip and resets its ink counter, the reset includes the verification. Every cycle writes the same
+//counter bytes, so after the last cycle and the normal reset that follows it the chip holds the same data as after a single reset.
+//A cycle that fails ends the benchmark, the normal reset then shows the error.
+//////////////////////////////////////////////////////////////////////////
+static void benchmarkChip(void)
+{
+    static const char *const phaseNames[] = {"read", "reset"};
+    uint8_t foundChips = dx4050FindChips();
+    uint8_t chip = 1;
+
+    if (foundChips == 0)
+    {
+        blinkLed(0, 1);
+        return;
+    }
+    while ((foundChips & (1 << (chip - 1))) == 0)
+    {
+        chip++;
+    }
+
+    bool cyclesOk = true;
+    chipRemoved = false;
+    PCMSK1 |= (1 << PCINT8); //watch gndDet, the cartridge is removed when it goes high
+    PCIFR |= (1 << PCIF1);
+    PCICR |= (1 << PCIE1);
+    benchStart();
+    for (uint8_t cycle = 0; cycle < benchCycles && cyclesOk == true; cycle++)
+    {
+        cyclesOk = (readDataFromChip(chip) == 0); //a chip with wrong data is never written
+        benchMark(0);
+        cyclesOk = cyclesOk && resetInkCounter(chip) == 0;
+        benchMark(1);
+        clearArray(cartridgeChipData, dataReadSize);
+        clearArray(resetChipData, dataWriteSize);
+    }
+    PCICR &= ~(1 << PCIE1);
+
+    dx4050ResetChips(foundChips); //the header packet was sent by dx4050FindChips
+    if (cyclesOk == true)
+    {
+        benchReport(phaseNames, 2, benchLed);
+    }
+}
+
+static void benchLed(bool on)
+{
+    PORTB = on ? whiteLed : offLed;
+}
+#endif
+
+#endif
+
+uint8_t dx4050FindChips(void) //sends the header packet and searches for chips, the trailer packet is sent if nothing was found
+{
+    sendData(startData, startEndSize); //header and trailer are sent only once for all connected chips
+    uint8_t foundChips = findConnectedChips();
+    if (foundChips == 0)
+    {
+        sendData(endData, startEndSize);
+    }
+    return foundChips;
+}
+
+void dx4050ResetChips(uint8_t foundChips) //resets every chip that was found, so all cartridges in a jig can be resetted at once
+{
+    uint8_t resetResults[chipsCount] = {0};
+
+    chipRemoved = false;
+    PCMSK1 |= (1 << PCINT8); //watch gndDet, the cartridge is removed when it goes high
+    PCIFR |= (1 << PCIF1);
+    PCICR |= (1 << PCIE1);
+    for (uint8_t chip = 1; chip <= chipsCount; chip++)
+    {
+        if (foundChips & (1 << (chip - 1)))
+        {
+            resetResults[chip - 1] = chipRemoved ? 4 : resetChip(chip);
+            clearArray(cartridgeChipData, dataReadSize);
+            clearArray(resetChipData, dataWriteSize);
+        }
+    }
+    PCICR &= ~(1 << PCIE1);
+    if (chipRemoved == false) //endTransmission already left the bus idle, there is nobody to send the trailer to
+    {
+        sendData(endData, startEndSize);
+    }
+    showResults(resetResults, foundChips);
+}
+
+static uint8_t findConnectedChips(void) //bit 0 - black, 1 - magenta, 2 - yellow, 3 - cyan, 0 if nothing is connected
+{
+    uint8_t foundChips = 0;
 
     if (bit_is_set(PINC, gndDet))
     {
         return 0; //if gndDetect is high then chip is not connected
     } //else go on
 
-    for (uint8_t addrNum = 0; addrNum < 4; addrNum++)
+    for (uint8_t chip = 1; chip <= chipsCount; chip++) //all chips share the bus, so every address is checked
     {
-        actualAddress = chipAddresses[addrNum]; //first select one of the addresses
-        pulseAndSetEn(); //indicate that next transmission will occur
-        for (uint8_t i = 128; i > 8; i /= 2) //MSB first, send only first nibble of the address
+        if ((startReading(chip) & 0x0F) == 0x0C) //chip is found, this part should always be 0x0C "ACK"
         {
-            chipPrt &= ~(1 << clk); //send first part of the address
-            if (actualAddress & i) //if on actualAddress bit position i is 1 then change the data line state
-            {
-                chipPrt |= (1 << data);
-            }
-            else
-            {
-                chipPrt &= ~(1 << data);
-            }
-            _delay_us(delay40khz); //after setting a state on the data pin, wait a while to let output value latch into chip input
-            chipPrt |= (1 << clk);
-            _delay_us(delay100khz); //on state should be shorter than off state
+            foundChips |= (1 << (chip - 1));
         }
-        chipPrt &= ~(1 << clk);
-        chipPrt &= ~(1 << data); //now read the response from the chip
-        DDRC = 0x6; //set the data line as input for now
-        for (uint8_t bitNum = 8; bitNum > 0; bitNum /= 2)
+        endTransmission();
+    }
+    return foundChips;
+}
+
+static uint8_t resetChip(uint8_t inkColor) //argument value 1-4 depends on found chip, returns 1 if chip was resetted, 2 if wrong data was read, 3 if ink counter was not resetted, 4 if chip was removed, 5 if resetted but worn
+{
+    if (readDataFromChip(inkColor) == 1)
+    {
+        return chipRemoved ? 4 : 2;
+    }
+#ifdef CHIP_HEALTH
+    uint16_t retries = stats.retries;
+#endif
+    uint8_t result = resetInkCounter(inkColor) == 1 ? (chipRemoved ? 4 : 3) : 1;
+#ifdef CHIP_HEALTH
+    //the chip has no ready signal, the reset waits byteWriteTime for every byte, so only the retries tell its health
+    if (result != 4 && healthCheck(healthDx4050 + inkColor - 1, chipId, 0, stats.retries - retries) == true && result == 1)
+    {
+        return 5;
+    }
+#endif
+    return result;
+}
+
+static uint8_t readDataFromChip(uint8_t inkColor) //argument value 1-4 depends on found chip, returns 1 if the read data is wrong, 0 if all is ok
+{
+    cartridgeChipData[0] = startReading(inkColor); //now we have the first byte
+    //the received data is checked as it arrives, so a wrong chip is rejected without reading all of it
+    if (cartridgeChipData[0] != dataToCheck[inkColor - 1]) //check if the connected chip send "ACK"
+    {
+        endTransmission();
+        return 1;
+    }
+
+    for (uint8_t i = 1; i < dataReadSize; i++)
+    {
+        cartridgeChipData[i] = receiveByte();
+        if (chipRemoved == true || checkReadByte(i, inkColor) == 1)
         {
-            chipPrt &= ~(1 << clk);
-            _delay_us(delay40khz);
-            chipPrt |= (1 << clk);
-            if (bit_is_set(PINC, data))
-            {
-                chipResponse |= bitNum; //set 1 on given bit
-            }
-            _delay_us(delay100khz);
+            endTransmission(); //there is no need to read the rest of the data
+            return 1;
         }
-        chipPrt &= ~(1 << clk);
-        DDRC = 0xE; //set the data line as output
-        chipPrt &= ~(1 << data);
-        if (chipResponse == 0x0C) //chip is found, this part should always be 0x0C "ACK"
+    }
+    endTransmission();
+    if (confirmIdBytes(inkColor) == 1) //the ID bytes are written back unchanged, so they must not come from a broken read
+    {
+        return 1;
+    }
+
+    uint16_t crc = 0xFFFF; //the fingerprint is computed after the transmission, so it doesn't stretch the gaps between the bytes
+    for (uint8_t i = 0; i < dataReadSize; i++)
+    {
+        crc = _crc_ccitt_update(crc, cartridgeChipData[i]);
+    }
+    stats.fingerprint = crc;
+#ifdef SERIAL_CONTROL
+    controlChip(inkColor - 1, crc);
+#endif
+#ifdef CHIP_HEALTH
+    chipId = 0xFFFF;
+    for (uint8_t i = 1; i <= dataWriteSize - 1; i++) //the ID bytes follow the first byte, the counter byte is after them
+    {
+        chipId = _crc_ccitt_update(chipId, cartridgeChipData[i]);
+    }
+#endif
+    return 0; //if everything is ok
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Nothing in the chip tells if its ID bytes are right, only the color and model bytes and the trailer are known.
+//A flipped or missed bit of one read isn't repeated by the next one, so the ID bytes are read again and must be the same.
+//////////////////////////////////////////////////////////////////////////
+static uint8_t confirmIdBytes(uint8_t inkColor)
+{
+    if (startReading(inkColor) != cartridgeChipData[0])
+    {
+        endTransmission();
+        return 1;
+    }
+    for (uint8_t i = 1; i < dataWriteSize; i++) //the counter byte after the ID bytes is zeroed, so it isn't compared
+    {
+        if (receiveByte() != cartridgeChipData[i] || chipRemoved == true)
         {
-            chipPrt &= ~(1 << clk);
-            chipPrt &= ~(1 << data);
-            chipPrt &= ~(1 << en);
-            DDRC = 0xE; //set the data line as output
-            return addrNum + 1; //the data line will stay in input mode in case a cartridge chip was found
+            endTransmission();
+            return 1;
         }
-        chipPrt &= ~(1 << en);
-        chipResponse = 0; //in case that a chip with given address was not found, reset response
     }
-    return 0; //if chip was not found then return 0
+    endTransmission();
+    return 0;
 }
 
-uint8_t readDataFromChip(uint8_t inkColor) //argument value 1-4 depends on found chip, returns 1 if the read data is wrong, 0 if all is ok
+static uint8_t startReading(uint8_t inkColor) //sends the read address of the chip and returns the first byte with its response
 {
     uint8_t chipAddresses[] = {blackChipReadAddr, magentaChipReadAddr, yellowChipReadAddr, cyanChipReadAddr};
     uint8_t actualAddress = 0;
-    uint8_t temp = 0;
 
     DDRC = 0xE; //set the data line as output
     pulseAndSetEn();
@@ -202,80 +454,159 @@ uint8_t readDataFromChip(uint8_t inkColor) //argument value 1-4 depends on found
         {
             chipPrt &= ~(1 << data);
         }
-        _delay_us(delay40khz);
+        _delay_us(clkLowDelay);
         chipPrt |= (1 << clk);
-        _delay_us(delay100khz);
+        clkStamp(timingClkLow);
+        _delay_us(clkHighDelay);
+        clkStamp(timingClkHigh);
     }
     chipPrt &= ~(1 << clk);
     chipPrt &= ~(1 << data); //after transmitting the address of found chip we can read response
     DDRC = 0x6; //set the data line as input for now
 
-    cartridgeChipData[0] = actualAddress & 0xF0; //keep the chip ID and prepare for "ACK" or "NACK"
-    actualAddress = cartridgeChipData[0];
+    actualAddress &= 0xF0; //keep the chip ID and prepare for "ACK" or "NACK"
     for (uint8_t bitNum = 8; bitNum > 0; bitNum /= 2) //read the second nibble of the first byte
     {
         chipPrt &= ~(1 << clk);
-        _delay_us(delay40khz);
+        _delay_us(clkLowDelay);
         chipPrt |= (1 << clk);
+        clkStamp(timingClkLow);
         if (bit_is_set(PINC, data))
         {
             actualAddress |= bitNum; //set 1 on given bit
         }
-        _delay_us(delay100khz);
+        _delay_us(clkHighDelay);
+        clkStamp(timingClkHigh);
     }
     chipPrt &= ~(1 << clk);
-    cartridgeChipData[0] = actualAddress; //now we have the first byte
+#ifdef FAULT_INJECTION
+    actualAddress = faultEpsonData(actualAddress);
+#endif
+    return actualAddress;
+}
 
-    for (uint8_t i = 1; i < dataReadSize; i++)
+static uint8_t checkReadByte(uint8_t pos, uint8_t inkColor) //checks the byte read at the given position, returns 1 if it is wrong, 0 if it is ok or not checked
+{
+    if (pos == 12 || pos == 13) //check if the chip ID corresponds to the ink color
     {
-        for (uint8_t bitNum = 128; bitNum > 0; bitNum /= 2)
+        return cartridgeChipData[pos] != dataToCheck[(pos == 12 ? 3 : 7) + inkColor];
+    }
+    if (pos > 20 && pos < 24) //check the 3 trail bytes
+    {
+        return cartridgeChipData[pos] != dataToCheck[pos - 9];
+    }
+    return 0;
+}
+
+static uint8_t receiveByte(void) //reads one byte from the chip, MSB first
+{
+    uint8_t temp = 0;
+
+    for (uint8_t bitNum = 128; bitNum > 0; bitNum /= 2)
+    {
+        chipPrt &= ~(1 << clk);
+        _delay_us(clkLowDelay);
+        chipPrt |= (1 << clk);
+        clkStamp(timingClkLow);
+        if (bit_is_set(PINC, data))
         {
-            chipPrt &= ~(1 << clk);
-            _delay_us(delay40khz);
-            chipPrt |= (1 << clk);
-            if (bit_is_set(PINC, data))
-            {
-                temp |= bitNum; //set 1 on given bit
-            }
-            _delay_us(delay100khz);
+            temp |= bitNum; //set 1 on given bit
         }
-        chipPrt &= ~(1 << clk);
-        cartridgeChipData[i] = temp;
-        temp = 0;
+        _delay_us(clkHighDelay);
+        clkStamp(timingClkHigh);
+    }
+    chipPrt &= ~(1 << clk);
+#ifdef FAULT_INJECTION
+    temp = faultEpsonData(temp);
+    if (faultRemoved()) //what the gndDet interrupt does when the cartridge is pulled out
+    {
+        chipRemoved = true;
     }
+#endif
+    return temp;
+}
+
+static void endTransmission(void) //ends the transmission and sets the data line as output
+{
+    chipPrt &= ~(1 << clk);
     chipPrt &= ~(1 << en);
     DDRC = 0xE; //set the data line as output
     chipPrt &= ~(1 << data);
-    //now we can check the received data
-    if (cartridgeChipData[0] != dataToCheck[inkColor - 1]) //check if the connected chip send "ACK"
+#ifdef TIMING_PROBE
+    timingFlush();
+#endif
+}
+
+static uint8_t resetInkCounter(uint8_t inkColor) //argument value 1-4 depends on found chip, returns 1 if resetting was not ok, 0 if all is ok
+{
+    for (uint8_t i = 0; i < dataWriteSize; i++) //first copy data that we will need
     {
-        return 1;
+        resetChipData[i] = cartridgeChipData[i + 1]; //copy data after the first byte(read address), because we use a different address when writing data
     }
-    if (cartridgeChipData[12] != dataToCheck[3 + inkColor] || cartridgeChipData[13] != dataToCheck[7 + inkColor]) //check if the chip ID corresponds to the ink color
+    resetChipData[3] = 0; //reset ink usage
+    startJournal(inkColor);
+
+    stats.resets++;
+    writeInkCounter(inkColor, 0);
+    //now check if writing was successful, a bad contact usually recovers after a short while, so only the counter is written again
+    for (uint8_t retry = 0; verifyInkCounter(inkColor) == 1; retry++)
     {
-        return 1;
+        if (retry == maxRetries || chipRemoved == true)
+        {
+            return 1; //the journal is kept, the ID bytes may be broken
+        }
+        retryWait(retry);
+        stats.retries++;
+        writeInkCounter(inkColor, retry + 1);
     }
-    for (uint8_t i = 14; i > 11; i--) //check the last 3 trail bytes
+    eeprom_update_byte(&journal[inkColor - 1].color, 0); //the chip holds its ID bytes again
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The chip has no ready signal, a byte whose write cycle is cut by the next CLK edge, a removal or a power loss gets a random
+//value, and the ID bytes are written back with the values read. So the read ID bytes are saved before the first write and
+//used instead of the read ones until the chip is verified. The journal holds the identity of the chip, another chip of the
+//same color gets its own ID bytes. The color is cleared before and written after the rest, so a power loss during the
+//write of the journal leaves no half written record, and the chip is written only after the color is in place.
+//////////////////////////////////////////////////////////////////////////
+static void startJournal(uint8_t inkColor)
+{
+    resetJournal lastReset;
+    uint16_t keptCrc = 0xFFFF;
+
+    for (uint8_t i = dataWriteSize + 1; i < dataReadSize; i++) //the bytes after the counter byte
+    {
+        keptCrc = _crc_ccitt_update(keptCrc, cartridgeChipData[i]);
+    }
+    eeprom_read_block(&lastReset, &journal[inkColor - 1], sizeof(resetJournal));
+    if (lastReset.color == inkColor && lastReset.chipId == keptCrc)
     {
-        if (cartridgeChipData[9 + i] != dataToCheck[i])
+        for (uint8_t i = 0; i < dataWriteSize - 1; i++)
         {
-            return 1;
+            resetChipData[i] = lastReset.idBytes[i];
         }
+        return;
     }
-    return 0; //if everything is ok
+    lastReset.chipId = keptCrc;
+    for (uint8_t i = 0; i < dataWriteSize - 1; i++)
+    {
+        lastReset.idBytes[i] = resetChipData[i];
+    }
+    eeprom_update_byte(&journal[inkColor - 1].color, 0);
+    eeprom_update_block(&lastReset, &journal[inkColor - 1], offsetof(resetJournal, color));
+    eeprom_update_byte(&journal[inkColor - 1].color, inkColor);
+    eeprom_busy_wait(); //the record must be complete before the first byte of the chip is written
 }
 
-uint8_t resetInkCounter(uint8_t inkColor) //argument value 1-4 depends on found chip, returns 1 if resetting was not ok, 0 if all is ok
+//////////////////////////////////////////////////////////////////////////
+//A write cycle longer than byteWriteTime is cut by the next byte, so every retry waits twice as long for every byte.
+//////////////////////////////////////////////////////////////////////////
+static void writeInkCounter(uint8_t inkColor, uint8_t retry)
 {
     uint8_t chipAddresses[] = {blackChipWriteAddr, magentaChipWriteAddr, yellowChipWriteAddr, cyanChipWriteAddr};
     uint8_t temp = 0;
 
-    for (uint8_t i = 0; i < dataWriteSize; i++) //first copy data that we will need
-    {
-        resetChipData[i] = cartridgeChipData[i + 1]; //copy data after the first byte(read address), because we use a different address when writing data
-    }
-    resetChipData[3] = 0; //reset ink usage
-
     DDRC = 0xE; //set the data line as output
     pulseAndSetEn();
     temp = chipAddresses[inkColor - 1];
@@ -290,14 +621,16 @@ uint8_t resetInkCounter(uint8_t inkColor) //argument value 1-4 depends on found
         {
             chipPrt &= ~(1 << data);
         }
-        _delay_us(delay10khz);
+        _delay_us(clkLowWriteDelay);
         chipPrt |= (1 << clk);
-        _delay_us(delay100khz);
+        clkStamp(timingClkLowWrite);
+        _delay_us(clkHighDelay);
+        clkStamp(timingClkHigh);
     }
     chipPrt &= ~(1 << clk);
     chipPrt &= ~(1 << data);
     temp = 0;
-    for (uint8_t pos = 0; pos < dataWriteSize; pos++) //start writing of zeroed ink usage count
+    for (uint8_t pos = 0; pos < dataWriteSize && chipRemoved == false; pos++) //start writing of zeroed ink usage count, stop when the chip is removed
     {
         temp = resetChipData[pos];
         for (uint8_t i = 128; i > 0; i /= 2) //MSB first
@@ -311,33 +644,56 @@ uint8_t resetInkCounter(uint8_t inkColor) //argument value 1-4 depends on found
             {
                 chipPrt &= ~(1 << data);
             }
-            _delay_us(delay10khz);
+            _delay_us(clkLowWriteDelay);
             chipPrt |= (1 << clk);
-            _delay_us(delay100khz);
+            clkStamp(timingClkLowWrite);
+            _delay_us(clkHighDelay);
+            clkStamp(timingClkHigh);
         }
-        _delay_ms(6); //wait for writing of the sent byte
+        for (uint8_t i = 0; i < (1 << retry); i++) //wait for writing of the sent byte, _delay_ms needs a constant argument
+        {
+            _delay_ms(byteWriteTime);
+        }
+        clkStamp(timingStart); //CLK stays high while the byte is written, this is not a half-period
         chipPrt &= ~(1 << clk);
         chipPrt &= ~(1 << data); //change the state of the data line in case the last bit was 1
     }
     chipPrt &= ~(1 << en);
-    //now check if writing was successful
-    clearArray(cartridgeChipData, dataReadSize);
-    uint8_t readResult = readDataFromChip(inkColor);
-    if (readResult == 1)
+#ifdef TIMING_PROBE
+    timingFlush();
+#endif
+}
+
+static uint8_t verifyInkCounter(uint8_t inkColor) //argument value 1-4 depends on found chip, returns 1 if the written data is wrong, 0 if all is ok
+{
+    //the rest of the data was checked by readDataFromChip and is not changed by writing, so only the written bytes are read back
+    if (startReading(inkColor) != cartridgeChipData[0]) //the chip should respond the same way as before writing
     {
+        endTransmission();
         return 1;
     }
-    for (uint8_t i = 0; i < dataWriteSize; i++) //if chip was read ok then check if was resetted correctly
+    for (uint8_t i = 0; i < dataWriteSize; i++)
     {
-        if (resetChipData[i] != cartridgeChipData[i + 1])
+        cartridgeChipData[i + 1] = receiveByte();
+        if (chipRemoved == true || cartridgeChipData[i + 1] != resetChipData[i]) //check if the byte was written correctly
         {
+            endTransmission();
             return 1;
         }
     }
+    endTransmission();
     return 0;
 }
 
-void sendData(const uint8_t dataToSend[], uint8_t sizeOfData)
+static void retryWait(uint8_t retry)
+{
+    for (uint16_t i = 0; i < (retryDelay << retry); i++) //_delay_ms needs a constant argument
+    {
+        _delay_ms(1);
+    }
+}
+
+static void sendData(const uint8_t dataToSend[], uint8_t sizeOfData)
 {
     uint8_t temp = 0;
     DDRC = 0xE; //set the data line as output
@@ -356,17 +712,22 @@ void sendData(const uint8_t dataToSend[], uint8_t sizeOfData)
             {
                 chipPrt &= ~(1 << data);
             }
-            _delay_us(delay40khz);
+            _delay_us(clkLowDelay);
             chipPrt |= (1 << clk);
-            _delay_us(delay100khz);
+            clkStamp(timingClkLow);
+            _delay_us(clkHighDelay);
+            clkStamp(timingClkHigh);
         }
         chipPrt &= ~(1 << clk);
         chipPrt &= ~(1 << data);
     }
     chipPrt &= ~(1 << en);
+#ifdef TIMING_PROBE
+    timingFlush();
+#endif
 }
 
-void clearArray(volatile uint8_t arrayToClear[], uint8_t sizeOfArray) //clears given array, arguments are array and array size
+static void clearArray(volatile uint8_t arrayToClear[], uint8_t sizeOfArray) //clears given array, arguments are array and array size
 {
     for (uint8_t i = 0; i < sizeOfArray; i++)
     {
@@ -374,12 +735,16 @@ void clearArray(volatile uint8_t arrayToClear[], uint8_t sizeOfArray) //clears g
     }
 }
 
-void blinkLed(uint8_t mode, uint8_t errorMode)
+static void blinkLed(uint8_t mode, uint8_t errorMode)
 {
+#ifdef FAULT_INJECTION
+    faultResult(mode == 0 ? errorMode : 0); //the bench reads results from the UART, not from the LEDs
+    return;
+#endif
     //0 - error, 1 - black, 2 - magenta, 3 - yellow, 4 - cyan
     switch (mode)
     {
-        case 0: //error, 1 white blink - chip not found, 2 white blinks - wrong data read, 3 white blinks - ink counter not resetted
+        case 0: //error, 1 white blink - chip not found, 2 white blinks - wrong data read, 3 white blinks - ink counter not resetted, 4 white blinks - chip removed, 5 white blinks - chip resetted but worn
             for (uint8_t i = 0; i < errorMode; i++)
             {
                 PORTB = whiteLed;
@@ -415,16 +780,72 @@ void blinkLed(uint8_t mode, uint8_t errorMode)
     }
 }
 
-void pulseAndSetEn(void)
+static void showResults(const uint8_t results[], uint8_t foundChips)
 {
+    if ((foundChips & (foundChips - 1)) == 0) //only one chip was found, so show its result the usual way
+    {
+        for (uint8_t chip = 1; chip <= chipsCount; chip++)
+        {
+            if (results[chip - 1] == 1)
+            {
+                blinkLed(chip, 0);
+            }
+            else if (results[chip - 1] != 0)
+            {
+                blinkLed(0, results[chip - 1]);
+            }
+        }
+        return;
+    }
+    for (uint8_t chip = 1; chip <= chipsCount; chip++) //show results in order black, magenta, yellow, cyan using the color of each chip
+    {
+        if (results[chip - 1] == 1) //chip resetted, long light
+        {
+            PORTB = chipLeds[chip - 1];
+            _delay_ms(1000);
+            PORTB = offLed;
+            _delay_ms(500);
+        }
+        else if (results[chip - 1] != 0) //error, 2 blinks - wrong data read, 3 blinks - ink counter not resetted, 4 blinks - chip removed, 5 blinks - resetted but worn
+        {
+            for (uint8_t i = 0; i < results[chip - 1]; i++)
+            {
+                PORTB = chipLeds[chip - 1];
+                _delay_ms(250);
+                PORTB = offLed;
+                _delay_ms(250);
+            }
+            _delay_ms(250);
+        }
+    }
+}
+
+static void pulseAndSetEn(void)
+{
+#ifdef TIMING_PROBE
+    timingBusStart();
+#endif
     chipPrt |= (1 << en);
-    _delay_us(60);
+    _delay_us(enPulseTime);
     chipPrt &= ~(1 << en);
-    _delay_us(5);
+    _delay_us(enLowTime);
     chipPrt |= (1 << en);
 }
 
+ISR(PCINT1_vect) //runs when gndDet changes during the reset
+{
+    if (bit_is_set(PINC, gndDet))
+    {
+        chipRemoved = true;
+    }
+}
+
+#ifndef UNIVERSAL_RESETTER
 ISR(INT0_vect)
 {
+#ifdef TIMING_PROBE
+    timingButton();
+#endif
     startResetting = true;
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,17 @@
+/*
+* DX4050_CHIP_RESETTER.h
+*
+* Reset engine of the DX4050 resetter, it is also used by the universal resetter
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef DX4050_CHIP_RESETTER_H
+#define DX4050_CHIP_RESETTER_H
+
+#include <stdint.h>
+
+uint8_t dx4050FindChips(void); //sends the header packet, returns bits of all connected chips, bit 0 - black, 1 - magenta, 2 - yellow, 3 - cyan
+void dx4050ResetChips(uint8_t); //resets all found chips, sends the trailer packet and shows the results, argument is value returned by dx4050FindChips
+
+#endif
@@ -0,0 +1,217 @@
+/*
+* DX4050_SNIFFER.c
+*
+* Passive sniffer of the traffic between a printer and Epson chips. EN, CLK and DATA are only read.
+* CLK (PC2) is also ADC2, so the analog comparator compares it with the bandgap reference
+* and drives the Timer1 input capture, every CLK edge gets a timestamp without any software latency.
+* Edges are stored in a ring in SRAM and decoded in the main loop, frames are sent over UART:
+*   <address nibble>/<ACK nibble>: <bytes> (<CLK period>us)
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef F_CPU
+#define F_CPU 8000000UL //8MHz internal RC, a crystal clocked board can be built with 16MHz or 20MHz
+#endif
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdbool.h>
+#include "../../../COMMON/FIRMWARE/uart.h"
+#include "DX4050_SNIFFER.h"
+
+#define en PINC1
+#define clk PINC2
+#define data PINC3
+#define sniffLed 2 //blue LED is on in sniffer mode
+
+#define ringSize 128 //edges in the ring, must be a power of 2
+#define frameSize 40 //longest frame is the 32 byte read
+#define timerPrescaler 8 //Timer1 tick is 1us at 8MHz
+#define ticksPerUs (F_CPU / 1000000UL / timerPrescaler)
+#define maxBitGap (200 * ticksPerUs) //longer gaps are write pauses, they are not used to compute the CLK period
+#define edgeCycles 100 //estimated CPU cycles of the capture ISR and decoding of one edge
+_Static_assert((ringSize & (ringSize - 1)) == 0, "ringSize must be a power of 2");
+_Static_assert(ticksPerUs >= 1, "F_CPU is too low for the sniffer timebase");
+//flags of a captured edge
+#define clkRising 0x01 //CLK went high, DATA is valid
+#define dataHigh 0x02 //DATA level at the edge
+#define enHigh 0x04 //EN level at the edge
+#define enChanged 0x08 //EN changed since the previous edge, a new frame starts
+
+typedef struct
+{
+    uint16_t time; //Timer1 value at the edge
+    uint8_t flags;
+} sniffedEdge;
+
+static volatile sniffedEdge ring[ringSize];
+static volatile uint8_t ringHead = 0; //written by the ISR
+static volatile uint8_t ringTail = 0; //read by the main loop
+static volatile uint16_t droppedEdges = 0; //edges lost because the ring was full
+static uint8_t frame[frameSize];
+static uint8_t frameBytes = 0;
+static uint8_t frameBits = 0; //bits of the byte being received
+static uint16_t lastRise = 0;
+static uint32_t periodSum = 0; //sum of CLK periods of the frame in timer ticks
+static uint16_t periodCount = 0;
+
+static void decodeEdge(const sniffedEdge *); //adds one edge to the frame
+static void sendFrame(void); //sends the received frame and starts a new one
+static void putNibble(uint8_t);
+
+void dx4050Sniff(void)
+{
+    DDRC = 0x0; //EN, CLK and DATA are inputs without pull-ups, the printer drives them
+    PORTC = 0x0;
+    DDRB = 0x7;
+    PORTB = sniffLed;
+    PCMSK1 = (1 << PCINT9); //EN changes set PCIF1, the interrupt itself stays disabled
+    PCIFR = (1 << PCIF1);
+    ADCSRA &= ~(1 << ADEN); //the comparator can use the ADC multiplexer only when the ADC is off
+    ADCSRB = (1 << ACME);
+    ADMUX = clk; //ADC2 is the negative input
+    ACSR = (1 << ACBG) | (1 << ACIC); //bandgap on the positive input, output drives the input capture
+    TCCR1A = 0;
+    TCCR1B = (1 << CS11); //prescaler 8, capture on the falling comparator output, which is the rising CLK
+    TIFR1 = (1 << ICF1);
+    TIMSK1 = (1 << ICIE1);
+    uartInit();
+    uartPutString("DX4050 sniffer, max ");
+    uartPutNumber(F_CPU / edgeCycles);
+    uartPutString(" edges/s\r\n");
+    sei();
+
+    while (1)
+    {
+        if (ringTail != ringHead)
+        {
+            sniffedEdge edge = ring[ringTail];
+            ringTail = (ringTail + 1) & (ringSize - 1);
+            decodeEdge(&edge);
+        }
+        else if ((frameBytes != 0 || frameBits != 0) && bit_is_clear(PINC, en)) //transmission ended and there are no more edges
+        {
+            sendFrame();
+        }
+        if (droppedEdges != 0)
+        {
+            cli();
+            uint16_t dropped = droppedEdges;
+            droppedEdges = 0;
+            sei();
+            uartPutString("dropped ");
+            uartPutNumber(dropped);
+            uartPutString(" edges\r\n");
+        }
+    }
+}
+
+static void decodeEdge(const sniffedEdge *edge)
+{
+    if (edge->flags & enChanged)
+    {
+        sendFrame();
+    }
+    if (!(edge->flags & clkRising) || !(edge->flags & enHigh)) //bits are valid only on the rising CLK during a transmission
+    {
+        return;
+    }
+    if (frameBits != 0 || frameBytes != 0)
+    {
+        uint16_t gap = edge->time - lastRise;
+        if (gap < maxBitGap)
+        {
+            periodSum += gap;
+            periodCount++;
+        }
+    }
+    lastRise = edge->time;
+    if (frameBytes < frameSize)
+    {
+        frame[frameBytes] = (frame[frameBytes] << 1) | ((edge->flags & dataHigh) ? 1 : 0);
+    }
+    if (++frameBits == 8)
+    {
+        frameBits = 0;
+        frameBytes++;
+    }
+}
+
+static void sendFrame(void)
+{
+    if (frameBytes == 0 && frameBits == 0)
+    {
+        return; //EN pulse without any data
+    }
+    if (frameBytes != 0)
+    {
+        putNibble(frame[0] >> 4); //address
+        uartPutChar('/');
+        putNibble(frame[0] & 0x0F); //"ACK" or "NACK"
+        uartPutChar(':');
+    }
+    for (uint8_t i = 1; i < frameBytes && i < frameSize; i++)
+    {
+        uartPutChar(' ');
+        uartPutHex(frame[i]);
+    }
+    if (frameBits != 0) //not a whole byte at the end
+    {
+        uartPutString(" +");
+        uartPutNumber(frameBits);
+        uartPutChar('b');
+    }
+    if (periodCount != 0)
+    {
+        uartPutString(" (");
+        uartPutNumber(periodSum / periodCount / ticksPerUs);
+        uartPutString("us)");
+    }
+    uartPutString("\r\n");
+
+    for (uint8_t i = 0; i < frameSize; i++)
+    {
+        frame[i] = 0;
+    }
+    frameBytes = 0;
+    frameBits = 0;
+    periodSum = 0;
+    periodCount = 0;
+}
+
+static void putNibble(uint8_t value)
+{
+    uartPutChar(value < 10 ? '0' + value : 'A' + value - 10);
+}
+
+ISR(TIMER1_CAPT_vect)
+{
+    uint16_t time = ICR1;
+    uint8_t flags = (TCCR1B & (1 << ICES1)) ? 0 : clkRising; //comparator output is high when CLK is low
+    uint8_t next = (ringHead + 1) & (ringSize - 1);
+
+    TCCR1B ^= (1 << ICES1); //the next edge goes the other way
+    TIFR1 = (1 << ICF1); //changing the edge can set the flag
+    if (bit_is_set(PINC, data))
+    {
+        flags |= dataHigh;
+    }
+    if (bit_is_set(PINC, en))
+    {
+        flags |= enHigh;
+    }
+    if (PCIFR & (1 << PCIF1))
+    {
+        flags |= enChanged;
+        PCIFR = (1 << PCIF1);
+    }
+    if (next == ringTail)
+    {
+        droppedEdges++;
+        return;
+    }
+    ring[ringHead].time = time;
+    ring[ringHead].flags = flags;
+    ringHead = next;
+}
@@ -0,0 +1,14 @@
+/*
+* DX4050_SNIFFER.h
+*
+* Passive sniffer of the traffic between a printer and Epson chips
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef DX4050_SNIFFER_H
+#define DX4050_SNIFFER_H
+
+void dx4050Sniff(void); //sets EN, CLK and DATA as inputs and sends decoded frames over UART, never returns
+
+#endif
@@ -7,13 +7,46 @@
 *
 */
 
-#define F_CPU 8000000UL //8MHz
+#ifndef F_CPU
+#define F_CPU 8000000UL //8MHz internal RC, a crystal clocked board can be built with 16MHz or 20MHz
+#endif
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <util/delay.h>
-#include "i2cmaster.h"
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include "../../../COMMON/FIRMWARE/i2cmaster.h"
+#include "SG2100N_CHIP_RESETTER.h"
+#ifdef CHIP_EMULATION
+#include "../../../COMMON/FIRMWARE/i2cslave.h"
+#endif
+#ifdef FAULT_INJECTION
+#include "../../../COMMON/FIRMWARE/faults.h"
+#endif
+#ifdef SELF_BENCHMARK
+#include "../../../COMMON/FIRMWARE/bench.h"
+#endif
+#ifdef SRAM_REPORT
+#include "../../../COMMON/FIRMWARE/sram.h"
+#endif
+#ifdef CHIP_BACKUP
+#include "../../../COMMON/FIRMWARE/backup.h"
+#endif
+#ifdef SERIAL_CONTROL
+#include "../../../COMMON/FIRMWARE/control.h"
+#endif
+#ifdef CHIP_HEALTH
+#include "../../../COMMON/FIRMWARE/health.h"
+#endif
+#if defined(SRAM_REPORT) || defined(CHIP_BACKUP) || defined(SERIAL_CONTROL) || defined(CHIP_HEALTH)
+#include "../../../COMMON/FIRMWARE/uart.h"
+#endif
+#ifdef TIMING_PROBE
+#include "../../../COMMON/FIRMWARE/timing.h"
+#endif
 
 #define chipAddrC 0xA2 //address of the cyan gel chip
 #define chipAddrM 0xA4 //address of the magenta gel chip
@@ -21,8 +54,16 @@
 #define chipAddrB 0xA0 //address of the black gel chip
 #define chipAddrW 0xA8 //address of the waste tank chip
 
-#define chipDataSize 1
 #define chipTypeSize 2
+#define gelChipSize 128 //bytes of the chip EEPROM
+#define wasteChipSize 256
+#define pageSize 8 //bytes in one page of the chip EEPROM
+#define maxRegions 40 //regions of the largest profile
+#ifndef maxRetries
+#define maxRetries 3 //how many times a region is written again when its verification fails
+#endif
+#define noPage 0xFF //page of the journal before the first page write
+#define retryDelay 2 //delay in milliseconds before the first retry, doubled before every next one
 
 #define redLed 4
 #define greenLed 1
@@ -31,22 +72,103 @@
 #define whiteLed 7
 #define offLed 0
 
+typedef struct
+{
+    uint8_t start; //address of the first byte
+    uint8_t size; //number of bytes
+    const uint8_t *values; //data to write, NULL if all bytes have the fill value
+    uint8_t fill; //value of all bytes of the region without data
+} resetRegion;
+
+#include "SG2100N_RESET_PLAN.h" //generated from DATA_MAP.map and WASTE_TANK_DATA_MAP.map by TOOLS/RESETPLAN
+
+typedef struct
+{
+    const resetRegion *regions; //in order of writing, every region is one page write
+    const uint8_t *verifyOrder; //regions in order of addresses
+    uint8_t regionsCount;
+    uint8_t verifyStart; //all regions are read back at once from here
+    uint8_t verifySize;
+    uint8_t journalId; //profile number saved in the journal
+    uint8_t writeCycle; //ms, i2c_start_wait() gives up after I2C_WAIT_MARGIN write cycles
+    uint8_t serialStart; //serial number, its bytes outside of the regions are the identity of the chip in the health table
+    uint8_t serialSize;
+    uint16_t chipSize;
+    uint16_t resetCrc; //CRC16 of the reset data of all regions in order of addresses
+} resetProfile;
+_Static_assert(gelRegionsCount <= maxRegions && wasteRegionsCount <= maxRegions, "maxRegions is too small for the reset plan");
+
+typedef struct
+{
+    uint8_t profile; //profile of the interrupted reset, 0 or 0xFF (erased EEPROM) if there is nothing to continue
+    uint8_t address; //I2C address of the chip
+    uint16_t chipId; //CRC16 of the bytes the reset doesn't write, the identity of the interrupted chip
+    uint8_t page; //page write started last, its write cycle may have been cut by the interruption, noPage if there is none
+} resetJournal;
+
+typedef struct
+{
+    uint16_t resets; //number of chips resetted since power on
+    uint16_t retries; //number of regions written again after failed verification
+    uint16_t fingerprint; //CRC16 of the last chip read before its reset
+} resetStatistics;
+
+#ifndef UNIVERSAL_RESETTER //the universal resetter has its own main loop
 volatile bool startResetting = false; //if true then user pressed the button
-bool chipTypeOk = false; //if true then we can start resetting
-bool resettedOk = false; //if true then chip was resetted successfully
-const uint8_t chipsAddr[] = {chipAddrC, chipAddrM, chipAddrY, chipAddrB, chipAddrW};
-const uint8_t gelType[chipTypeSize] = {227, 18};
-const uint8_t wasteType[chipTypeSize] = {227, 1};
-const uint8_t dataToCheck[chipDataSize] = {100};
-volatile uint8_t readData[chipDataSize] = {0};
-volatile uint8_t readChipType[chipTypeSize] = {0};
-
-uint8_t findChip(void); //searches for a gel or waste tank chip, returns a number from 1 to 5 in order C M Y B W, or 0 if a chip was not found
-void writeZeros(uint8_t, uint8_t, uint8_t); //writes given number of zeros starting from given address
-uint8_t checkZeros(uint8_t, uint8_t, uint8_t); //reads data and checks if all read bytes are 0
-void writeOnes(uint8_t, uint8_t, uint8_t); //writes given number of ones starting from given address
-uint8_t checkOnes(uint8_t, uint8_t, uint8_t); //reads data and checks if all read bytes are 1
-void blinkLed(uint8_t, uint8_t); //arguments are blink type and error mode, 0 - error(error mode can be set from 1 to 3), 1 - cyan resetted, 2 - magenta, 3 - yellow, 4 - black, 5 - waste tank
+#endif
+static bool resettedOk = false; //if true then chip was resetted successfully
+static bool chipRemoved = false; //if true then the chip stopped answering during the reset
+static const uint8_t chipsAddr[] = {chipAddrC, chipAddrM, chipAddrY, chipAddrB, chipAddrW};
+static const uint8_t gelType[chipTypeSize] = {227, 18};
+static const uint8_t wasteType[chipTypeSize] = {227, 1};
+//the ink level is written last, so an interrupted reset never leaves a full chip with old data
+static const resetProfile gelProfile = {gelRegions, gelVerifyOrder, gelRegionsCount, gelVerifyStart, gelVerifySize, sg2100nGelProfile, gelWriteCycle, gelSerialStart, gelSerialSize, gelChipSize, gelResetCrc};
+static const resetProfile wasteProfile = {wasteRegions, wasteVerifyOrder, wasteRegionsCount, wasteVerifyStart, wasteVerifySize, sg2100nWasteProfile, wasteWriteCycle, wasteSerialStart, wasteSerialSize, wasteChipSize, wasteResetCrc};
+static bool failedRegions[maxRegions]; //regions with data different from the reset data, found by the last read of the chip
+static volatile uint8_t readChipType[chipTypeSize] = {0};
+static resetStatistics stats = {0};
+static bool wholeRead = false; //if true then the next checkRegions() reads the whole chip
+static uint16_t chipCrc = 0; //CRC16 of all bytes read by the last checkRegions(), the fingerprint of the chip after a whole read
+static resetJournal journal EEMEM; //record of the reset in progress, kept in the internal EEPROM so it survives a power loss
+#ifdef SELF_BENCHMARK
+static bool benchmarking = false; //if true then the page writes are not saved in the journal, the benchmark has no reset to continue
+#endif
+#ifdef CHIP_BACKUP
+static bool backupPending = false; //if true then the next checkRegions() packs the chip for the backup
+#endif
+static uint16_t keptCrc = 0; //CRC16 of the bytes outside of the regions read by the last checkRegions(), the identity of the chip after a whole read
+#ifdef CHIP_HEALTH
+static uint16_t serialCrc = 0; //CRC16 of the address and the serial number read by the last checkRegions(), the identity of the chip in the health table
+static uint16_t writePolls = 0; //busy answers before the page writes of writeRegions() and the verify read after them
+static uint8_t pageWrites = 0; //page writes of writeRegions()
+#endif
+
+static const resetProfile *chipProfile(uint8_t); //reads the chip type, returns the profile of the chip or NULL if the type is wrong or the bus got stuck (i2c_error()), argument is index of the chip address
+static const resetProfile *typeProfile(uint8_t, uint8_t); //returns the profile of the type given by the first two bytes of the chip, NULL if the type is not known
+static void resetChip(uint8_t, const resetProfile *); //resets the chip with the profile and shows the result, arguments are index of the chip address and the profile, NULL if the type is wrong
+static void writeRegions(uint8_t, const resetProfile *); //writes the regions marked in failedRegions and the page cut by an interrupted reset of the same chip found by the whole read before
+static bool checkRegions(uint8_t, const resetProfile *); //reads all regions back in one transaction and marks the wrong ones in failedRegions, returns true if all of them hold the reset data of the plan
+static uint8_t pagePartSize(const resetRegion *, uint8_t); //returns number of bytes that can be written at once from the given offset of the region
+static void writePagePart(uint8_t, const resetRegion *, uint8_t, uint8_t); //writes a part of the region that fits in one page
+static uint8_t checkRegion(uint8_t, const resetRegion *); //reads the region back, returns 0 if it holds the written data
+static bool retryRegion(uint8_t, const resetRegion *); //writes the region again until it is verified, returns false if all retries failed
+static void retryWait(uint8_t); //waits before the given retry, every next retry waits twice as long
+#ifdef CHIP_BACKUP
+static uint8_t goldenByte(uint8_t, uint8_t); //returns the reset data of the byte, 0 if the reset doesn't write it, arguments are journalId of the profile and address
+static bool keptByte(uint8_t, uint8_t); //returns true if the reset doesn't write the byte, arguments are journalId of the profile and address
+static void restoreRegions(uint8_t, const resetProfile *); //writes the regions from the record found by backupFind(), sets chipRemoved if the chip stops answering, arguments are chip address and profile
+#endif
+static void blinkLed(uint8_t, uint8_t); //arguments are blink type and error mode, 0 - error(error mode can be set from 1 to 5), 1 - cyan resetted, 2 - magenta, 3 - yellow, 4 - black, 5 - waste tank
+
+#ifndef UNIVERSAL_RESETTER
+#ifdef CHIP_EMULATION
+static void emulateChip(void); //copies the chip to SRAM, resets the copy and answers instead of the chip, returns only if the chip can't be copied
+#endif
+static void findAndResetChip(void); //resets the connected chip or blinks the error if there is none
+#ifdef SELF_BENCHMARK
+static void benchmarkChip(void); //times read, write and verify of the connected chip, then resets it as usual and shows the results
+static void benchLed(bool);
+#endif
 
 int main(void)
 {
@@ -60,222 +182,752 @@ int main(void)
     EIMSK |= (1 << INT0); //enable INT0
     //----------------------------------------------
     i2c_init(); //initialize I2C library
+#ifdef CHIP_EMULATION
+    _delay_ms(10); //wait for the pull-up of the button
+    if (bit_is_clear(PIND, PIND2)) //button held at power-on starts the chip emulation
+    {
+        emulateChip();
+    }
+#endif
+#ifdef TIMING_PROBE
+    timingInit();
+#endif
+#if defined(SRAM_REPORT) || defined(CHIP_BACKUP) || defined(SERIAL_CONTROL) || defined(CHIP_HEALTH)
+    uartInit(); //for the commands of the reports
+#endif
+#ifdef CHIP_BACKUP
+    backupInit(goldenByte);
+#endif
     sei(); //enable interrupts
+#ifdef FAULT_INJECTION
+    faultRun(findAndResetChip); //bench build, resets the chip once for every fault and never returns
+#endif
 
     while (1)
     {
+#if defined(SRAM_REPORT) || defined(CHIP_BACKUP) || defined(SERIAL_CONTROL) || defined(CHIP_HEALTH)
+        char command = uartCharReady() == 1 ? uartGetChar() : 0; //one received char is read for all reports
+#endif
+#ifdef SRAM_REPORT
+        sramPoll(command);
+#endif
+#ifdef CHIP_BACKUP
+        backupPoll(command); //the backup of the last chip is written between resets
+        if (command == backupRestore)
+        {
+            sg2100nRestoreChip();
+        }
+#endif
+#ifdef CHIP_HEALTH
+        healthPoll(command);
+#endif
+#ifdef SERIAL_CONTROL
+        if (controlCommand(command, stats.resets, stats.retries, stats.fingerprint) == true)
+        {
+            startResetting = true; //the same as a press of the button
+        }
+#endif
         if (startResetting == true)
         {
             EIMSK &= ~(1 << INT0); //disable INT0 for the time of resetting
-            uint8_t foundChip = findChip(); //search for the connected chip
-            if (foundChip != 0) //chip was found
+#ifdef SELF_BENCHMARK
+            if (benchLongPress() == true)
             {
-                foundChip--; //subtract 1 because the function returns 0 when chip is not found, so all numbers are +1
-                i2c_write(0x0);
-                i2c_rep_start(chipsAddr[foundChip] + I2C_READ);
-                readChipType[0] = i2c_readAck();
-                readChipType[1] = i2c_readNak();
-                i2c_stop();
+                benchmarkChip();
+            }
+            else
+#endif
+            findAndResetChip();
+#ifdef TIMING_PROBE
+            timingReport();
+#endif
+#ifdef SERIAL_CONTROL
+            controlDone();
+#endif
+            EIMSK |= (1 << INT0); //enable INT0 again
+            EIFR |= (1 << INTF0); //clear INT0 flag, this will eliminate additional reading after release of the button
+            startResetting = false; //end resetting
+        }
+    }
+}
 
-                for (uint8_t i = 0; i < chipTypeSize; i++) //check if chip type matches
-                {
-                    if (readChipType[i] != gelType[i] && readChipType[i] != wasteType[i]) //check if read type don't matches any known value
-                    {
-                        chipTypeOk = false;
-                        break;
-                    }
-                    chipTypeOk = true;
-                }
+static void findAndResetChip(void)
+{
+    uint8_t foundChip = sg2100nFindChip(); //search for the connected chip
+    if (foundChip != 0) //chip was found
+    {
+        sg2100nResetChip(foundChip);
+    }
+    else //if something is wrong then blink
+    {
+        blinkLed(0, 1); //error, 1 blink
+    }
+}
 
-                if (chipTypeOk == false)
-                {
-                    blinkLed(0, 2); //show that the chip type is wrong, stop resetting
-                }
-                else
+#ifdef SELF_BENCHMARK
+//////////////////////////////////////////////////////////////////////////
+//Every cycle reads all regions, writes all of them and reads them again. The written data is always the reset data,
+//so after the last cycle and the normal reset that follows it the chip holds the same data as after a single reset.
+//A cycle that fails ends the benchmark, the normal reset then shows the error.
+//////////////////////////////////////////////////////////////////////////
+static void benchmarkChip(void)
+{
+    static const char *const phaseNames[] = {"read", "write", "verify"};
+    uint8_t foundChip = sg2100nFindChip();
+    if (foundChip == 0)
+    {
+        blinkLed(0, 1);
+        return;
+    }
+    const resetProfile *profile = chipProfile(foundChip - 1);
+    if (profile == NULL && i2c_error() != 0)
+    {
+        i2c_recover();
+        blinkLed(0, 4);
+        return;
+    }
+    if (profile == NULL)
+    {
+        blinkLed(0, 2); //a chip of a wrong type is never written
+        return;
+    }
+
+    uint8_t chipAddr = chipsAddr[foundChip - 1];
+    bool cyclesOk = true;
+    i2c_write_cycle(profile->writeCycle);
+    chipRemoved = false;
+    benchmarking = true;
+    benchStart();
+    for (uint8_t cycle = 0; cycle < benchCycles && cyclesOk == true; cycle++)
+    {
+        checkRegions(chipAddr, profile);
+        benchMark(0);
+        for (uint8_t i = 0; i < profile->regionsCount; i++)
+        {
+            failedRegions[i] = true; //every region is written, as on a new chip
+        }
+        writeRegions(chipAddr, profile);
+        benchMark(1);
+        cyclesOk = checkRegions(chipAddr, profile);
+        benchMark(2);
+    }
+    benchmarking = false;
+    if (chipRemoved == true)
+    {
+        i2c_recover();
+    }
+
+    sg2100nResetChip(foundChip);
+    if (cyclesOk == true)
+    {
+        benchReport(phaseNames, 3, benchLed);
+    }
+}
+
+static void benchLed(bool on)
+{
+    PORTB = on ? whiteLed : offLed;
+}
+#endif
+
+#ifdef CHIP_EMULATION
+//////////////////////////////////////////////////////////////////////////
+//Function reads the whole chip, writes the reset data to this copy and answers at the chip address instead of the chip.
+//The board is then connected to the printer in place of the chip, so the worn chip EEPROM is not written at all.
+//Writes of the printer change only the copy in SRAM, the LED of the chip color is on while the chip is emulated.
+//////////////////////////////////////////////////////////////////////////
+static void emulateChip(void)
+{
+    const uint8_t chipLeds[] = {blueLed, redLed, yellowLed, whiteLed, greenLed}; //the same colors as after reset of C M Y B W chips
+    uint8_t foundChip = sg2100nFindChip();
+    if (foundChip == 0)
+    {
+        blinkLed(0, 1);
+        return;
+    }
+    foundChip--;
+    const resetProfile *profile = chipProfile(foundChip); //the type gives the size of the copy
+    if (profile == NULL)
+    {
+        if (i2c_error() != 0)
+        {
+            i2c_recover();
+            blinkLed(0, 4);
+        }
+        else
+        {
+            blinkLed(0, 2); //wrong chip type
+        }
+        return;
+    }
+    if (i2c_start_wait(chipsAddr[foundChip] + I2C_WRITE) != 0 || i2c_write(0x0) != 0 || i2c_rep_start(chipsAddr[foundChip] + I2C_READ) != 0) //the chip stopped answering, nothing is copied
+    {
+        i2c_recover();
+        blinkLed(0, 4);
+        return;
+    }
+    for (uint16_t i = 0; i < profile->chipSize; i++)
+    {
+        i2c_slave_image[i] = (i < profile->chipSize - 1) ? i2c_readAck() : i2c_readNak();
+    }
+    if (i2c_error() != 0) //the copy is not valid
+    {
+        i2c_recover();
+        blinkLed(0, 4);
+        return;
+    }
+    i2c_stop();
+    for (uint8_t i = 0; i < profile->regionsCount; i++)
+    {
+        const resetRegion *region = &profile->regions[i];
+        for (uint8_t j = 0; j < region->size; j++)
+        {
+            i2c_slave_image[region->start + j] = region->values != NULL ? region->values[j] : region->fill;
+        }
+    }
+
+    EIMSK &= ~(1 << INT0); //the button does nothing now
+    i2c_slave_init(chipsAddr[foundChip], profile->chipSize); //the word address wraps like in the chip of this type
+    PORTB = chipLeds[foundChip];
+    sei();
+    while (1); //everything is done in the TWI interrupt
+}
+#endif
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//Resets the found chip, argument is a number from 1 to 5 returned by sg2100nFindChip
+//////////////////////////////////////////////////////////////////////////
+void sg2100nResetChip(uint8_t foundChip)
+{
+    foundChip--; //subtract 1 because the function returns 0 when chip is not found, so all numbers are +1
+    resetChip(foundChip, chipProfile(foundChip));
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The universal resetter has read the type of the chip already, so the chip is not read again
+//////////////////////////////////////////////////////////////////////////
+void sg2100nResetProfile(uint8_t foundChip, uint8_t profileId)
+{
+    resetChip(foundChip - 1, profileId == sg2100nWasteProfile ? &wasteProfile : &gelProfile);
+}
+
+static void resetChip(uint8_t foundChip, const resetProfile *profile)
+{
+    chipRemoved = false;
+    if (profile == NULL && i2c_error() != 0) //the bus got stuck while the type was read
+    {
+        i2c_recover();
+        blinkLed(0, 4);
+    }
+    else if (profile == NULL)
+    {
+        blinkLed(0, 2); //show that the chip type is wrong, stop resetting
+    }
+    else
+    {
+        stats.resets++;
+        i2c_write_cycle(profile->writeCycle); //a slow chip is waited for, a removed one is found after I2C_WAIT_MARGIN write cycles
+#ifdef CHIP_BACKUP
+        backupPending = true;
+#endif
+#ifdef CHIP_HEALTH
+        uint16_t retries = stats.retries;
+        uint16_t chipId = 0;
+        writePolls = 0;
+        pageWrites = 0;
+#endif
+        wholeRead = true;
+        checkRegions(chipsAddr[foundChip], profile); //regions that already hold the reset data are not written, every write wears the chip EEPROM
+        if (chipRemoved == false)
+        {
+            stats.fingerprint = chipCrc;
+#ifdef SERIAL_CONTROL
+            controlChip(foundChip, chipCrc);
+#endif
+#ifdef CHIP_HEALTH
+            chipId = serialCrc;
+#endif
+        }
+        writeRegions(chipsAddr[foundChip], profile);
+
+        //now check if data was written successfully, only regions that failed are written again
+        resettedOk = checkRegions(chipsAddr[foundChip], profile);
+#ifdef CHIP_HEALTH
+        writePolls += i2c_busy_polls(); //the verify read waited for the last page write
+#endif
+        if (resettedOk == false)
+        {
+            resettedOk = true;
+            for (uint8_t i = 0; i < profile->regionsCount && chipRemoved == false; i++)
+            {
+                if (failedRegions[i] == true && retryRegion(chipsAddr[foundChip], &profile->regions[i]) == false)
                 {
-                    uint8_t zerosCheck = 0; //this var will indicate if needed data is 0's
-                    uint8_t onesCheck = 0xFF; //this var will indicate if needed data is 1's
-                    if (foundChip < 4) //if we reset a gel chip
-                    {
-                        writeZeros(chipsAddr[foundChip], 1, 0x06);
-                        writeOnes(chipsAddr[foundChip], 1, 0x07);
-
-                        i2c_start_wait(chipsAddr[foundChip] + I2C_WRITE); //set device address and write mode, repeated start
-                        i2c_write(0x08); //initial ink level
-                        i2c_write(100); //reset to full
-                        i2c_stop();
-
-                        writeZeros(chipsAddr[foundChip], 1, 0x09);
-                        writeOnes(chipsAddr[foundChip], 6, 0x10);
-                        writeOnes(chipsAddr[foundChip], 8, 0x18);
-                        writeOnes(chipsAddr[foundChip], 1, 0x28);
-                        writeZeros(chipsAddr[foundChip], 1, 0x29);
-                        writeOnes(chipsAddr[foundChip], 22, 0x2A);
-                        writeOnes(chipsAddr[foundChip], 11, 0x43);
-                        writeOnes(chipsAddr[foundChip], 49, 0x4F);
-
-                        //now check if data was written successfully
-                        //read previously written values back from EEPROM
-                        i2c_start_wait(chipsAddr[foundChip] + I2C_WRITE); //set device address and write mode
-                        i2c_write(0x08); //initial ink level
-                        i2c_rep_start(chipsAddr[foundChip] + I2C_READ); //set device address and read mode
-                        readData[0] = i2c_readNak(); //read one byte from EEPROM
-                        i2c_stop();
-
-                        zerosCheck |= checkZeros(chipsAddr[foundChip], 1, 0x06);
-                        zerosCheck |= checkZeros(chipsAddr[foundChip], 1, 0x09);
-                        zerosCheck |= checkZeros(chipsAddr[foundChip], 1, 0x29);
-
-                        onesCheck &= checkOnes(chipsAddr[foundChip], 1, 0x07);
-                        onesCheck &= checkOnes(chipsAddr[foundChip], 6, 0x10);
-                        onesCheck &= checkOnes(chipsAddr[foundChip], 8, 0x18);
-                        onesCheck &= checkOnes(chipsAddr[foundChip], 1, 0x28);
-                        onesCheck &= checkOnes(chipsAddr[foundChip], 22, 0x2A);
-                        onesCheck &= checkOnes(chipsAddr[foundChip], 11, 0x43);
-                        onesCheck &= checkOnes(chipsAddr[foundChip], 49, 0x4F);
-
-                        for (uint8_t i = 0; i < chipDataSize; i++) //check if chip was resetted successfully
-                        {
-                            if (readData[i] != dataToCheck[i])
-                            {
-                                resettedOk = false;
-                                break;
-                            }
-                            resettedOk = true;
-                        }
-
-                        if (resettedOk == true && zerosCheck == 0 && onesCheck == 0xFF) //also check if all needed data have the right value
-                        {
-                            blinkLed(foundChip + 1, 0); //resetting was successful (+1 because error is mode 0)
-                        }
-                        else
-                        {
-                            blinkLed(0, 3);
-                        }
-                    }
-                    else //otherwise we reset the waste tank chip
-                    {
-                        writeZeros(chipsAddr[foundChip], 5, 0x04);
-                        writeZeros(chipsAddr[foundChip], 74, 0x14);
-                        writeZeros(chipsAddr[foundChip], 160, 0x5F);
-
-                        //now check if data was written successfully
-                        zerosCheck |= checkZeros(chipsAddr[foundChip], 5, 0x04);
-                        zerosCheck |= checkZeros(chipsAddr[foundChip], 74, 0x14);
-                        zerosCheck |= checkZeros(chipsAddr[foundChip], 160, 0x5F);
-
-                        //we don't need to read any custom data from the chip
-
-                        if (zerosCheck == 0) //also check if all needed data is zeroed
-                        {
-                            blinkLed(foundChip + 1, 0); //resetting was successful (+1 because error is mode 0)
-                        }
-                        else
-                        {
-                            blinkLed(0, 3);
-                        }
-                    }
+                    resettedOk = false;
+                    break;
                 }
             }
-            else //if something is wrong then blink
+            if (resettedOk == true && chipRemoved == false) //the written again regions are confirmed with the rest of the chip
+            {
+                resettedOk = checkRegions(chipsAddr[foundChip], profile);
+            }
+        }
+
+        if (resettedOk == true && chipRemoved == false) //the last page write ended during the verify read
+        {
+            eeprom_update_byte(&journal.profile, 0); //the chip is verified, there is nothing to continue
+        }
+        if (chipRemoved == true) //the bus may be left in the middle of a byte, the journal keeps the written pages for the next try
+        {
+            i2c_recover();
+            blinkLed(0, 4);
+        }
+#ifdef CHIP_HEALTH
+        else if (healthCheck(healthSg2100n + profile->journalId, chipId, pageWrites != 0 ? i2c_wait_load(writePolls / pageWrites) : 0,
+                             stats.retries - retries) == true && resettedOk == true)
+        {
+            blinkLed(0, 5); //the reset data is written, but the chip should be thrown out
+        }
+#endif
+        else if (resettedOk == true)
+        {
+            blinkLed(foundChip + 1, 0); //resetting was successful (+1 because error is mode 0)
+        }
+        else
+        {
+            blinkLed(0, 3);
+        }
+    }
+}
+
+#ifdef CHIP_BACKUP
+//////////////////////////////////////////////////////////////////////////
+//Undoes the last reset of the connected chip. Its record is found by the bytes the reset doesn't write, so only the regions
+//are written back. The chip is read again and must give the CRC16 of the record. A restore cut by a power loss is not continued,
+//the chip can be restored or resetted again.
+//////////////////////////////////////////////////////////////////////////
+void sg2100nRestoreChip(void)
+{
+    uint8_t foundChip = sg2100nFindChip();
+    if (foundChip == 0)
+    {
+        return;
+    }
+    foundChip--;
+    const resetProfile *profile = chipProfile(foundChip);
+    if (profile == NULL) //a chip of a wrong type is never written
+    {
+        if (i2c_error() != 0)
+        {
+            i2c_recover();
+        }
+        return;
+    }
+
+    uint8_t chipAddr = chipsAddr[foundChip];
+    uint16_t crc = 0;
+    i2c_write_cycle(profile->writeCycle);
+    chipRemoved = false;
+    wholeRead = true;
+    checkRegions(chipAddr, profile);
+    uartPutString("chip ");
+    uartPutNumber(foundChip);
+    if (chipRemoved == false && backupFind(profile->journalId, keptCrc, goldenByte, keptByte, &crc) == false)
+    {
+        uartPutString(" no backup\r\n");
+        return;
+    }
+    if (chipRemoved == false)
+    {
+        restoreRegions(chipAddr, profile);
+    }
+    if (chipRemoved == false)
+    {
+        wholeRead = true;
+        checkRegions(chipAddr, profile);
+    }
+    if (chipRemoved == true)
+    {
+        i2c_recover();
+    }
+    uartPutString(chipRemoved == false && chipCrc == crc ? " restored\r\n" : " failed\r\n");
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The record is unpacked in order of addresses, so the regions are written in the order of the verify read.
+//////////////////////////////////////////////////////////////////////////
+static void restoreRegions(uint8_t chipAddr, const resetProfile *profile)
+{
+    for (uint8_t i = 0; i < profile->regionsCount && chipRemoved == false; i++)
+    {
+        const resetRegion *region = &profile->regions[profile->verifyOrder[i]];
+        uint8_t size = 0;
+        for (uint8_t offset = 0; offset < region->size && chipRemoved == false; offset += size)
+        {
+            uint8_t address = region->start + offset;
+            size = pagePartSize(region, offset);
+            chipRemoved = (i2c_start_wait(chipAddr + I2C_WRITE) != 0 || i2c_write(address) != 0); //waits until the previous page is written
+            for (uint8_t j = 0; j < size && chipRemoved == false; j++)
+            {
+                chipRemoved = (i2c_write(backupRestoreByte(address + j)) != 0);
+            }
+            if (chipRemoved == false)
             {
                 i2c_stop();
-                blinkLed(0, 1); //error, 1 blink
             }
-            EIMSK |= (1 << INT0); //enable INT0 again
-            EIFR |= (1 << INTF0); //clear INT0 flag, this will eliminate additional reading after release of the button
-            startResetting = false; //end resetting
         }
     }
 }
+#endif
+
+static const resetProfile *chipProfile(uint8_t foundChip)
+{
+    i2c_start(chipsAddr[foundChip] + I2C_WRITE);
+    i2c_write(0x0);
+    i2c_rep_start(chipsAddr[foundChip] + I2C_READ);
+    readChipType[0] = i2c_readAck();
+    readChipType[1] = i2c_readNak();
+    if (i2c_error() != 0) //the type is not valid, resetChip() recovers the bus
+    {
+        return NULL;
+    }
+    i2c_stop();
+    return typeProfile(readChipType[0], readChipType[1]);
+}
+
+static const resetProfile *typeProfile(uint8_t type0, uint8_t type1)
+{
+    if (type0 == gelType[0] && type1 == gelType[1])
+    {
+        return &gelProfile;
+    }
+    if (type0 == wasteType[0] && type1 == wasteType[1])
+    {
+        return &wasteProfile;
+    }
+    return NULL; //a chip of another type is never written
+}
 
 //////////////////////////////////////////////////////////////////////////
 //Search for the chip
 //////////////////////////////////////////////////////////////////////////
-uint8_t findChip(void)
+uint8_t sg2100nFindChip(void)
 {
     for (uint8_t i = 0; i < 5; i++)
     {
-        if (i2c_start(chipsAddr[i] + I2C_WRITE) == 0) { return i + 1; } //if we get 0 then we can connect to the chip, else end the search procedure
+        if (i2c_start(chipsAddr[i] + I2C_WRITE) == 0) //if we get 0 then we can connect to the chip, else end the search procedure
+        {
+            i2c_stop();
+            return i + 1;
+        }
+    }
+    if (i2c_error() != 0) //the bus is stuck, nothing answers until it is recovered
+    {
+        i2c_recover();
+        return 0;
     }
+    i2c_stop();
     return 0; //if chip is not found then return 0
 }
 
 //////////////////////////////////////////////////////////////////////////
-//Function writes given number of zeros starting from given address
+//Function writes all regions marked in failedRegions page after page, the whole read before the reset decides what is written.
+//Every page is saved in the journal before its write, so if the reset of the same chip was interrupted (power loss, cartridge removed),
+//the page whose write cycle was cut is written again even if it reads right, its bytes may not hold. The journal holds the identity
+//of the chip, another chip of the same type at the same address is only written where it differs.
 //////////////////////////////////////////////////////////////////////////
-void writeZeros(uint8_t chipAddr, uint8_t howMany, uint8_t whereStart)
+static void writeRegions(uint8_t chipAddr, const resetProfile *profile)
 {
-    for (uint8_t i = 0; i < howMany; i++)
+    const resetRegion *regions = profile->regions;
+    resetJournal lastReset;
+    uint8_t page = 0;
+    uint8_t cutPage = noPage;
+
+    if (chipRemoved == true) //the chip wasn't read, the journal keeps the interrupted reset
+    {
+        return;
+    }
+#ifdef SELF_BENCHMARK
+    if (benchmarking == false) //the benchmark has no reset to continue, the journal of the last reset stays as it is
+#endif
+    {
+        eeprom_read_block(&lastReset, &journal, sizeof(resetJournal));
+        if (lastReset.profile == profile->journalId && lastReset.address == chipAddr && lastReset.chipId == keptCrc)
+        {
+            cutPage = lastReset.page;
+        }
+        else //nothing to continue, start a new record
+        {
+            lastReset.profile = profile->journalId;
+            lastReset.address = chipAddr;
+            lastReset.chipId = keptCrc;
+            lastReset.page = noPage;
+            eeprom_update_block(&lastReset, &journal, sizeof(resetJournal));
+        }
+    }
+
+    for (uint8_t i = 0; i < profile->regionsCount; i++)
     {
-        i2c_start_wait(chipAddr + I2C_WRITE); //set device address and write mode
-        i2c_write(whereStart + i);
-        i2c_write(0x0);
-        i2c_stop(); //do it for every byte because of page write (8 bytes per page), so this way it will be shorter in code
+        uint8_t size = 0;
+        for (uint8_t offset = 0; offset < regions[i].size; offset += size)
+        {
+            size = pagePartSize(&regions[i], offset);
+            if (chipRemoved == true) //stop at once, the journal points to the page that was written last
+            {
+                return;
+            }
+            if (failedRegions[i] == true || page == cutPage) //pages without changes are not written
+            {
+#ifdef SELF_BENCHMARK
+                if (benchmarking == false)
+#endif
+                eeprom_update_byte(&journal.page, page); //the EEPROM write ends during the page write of the chip, which is longer
+                writePagePart(chipAddr, &regions[i], offset, size);
+#ifdef CHIP_HEALTH
+                writePolls += i2c_busy_polls(); //the first page finds the chip idle, every next one waits for the previous page write
+                pageWrites++;
+#endif
+            }
+            page++;
+        }
     }
 }
 
 //////////////////////////////////////////////////////////////////////////
-//Function checks if there is given number of zeros counting from given address
+//Function returns number of bytes of the region that can be written at once, page write can't cross page boundary
+//////////////////////////////////////////////////////////////////////////
+static uint8_t pagePartSize(const resetRegion *region, uint8_t offset)
+{
+    uint8_t size = region->size - offset;
+    uint8_t pageLeft = pageSize - (region->start + offset) % pageSize;
+
+    return size < pageLeft ? size : pageLeft;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Function writes given number of bytes of the region starting from given offset, all of them must be in one page.
+//A NACK means that the chip was removed, so writing stops after the byte that was not acknowledged.
 //////////////////////////////////////////////////////////////////////////
-uint8_t checkZeros(uint8_t chipAddr, uint8_t howMany, uint8_t whereStart)
+static void writePagePart(uint8_t chipAddr, const resetRegion *region, uint8_t offset, uint8_t size)
+{
+    if (i2c_start_wait(chipAddr + I2C_WRITE) != 0 || i2c_write(region->start + offset) != 0) //set device address and write mode, waits until the previous page is written
+    {
+        chipRemoved = true;
+        return;
+    }
+    for (uint8_t i = offset; i < offset + size; i++)
+    {
+        if (i2c_write(region->values != NULL ? region->values[i] : region->fill) != 0)
+        {
+            chipRemoved = true;
+            break;
+        }
+    }
+    i2c_stop();
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Function reads the region and compares it with the written data
+//////////////////////////////////////////////////////////////////////////
+static uint8_t checkRegion(uint8_t chipAddr, const resetRegion *region)
 {
     uint8_t readByte = 0;
+    uint8_t wrongBytes = 0;
 
-    i2c_start(chipAddr + I2C_WRITE); //set device address and write mode
-    i2c_write(whereStart);
-    i2c_rep_start(chipAddr + I2C_READ); //set device address and read mode
-    for (uint8_t i = 0; i < howMany - 1; i++) //read -1 bytes because we must NACK the last one
+    if (i2c_start_wait(chipAddr + I2C_WRITE) != 0 || i2c_write(region->start) != 0 || i2c_rep_start(chipAddr + I2C_READ) != 0) //set device address, then read mode
+    {
+        chipRemoved = true;
+        return 0xFF;
+    }
+    for (uint8_t i = 0; i < region->size; i++)
+    {
+        readByte = (i < region->size - 1) ? i2c_readAck() : i2c_readNak(); //we must NACK the last byte
+        wrongBytes |= readByte ^ (region->values != NULL ? region->values[i] : region->fill);
+    }
+    if (i2c_error() != 0) //the bus is stuck, the caller recovers it
     {
-        readByte = readByte | i2c_readAck(); //read one byte from EEPROM
+        chipRemoved = true;
+        return 0xFF;
     }
-    readByte = readByte | i2c_readNak(); //read one byte from EEPROM
     i2c_stop();
-    return readByte;
+
+    return wrongBytes;
 }
 
 //////////////////////////////////////////////////////////////////////////
-//Function writes given number of ones starting from given address
+//Function reads all regions of the profile with one sequential read, bytes between the regions are read but not checked.
+//The bytes of the regions also give the CRC16 that resetplan computed from the map of the profile, so a chip that passes
+//holds exactly the reset data of the plan, all bytes read give the fingerprint of the chip.
 //////////////////////////////////////////////////////////////////////////
-void writeOnes(uint8_t chipAddr, uint8_t howMany, uint8_t whereStart)
+static bool checkRegions(uint8_t chipAddr, const resetProfile *profile)
+{
+    uint8_t next = 0; //position in verifyOrder of the first region that doesn't end before the read byte
+    uint8_t start = profile->verifyStart;
+    uint16_t size = profile->verifySize;
+    bool reading = true;
+    bool regionsOk = true;
+    uint16_t resetCrc = 0xFFFF; //CRC16 of the bytes of the regions
+
+    for (uint8_t i = 0; i < profile->regionsCount; i++)
+    {
+        failedRegions[i] = false;
+    }
+    if (wholeRead == true) //the first read of a reset reads the whole chip, only a few bytes are outside of the regions
+    {
+        wholeRead = false;
+        start = 0;
+        size = profile->chipSize;
+    }
+#ifdef CHIP_BACKUP
+    if (backupPending == true)
+    {
+        backupBegin(profile->journalId);
+    }
+#endif
+    chipCrc = 0xFFFF;
+    keptCrc = 0xFFFF;
+#ifdef CHIP_HEALTH
+    serialCrc = _crc_ccitt_update(0xFFFF, chipAddr); //gel chips of all colors have the same type, the address gives the color
+#endif
+    if (i2c_start_wait(chipAddr + I2C_WRITE) != 0 || i2c_write(start) != 0 || i2c_rep_start(chipAddr + I2C_READ) != 0) //set device address, then read mode
+    {
+        chipRemoved = true;
+        reading = false;
+    }
+    for (uint16_t i = 0; i < size && reading == true; i++)
+    {
+        uint16_t address = start + i;
+        uint8_t readByte = (i < size - 1) ? i2c_readAck() : i2c_readNak(); //we must NACK the last byte
+        if (i2c_error() != 0) //the bus is stuck and the byte is not valid, the caller recovers the bus
+        {
+            chipRemoved = true;
+            reading = false;
+            break;
+        }
+        uint8_t resetByte = 0; //0 if this byte is not written by the reset
+        chipCrc = _crc_ccitt_update(chipCrc, readByte);
+        while (next < profile->regionsCount && address >= profile->regions[profile->verifyOrder[next]].start + profile->regions[profile->verifyOrder[next]].size)
+        {
+            next++;
+        }
+        if (next < profile->regionsCount && address >= profile->regions[profile->verifyOrder[next]].start)
+        {
+            const resetRegion *region = &profile->regions[profile->verifyOrder[next]];
+            uint8_t offset = address - region->start;
+            resetByte = region->values != NULL ? region->values[offset] : region->fill;
+            resetCrc = _crc_ccitt_update(resetCrc, readByte);
+            if (readByte != resetByte)
+            {
+                failedRegions[profile->verifyOrder[next]] = true;
+                regionsOk = false;
+            }
+        }
+        else
+        {
+            keptCrc = _crc_ccitt_update(keptCrc, readByte); //bytes the reset doesn't write, the printer doesn't change them either
+#ifdef CHIP_HEALTH
+            if (address >= profile->serialStart && address < profile->serialStart + profile->serialSize)
+            {
+                serialCrc = _crc_ccitt_update(serialCrc, readByte); //other chips of the model have the same kept bytes, only the serial number differs
+            }
+#endif
+        }
+#ifdef CHIP_BACKUP
+        if (backupPending == true)
+        {
+            backupByte(readByte, resetByte);
+        }
+#endif
+    }
+    if (reading == true)
+    {
+        i2c_stop();
+    }
+#ifdef CHIP_BACKUP
+    if (backupPending == true)
+    {
+        backupPending = false;
+        backupEnd(reading, chipCrc); //the record is written by the main loop
+    }
+#endif
+    return reading == true && regionsOk == true && resetCrc == profile->resetCrc;
+}
+
+#ifdef CHIP_BACKUP
+static uint8_t goldenByte(uint8_t journalId, uint8_t address)
+{
+    const resetProfile *profile = journalId == gelProfile.journalId ? &gelProfile : &wasteProfile;
+
+    for (uint8_t i = 0; i < profile->regionsCount; i++)
+    {
+        const resetRegion *region = &profile->regions[i];
+        if (address >= region->start && address - region->start < region->size)
+        {
+            return region->values != NULL ? region->values[address - region->start] : region->fill;
+        }
+    }
+    return 0;
+}
+
+static bool keptByte(uint8_t journalId, uint8_t address)
 {
-    for (uint8_t i = 0; i < howMany; i++)
+    const resetProfile *profile = journalId == gelProfile.journalId ? &gelProfile : &wasteProfile;
+
+    for (uint8_t i = 0; i < profile->regionsCount; i++)
     {
-        i2c_start_wait(chipAddr + I2C_WRITE); //set device address and write mode
-        i2c_write(whereStart + i);
-        i2c_write(0xFF);
-        i2c_stop(); //do it for every byte because of page write (8 bytes per page), so this way it will be shorter in code
+        if (address >= profile->regions[i].start && address - profile->regions[i].start < profile->regions[i].size)
+        {
+            return false;
+        }
     }
+    return true;
 }
+#endif
 
 //////////////////////////////////////////////////////////////////////////
-//Function checks if there is given number of ones counting from given address
+//Function writes the region again after a growing delay, a bad contact usually recovers after a short while
 //////////////////////////////////////////////////////////////////////////
-uint8_t checkOnes(uint8_t chipAddr, uint8_t howMany, uint8_t whereStart)
+static bool retryRegion(uint8_t chipAddr, const resetRegion *region)
 {
-    uint8_t readByte = 0xFF;
+    for (uint8_t retry = 0; retry < maxRetries && chipRemoved == false; retry++)
+    {
+        retryWait(retry);
+        stats.retries++;
+        uint8_t size = 0;
+        for (uint8_t offset = 0; offset < region->size && chipRemoved == false; offset += size)
+        {
+            size = pagePartSize(region, offset);
+            writePagePart(chipAddr, region, offset, size);
+        }
+        if (checkRegion(chipAddr, region) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
 
-    i2c_start(chipAddr + I2C_WRITE); //set device address and write mode
-    i2c_write(whereStart);
-    i2c_rep_start(chipAddr + I2C_READ); //set device address and read mode
-    for (uint8_t i = 0; i < howMany - 1; i++) //read -1 bytes because we must NACK the last one
+static void retryWait(uint8_t retry)
+{
+    for (uint16_t i = 0; i < (retryDelay << retry); i++) //_delay_ms needs a constant argument
     {
-        readByte = readByte & i2c_readAck(); //read one byte from EEPROM
+        _delay_ms(1);
     }
-    readByte = readByte & i2c_readNak(); //read one byte from EEPROM
-    i2c_stop();
-    return readByte;
 }
 
 //////////////////////////////////////////////////////////////////////////
 //Function blinks LED with given color
 //////////////////////////////////////////////////////////////////////////
-void blinkLed(uint8_t mode, uint8_t errorMode)
+static void blinkLed(uint8_t mode, uint8_t errorMode)
 {
+#ifdef FAULT_INJECTION
+    faultResult(mode == 0 ? errorMode : 0); //the bench reads results from the UART, not from the LEDs
+    return;
+#endif
     //0 - error, 1 - black resetted, 2 - magenta, 3 - yellow, 4 - cyan, 5 - waste tank
     switch (mode)
     {
-        case 0: //error, 1 white blink - chip not found, 2 white blinks - wrong data read, 3 white blinks - ink counter not resetted
+        case 0: //error, 1 white blink - chip not found, 2 white blinks - wrong data read, 3 white blinks - ink counter not resetted, 4 white blinks - chip removed during reset, 5 white blinks - chip resetted but worn
             for (uint8_t i = 0; i < errorMode; i++)
             {
                 PORTB = whiteLed;
@@ -317,7 +969,12 @@ void blinkLed(uint8_t mode, uint8_t errorMode)
     }
 }
 
+#ifndef UNIVERSAL_RESETTER
 ISR(INT0_vect)
 {
+#ifdef TIMING_PROBE
+    timingButton();
+#endif
     startResetting = true;
 }
+#endif
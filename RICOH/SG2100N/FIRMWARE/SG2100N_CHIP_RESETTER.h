@@ -0,0 +1,24 @@
+/*
+* SG2100N_CHIP_RESETTER.h
+*
+* Reset engine of the SG2100N resetter, it is also used by the universal resetter
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef SG2100N_CHIP_RESETTER_H
+#define SG2100N_CHIP_RESETTER_H
+
+#include <stdint.h>
+
+#define sg2100nGelProfile 1 //profiles of the chip types, gel {227, 18} and waste tank {227, 1}
+#define sg2100nWasteProfile 2
+
+uint8_t sg2100nFindChip(void); //searches for a gel or waste tank chip, returns a number from 1 to 5 in order C M Y B W, or 0 if a chip was not found
+void sg2100nResetChip(uint8_t); //reads the chip type, resets the chip and shows the result, argument is a number from 1 to 5 returned by sg2100nFindChip
+void sg2100nResetProfile(uint8_t, uint8_t); //resets the chip of a type already read, arguments are a number from 1 to 5 and sg2100nGelProfile or sg2100nWasteProfile
+#ifdef CHIP_BACKUP
+void sg2100nRestoreChip(void); //writes the newest backup back to the connected chip, sends the result on the UART
+#endif
+
+#endif
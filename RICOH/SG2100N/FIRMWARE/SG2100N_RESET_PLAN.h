@@ -0,0 +1,94 @@
+/*
+* SG2100N_RESET_PLAN.h
+*
+* Generated by TOOLS/RESETPLAN/resetplan from DATA_MAP.map WASTE_TANK_DATA_MAP.map, do not edit.
+* Include it after the resetRegion typedef.
+*
+* gel: 17 page writes, verify 0x06-0x7F in one read, predicted 108.8 ms at 100 kHz
+* waste: 33 page writes, verify 0x04-0xFE in one read, predicted 216.0 ms at 100 kHz
+*
+*/
+
+#ifndef SG2100N_RESET_PLAN_H
+#define SG2100N_RESET_PLAN_H
+
+#define gelRegionsCount 17
+#define gelVerifyStart 0x06
+#define gelVerifySize 122
+#define gelWriteCycle 5 //ms, i2c_start_wait() waits for a page write with a margin
+#define gelSerialStart 0x10 //serial number, 2 of its 8 bytes are outside of the regions, they are the identity of the chip
+#define gelSerialSize 8
+static const uint8_t gelData[10] = {0, 255, 255, 0, 255, 255, 255, 255, 255, 255};
+//data written to the chip in order of writing, every region is one page write
+static const resetRegion gelRegions[gelRegionsCount] = {
+    {0x06, 2, &gelData[0], 0},
+    {0x09, 1, NULL, 0x00},
+    {0x10, 6, NULL, 0xFF},
+    {0x18, 8, NULL, 0xFF},
+    {0x28, 8, &gelData[2], 0},
+    {0x30, 8, NULL, 0xFF},
+    {0x38, 8, NULL, 0xFF},
+    {0x43, 5, NULL, 0xFF},
+    {0x48, 6, NULL, 0xFF},
+    {0x4F, 1, NULL, 0xFF},
+    {0x50, 8, NULL, 0xFF},
+    {0x58, 8, NULL, 0xFF},
+    {0x60, 8, NULL, 0xFF},
+    {0x68, 8, NULL, 0xFF},
+    {0x70, 8, NULL, 0xFF},
+    {0x78, 8, NULL, 0xFF},
+    {0x08, 1, NULL, 0x64}
+};
+//CRC16 of the data of all regions in order of addresses, the chip is resetted when the verify read gives the same
+#define gelResetCrc 0x5A0B
+//regions in order of addresses, used by the verify read
+static const uint8_t gelVerifyOrder[gelRegionsCount] = {0, 16, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+
+#define wasteRegionsCount 33
+#define wasteVerifyStart 0x04
+#define wasteVerifySize 251
+#define wasteWriteCycle 5 //ms, i2c_start_wait() waits for a page write with a margin
+#define wasteSerialStart 0x09 //serial number, 8 of its 8 bytes are outside of the regions, they are the identity of the chip
+#define wasteSerialSize 8
+//data written to the chip in order of writing, every region is one page write
+static const resetRegion wasteRegions[wasteRegionsCount] = {
+    {0x04, 4, NULL, 0x00},
+    {0x08, 1, NULL, 0x00},
+    {0x14, 4, NULL, 0x00},
+    {0x18, 8, NULL, 0x00},
+    {0x20, 8, NULL, 0x00},
+    {0x28, 8, NULL, 0x00},
+    {0x30, 8, NULL, 0x00},
+    {0x38, 8, NULL, 0x00},
+    {0x40, 8, NULL, 0x00},
+    {0x48, 8, NULL, 0x00},
+    {0x50, 8, NULL, 0x00},
+    {0x58, 6, NULL, 0x00},
+    {0x5F, 1, NULL, 0x00},
+    {0x60, 8, NULL, 0x00},
+    {0x68, 8, NULL, 0x00},
+    {0x70, 8, NULL, 0x00},
+    {0x78, 8, NULL, 0x00},
+    {0x80, 8, NULL, 0x00},
+    {0x88, 8, NULL, 0x00},
+    {0x90, 8, NULL, 0x00},
+    {0x98, 8, NULL, 0x00},
+    {0xA0, 8, NULL, 0x00},
+    {0xA8, 8, NULL, 0x00},
+    {0xB0, 8, NULL, 0x00},
+    {0xB8, 8, NULL, 0x00},
+    {0xC0, 8, NULL, 0x00},
+    {0xC8, 8, NULL, 0x00},
+    {0xD0, 8, NULL, 0x00},
+    {0xD8, 8, NULL, 0x00},
+    {0xE0, 8, NULL, 0x00},
+    {0xE8, 8, NULL, 0x00},
+    {0xF0, 8, NULL, 0x00},
+    {0xF8, 7, NULL, 0x00}
+};
+//CRC16 of the data of all regions in order of addresses, the chip is resetted when the verify read gives the same
+#define wasteResetCrc 0xC22A
+//regions in order of addresses, used by the verify read
+static const uint8_t wasteVerifyOrder[wasteRegionsCount] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32};
+
+#endif
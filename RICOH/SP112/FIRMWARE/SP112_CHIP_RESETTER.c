@@ -7,30 +7,154 @@
 *
 */
 
-#define F_CPU 8000000UL //8MHz
+#ifndef F_CPU
+#define F_CPU 8000000UL //8MHz internal RC, a crystal clocked board can be built with 16MHz or 20MHz
+#endif
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <util/delay.h>
-#include "i2cmaster.h"
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include "../../../COMMON/FIRMWARE/i2cmaster.h"
+#include "SP112_CHIP_RESETTER.h"
+#ifdef CHIP_EMULATION
+#include "../../../COMMON/FIRMWARE/i2cslave.h"
+#endif
+#ifdef FAULT_INJECTION
+#include "../../../COMMON/FIRMWARE/faults.h"
+#endif
+#ifdef SELF_BENCHMARK
+#include "../../../COMMON/FIRMWARE/bench.h"
+#endif
+#ifdef SRAM_REPORT
+#include "../../../COMMON/FIRMWARE/sram.h"
+#endif
+#ifdef CHIP_BACKUP
+#include "../../../COMMON/FIRMWARE/backup.h"
+#endif
+#ifdef SERIAL_CONTROL
+#include "../../../COMMON/FIRMWARE/control.h"
+#endif
+#ifdef CHIP_HEALTH
+#include "../../../COMMON/FIRMWARE/health.h"
+#endif
+#if defined(SRAM_REPORT) || defined(CHIP_BACKUP) || defined(SERIAL_CONTROL) || defined(CHIP_HEALTH)
+#include "../../../COMMON/FIRMWARE/uart.h"
+#endif
+#ifdef TIMING_PROBE
+#include "../../../COMMON/FIRMWARE/timing.h"
+#endif
 
 #define chipAddr 0xA6 //I2C address of the cartridge chip
+#define muxAddr 0xE0 //I2C address of the TCA9548A multiplexer (A0, A1, A2 connected to GND)
+#define muxSockets 8 //number of multiplexer channels, every channel can have its own cartridge socket
 
-#define chipDataSize 11
 #define cartridgeTypeSize 2
+#define chipSize 128 //bytes of the chip EEPROM
+#define pageSize 8 //bytes in one page of the chip EEPROM
+#define sp112Profile 1 //profile number saved in the journal
+#ifndef maxRetries
+#define maxRetries 3 //how many times a region is written again when its verification fails
+#endif
+#define noPage 0xFF //page of the journal before the first page write
+#define retryDelay 2 //delay in milliseconds before the first retry, doubled before every next one
 
+typedef struct
+{
+    uint8_t start; //address of the first byte
+    uint8_t size; //number of bytes
+    const uint8_t *values; //data to write, NULL if all bytes have the fill value
+    uint8_t fill; //value of all bytes of the region without data
+} resetRegion;
+
+#include "SP112_RESET_PLAN.h" //generated from DATA_MAP.map by TOOLS/RESETPLAN
+
+typedef struct
+{
+    uint8_t profile; //profile of the interrupted reset, 0 or 0xFF (erased EEPROM) if there is nothing to continue
+    uint8_t address; //I2C address of the chip
+    uint16_t chipId; //CRC16 of the bytes the reset doesn't write, the identity of the interrupted chip
+    uint8_t page; //page write started last, its write cycle may have been cut by the interruption, noPage if there is none
+} resetJournal;
+
+typedef struct
+{
+    uint16_t resets; //number of chips resetted since power on
+    uint16_t retries; //number of regions written again after failed verification
+    uint16_t fingerprint; //CRC16 of the last chip read before its reset
+} resetStatistics;
+
+#ifndef UNIVERSAL_RESETTER //the universal resetter has its own main loop
 volatile bool startResetting = false; //if true then user pressed the chip reset button
-bool cartridgeTypeOk = false; //if true then we can start resetting procedure
-bool resettedOk = false; //if true then chip was resetted successfully
-const uint8_t cartridgeType[cartridgeTypeSize] = {32, 0}; //default cartridge type data
-const uint8_t dataToCheck[chipDataSize] = {3, 1, 1, 100, 52, 48, 55, 49, 54, 54, 100};
-volatile uint8_t readData[chipDataSize] = {0}; //holds data read from the chip
-volatile uint8_t readCartridgeType[cartridgeTypeSize] = {0}; //holds cartridge type read from the chip
+#endif
+static bool muxPresent = false; //if true then cartridge sockets are connected through the multiplexer
+static const uint8_t cartridgeType[cartridgeTypeSize] = {32, 0}; //default cartridge type data
+//toner levels are written last by the reset plan, so an interrupted reset never leaves a full cartridge with old data
+static bool failedRegions[sp112RegionsCount] = {false}; //regions with data different from the reset data, found by the last read of the chip
+static uint32_t socketChanged[muxSockets] = {0}; //bit for every region that must be written in every socket, regions that already hold the reset data are not written
+_Static_assert(sp112RegionsCount <= 32, "socketChanged has one bit for every region");
+static volatile uint8_t readCartridgeType[cartridgeTypeSize] = {0}; //holds cartridge type read from the chip
+static uint8_t socketResults[muxSockets] = {0}; //0 - no chip, 1 - reset successfull, 2 - wrong cartridge chip type, 3 - other error, 4 - chip is being resetted, 5 - chip removed during reset, 6 - chip resetted but worn
+static uint16_t socketBusy[muxSockets] = {0}; //busy answers in a row for every socket, the chip is treated as removed at i2c_wait_polls()
+static bool chipRemoved = false; //if true then the chip in the selected socket stopped answering
+static uint8_t socketRegion[muxSockets] = {0}; //next region to write for every socket
+static uint8_t socketOffset[muxSockets] = {0}; //next byte of that region
+static uint8_t socketPages[muxSockets] = {0}; //number of pages passed in every socket, written or not
+static uint8_t socketCutPage[muxSockets] = {0}; //page whose write cycle was cut by an interrupted reset of the chip in every socket, noPage if there is none
+static resetStatistics stats = {0};
+static bool wholeRead = false; //if true then the next checkRegions() reads the whole chip
+static uint16_t chipCrc = 0; //CRC16 of all bytes read by the last checkRegions(), the fingerprint of the chip after a whole read
+static resetJournal journal[muxSockets] EEMEM; //record of the reset in progress for every socket, kept in the internal EEPROM so it survives a power loss
+#ifdef SELF_BENCHMARK
+static bool benchmarking = false; //if true then the page writes are not saved in the journal, the benchmark has no reset to continue
+#endif
+#ifdef CHIP_BACKUP
+static bool backupPending = false; //if true then the next checkRegions() packs the chip for the backup
+#endif
+static uint16_t keptCrc = 0; //CRC16 of the bytes outside of the regions read by the last checkRegions(), the identity of the chip after a whole read
+#ifdef CHIP_HEALTH
+static uint16_t serialCrc = 0; //CRC16 of the serial number read by the last checkRegions(), the identity of the chip in the health table
+static uint16_t socketId[muxSockets] = {0}; //identity of the chip in every socket
+static uint32_t socketPolls[muxSockets] = {0}; //bus time from the end of every page write to the last busy answer of the chip, for every socket
+static uint16_t socketStamp[muxSockets] = {0}; //i2c_bus_polls() at the end of the last page write or at the last busy answer of every socket
+static uint8_t socketWrites[muxSockets] = {0}; //number of page writes acknowledged in every socket
+static uint8_t socketWaits[muxSockets] = {0}; //number of page writes that found the chip busy at least twice in every socket
+#endif
+
+static uint8_t findSockets(void); //checks if the multiplexer is connected, returns number of sockets to check
+static void selectSocket(uint8_t); //switches the multiplexer to the given socket, does nothing without the multiplexer
+static uint8_t checkChip(void); //checks the chip in the selected socket, returns 0 if there is no chip, 2 if its type is wrong, 4 if it can be resetted, 5 if the bus got stuck
+static void resetChips(uint8_t); //writes the reset data to all found chips, argument is number of sockets
+static void startJournal(uint8_t); //finds the page cut by an interrupted reset of the chip in the given socket or starts a new record, called after the whole read of the chip
+static uint8_t pagePartSize(const resetRegion *, uint8_t); //returns number of bytes that can be written at once from the given offset of the region
+static void nextPagePart(uint8_t); //moves the given socket to the next part of the reset data
+static void writeNextStep(uint8_t); //writes the next part of the reset data to the chip in the given socket, if the chip is not busy
+static bool checkRegions(void); //reads all regions back in one transaction and marks the wrong ones in failedRegions, returns true if all of them hold the reset data of the plan
+static uint8_t checkRegion(const resetRegion *); //reads the region back, returns 0 if it holds the written data
+static bool retryRegion(const resetRegion *); //writes the region again until it is verified, returns false if all retries failed
+static void retryWait(uint8_t); //waits before the given retry, every next retry waits twice as long
+#ifdef CHIP_BACKUP
+static uint8_t goldenByte(uint8_t, uint8_t); //returns the reset data of the byte, 0 if the reset doesn't write it, arguments are profile and address
+static bool keptByte(uint8_t, uint8_t); //returns true if the reset doesn't write the byte, arguments are profile and address
+static void restoreChip(void); //writes the regions of the chip in the selected socket from the record found by backupFind(), sets chipRemoved if the chip stops answering
+#endif
+#ifdef CHIP_HEALTH
+static uint8_t writeLoad(uint8_t); //returns the mean write load of the page writes in the given socket, 0 if none was timed
+#endif
+static void showResults(uint8_t); //shows results of all sockets, argument is number of sockets
+static void ledBlink(uint8_t); //blinks LED, 1 - reset successfull, 2 - wrong cartridge chip type, 3 - other error, 5 - chip removed during reset, 6 - chip resetted but worn
 
-void writeZeros(uint8_t, uint8_t); //writes given number of zeros starting from the specified address
-uint8_t checkZeros(uint8_t, uint8_t); //reads data and checks if all read bytes are 0
-void ledBlink(uint8_t); //blinks LED, 1 - reset successfull, 2 - wrong cartridge chip type, 3 - other error
+#ifndef UNIVERSAL_RESETTER
+#ifdef CHIP_EMULATION
+static void emulateChip(void); //copies the chip to SRAM, resets the copy and answers instead of the chip, returns only if the chip can't be copied
+#endif
+#ifdef SELF_BENCHMARK
+static void benchmarkChip(void); //times read, write and verify of the chip in the first socket with a chip, then resets all chips as usual
+static void benchLed(bool);
+#endif
 
 int main(void)
 {
@@ -44,181 +168,857 @@ int main(void)
     EIMSK |= (1 << INT0); //enable INT0
     //----------------------------------------------
     i2c_init(); //initialize I2C library
+#ifdef CHIP_EMULATION
+    _delay_ms(10); //wait for the pull-up of the button
+    if (bit_is_clear(PIND, PIND2)) //button held at power-on starts the chip emulation
+    {
+        emulateChip();
+    }
+#endif
+#ifdef TIMING_PROBE
+    timingInit();
+#endif
+#if defined(SRAM_REPORT) || defined(CHIP_BACKUP) || defined(SERIAL_CONTROL) || defined(CHIP_HEALTH)
+    uartInit(); //for the commands of the reports
+#endif
+#ifdef CHIP_BACKUP
+    backupInit(goldenByte);
+#endif
     sei(); //enable interrupts
+#ifdef FAULT_INJECTION
+    faultRun(sp112ResetChips); //bench build, resets the chip once for every fault and never returns
+#endif
 
     while (1)
     {
+#if defined(SRAM_REPORT) || defined(CHIP_BACKUP) || defined(SERIAL_CONTROL) || defined(CHIP_HEALTH)
+        char command = uartCharReady() == 1 ? uartGetChar() : 0; //one received char is read for all reports
+#endif
+#ifdef SRAM_REPORT
+        sramPoll(command);
+#endif
+#ifdef CHIP_BACKUP
+        backupPoll(command); //the backup of the last chip is written between resets
+        if (command == backupRestore)
+        {
+            sp112RestoreChips();
+        }
+#endif
+#ifdef CHIP_HEALTH
+        healthPoll(command);
+#endif
+#ifdef SERIAL_CONTROL
+        if (controlCommand(command, stats.resets, stats.retries, stats.fingerprint) == true)
+        {
+            startResetting = true; //the same as a press of the button
+        }
+#endif
         if (startResetting == true)
         {
             EIMSK &= ~(1 << INT0); //disable INT0 for the time of resetting
-            uint8_t isChipOk = i2c_start(chipAddr + I2C_WRITE); //if we get 0 then we can connect to the chip, else end procedure
-            if (isChipOk == 0) //chip responded
+#ifdef SELF_BENCHMARK
+            if (benchLongPress() == true)
             {
-                i2c_write(0x0);
-                i2c_rep_start(chipAddr + I2C_READ);
-                readCartridgeType[0] = i2c_readAck();
-                readCartridgeType[1] = i2c_readNak();
-                i2c_stop();
+                benchmarkChip();
+            }
+            else
+#endif
+            sp112ResetChips();
+#ifdef TIMING_PROBE
+            timingReport();
+#endif
+#ifdef SERIAL_CONTROL
+            controlDone();
+#endif
+            EIMSK |= (1 << INT0); //enable INT0 again
+            EIFR |= (1 << INTF0); //clear INT0 flag, this will eliminate additional reset after release of the chip reset button
+            startResetting = false; //end resetting
+        }
+    }
+}
 
-                for (uint8_t i = 0; i < cartridgeTypeSize; i++) //check if cartridge chip type matches
+#ifdef CHIP_EMULATION
+//////////////////////////////////////////////////////////////////////////
+//Reads the whole chip, writes the reset data to this copy and answers at the chip address instead of the chip.
+//The board is then connected to the printer in place of the chip, so the worn chip EEPROM is not written at all.
+//Writes of the printer change only the copy in SRAM, the LED is on while the chip is emulated.
+//////////////////////////////////////////////////////////////////////////
+static void emulateChip(void)
+{
+    findSockets();
+    selectSocket(0); //with the multiplexer the chip is copied from the first socket
+    uint8_t chipState = checkChip();
+    if (chipState != 4)
+    {
+        ledBlink(chipState == 0 ? 3 : chipState);
+        return;
+    }
+    if (i2c_start_wait(chipAddr + I2C_WRITE) != 0 || i2c_write(0x0) != 0 || i2c_rep_start(chipAddr + I2C_READ) != 0) //the chip stopped answering, nothing is copied
+    {
+        i2c_recover();
+        ledBlink(5);
+        return;
+    }
+    for (uint8_t i = 0; i < chipSize; i++)
+    {
+        i2c_slave_image[i] = (i < chipSize - 1) ? i2c_readAck() : i2c_readNak();
+    }
+    if (i2c_error() != 0) //the copy is not valid
+    {
+        i2c_recover();
+        ledBlink(5);
+        return;
+    }
+    i2c_stop();
+    if (muxPresent == true)
+    {
+        selectSocket(muxSockets); //the copied chip must not answer together with the emulation
+    }
+
+    for (uint8_t i = 0; i < sp112RegionsCount; i++)
+    {
+        for (uint8_t j = 0; j < sp112Regions[i].size; j++)
+        {
+            i2c_slave_image[sp112Regions[i].start + j] = sp112Regions[i].values != NULL ? sp112Regions[i].values[j] : sp112Regions[i].fill;
+        }
+    }
+
+    EIMSK &= ~(1 << INT0); //the button does nothing now
+    i2c_slave_init(chipAddr, chipSize); //the word address wraps after 128 bytes like in the chip
+    PORTB |= (1 << PINB0); //turn on LED
+    sei();
+    while (1); //everything is done in the TWI interrupt
+}
+#endif
+
+#ifdef SELF_BENCHMARK
+//////////////////////////////////////////////////////////////////////////
+//Every cycle reads all regions, writes all of them with the same page writes as a reset and reads them again.
+//The written data is always the reset data, so after the last cycle and the normal reset that follows it the chip holds
+//the same data as after a single reset. A cycle that fails ends the benchmark, the normal reset then shows the error.
+//////////////////////////////////////////////////////////////////////////
+static void benchmarkChip(void)
+{
+    static const char *const phaseNames[] = {"read", "write", "verify"};
+    i2c_write_cycle(sp112WriteCycle);
+    uint8_t socketsCount = findSockets();
+    uint8_t socket = 0;
+    uint8_t chipState = 0;
+
+    for (; socket < socketsCount && chipState != 4; socket++) //a chip of a wrong type is never written
+    {
+        selectSocket(socket);
+        chipState = checkChip();
+    }
+    if (chipState != 4)
+    {
+        ledBlink(chipState == 0 ? 3 : chipState);
+        return;
+    }
+    socket--;
+
+    bool cyclesOk = true;
+    chipRemoved = false;
+    benchmarking = true;
+    benchStart();
+    for (uint8_t cycle = 0; cycle < benchCycles && cyclesOk == true; cycle++)
+    {
+        checkRegions();
+        benchMark(0);
+        socketResults[socket] = 4;
+        socketRegion[socket] = 0;
+        socketOffset[socket] = 0;
+        socketPages[socket] = 0;
+        socketBusy[socket] = 0;
+        socketChanged[socket] = 0xFFFFFFFF >> (32 - sp112RegionsCount); //every region is written, as on a new chip
+        resetChips(socket + 1); //sockets before it have no chip of the right type
+        benchMark(1);
+        cyclesOk = checkRegions();
+        benchMark(2);
+        cyclesOk = cyclesOk && socketResults[socket] == 4 && chipRemoved == false;
+    }
+    benchmarking = false;
+    if (socketResults[socket] == 5 || chipRemoved == true)
+    {
+        i2c_recover();
+    }
+
+    sp112ResetChips();
+    if (cyclesOk == true)
+    {
+        benchReport(phaseNames, 3, benchLed);
+    }
+}
+
+static void benchLed(bool on)
+{
+    if (on == true)
+    {
+        PORTB |= (1 << PINB0); //turn on LED
+    }
+    else
+    {
+        PORTB &= ~(1 << PINB0);
+    }
+}
+#endif
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//Resets chips in all sockets and shows the results.
+//////////////////////////////////////////////////////////////////////////
+void sp112ResetChips(void)
+{
+    i2c_write_cycle(sp112WriteCycle); //a slow chip is waited for, a removed one is found after I2C_WAIT_MARGIN write cycles
+    uint8_t socketsCount = findSockets();
+    for (uint8_t socket = 0; socket < socketsCount; socket++) //check which sockets have a chip of the right type
+    {
+        selectSocket(socket);
+        socketResults[socket] = checkChip();
+        socketRegion[socket] = 0;
+        socketOffset[socket] = 0;
+        socketPages[socket] = 0;
+        socketBusy[socket] = 0;
+#ifdef CHIP_HEALTH
+        socketPolls[socket] = 0;
+        socketWrites[socket] = 0;
+        socketWaits[socket] = 0;
+#endif
+        if (socketResults[socket] == 4)
+        {
+#ifdef CHIP_BACKUP
+            backupPending = true; //with more chips the record of the previous one is written first
+#endif
+            chipRemoved = false;
+            wholeRead = true;
+            checkRegions(); //every write wears the chip EEPROM, so only regions that differ are written
+            if (chipRemoved == true) //nothing is written to a chip that can't be read, the bus may be stuck
+            {
+                i2c_recover();
+                socketResults[socket] = 5;
+            }
+            else
+            {
+                stats.fingerprint = chipCrc;
+                startJournal(socket);
+#ifdef SERIAL_CONTROL
+                controlChip(socket, chipCrc);
+#endif
+#ifdef CHIP_HEALTH
+                socketId[socket] = serialCrc;
+#endif
+            }
+            socketChanged[socket] = 0;
+            for (uint8_t i = 0; i < sp112RegionsCount; i++)
+            {
+                socketChanged[socket] |= (uint32_t)failedRegions[i] << i;
+            }
+        }
+    }
+
+    resetChips(socketsCount);
+
+    //now check if data was written successfully
+    for (uint8_t socket = 0; socket < socketsCount; socket++)
+    {
+        if (socketResults[socket] == 4)
+        {
+            selectSocket(socket);
+            stats.resets++;
+            chipRemoved = false;
+            socketResults[socket] = 1;
+#ifdef CHIP_HEALTH
+            uint16_t retries = stats.retries;
+#endif
+            if (checkRegions() == false)
+            {
+                for (uint8_t i = 0; i < sp112RegionsCount && chipRemoved == false; i++) //only regions that failed are written again
                 {
-                    if (readCartridgeType[i] != cartridgeType[i])
+                    if (failedRegions[i] == true && retryRegion(&sp112Regions[i]) == false)
                     {
-                        cartridgeTypeOk = false;
+                        socketResults[socket] = 3;
                         break;
                     }
-                    cartridgeTypeOk = true;
                 }
-
-                if (cartridgeTypeOk == false)
+                if (socketResults[socket] == 1 && chipRemoved == false && checkRegions() == false) //the written again regions are confirmed with the rest of the chip
                 {
-                    ledBlink(2); //show that cartridge type is wrong, stop resetting
+                    socketResults[socket] = 3;
                 }
-                else
-                {
-                    uint8_t zerosCheck = 0; //this var will indicate if needed data are 0's
-
-                    i2c_start(chipAddr + I2C_WRITE);
-                    i2c_write(0x04); //set address of data to 4
-                    i2c_write(3); //change type of cartridge to standard
-                    i2c_write(1); //change type of cartridge to standard
-                    i2c_write(1); //change type of cartridge to standard
-                    i2c_stop(); //set stop conditon = release bus
-
-                    writeZeros(1, 0x07);
-                    
-					i2c_start_wait(chipAddr + I2C_WRITE); //set device address and write mode, repeated start
-                    i2c_write(0x08); //initial toner level
-                    i2c_write(100);
-                    i2c_stop();
-					
-                    writeZeros(1, 0x09);
-
-                    i2c_start_wait(chipAddr + I2C_WRITE); //set device address and write mode, repeated start
-                    i2c_write(0x0A); //write EDP code (407166)
-                    i2c_write(52); //write number in ASCII
-                    i2c_write(48);
-                    i2c_write(55);
-                    i2c_write(49);
-                    i2c_write(54);
-                    i2c_write(54);
-                    i2c_stop();
-
-                    writeZeros(20, 0x18);
-
-                    i2c_start_wait(chipAddr + I2C_WRITE); //remaining toner level
-                    i2c_write(0x2C);
-                    i2c_write(100);
-                    i2c_stop();
-
-                    writeZeros(83, 0x2D); //reset all other data
-
-                    //now check if data was written successfully
-                    //read previously written value back from EEPROM
-                    i2c_start_wait(chipAddr + I2C_WRITE); //set device address and write mode
-                    i2c_write(0x04); //cartridge type
-                    i2c_rep_start(chipAddr + I2C_READ); //set device address and read mode
-                    readData[0] = i2c_readAck(); //read one byte from EEPROM
-                    readData[1] = i2c_readAck();
-                    readData[2] = i2c_readNak();
-                    i2c_stop();
-
-                    i2c_start(chipAddr + I2C_WRITE); //set device address and write mode
-                    i2c_write(0x08); //initial toner level
-                    i2c_rep_start(chipAddr + I2C_READ); //set device address and read mode
-                    readData[3] = i2c_readNak(); //read one byte from EEPROM
-                    i2c_stop();
-
-                    i2c_start(chipAddr + I2C_WRITE); //set device address and write mode
-                    i2c_write(0x0A); //EDP code
-                    i2c_rep_start(chipAddr + I2C_READ); //set device address and read mode
-                    readData[4] = i2c_readAck(); //read one byte from EEPROM
-                    readData[5] = i2c_readAck();
-                    readData[6] = i2c_readAck();
-                    readData[7] = i2c_readAck();
-                    readData[8] = i2c_readAck();
-                    readData[9] = i2c_readNak();
-                    i2c_stop();
-
-                    i2c_start(chipAddr + I2C_WRITE); //set device address and write mode
-                    i2c_write(0x2C); //remaining toner level
-                    i2c_rep_start(chipAddr + I2C_READ); //set device address and read mode
-                    readData[10] = i2c_readNak(); //read one byte from EEPROM
-                    i2c_stop();
-
-                    zerosCheck |= checkZeros(1, 0x07);
-                    zerosCheck |= checkZeros(1, 0x09);
-                    zerosCheck |= checkZeros(20, 0x18);
-                    zerosCheck |= checkZeros(83, 0x2D);
-
-                    for (uint8_t i = 0; i < chipDataSize; i++) //check if chip was resetted successfully
-                    {
-                        if (readData[i] != dataToCheck[i])
-                        {
-                            resettedOk = false;
-                            break;
-                        }
-                        resettedOk = true;
-                    }
+            }
+            if (socketResults[socket] == 1 && chipRemoved == false) //the last page write ended during the verify read
+            {
+                eeprom_update_byte(&journal[socket].profile, 0); //the chip is verified, there is nothing to continue
+            }
+            if (chipRemoved == true)
+            {
+                i2c_recover();
+                socketResults[socket] = 5;
+            }
+#ifdef CHIP_HEALTH
+            else if (healthCheck(healthSp112, socketId[socket], writeLoad(socket), stats.retries - retries) == true && socketResults[socket] == 1)
+            {
+                socketResults[socket] = 6; //the reset data is written, but the chip should be thrown out
+            }
+#endif
+        }
+    }
+    if (muxPresent == true)
+    {
+        selectSocket(muxSockets); //disconnect all sockets
+    }
 
-                    if (resettedOk == true && zerosCheck == 0) //check also if all needed data is zeroed
-                    {
-                        ledBlink(1);
-                    }
-                    else
-                    {
-                        ledBlink(3);
-                    }
-                }
+    showResults(socketsCount);
+}
+
+#ifdef CHIP_BACKUP
+//////////////////////////////////////////////////////////////////////////
+//Undoes the last reset of the chip in every socket. Its record is found by the bytes the reset doesn't write, so only the regions
+//are written back. The chip is read again and must give the CRC16 of the record. A restore cut by a power loss is not continued,
+//the chip can be restored or resetted again.
+//////////////////////////////////////////////////////////////////////////
+void sp112RestoreChips(void)
+{
+    i2c_write_cycle(sp112WriteCycle);
+    uint8_t socketsCount = findSockets();
+    for (uint8_t socket = 0; socket < socketsCount; socket++)
+    {
+        uint16_t crc = 0;
+
+        selectSocket(socket);
+        if (checkChip() != 4) //a chip of a wrong type is never written
+        {
+            continue;
+        }
+        chipRemoved = false;
+        wholeRead = true;
+        checkRegions();
+        uartPutString("chip ");
+        uartPutNumber(socket);
+        if (chipRemoved == false && backupFind(sp112Profile, keptCrc, goldenByte, keptByte, &crc) == false)
+        {
+            uartPutString(" no backup\r\n");
+            continue;
+        }
+        if (chipRemoved == false)
+        {
+            restoreChip();
+        }
+        if (chipRemoved == false)
+        {
+            wholeRead = true;
+            checkRegions();
+        }
+        if (chipRemoved == true)
+        {
+            i2c_recover();
+        }
+        uartPutString(chipRemoved == false && chipCrc == crc ? " restored\r\n" : " failed\r\n");
+    }
+    if (muxPresent == true)
+    {
+        selectSocket(muxSockets); //disconnect all sockets
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The record is unpacked in order of addresses, so the regions are written in the order of the verify read.
+//////////////////////////////////////////////////////////////////////////
+static void restoreChip(void)
+{
+    for (uint8_t i = 0; i < sp112RegionsCount && chipRemoved == false; i++)
+    {
+        const resetRegion *region = &sp112Regions[sp112VerifyOrder[i]];
+        uint8_t size = 0;
+        for (uint8_t offset = 0; offset < region->size && chipRemoved == false; offset += size)
+        {
+            uint8_t address = region->start + offset;
+            size = pagePartSize(region, offset);
+            chipRemoved = (i2c_start_wait(chipAddr + I2C_WRITE) != 0 || i2c_write(address) != 0); //waits until the previous page is written
+            for (uint8_t j = 0; j < size && chipRemoved == false; j++)
+            {
+                chipRemoved = (i2c_write(backupRestoreByte(address + j)) != 0);
             }
-            else //if something is wrong then blink 3 times
+            if (chipRemoved == false)
             {
                 i2c_stop();
-                ledBlink(3); //select mode 3
             }
-            EIMSK |= (1 << INT0); //enable INT0 again
-            EIFR |= (1 << INTF0); //clear INT0 flag, this will eliminate additional reset after release of the chip reset button
-            startResetting = false; //end resetting
         }
     }
 }
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//Checks if the multiplexer is connected, all chips have the same address, so with the multiplexer every socket is on its own channel.
+//////////////////////////////////////////////////////////////////////////
+static uint8_t findSockets(void)
+{
+    muxPresent = false;
+    for (uint8_t retry = 0; retry <= maxRetries && muxPresent == false; retry++) //a missed acknowledge must not hide the multiplexer and its chips
+    {
+        muxPresent = (i2c_start(muxAddr + I2C_WRITE) == 0);
+        if (i2c_error() != 0)
+        {
+            i2c_recover();
+        }
+        else
+        {
+            i2c_stop();
+        }
+    }
+    return muxPresent ? muxSockets : 1;
+}
 
 //////////////////////////////////////////////////////////////////////////
-//Writes given number of zeros starting from the specified address.
+//Switches the multiplexer to the given socket, socket number equal to muxSockets disconnects all of them.
+//A bus stuck by the write is recovered and the channel is switched again, the next chip must not be read through the old one.
 //////////////////////////////////////////////////////////////////////////
-void writeZeros(uint8_t howMany, uint8_t whereStart)
+static void selectSocket(uint8_t socket)
 {
-    for (uint8_t i = 0; i < howMany; i++)
+    if (muxPresent == false)
+    {
+        return; //the only socket is connected directly
+    }
+    for (uint8_t retry = 0; retry <= maxRetries; retry++)
     {
-        i2c_start_wait(chipAddr + I2C_WRITE); //set device address and write mode
-        i2c_write(whereStart + i);
-        i2c_write(0x0);
-        i2c_stop(); //do it for every byte because of page write (8 bytes per page), so this way the code will be shorter (no page change code)
+        if (i2c_start(muxAddr + I2C_WRITE) == 0 && i2c_write(socket < muxSockets ? (1 << socket) : 0) == 0) //control register, one bit for every channel
+        {
+            i2c_stop();
+            return;
+        }
+        i2c_recover(); //after a NACK the previous channel stays connected, its chip would answer for this socket
     }
 }
 
 //////////////////////////////////////////////////////////////////////////
-//Checks if there is given number of zeros, starts counting from the specified address.
+//Checks if a chip is connected to the selected socket and if its type matches.
 //////////////////////////////////////////////////////////////////////////
-uint8_t checkZeros(uint8_t howMany, uint8_t whereStart)
+static uint8_t checkChip(void)
+{
+    if (i2c_start(chipAddr + I2C_WRITE) != 0) //chip didn't respond
+    {
+        i2c_stop();
+        return 0;
+    }
+    i2c_write(0x0);
+    i2c_rep_start(chipAddr + I2C_READ);
+    readCartridgeType[0] = i2c_readAck();
+    readCartridgeType[1] = i2c_readNak();
+    if (i2c_error() != 0) //the chip answered but the bus got stuck, it is treated as removed
+    {
+        i2c_recover();
+        return 5;
+    }
+    i2c_stop();
+
+    for (uint8_t i = 0; i < cartridgeTypeSize; i++) //check if cartridge chip type matches
+    {
+        if (readCartridgeType[i] != cartridgeType[i])
+        {
+            return 2;
+        }
+    }
+    return 4;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Writes reset data to all found chips. When one chip is busy with writing to its EEPROM, the next socket is served.
+//A socket ends when its data is written or its chip is removed, the passes are bounded too, so no chip can keep the loop running.
+//////////////////////////////////////////////////////////////////////////
+static void resetChips(uint8_t socketsCount)
+{
+    bool writing = true;
+    uint32_t maxPasses = (uint32_t)sp112RegionsCount * (i2c_wait_polls() + 1); //every page waits at most i2c_wait_polls() passes
+
+    for (uint32_t pass = 0; writing == true; pass++)
+    {
+        writing = false;
+        for (uint8_t socket = 0; socket < socketsCount; socket++)
+        {
+            if (socketResults[socket] != 4 || socketRegion[socket] == sp112RegionsCount)
+            {
+                continue; //nothing to write in this socket
+            }
+            if (pass == maxPasses) //the chip answers, but its pages are never done, the loop must end anyway
+            {
+                socketResults[socket] = 3;
+                continue;
+            }
+            selectSocket(socket);
+            writeNextStep(socket);
+            writing = true;
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Every page is saved in the journal before its write, so if the reset of the chip in this socket was interrupted (power loss,
+//cartridge removed), the page whose write cycle was cut is written again even if it reads right, its bytes may not hold.
+//The other pages are written only when the whole read found them different. The journal holds the identity of the chip,
+//another chip put in the socket after the interruption is only written where it differs.
+//////////////////////////////////////////////////////////////////////////
+static void startJournal(uint8_t socket)
+{
+    resetJournal lastReset;
+
+    eeprom_read_block(&lastReset, &journal[socket], sizeof(resetJournal));
+    if (lastReset.profile == sp112Profile && lastReset.address == chipAddr && lastReset.chipId == keptCrc)
+    {
+        socketCutPage[socket] = lastReset.page;
+        return;
+    }
+    socketCutPage[socket] = noPage;
+    lastReset.profile = sp112Profile;
+    lastReset.address = chipAddr;
+    lastReset.chipId = keptCrc;
+    lastReset.page = noPage;
+    eeprom_update_block(&lastReset, &journal[socket], sizeof(resetJournal));
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Returns number of bytes of the region that can be written at once, page write can't cross page boundary.
+//////////////////////////////////////////////////////////////////////////
+static uint8_t pagePartSize(const resetRegion *region, uint8_t offset)
+{
+    uint8_t size = region->size - offset;
+    uint8_t pageLeft = pageSize - (region->start + offset) % pageSize;
+
+    return size < pageLeft ? size : pageLeft;
+}
+
+static void nextPagePart(uint8_t socket)
+{
+    const resetRegion *region = &sp112Regions[socketRegion[socket]];
+
+    socketOffset[socket] += pagePartSize(region, socketOffset[socket]);
+    socketPages[socket]++;
+    if (socketOffset[socket] == region->size) //region is written, go to the next one
+    {
+        socketRegion[socket]++;
+        socketOffset[socket] = 0;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Writes the next part of reset data to the chip in the selected socket. If the chip is still busy, nothing is written.
+//A chip that is busy for too long or doesn't acknowledge a byte was removed, its socket is stopped at once and the bus is recovered.
+//Parts of regions that already hold the reset data are skipped without writing, except the page cut by an interrupted reset.
+//////////////////////////////////////////////////////////////////////////
+static void writeNextStep(uint8_t socket)
+{
+    const resetRegion *region = &sp112Regions[socketRegion[socket]];
+    uint8_t offset = socketOffset[socket];
+    uint8_t size = pagePartSize(region, offset);
+
+    if ((socketChanged[socket] & ((uint32_t)1 << socketRegion[socket])) == 0 && socketPages[socket] != socketCutPage[socket])
+    {
+        nextPagePart(socket);
+        return;
+    }
+#ifdef SELF_BENCHMARK
+    if (benchmarking == false)
+#endif
+    if (socketBusy[socket] == 0) //written at the first try of the page, the busy polls don't wait for the internal EEPROM
+    {
+        while (eeprom_is_ready() == 0) //the journal of the page written before is not done yet
+        {
+            i2c_idle_poll(); //the wait is bus time too, a chip of another socket writes its page meanwhile
+        }
+        eeprom_update_byte(&journal[socket].page, socketPages[socket]);
+    }
+    if (i2c_start(chipAddr + I2C_WRITE) != 0) //chip doesn't respond while writing data to its EEPROM
+    {
+        if (i2c_error() != 0) //a stuck bus is not a busy chip, the socket is stopped at once
+        {
+            i2c_recover();
+            socketResults[socket] = 5;
+            return;
+        }
+        i2c_stop();
+        if (++socketBusy[socket] == i2c_wait_polls())
+        {
+            socketResults[socket] = 5;
+        }
+#ifdef CHIP_HEALTH
+        if (socketWrites[socket] != 0 && socketBusy[socket] > 1) //the chip still writes the previous page, one busy answer may be a bad contact
+        {
+            uint16_t now = i2c_bus_polls();
+            socketPolls[socket] += (uint16_t)(now - socketStamp[socket]); //the passes of the other sockets are in the time
+            socketStamp[socket] = now;
+            socketWaits[socket] += socketBusy[socket] == 2 ? 1 : 0;
+        }
+#endif
+        return;
+    }
+    socketBusy[socket] = 0;
+    bool nack = (i2c_write(region->start + offset) != 0);
+    for (uint8_t i = offset; i < offset + size && nack == false; i++)
+    {
+        nack = (i2c_write(region->values != NULL ? region->values[i] : region->fill) != 0);
+    }
+    if (nack == true) //the journal points to this page, so it will be written again on the next try
+    {
+        i2c_recover();
+        socketResults[socket] = 5;
+        return;
+    }
+    i2c_stop();
+#ifdef CHIP_HEALTH
+    socketWrites[socket]++;
+    socketStamp[socket] = i2c_bus_polls();
+#endif
+
+    nextPagePart(socket);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Reads all regions with one sequential read, bytes between the regions are read but not checked.
+//The bytes of the regions also give the CRC16 that resetplan computed from the map, so a chip that passes
+//holds exactly the reset data of the plan, all bytes read give the fingerprint of the chip.
+//////////////////////////////////////////////////////////////////////////
+static bool checkRegions(void)
+{
+    uint8_t next = 0; //position in sp112VerifyOrder of the first region that doesn't end before the read byte
+    uint8_t start = sp112VerifyStart;
+    uint8_t size = sp112VerifySize;
+    bool reading = true;
+    bool regionsOk = true;
+    uint16_t resetCrc = 0xFFFF; //CRC16 of the bytes of the regions
+
+    for (uint8_t i = 0; i < sp112RegionsCount; i++)
+    {
+        failedRegions[i] = false;
+    }
+    if (wholeRead == true) //the first read of a reset reads the whole chip, only a few bytes are outside of the regions
+    {
+        wholeRead = false;
+        start = 0;
+        size = chipSize;
+    }
+#ifdef CHIP_BACKUP
+    if (backupPending == true)
+    {
+        backupBegin(sp112Profile);
+    }
+#endif
+    chipCrc = 0xFFFF;
+    keptCrc = 0xFFFF;
+#ifdef CHIP_HEALTH
+    serialCrc = 0xFFFF;
+#endif
+    if (i2c_start_wait(chipAddr + I2C_WRITE) != 0 || i2c_write(start) != 0 || i2c_rep_start(chipAddr + I2C_READ) != 0) //set device address, then read mode
+    {
+        chipRemoved = true;
+        reading = false;
+    }
+    for (uint8_t i = 0; i < size && reading == true; i++)
+    {
+        uint8_t address = start + i;
+        uint8_t readByte = (i < size - 1) ? i2c_readAck() : i2c_readNak(); //we must NACK the last byte
+        if (i2c_error() != 0) //the bus is stuck and the byte is not valid, the caller recovers the bus
+        {
+            chipRemoved = true;
+            reading = false;
+            break;
+        }
+        uint8_t resetByte = 0; //0 if this byte is not written by the reset
+        chipCrc = _crc_ccitt_update(chipCrc, readByte);
+        while (next < sp112RegionsCount && address >= sp112Regions[sp112VerifyOrder[next]].start + sp112Regions[sp112VerifyOrder[next]].size)
+        {
+            next++;
+        }
+        if (next < sp112RegionsCount && address >= sp112Regions[sp112VerifyOrder[next]].start)
+        {
+            const resetRegion *region = &sp112Regions[sp112VerifyOrder[next]];
+            resetByte = region->values != NULL ? region->values[address - region->start] : region->fill;
+            resetCrc = _crc_ccitt_update(resetCrc, readByte);
+            if (readByte != resetByte)
+            {
+                failedRegions[sp112VerifyOrder[next]] = true;
+                regionsOk = false;
+            }
+        }
+        else
+        {
+            keptCrc = _crc_ccitt_update(keptCrc, readByte); //bytes the reset doesn't write, the printer doesn't change them either
+#ifdef CHIP_HEALTH
+            if (address >= sp112SerialStart && address < sp112SerialStart + sp112SerialSize)
+            {
+                serialCrc = _crc_ccitt_update(serialCrc, readByte); //other cartridges of the model have the same kept bytes, only the serial number differs
+            }
+#endif
+        }
+#ifdef CHIP_BACKUP
+        if (backupPending == true)
+        {
+            backupByte(readByte, resetByte);
+        }
+#endif
+    }
+    if (reading == true)
+    {
+        i2c_stop();
+    }
+#ifdef CHIP_BACKUP
+    if (backupPending == true)
+    {
+        backupPending = false;
+        backupEnd(reading, chipCrc); //the record is written by the main loop
+    }
+#endif
+    return reading == true && regionsOk == true && resetCrc == sp112ResetCrc;
+}
+
+#ifdef CHIP_HEALTH
+//////////////////////////////////////////////////////////////////////////
+//The wait of a page write is the bus time from the end of the previous write to the last busy answer of the chip, with more
+//sockets it holds the passes of the other sockets as long as they took. A page that finds the chip busy less than twice was
+//written in about one pass or met a bad contact, it is not timed, so the load of a chip never grows with the sockets written with it.
+//////////////////////////////////////////////////////////////////////////
+static uint8_t writeLoad(uint8_t socket)
+{
+    if (socketWaits[socket] == 0)
+    {
+        return 0;
+    }
+    return i2c_wait_load(socketPolls[socket] / socketWaits[socket]);
+}
+#endif
+
+#ifdef CHIP_BACKUP
+static uint8_t goldenByte(uint8_t profile, uint8_t address)
+{
+    for (uint8_t i = 0; i < sp112RegionsCount && profile == sp112Profile; i++)
+    {
+        const resetRegion *region = &sp112Regions[i];
+        if (address >= region->start && address - region->start < region->size)
+        {
+            return region->values != NULL ? region->values[address - region->start] : region->fill;
+        }
+    }
+    return 0;
+}
+
+static bool keptByte(uint8_t profile, uint8_t address)
+{
+    for (uint8_t i = 0; i < sp112RegionsCount && profile == sp112Profile; i++)
+    {
+        if (address >= sp112Regions[i].start && address - sp112Regions[i].start < sp112Regions[i].size)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//Reads the region and compares it with the written data.
+//////////////////////////////////////////////////////////////////////////
+static uint8_t checkRegion(const resetRegion *region)
 {
     uint8_t readByte = 0;
+    uint8_t wrongBytes = 0;
 
-    i2c_start(chipAddr + I2C_WRITE); //set device address and write mode
-    i2c_write(whereStart);
-    i2c_rep_start(chipAddr + I2C_READ); //set device address and read mode
-    for (uint8_t i = 0; i < howMany - 1; i++) //read -1 bytes because we must NACK last one
+    if (i2c_start_wait(chipAddr + I2C_WRITE) != 0 || i2c_write(region->start) != 0 || i2c_rep_start(chipAddr + I2C_READ) != 0) //set device address, then read mode
     {
-        readByte = readByte | i2c_readAck(); //read one byte from EEPROM
+        chipRemoved = true;
+        return 0xFF;
+    }
+    for (uint8_t i = 0; i < region->size; i++)
+    {
+        readByte = (i < region->size - 1) ? i2c_readAck() : i2c_readNak(); //we must NACK the last byte
+        wrongBytes |= readByte ^ (region->values != NULL ? region->values[i] : region->fill);
+    }
+    if (i2c_error() != 0) //the bus is stuck, the caller recovers it
+    {
+        chipRemoved = true;
+        return 0xFF;
     }
-    readByte = readByte | i2c_readNak(); //read one byte from EEPROM
     i2c_stop();
-	
-    return readByte;
+
+    return wrongBytes;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Writes the region again after a growing delay, a bad contact usually recovers after a short while.
+//////////////////////////////////////////////////////////////////////////
+static bool retryRegion(const resetRegion *region)
+{
+    for (uint8_t retry = 0; retry < maxRetries && chipRemoved == false; retry++)
+    {
+        retryWait(retry);
+        stats.retries++;
+        uint8_t size = 0;
+        for (uint8_t offset = 0; offset < region->size && chipRemoved == false; offset += size)
+        {
+            size = pagePartSize(region, offset);
+            if (i2c_start_wait(chipAddr + I2C_WRITE) != 0 || i2c_write(region->start + offset) != 0) //waits until the previous page is written
+            {
+                chipRemoved = true;
+                break;
+            }
+            for (uint8_t i = offset; i < offset + size; i++)
+            {
+                if (i2c_write(region->values != NULL ? region->values[i] : region->fill) != 0)
+                {
+                    chipRemoved = true;
+                    break;
+                }
+            }
+            i2c_stop();
+        }
+        if (checkRegion(region) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void retryWait(uint8_t retry)
+{
+    for (uint16_t i = 0; i < (retryDelay << retry); i++) //_delay_ms needs a constant argument
+    {
+        _delay_ms(1);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Shows results. With the multiplexer every socket is shown in order, a long light for a resetted chip, blinks for errors and no light for an empty socket.
+//////////////////////////////////////////////////////////////////////////
+static void showResults(uint8_t socketsCount)
+{
+    if (muxPresent == false)
+    {
+        ledBlink(socketResults[0] == 0 ? 3 : socketResults[0]); //no chip is shown as other error
+        return;
+    }
+    for (uint8_t socket = 0; socket < socketsCount; socket++)
+    {
+        if (socketResults[socket] == 1)
+        {
+            PORTB |= (1 << PINB0); //turn on LED
+            _delay_ms(1000);
+            PORTB &= ~(1 << PINB0);
+        }
+        else if (socketResults[socket] == 0)
+        {
+            _delay_ms(1000);
+        }
+        else
+        {
+            ledBlink(socketResults[socket]);
+        }
+        _delay_ms(750); //pause between sockets
+    }
 }
 
-void ledBlink(uint8_t blinkType)
+static void ledBlink(uint8_t blinkType)
 {
+#ifdef FAULT_INJECTION
+    faultResult(blinkType == 1 ? 0 : blinkType); //the bench reads results from the UART, not from the LED
+    return;
+#endif
     switch (blinkType)
     {
         case 1: //all ok
@@ -250,10 +1050,35 @@ void ledBlink(uint8_t blinkType)
             _delay_ms(250);
             PORTB &= ~(1 << PINB0);
             break;
+
+        case 5: //error, chip removed during reset, 4 blinks
+            for (uint8_t i = 0; i < 4; i++)
+            {
+                PORTB |= (1 << PINB0); //turn on LED
+                _delay_ms(250);
+                PORTB &= ~(1 << PINB0);
+                _delay_ms(250);
+            }
+            break;
+
+        case 6: //chip resetted but worn, throw it out, 5 blinks
+            for (uint8_t i = 0; i < 5; i++)
+            {
+                PORTB |= (1 << PINB0); //turn on LED
+                _delay_ms(250);
+                PORTB &= ~(1 << PINB0);
+                _delay_ms(250);
+            }
+            break;
     }
 }
 
+#ifndef UNIVERSAL_RESETTER
 ISR(INT0_vect) //runs when the chip reset button is pressed
 {
+#ifdef TIMING_PROBE
+    timingButton();
+#endif
     startResetting = true;
-}
\ No newline at end of file
+}
+#endif
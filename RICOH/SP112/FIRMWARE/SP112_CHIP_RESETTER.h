@@ -0,0 +1,19 @@
+/*
+* SP112_CHIP_RESETTER.h
+*
+* Reset engine of the SP112 resetter, it is also used by the universal resetter
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef SP112_CHIP_RESETTER_H
+#define SP112_CHIP_RESETTER_H
+
+#include <stdint.h>
+
+void sp112ResetChips(void); //resets chips in all sockets (one without the multiplexer) and shows the results
+#ifdef CHIP_BACKUP
+void sp112RestoreChips(void); //writes the newest backup back to the chip in every socket, sends the results on the UART
+#endif
+
+#endif
@@ -0,0 +1,47 @@
+/*
+* SP112_RESET_PLAN.h
+*
+* Generated by TOOLS/RESETPLAN/resetplan from DATA_MAP.map, do not edit.
+* Include it after the resetRegion typedef.
+*
+* sp112: 18 page writes, verify 0x04-0x7F in one read, predicted 115.5 ms at 100 kHz
+*
+*/
+
+#ifndef SP112_RESET_PLAN_H
+#define SP112_RESET_PLAN_H
+
+#define sp112RegionsCount 18
+#define sp112VerifyStart 0x04
+#define sp112VerifySize 124
+#define sp112WriteCycle 5 //ms, i2c_start_wait() waits for a page write with a margin
+#define sp112SerialStart 0x10 //serial number, 8 of its 8 bytes are outside of the regions, they are the identity of the chip
+#define sp112SerialSize 8
+static const uint8_t sp112Data[11] = {3, 1, 1, 0, 0, 52, 48, 55, 49, 54, 54};
+//data written to the chip in order of writing, every region is one page write
+static const resetRegion sp112Regions[sp112RegionsCount] = {
+    {0x04, 4, &sp112Data[0], 0},
+    {0x09, 7, &sp112Data[4], 0},
+    {0x18, 8, NULL, 0x00},
+    {0x20, 8, NULL, 0x00},
+    {0x28, 4, NULL, 0x00},
+    {0x2D, 3, NULL, 0x00},
+    {0x30, 8, NULL, 0x00},
+    {0x38, 8, NULL, 0x00},
+    {0x40, 8, NULL, 0x00},
+    {0x48, 8, NULL, 0x00},
+    {0x50, 8, NULL, 0x00},
+    {0x58, 8, NULL, 0x00},
+    {0x60, 8, NULL, 0x00},
+    {0x68, 8, NULL, 0x00},
+    {0x70, 8, NULL, 0x00},
+    {0x78, 8, NULL, 0x00},
+    {0x08, 1, NULL, 0x64},
+    {0x2C, 1, NULL, 0x64}
+};
+//CRC16 of the data of all regions in order of addresses, the chip is resetted when the verify read gives the same
+#define sp112ResetCrc 0x2FE2
+//regions in order of addresses, used by the verify read
+static const uint8_t sp112VerifyOrder[sp112RegionsCount] = {0, 16, 1, 2, 3, 4, 17, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+
+#endif
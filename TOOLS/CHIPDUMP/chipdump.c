@@ -0,0 +1,671 @@
+/*
+* chipdump.c
+*
+* Batch decoder of archived chip images. An archive is a file of raw images of one chip model back to back, every image
+* as big as the chip in its data map, the map given before the archive. The fields are the "set", "copy" and "check" lines
+* of the same data maps the firmware plans are generated from (TOOLS/RESETPLAN/datamap.c), so the decoder can't drift
+* from the resetters. Archives are mapped into memory and every round of images is split between the threads, each one
+* decodes its slice into its own output buffer and statistics, the buffers are written in order after the round.
+* Every image gets a state:
+*   reset    all bytes written by the reset hold the reset data
+*   used     only bytes the printer changes ("used" lines) differ, a resetted chip after some printing
+*   changed  other written bytes differ, the chip was never resetted by this map
+*   wrong    a "check" field matches none of its values, the resetter would refuse the chip
+* The summary gives per map the images of every state, the matches of every check and the distribution of every
+* one byte field written by the reset (ink and toner levels, the Epson ink counter) over the images that are not wrong.
+* With -o every map gets PREFIX.CHIP.csv (one row per image) or PREFIX.CHIP.col (-b), a columnar file: the magic "CHIPCOL",
+* a zero byte, the number of columns (uint32), 32 bytes of name and the width in bytes (uint32) of every column, then
+* row groups until the end of the file, each one the number of rows (uint32) followed by every column for all its rows.
+* Numbers are in the byte order of the PC, fields are their raw chip bytes, a check column is the number of the matching
+* line of the map with that name (1 is the first one) or 0.
+*
+* Build: cc -std=gnu99 -O2 -pthread -o chipdump chipdump.c ../RESETPLAN/datamap.c
+* Usage: chipdump [-j THREADS] [-o PREFIX] [-b] MAP.map ARCHIVE... [MAP.map ARCHIVE...]
+* Example: chipdump -o dumps ../../RICOH/SP112/DATA_MAP.map sp112.bin
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "../RESETPLAN/resetplan.h"
+
+#define maxThreads 64
+#define sliceImages 32768 //images decoded by one thread in one round
+#define columnNameSize 32
+#define bucketWidth 10 //values of one bucket of the distributions
+#define bucketsCount (256 / bucketWidth + 1)
+
+enum imageState { stateReset, stateUsed, stateChanged, stateWrong, statesCount };
+
+typedef struct
+{
+    unsigned long long images;
+    unsigned long long states[statesCount];
+    unsigned long long matches[maxChecks]; //images matching every check line
+    unsigned long long failed[maxChecks]; //images matching no line of every check group
+    unsigned long long values[maxFields][256]; //only one byte fields of images that are not wrong
+} profileStats;
+
+typedef struct
+{
+    chipMap map;
+    unsigned groupsCount; //check lines with the same name are one group
+    unsigned groupFirst[maxChecks]; //first line of every group
+    unsigned char checkGroup[maxChecks];
+    unsigned rowSize; //longest CSV row or bytes of one binary row
+    FILE *output;
+    unsigned long long archives;
+    unsigned long long partialBytes; //bytes at the end of archives that are not a whole image
+    profileStats stats;
+} chipProfile;
+
+typedef struct
+{
+    pthread_t thread;
+    bool threaded; //false if the slice was decoded by the main thread
+    const chipProfile *profile;
+    const unsigned char *images; //first image of the slice
+    unsigned long long first; //number of the first image in its archive
+    unsigned long long count;
+    unsigned archive;
+    bool binary;
+    bool rows; //per image output is written
+    char *output; //kept for the next rounds
+    size_t capacity;
+    size_t length;
+    profileStats stats;
+} sliceWorker;
+
+static const char *const stateNames[statesCount] = {"reset", "used", "changed", "wrong"};
+static chipProfile profiles[maxProfiles];
+static unsigned profilesCount = 0;
+static sliceWorker workers[maxThreads];
+
+static chipProfile *addProfile(const char *, const char *, bool); //returns NULL if the map is wrong
+static bool decodeArchive(chipProfile *, const char *, unsigned, unsigned, bool, bool);
+static void *decodeSlice(void *);
+static uint8_t decodeImage(const chipProfile *, const unsigned char *, uint8_t *);
+static char *putRow(char *, const chipProfile *, unsigned, unsigned long long, const unsigned char *, uint8_t, const uint8_t *);
+static void putColumns(char *, const chipProfile *, const sliceWorker *, unsigned long long, const unsigned char *, uint8_t, const uint8_t *);
+static char *putNumber(char *, unsigned long long);
+static char *putField(char *, const unsigned char *, unsigned);
+static void writeHeader(const chipProfile *, bool);
+static void mergeStats(profileStats *, const profileStats *);
+static void printSummary(const chipProfile *);
+
+int main(int argc, char *argv[])
+{
+    unsigned long threads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    const char *prefix = NULL;
+    bool binary = false;
+    unsigned archives = 0;
+    chipProfile *profile = NULL; //profile of the next archives
+    unsigned long long images = 0;
+    unsigned long long bytes = 0;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 1; i < argc; i++)
+    {
+        size_t length = strlen(argv[i]);
+
+        if (argv[i][0] == '-' && profilesCount == 0) //options are given before the first map
+        {
+            if (strcmp(argv[i], "-j") == 0 && i + 1 < argc && parseNumber(argv[i + 1], &threads) && threads != 0 && threads <= maxThreads)
+            {
+                i++;
+                continue;
+            }
+            if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            {
+                prefix = argv[++i];
+                continue;
+            }
+            if (strcmp(argv[i], "-b") == 0)
+            {
+                binary = true;
+                continue;
+            }
+            fprintf(stderr, "usage: chipdump [-j THREADS] [-o PREFIX] [-b] MAP.map ARCHIVE... [MAP.map ARCHIVE...]\n");
+            return 2;
+        }
+        if (length > 4 && strcmp(argv[i] + length - 4, ".map") == 0)
+        {
+            profile = addProfile(argv[i], prefix, binary);
+            if (profile == NULL)
+            {
+                return 1;
+            }
+            continue;
+        }
+        if (profile == NULL)
+        {
+            fprintf(stderr, "%s: the data map of the archive must be given before it\n", argv[i]);
+            return 2;
+        }
+        if (!decodeArchive(profile, argv[i], ++archives, threads, binary, prefix != NULL))
+        {
+            return 1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (archives == 0)
+    {
+        fprintf(stderr, "usage: chipdump [-j THREADS] [-o PREFIX] [-b] MAP.map ARCHIVE... [MAP.map ARCHIVE...]\n");
+        return 2;
+    }
+
+    for (unsigned i = 0; i < profilesCount; i++)
+    {
+        printSummary(&profiles[i]);
+        images += profiles[i].stats.images;
+        bytes += profiles[i].stats.images * profiles[i].map.size;
+        if (profiles[i].output != NULL && fclose(profiles[i].output) != 0)
+        {
+            perror(profiles[i].map.name);
+            return 1;
+        }
+    }
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("\n%llu images (%.1f MB) in %.3f s with %lu threads, %.0f images/s\n", images, bytes / 1e6, seconds, threads,
+           seconds > 0 ? images / seconds : 0.0);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Reads a data map, groups its check lines by name and opens its output. A map given again is the same profile.
+//////////////////////////////////////////////////////////////////////////
+static chipProfile *addProfile(const char *file, const char *prefix, bool binary)
+{
+    chipProfile *profile = &profiles[profilesCount];
+    chipMap *map = &profile->map;
+    char path[4096];
+
+    if (profilesCount == maxProfiles)
+    {
+        fprintf(stderr, "%s: at most %u data maps\n", file, maxProfiles);
+        return NULL;
+    }
+    memset(profile, 0, sizeof(chipProfile));
+    if (!parseMap(file, map))
+    {
+        return NULL;
+    }
+    for (unsigned i = 0; i < profilesCount; i++)
+    {
+        if (strcmp(profiles[i].map.name, map->name) == 0 && strcmp(profiles[i].map.file, file) == 0)
+        {
+            return &profiles[i];
+        }
+        if (strcmp(profiles[i].map.name, map->name) == 0)
+        {
+            fprintf(stderr, "%s: chip %s is given by %s already\n", file, map->name, profiles[i].map.file);
+            return NULL;
+        }
+    }
+
+    for (unsigned i = 0; i < map->checksCount; i++)
+    {
+        unsigned group = 0;
+
+        while (group < profile->groupsCount && strcmp(map->checks[profile->groupFirst[group]].name, map->checks[i].name) != 0)
+        {
+            group++;
+        }
+        if (group == profile->groupsCount)
+        {
+            profile->groupFirst[profile->groupsCount++] = i;
+        }
+        profile->checkGroup[i] = group;
+    }
+    if (binary)
+    {
+        profile->rowSize = 4 + 8 + 1 + profile->groupsCount;
+        for (unsigned i = 0; i < map->fieldsCount; i++)
+        {
+            profile->rowSize += map->fields[i].size;
+        }
+    }
+    else
+    {
+        profile->rowSize = 10 + 1 + 20 + 1 + 8 + 1 + 1; //archive, image, state and the line end
+        for (unsigned i = 0; i < profile->groupsCount; i++)
+        {
+            profile->rowSize += nameSize + 1;
+        }
+        for (unsigned i = 0; i < map->fieldsCount; i++)
+        {
+            profile->rowSize += 2 * map->fields[i].size + 3; //hex or quoted text
+        }
+    }
+
+    if (prefix != NULL)
+    {
+        snprintf(path, sizeof(path), "%s.%s.%s", prefix, map->name, binary ? "col" : "csv");
+        profile->output = fopen(path, "wb");
+        if (profile->output == NULL)
+        {
+            perror(path);
+            return NULL;
+        }
+        writeHeader(profile, binary);
+    }
+    profilesCount++;
+    return profile;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Every round gives each thread a slice of up to sliceImages images, the outputs of the slices are written in order,
+//so the output doesn't depend on the number of threads. Pages of the archive are read ahead by the kernel.
+//////////////////////////////////////////////////////////////////////////
+static bool decodeArchive(chipProfile *profile, const char *file, unsigned archive, unsigned threads, bool binary, bool rows)
+{
+    int descriptor = open(file, O_RDONLY);
+    struct stat status;
+    const unsigned char *data = NULL;
+    unsigned long long count = 0;
+
+    if (descriptor < 0 || fstat(descriptor, &status) != 0)
+    {
+        perror(file);
+        return false;
+    }
+    count = status.st_size / profile->map.size;
+    profile->archives++;
+    profile->partialBytes += status.st_size % profile->map.size;
+    if (count == 0)
+    {
+        close(descriptor);
+        return true;
+    }
+    data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (data == MAP_FAILED)
+    {
+        perror(file);
+        return false;
+    }
+    madvise((void *)data, status.st_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+    for (unsigned long long next = 0; next < count;)
+    {
+        unsigned started = 0;
+
+        for (; started < threads && next < count; started++)
+        {
+            sliceWorker *worker = &workers[started];
+            size_t size = 0;
+
+            worker->profile = profile;
+            worker->archive = archive;
+            worker->first = next;
+            worker->count = count - next < sliceImages ? count - next : sliceImages;
+            worker->images = data + next * profile->map.size;
+            worker->binary = binary;
+            worker->rows = rows;
+            size = rows ? 4 + worker->count * profile->rowSize : 0;
+            if (size > worker->capacity)
+            {
+                free(worker->output);
+                worker->output = malloc(size);
+                worker->capacity = worker->output != NULL ? size : 0;
+            }
+            if (size > worker->capacity)
+            {
+                fprintf(stderr, "%s: out of memory\n", file);
+                return false;
+            }
+            next += worker->count;
+            worker->threaded = pthread_create(&worker->thread, NULL, decodeSlice, worker) == 0;
+            if (!worker->threaded)
+            {
+                decodeSlice(worker); //no more threads, this slice is decoded here
+            }
+        }
+        for (unsigned i = 0; i < started; i++)
+        {
+            sliceWorker *worker = &workers[i];
+
+            if (worker->threaded)
+            {
+                pthread_join(worker->thread, NULL);
+            }
+            mergeStats(&profile->stats, &worker->stats);
+            if (rows && fwrite(worker->output, 1, worker->length, profile->output) != worker->length)
+            {
+                perror(profile->map.name);
+                return false;
+            }
+        }
+    }
+    munmap((void *)data, status.st_size);
+    return true;
+}
+
+static void *decodeSlice(void *argument)
+{
+    sliceWorker *worker = argument;
+    const chipProfile *profile = worker->profile;
+    char *position = worker->output;
+
+    memset(&worker->stats, 0, sizeof(profileStats));
+    for (unsigned long long i = 0; i < worker->count; i++)
+    {
+        const unsigned char *image = worker->images + i * profile->map.size;
+        uint8_t matches[maxChecks];
+        uint8_t state = decodeImage(profile, image, matches);
+
+        worker->stats.images++;
+        worker->stats.states[state]++;
+        for (unsigned group = 0; group < profile->groupsCount; group++)
+        {
+            if (matches[group] == 0)
+            {
+                worker->stats.failed[group]++;
+            }
+            else
+            {
+                worker->stats.matches[matches[group] - 1]++;
+            }
+        }
+        for (unsigned f = 0; f < profile->map.fieldsCount && state != stateWrong; f++) //fields of other chips mean nothing
+        {
+            if (profile->map.fields[f].size == 1)
+            {
+                worker->stats.values[f][image[profile->map.fields[f].start]]++;
+            }
+        }
+        if (worker->rows && worker->binary)
+        {
+            putColumns(worker->output, profile, worker, i, image, state, matches);
+        }
+        else if (worker->rows)
+        {
+            position = putRow(position, profile, worker->archive, worker->first + i, image, state, matches);
+        }
+    }
+    worker->length = worker->rows && worker->binary ? 4 + worker->count * profile->rowSize : (size_t)(position - worker->output);
+    return NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Returns the state of the image, matches gets the matching line of every check group plus one, 0 if none matches.
+//////////////////////////////////////////////////////////////////////////
+static uint8_t decodeImage(const chipProfile *profile, const unsigned char *image, uint8_t *matches)
+{
+    const chipMap *map = &profile->map;
+    uint8_t state = stateReset;
+
+    memset(matches, 0, profile->groupsCount);
+    for (unsigned i = 0; i < map->checksCount; i++)
+    {
+        const chipCheck *check = &map->checks[i];
+
+        if (matches[profile->checkGroup[i]] == 0 && memcmp(image + check->start, check->value, check->size) == 0)
+        {
+            matches[profile->checkGroup[i]] = i + 1;
+        }
+    }
+    for (unsigned group = 0; group < profile->groupsCount; group++)
+    {
+        if (matches[group] == 0)
+        {
+            return stateWrong;
+        }
+    }
+    for (unsigned cell = 0; cell < map->size && state != stateChanged; cell++)
+    {
+        if (map->kind[cell] == cellSet && image[cell] != map->value[cell])
+        {
+            state = map->used[cell] ? stateUsed : stateChanged;
+        }
+    }
+    return state;
+}
+
+static char *putRow(char *position, const chipProfile *profile, unsigned archive, unsigned long long number, const unsigned char *image,
+                    uint8_t state, const uint8_t *matches)
+{
+    const chipMap *map = &profile->map;
+
+    position = putNumber(position, archive);
+    *position++ = ',';
+    position = putNumber(position, number);
+    *position++ = ',';
+    position = stpcpy(position, stateNames[state]);
+    for (unsigned group = 0; group < profile->groupsCount; group++)
+    {
+        const chipCheck *check = matches[group] != 0 ? &map->checks[matches[group] - 1] : NULL;
+
+        *position++ = ',';
+        position = stpcpy(position, check == NULL ? "bad" : check->label[0] != '\0' ? check->label : "ok");
+    }
+    for (unsigned f = 0; f < map->fieldsCount; f++)
+    {
+        *position++ = ',';
+        position = putField(position, image + map->fields[f].start, map->fields[f].size);
+    }
+    *position++ = '\n';
+    return position;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The slice is one row group, every value of the image goes to its place in its column.
+//////////////////////////////////////////////////////////////////////////
+static void putColumns(char *group, const chipProfile *profile, const sliceWorker *worker, unsigned long long i, const unsigned char *image,
+                       uint8_t state, const uint8_t *matches)
+{
+    const chipMap *map = &profile->map;
+    unsigned long long rows = worker->count;
+    uint32_t archive = worker->archive;
+    uint64_t number = worker->first + i;
+    char *column = group + 4 + 13 * rows + profile->groupsCount * rows; //first field
+
+    if (i == 0)
+    {
+        uint32_t count = rows;
+
+        memcpy(group, &count, 4);
+    }
+    memcpy(group + 4 + 4 * i, &archive, 4);
+    memcpy(group + 4 + 4 * rows + 8 * i, &number, 8);
+    group[4 + 12 * rows + i] = state;
+    for (unsigned g = 0; g < profile->groupsCount; g++)
+    {
+        group[4 + 13 * rows + g * rows + i] = matches[g];
+    }
+    for (unsigned f = 0; f < map->fieldsCount; f++)
+    {
+        memcpy(column + map->fields[f].size * i, image + map->fields[f].start, map->fields[f].size);
+        column += map->fields[f].size * rows;
+    }
+}
+
+static char *putNumber(char *position, unsigned long long number)
+{
+    char digits[20];
+    unsigned count = 0;
+
+    do
+    {
+        digits[count++] = '0' + number % 10;
+        number /= 10;
+    } while (number != 0);
+    while (count != 0)
+    {
+        *position++ = digits[--count];
+    }
+    return position;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//One byte fields are numbers, fields of printable ASCII (the EDP code) are text, other fields are hex.
+//////////////////////////////////////////////////////////////////////////
+static char *putField(char *position, const unsigned char *bytes, unsigned size)
+{
+    static const char hexDigits[] = "0123456789ABCDEF";
+    bool text = size > 1;
+
+    if (size == 1)
+    {
+        return putNumber(position, bytes[0]);
+    }
+    for (unsigned i = 0; i < size && text; i++)
+    {
+        text = bytes[i] >= 0x20 && bytes[i] < 0x7F;
+    }
+    if (text)
+    {
+        *position++ = '"';
+        for (unsigned i = 0; i < size; i++)
+        {
+            if (bytes[i] == '"')
+            {
+                *position++ = '"';
+            }
+            *position++ = bytes[i];
+        }
+        *position++ = '"';
+        return position;
+    }
+    for (unsigned i = 0; i < size; i++)
+    {
+        *position++ = hexDigits[bytes[i] >> 4];
+        *position++ = hexDigits[bytes[i] & 0x0F];
+    }
+    return position;
+}
+
+static void writeHeader(const chipProfile *profile, bool binary)
+{
+    const chipMap *map = &profile->map;
+    const char *names[3 + maxChecks + maxFields] = {"archive", "image", "state"};
+    uint32_t widths[3 + maxChecks + maxFields] = {4, 8, 1};
+    uint32_t count = 3;
+    char checkNames[maxChecks][nameSize + 5]; //a check may have the name of a field
+
+    for (unsigned group = 0; group < profile->groupsCount; group++)
+    {
+        snprintf(checkNames[group], sizeof(checkNames[group]), "%sCheck", map->checks[profile->groupFirst[group]].name);
+        names[count] = checkNames[group];
+        widths[count++] = 1;
+    }
+    for (unsigned f = 0; f < map->fieldsCount; f++)
+    {
+        names[count] = map->fields[f].name;
+        widths[count++] = map->fields[f].size;
+    }
+    if (!binary)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            fprintf(profile->output, "%s%s", i == 0 ? "" : ",", names[i]);
+        }
+        fprintf(profile->output, "\n");
+        return;
+    }
+    fwrite("CHIPCOL", 1, 8, profile->output);
+    fwrite(&count, 4, 1, profile->output);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        char name[columnNameSize] = {0};
+
+        strncpy(name, names[i], columnNameSize - 1);
+        fwrite(name, 1, columnNameSize, profile->output);
+        fwrite(&widths[i], 4, 1, profile->output);
+    }
+}
+
+static void mergeStats(profileStats *total, const profileStats *part)
+{
+    total->images += part->images;
+    for (unsigned i = 0; i < statesCount; i++)
+    {
+        total->states[i] += part->states[i];
+    }
+    for (unsigned i = 0; i < maxChecks; i++)
+    {
+        total->matches[i] += part->matches[i];
+        total->failed[i] += part->failed[i];
+    }
+    for (unsigned f = 0; f < maxFields; f++)
+    {
+        for (unsigned v = 0; v < 256; v++)
+        {
+            total->values[f][v] += part->values[f][v];
+        }
+    }
+}
+
+static void printSummary(const chipProfile *profile)
+{
+    const chipMap *map = &profile->map;
+    const profileStats *stats = &profile->stats;
+    unsigned long long known = stats->images - stats->states[stateWrong];
+    double percent = stats->images != 0 ? 100.0 / stats->images : 0.0;
+
+    printf("%s (%s): %llu images in %llu archives", map->name, map->file, stats->images, profile->archives);
+    if (profile->partialBytes != 0)
+    {
+        printf(", %llu bytes of partial images skipped", profile->partialBytes);
+    }
+    printf("\n");
+    for (unsigned i = 0; i < statesCount; i++)
+    {
+        printf("  %-8s %12llu  %5.1f%%\n", stateNames[i], stats->states[i], stats->states[i] * percent);
+    }
+    for (unsigned group = 0; group < profile->groupsCount; group++)
+    {
+        printf("  check %s:", map->checks[profile->groupFirst[group]].name);
+        for (unsigned i = 0; i < map->checksCount; i++)
+        {
+            if (profile->checkGroup[i] == group)
+            {
+                printf(" %s %llu,", map->checks[i].label[0] != '\0' ? map->checks[i].label : "ok", stats->matches[i]);
+            }
+        }
+        printf(" bad %llu\n", stats->failed[group]);
+    }
+    for (unsigned f = 0; f < map->fieldsCount; f++)
+    {
+        unsigned long long buckets[bucketsCount] = {0};
+        unsigned long long sum = 0;
+        unsigned minimum = 256;
+        unsigned maximum = 0;
+
+        if (map->fields[f].size != 1 || map->kind[map->fields[f].start] != cellSet || known == 0)
+        {
+            continue;
+        }
+        for (unsigned v = 0; v < 256; v++)
+        {
+            buckets[v / bucketWidth] += stats->values[f][v];
+            sum += stats->values[f][v] * v;
+            minimum = stats->values[f][v] != 0 && v < minimum ? v : minimum;
+            maximum = stats->values[f][v] != 0 ? v : maximum;
+        }
+        printf("  %s (reset %u): min %u, mean %.1f, max %u\n", map->fields[f].name, map->value[map->fields[f].start], minimum,
+               (double)sum / known, maximum);
+        for (unsigned b = 0; b < bucketsCount; b++)
+        {
+            unsigned top = b * bucketWidth + bucketWidth - 1 < 255 ? b * bucketWidth + bucketWidth - 1 : 255;
+
+            if (buckets[b] != 0)
+            {
+                printf("    %3u-%3u %12llu  %5.1f%%\n", b * bucketWidth, top, buckets[b], 100.0 * buckets[b] / known);
+            }
+        }
+    }
+}
@@ -0,0 +1,207 @@
+/*
+* cycles.c
+*
+* Code size and cycle count of every function of a firmware build, read from the disassembly of avr-objdump.
+* The cycles of a function are one pass through all of its instructions, with no branch taken and no instruction
+* skipped (ATmega328P timing, a taken branch or skip adds 1 or 2), so they don't include waits and repeats of loops.
+* They follow every change of a driver, a faster byte loop or one instruction less in a bit loop shows at once,
+* while the time of a whole reset is measured by the SELF_BENCHMARK and TIMING_PROBE builds. Every function also
+* gets its branches back to itself (loops) and its calls. COMMON/FIRMWARE/Makefile writes this report for every board.
+*
+* Build: cc -std=c99 -O2 -o cycles cycles.c
+* Usage: avr-objdump -d FIRMWARE.elf | cycles [-s] (-s sorts by size, otherwise functions are in order of addresses)
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define lineSize 1024
+#define nameSize 128
+#define maxFunctions 1024
+
+typedef struct
+{
+    char name[nameSize];
+    unsigned long address;
+    unsigned long bytes;
+    unsigned long instructions;
+    unsigned long cycles;
+    unsigned long loops; //branches to a lower address of the same function
+    unsigned long calls;
+} functionCost;
+
+typedef struct
+{
+    const char *mnemonic;
+    unsigned char cycles;
+} instructionTiming;
+
+//instructions that don't take one cycle, the others do
+static const instructionTiming timings[] = {
+    {"adiw", 2}, {"sbiw", 2}, {"mul", 2}, {"muls", 2}, {"mulsu", 2}, {"fmul", 2}, {"fmuls", 2}, {"fmulsu", 2},
+    {"rjmp", 2}, {"ijmp", 2}, {"eijmp", 2}, {"jmp", 3}, {"rcall", 3}, {"icall", 3}, {"eicall", 4}, {"call", 4},
+    {"ret", 4}, {"reti", 4}, {"ld", 2}, {"ldd", 2}, {"lds", 2}, {"st", 2}, {"std", 2}, {"sts", 2}, {"push", 2},
+    {"pop", 2}, {"sbi", 2}, {"cbi", 2}, {"lpm", 3}, {"elpm", 3}, {"spm", 4}};
+static functionCost functions[maxFunctions];
+static unsigned functionsCount = 0;
+static unsigned long unknownLines = 0;
+
+static void readDisassembly(FILE *);
+static void addInstruction(functionCost *, const char *, unsigned long);
+static unsigned char instructionCycles(const char *);
+static bool isBranch(const char *);
+static void printReport(bool);
+static int compareSizes(const void *, const void *);
+
+int main(int argc, char *argv[])
+{
+    bool bySize = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-s") == 0)
+        {
+            bySize = true;
+            continue;
+        }
+        fprintf(stderr, "usage: avr-objdump -d FIRMWARE.elf | cycles [-s]\n");
+        return 2;
+    }
+    readDisassembly(stdin);
+    if (functionsCount == 0)
+    {
+        fprintf(stderr, "no functions found, give the output of avr-objdump -d\n");
+        return 1;
+    }
+    printReport(bySize);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//A function starts with "00000068 <name>:", its instructions are "  68:\t0e 94 34 00 \tcall\t0x68\t; 0x68 <name>".
+//Data in the code (.word of tables) is counted in the bytes only.
+//////////////////////////////////////////////////////////////////////////
+static void readDisassembly(FILE *file)
+{
+    char line[lineSize];
+    functionCost *function = NULL;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char name[nameSize];
+        unsigned long address = 0;
+
+        if (sscanf(line, "%lx <%127[^>]>:", &address, name) == 2)
+        {
+            if (functionsCount == maxFunctions)
+            {
+                fprintf(stderr, "more than %u functions, the rest is not counted\n", maxFunctions);
+                return;
+            }
+            function = &functions[functionsCount++];
+            memset(function, 0, sizeof(functionCost));
+            strcpy(function->name, name);
+            function->address = address;
+            continue;
+        }
+        char *bytes = strchr(line, '\t');
+        if (function == NULL || bytes == NULL || sscanf(line, " %lx:", &address) != 1)
+        {
+            continue;
+        }
+        char *text = strchr(bytes + 1, '\t');
+        unsigned long count = 0;
+
+        for (char *at = bytes + 1; at != text && *at != '\0' && *at != '\n'; at++)
+        {
+            count += *at != ' ' && (at[1] == ' ' || at[1] == '\t' || at[1] == '\n'); //every byte is two hex digits
+        }
+        function->bytes += count;
+        if (text != NULL && strncmp(text + 1, ".word", 5) != 0 && strncmp(text + 1, ".byte", 5) != 0)
+        {
+            addInstruction(function, text + 1, address);
+        }
+    }
+}
+
+static void addInstruction(functionCost *function, const char *text, unsigned long address)
+{
+    char mnemonic[16];
+    const char *operands = text + strcspn(text, "\t ");
+    unsigned long target = 0;
+
+    if (sscanf(text, "%15s", mnemonic) != 1)
+    {
+        unknownLines++;
+        return;
+    }
+    function->instructions++;
+    function->cycles += instructionCycles(mnemonic);
+    if (strcmp(mnemonic, "call") == 0 || strcmp(mnemonic, "rcall") == 0 || strcmp(mnemonic, "icall") == 0)
+    {
+        function->calls++;
+    }
+    //the target of a relative branch is given after the ';' as an absolute address
+    const char *comment = strchr(operands, ';');
+    if ((isBranch(mnemonic) || strcmp(mnemonic, "rjmp") == 0) && comment != NULL && sscanf(comment, "; 0x%lx", &target) == 1
+        && target >= function->address && target <= address)
+    {
+        function->loops++;
+    }
+}
+
+static unsigned char instructionCycles(const char *mnemonic)
+{
+    for (size_t i = 0; i < sizeof(timings) / sizeof(timings[0]); i++)
+    {
+        if (strcmp(mnemonic, timings[i].mnemonic) == 0)
+        {
+            return timings[i].cycles;
+        }
+    }
+    return 1;
+}
+
+static bool isBranch(const char *mnemonic)
+{
+    return mnemonic[0] == 'b' && mnemonic[1] == 'r' && mnemonic[2] != '\0' && strcmp(mnemonic, "break") != 0;
+}
+
+static void printReport(bool bySize)
+{
+    unsigned long bytes = 0;
+    unsigned long cycles = 0;
+
+    if (bySize)
+    {
+        qsort(functions, functionsCount, sizeof(functionCost), compareSizes);
+    }
+    printf("address   bytes  instr  cycles  loops  calls  function\n");
+    for (unsigned i = 0; i < functionsCount; i++)
+    {
+        functionCost *function = &functions[i];
+
+        printf("%07lx %7lu %6lu %7lu %6lu %6lu  %s\n", function->address, function->bytes, function->instructions,
+               function->cycles, function->loops, function->calls, function->name);
+        bytes += function->bytes;
+        cycles += function->cycles;
+    }
+    printf("%u functions, %lu bytes, %lu cycles\n", functionsCount, bytes, cycles);
+    if (unknownLines != 0)
+    {
+        printf("%lu lines not understood\n", unknownLines);
+    }
+}
+
+static int compareSizes(const void *a, const void *b)
+{
+    const functionCost *first = a;
+    const functionCost *second = b;
+
+    return (first->bytes < second->bytes) - (first->bytes > second->bytes);
+}
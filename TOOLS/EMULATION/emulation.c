@@ -0,0 +1,327 @@
+/*
+* emulation.c
+*
+* Test of the chip emulation (COMMON/FIRMWARE/i2cslave.c, CHIP_EMULATION builds) against a TWI master on the PC.
+* The master plays the printer with random page writes, current address reads, random reads and transfers to the
+* address of another chip, and every byte it reads is checked against a model of the serial EEPROM. This runs for
+* every chip of the RICOH resetters: SP112 and SG2100N gel chips of 128 bytes and the 256 bytes of the waste tank chip,
+* so reads and writes cross the end of the chip and its word address wraps like in the chip. The bytes of the image
+* behind a smaller chip are filled with a marker, a read or write that reaches them is a failure too.
+* The TWI of the ATmega328P in slave mode is simulated here with the register headers of TOOLS/SOAK/host: every byte
+* gives the ISR its status while SCL is held low, and the ISR must clear TWINT and keep TWEA set.
+* With the cycles of the ISR given by -c, from TWI_vect in BOARD.cycles of a build with FLAGS=-DCHIP_EMULATION, the time
+* SCL is held low per byte is compared to the byte time of a printer clocked at 100 kHz and 400 kHz.
+*
+* Build: cc -std=gnu99 -O2 -DF_CPU=8000000UL -I../SOAK/host -o emulation emulation.c ../../COMMON/FIRMWARE/i2cslave.c
+* Usage: emulation [-n transfers of every chip] [-s seed] [-c ISR cycles]
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <avr/io.h>
+#include <util/twi.h>
+#include "../../COMMON/FIRMWARE/i2cmaster.h" //I2C_READ and I2C_WRITE
+#include "../../COMMON/FIRMWARE/i2cslave.h"
+
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+
+#define defaultTransfers 100000
+#define defaultIsrCycles 100 //the longest path of TWI_vect with the push and pop of its registers, avr-gcc -Os
+#define interruptCycles 7 //response to the interrupt and the jump of the vector table
+#define pageSize 8
+#define maxRead 24 //longest read, reads cross pages and the end of the chip
+#define unusedMarker 0xEE //bytes of the image behind the chip
+#define chipsCount 3
+#define failuresShown 10
+
+typedef struct
+{
+    const char *name;
+    uint8_t address;
+    unsigned size;
+} emulatedChip;
+
+typedef struct
+{
+    unsigned long transfers;
+    unsigned long bytes;
+    unsigned long wrong; //bytes read with a value other than in the model
+    unsigned long nack; //bytes or addresses of the chip not acknowledged, or an address of another chip acknowledged
+    unsigned long held; //ISR calls that didn't clear TWINT, the bus would stay held
+    unsigned long outside; //bytes of the image behind the chip that changed
+} chipResult;
+
+static const emulatedChip chips[chipsCount] = {{"sp112", 0xA6, 128}, {"sg2100n gel", 0xA2, 128}, {"sg2100n waste", 0xA8, 256}};
+static uint8_t registers[registersCount];
+static uint8_t model[I2C_SLAVE_IMAGE_SIZE]; //the chip as a real serial EEPROM would hold it
+static unsigned modelAddress; //address counter of the real chip
+static uint64_t randomState;
+static unsigned long failuresPrinted;
+
+void TWI_vect(void); //ISR of i2cslave.c
+
+static uint32_t nextRandom(void);
+static bool slaveEvent(uint8_t, chipResult *); //runs the ISR with the status, returns true if the next byte is acknowledged
+static bool slaveAddress(uint8_t, chipResult *); //start and address byte, returns true if the emulation answered
+static void slaveStop(chipResult *);
+static void writePage(const emulatedChip *, chipResult *);
+static void readBytes(const emulatedChip *, chipResult *, bool); //the last argument is true for a random read
+static void otherChip(const emulatedChip *, chipResult *);
+static void testChip(const emulatedChip *, unsigned long, chipResult *);
+static void printStretch(unsigned);
+
+volatile uint8_t *soakRegister(unsigned reg)
+{
+    return &registers[reg];
+}
+
+uint16_t soakTimer1(void)
+{
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long transfers = defaultTransfers;
+    unsigned isrCycles = defaultIsrCycles;
+    uint64_t seed = 1;
+    int option = 0;
+    bool failed = false;
+
+    while ((option = getopt(argc, argv, "n:s:c:")) != -1)
+    {
+        switch (option)
+        {
+            case 'n':
+                transfers = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'c':
+                isrCycles = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n transfers of every chip] [-s seed] [-c ISR cycles]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    randomState = seed;
+    printf("chip           size  transfers      bytes  wrong   nack   held  outside\n");
+    for (unsigned i = 0; i < chipsCount; i++)
+    {
+        chipResult result = {0};
+
+        testChip(&chips[i], transfers, &result);
+        printf("%-13s %5u %10lu %10lu %6lu %6lu %6lu %8lu\n", chips[i].name, chips[i].size, result.transfers, result.bytes,
+               result.wrong, result.nack, result.held, result.outside);
+        failed |= result.wrong != 0 || result.nack != 0 || result.held != 0 || result.outside != 0;
+    }
+    printStretch(isrCycles);
+    printf(failed ? "FAILED\n" : "passed\n");
+    return failed ? 1 : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//SplitMix64 like the soak harness, a seed gives the same transfers every run.
+//////////////////////////////////////////////////////////////////////////
+static uint32_t nextRandom(void)
+{
+    uint64_t z = (randomState += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The TWI sets TWINT with the status and holds SCL low. The ISR must write TWCR with TWINT to release SCL,
+//with TWEA the TWI acknowledges the next byte and answers at its address again.
+//////////////////////////////////////////////////////////////////////////
+static bool slaveEvent(uint8_t status, chipResult *result)
+{
+    registers[regTwsr] = status;
+    registers[regTwcr] = (1 << TWEN) | (1 << TWIE); //TWINT set by the TWI reads back as 0 here, only a write of the ISR sets it
+    TWI_vect();
+    if ((registers[regTwcr] & (1 << TWINT)) == 0)
+    {
+        result->held++;
+        return false;
+    }
+    return (registers[regTwcr] & (1 << TWEA)) != 0;
+}
+
+static bool slaveAddress(uint8_t address, chipResult *result)
+{
+    if ((registers[regTwcr] & (1 << TWEA)) == 0 || (address & 0xFE) != (registers[regTwar] & 0xFE))
+    {
+        return false; //the TWI doesn't answer, the ISR isn't called
+    }
+    return slaveEvent((address & I2C_READ) != 0 ? TW_ST_SLA_ACK : TW_SR_SLA_ACK, result);
+}
+
+static void slaveStop(chipResult *result)
+{
+    slaveEvent(TW_SR_STOP, result);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Word address and up to a page of data, the address wraps inside the page. Only the address bits of the chip
+//are used, so the printer may send any byte as the address.
+//////////////////////////////////////////////////////////////////////////
+static void writePage(const emulatedChip *chip, chipResult *result)
+{
+    uint8_t wordAddress = nextRandom();
+    unsigned count = 1 + nextRandom() % pageSize;
+
+    if (slaveAddress(chip->address + I2C_WRITE, result) == false)
+    {
+        result->nack++;
+        return;
+    }
+    registers[regTwdr] = wordAddress;
+    if (slaveEvent(TW_SR_DATA_ACK, result) == false)
+    {
+        result->nack++;
+    }
+    modelAddress = wordAddress & (chip->size - 1);
+    for (unsigned i = 0; i < count; i++)
+    {
+        uint8_t value = nextRandom();
+
+        registers[regTwdr] = value;
+        if (slaveEvent(TW_SR_DATA_ACK, result) == false)
+        {
+            result->nack++;
+        }
+        model[modelAddress] = value;
+        modelAddress = (modelAddress & ~(pageSize - 1)) | ((modelAddress + 1) & (pageSize - 1));
+        result->bytes++;
+    }
+    slaveStop(result);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//A random read writes the word address and reads after a repeated start, a current address read only reads.
+//The master acknowledges every byte but the last one.
+//////////////////////////////////////////////////////////////////////////
+static void readBytes(const emulatedChip *chip, chipResult *result, bool random)
+{
+    unsigned count = 1 + nextRandom() % maxRead;
+
+    if (random == true)
+    {
+        uint8_t wordAddress = nextRandom();
+
+        if (slaveAddress(chip->address + I2C_WRITE, result) == false)
+        {
+            result->nack++;
+            return;
+        }
+        registers[regTwdr] = wordAddress;
+        if (slaveEvent(TW_SR_DATA_ACK, result) == false)
+        {
+            result->nack++;
+        }
+        slaveStop(result); //a repeated start gives the same status
+        modelAddress = wordAddress & (chip->size - 1);
+    }
+    if (slaveAddress(chip->address + I2C_READ, result) == false)
+    {
+        result->nack++;
+        return;
+    }
+    for (unsigned i = 0; i < count; i++)
+    {
+        if (registers[regTwdr] != model[modelAddress])
+        {
+            result->wrong++;
+            if (failuresPrinted++ < failuresShown)
+            {
+                printf("%s: byte %u read as %02X, expected %02X\n", chip->name, modelAddress, registers[regTwdr], model[modelAddress]);
+            }
+        }
+        modelAddress = (modelAddress + 1) & (chip->size - 1);
+        result->bytes++;
+        slaveEvent(i < count - 1 ? TW_ST_DATA_ACK : TW_ST_DATA_NACK, result);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The printer also talks to the other chips on the bus, the emulation must not answer them.
+//////////////////////////////////////////////////////////////////////////
+static void otherChip(const emulatedChip *chip, chipResult *result)
+{
+    uint8_t address = 0xA0 + ((nextRandom() % 8) << 1);
+
+    if (address != chip->address && slaveAddress(address + (nextRandom() & I2C_READ), result) == true)
+    {
+        result->nack++;
+    }
+}
+
+static void testChip(const emulatedChip *chip, unsigned long transfers, chipResult *result)
+{
+    for (unsigned i = 0; i < I2C_SLAVE_IMAGE_SIZE; i++)
+    {
+        model[i] = nextRandom();
+        i2c_slave_image[i] = i < chip->size ? model[i] : unusedMarker;
+    }
+    modelAddress = 0;
+    i2c_slave_init(chip->address, chip->size);
+
+    for (result->transfers = 0; result->transfers < transfers; result->transfers++)
+    {
+        uint32_t kind = nextRandom() % 10;
+
+        if (kind < 4)
+        {
+            writePage(chip, result);
+        }
+        else if (kind < 7)
+        {
+            readBytes(chip, result, true);
+        }
+        else if (kind < 9)
+        {
+            readBytes(chip, result, false);
+        }
+        else
+        {
+            otherChip(chip, result);
+        }
+    }
+    for (unsigned i = chip->size; i < I2C_SLAVE_IMAGE_SIZE; i++)
+    {
+        result->outside += i2c_slave_image[i] != unusedMarker;
+    }
+    i2c_slave_stop();
+}
+
+//////////////////////////////////////////////////////////////////////////
+//A byte is 9 clocks with the acknowledge, SCL is held low for the ISR after it.
+//////////////////////////////////////////////////////////////////////////
+static void printStretch(unsigned isrCycles)
+{
+    static const unsigned clocks[] = {100000, 400000};
+    double stretch = (isrCycles + interruptCycles) * 1000000.0 / F_CPU;
+
+    printf("SCL held low %.1f us per byte (%u ISR cycles at %lu Hz)\n", stretch, isrCycles, (unsigned long)F_CPU);
+    for (unsigned i = 0; i < sizeof(clocks) / sizeof(clocks[0]); i++)
+    {
+        double byteTime = 9 * 1000000.0 / clocks[i];
+
+        printf("%3u kHz: byte %.1f us, %.1f us with the stretch, %.0f%% slower\n", clocks[i] / 1000, byteTime, byteTime + stretch,
+               100.0 * stretch / byteTime);
+    }
+}
@@ -0,0 +1,623 @@
+/*
+* fleet.c
+*
+* Drives many resetter boards at once over their serial ports. The boards are built with SERIAL_CONTROL (control.c),
+* every job is one command char and ends with the line "done", "ok" or "?" of the board. All ports are non-blocking
+* and served by one epoll loop, so a slow board only delays its own queue. Every line of every board and every finished
+* job go to one log, the report at the end gives jobs, timeouts, latency and resets per minute of every board.
+* Jobs are read from stdin, one per line: BOARD JOB [COUNT], BOARD is the number of the port or "all",
+* JOB is reset, stats, sram (SRAM_REPORT builds), dump or restore (CHIP_BACKUP builds). "report" prints the report at once.
+* A restore writes the newest backup back to every chip of the board, so the last reset of a chip can be undone.
+* After the end of stdin the queues are finished and the report is printed.
+* A board that doesn't finish its job in time is given up, its late answer could not be told from the next one.
+* The "chip N crc XXXX" lines sent before "done" are the fingerprints of the chips read by the reset, the log marks
+* every chip as new or seen, so the chips seen already don't need their images stored again. With -s the set of
+* seen fingerprints is kept in a file (a bitmap of all CRC16 values) from one run to the next.
+* TOOLS/FLEET/fleetsim.c gives pseudo-terminals backed by the soak simulation of the firmware to try it without boards.
+*
+* Build: cc -std=gnu99 -O2 -o fleet fleet.c
+* Usage: fleet [-o LOG] [-t RESET TIMEOUT S] [-s SEEN] PORT...
+* Example: ./fleetsim -n 8 > ports & echo "all reset 20" | ./fleet $(cat ports)
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#define _GNU_SOURCE
+#include <asm/termbits.h> //termios2, the 250000 baud of the boards is not one of the standard rates
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define maxBoards 128
+#define queueSize 1024 //jobs waiting for one board
+#define lineSize 256
+#define readSize 512
+#define boardBaud 250000 //uartBaud of the firmware
+#define defaultResetTimeout 60.0 //s, the LED display of 8 SP112 sockets takes 22 s
+#define commandTimeout 5.0 //s, the dump of a full backup store and the restore of 8 SP112 sockets are the longest answers, about 1 s
+#define stdinKey maxBoards //epoll key of stdin, boards are keyed by their number
+#define fingerprintsCount 65536 //CRC16 of control.c
+
+enum jobKind { jobReset, jobStats, jobSram, jobDump, jobRestore, jobsCount };
+enum jobStatus { statusOk, statusUnknown, statusTimeout, statusLost, statusesCount };
+
+typedef struct
+{
+    uint64_t count[statusesCount];
+    double *latencies; //ms of every finished job, sorted for the report
+    size_t latenciesCount;
+    size_t latenciesSize;
+} jobMetrics;
+
+typedef struct
+{
+    const char *path;
+    int fd; //-1 after the board was given up
+    uint8_t queue[queueSize]; //jobKind
+    unsigned queueHead;
+    unsigned queueCount;
+    bool busy; //a job was sent and its answer didn't end yet
+    uint8_t job;
+    double sent; //s
+    double deadline;
+    char line[lineSize];
+    unsigned lineLength;
+    uint64_t bytesIn;
+    double firstSent; //s, the first and the last reset give the resets per minute
+    double lastDone;
+    uint64_t chipsRead; //fingerprints received
+    uint64_t chipsNew; //fingerprints not seen before
+    jobMetrics metrics[jobsCount];
+} fleetBoard;
+
+static const char *const jobNames[jobsCount] = {"reset", "stats", "sram", "dump", "restore"};
+static const char jobCommands[jobsCount] = {'r', 's', 'm', 'b', 'u'}; //controlReset, controlStats, sramCommand, backupCommand, backupRestore
+static const char *const statusNames[statusesCount] = {"ok", "unknown", "timeout", "lost"};
+static fleetBoard boards[maxBoards];
+static unsigned boardsCount = 0;
+static FILE *logFile = NULL;
+static double startTime = 0.0;
+static double resetTimeout = defaultResetTimeout;
+static uint8_t seenChips[fingerprintsCount / 8]; //bit for every fingerprint seen
+
+static bool openBoard(fleetBoard *, const char *);
+static void readBoard(unsigned); //reads what the board sent, ends the job at its last line
+static void readFingerprint(unsigned); //marks the chip of a "chip N crc XXXX" line as seen
+static bool loadSeen(const char *); //reads the seen fingerprints, a missing file is an empty set
+static bool saveSeen(const char *);
+static void sendJobs(void); //sends the next job to every idle board with a queue
+static void endJob(unsigned, uint8_t);
+static void dropBoard(unsigned, const char *); //gives the board up, its queue ends as lost
+static bool readJobs(int, bool *); //reads job lines from stdin, the second argument is set at its end
+static bool addJobs(const char *);
+static double nextDeadline(void); //s, 0 if no job waits for an answer
+static void report(FILE *);
+static int compareLatencies(const void *, const void *);
+static double now(void);
+
+int main(int argc, char *argv[])
+{
+    const char *logPath = "fleet.log";
+    const char *seenPath = NULL;
+    int poll = epoll_create1(0);
+    bool inputOpen = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            logPath = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc && atof(argv[i + 1]) > 0.0)
+        {
+            resetTimeout = atof(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            seenPath = argv[++i];
+            continue;
+        }
+        if (argv[i][0] == '-' || boardsCount == maxBoards)
+        {
+            fprintf(stderr, "usage: fleet [-o LOG] [-t RESET TIMEOUT S] [-s SEEN] PORT...\n");
+            return 2;
+        }
+        if (!openBoard(&boards[boardsCount], argv[i]))
+        {
+            return 1;
+        }
+        boardsCount++;
+    }
+    if (boardsCount == 0)
+    {
+        fprintf(stderr, "usage: fleet [-o LOG] [-t RESET TIMEOUT S] [-s SEEN] PORT...\n");
+        return 2;
+    }
+    if (seenPath != NULL && !loadSeen(seenPath))
+    {
+        return 1;
+    }
+    logFile = fopen(logPath, "a");
+    if (logFile == NULL || poll < 0)
+    {
+        perror(logFile == NULL ? logPath : "epoll");
+        return 1;
+    }
+    startTime = now();
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+    for (unsigned i = 0; i <= boardsCount; i++)
+    {
+        struct epoll_event event = {.events = EPOLLIN, .data.u32 = i < boardsCount ? i : stdinKey};
+
+        if (epoll_ctl(poll, EPOLL_CTL_ADD, i < boardsCount ? boards[i].fd : STDIN_FILENO, &event) == 0)
+        {
+            continue;
+        }
+        if (i < boardsCount)
+        {
+            perror(boards[i].path);
+            return 1;
+        }
+        while (inputOpen) //a regular file can't be polled, its jobs are read at once
+        {
+            readJobs(poll, &inputOpen);
+        }
+    }
+    fprintf(logFile, "%.3f fleet of %u boards\n", 0.0, boardsCount);
+
+    while (true)
+    {
+        struct epoll_event events[maxBoards + 1];
+        sendJobs();
+        double deadline = nextDeadline();
+        int timeout = deadline == 0.0 ? -1 : (int)((deadline - now()) * 1000.0) + 1;
+        bool idle = !inputOpen;
+
+        for (unsigned i = 0; i < boardsCount && idle; i++)
+        {
+            idle = boards[i].fd < 0 || (boards[i].busy == false && boards[i].queueCount == 0);
+        }
+        if (idle)
+        {
+            break;
+        }
+        int count = epoll_wait(poll, events, maxBoards + 1, timeout < 0 && inputOpen == false ? 1000 : timeout);
+        for (int i = 0; i < count; i++)
+        {
+            if (events[i].data.u32 == stdinKey)
+            {
+                if (!readJobs(poll, &inputOpen))
+                {
+                    fprintf(stderr, "job lines: BOARD|all reset|stats|sram|dump|restore [COUNT], or report\n");
+                }
+            }
+            else
+            {
+                readBoard(events[i].data.u32);
+            }
+        }
+        for (unsigned i = 0; i < boardsCount; i++)
+        {
+            if (boards[i].fd >= 0 && boards[i].busy == true && now() >= boards[i].deadline)
+            {
+                endJob(i, statusTimeout);
+                dropBoard(i, "no answer in time");
+            }
+        }
+    }
+    report(stdout);
+    report(logFile);
+    fclose(logFile);
+    return seenPath != NULL && !saveSeen(seenPath) ? 1 : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Raw 8N1 at boardBaud. A pseudo-terminal takes the settings too, its speed just doesn't matter.
+//////////////////////////////////////////////////////////////////////////
+static bool openBoard(fleetBoard *board, const char *path)
+{
+    struct termios2 settings;
+
+    memset(board, 0, sizeof(fleetBoard));
+    board->path = path;
+    board->fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (board->fd < 0 || ioctl(board->fd, TCGETS2, &settings) != 0)
+    {
+        perror(path);
+        return false;
+    }
+    settings.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF);
+    settings.c_oflag &= ~OPOST;
+    settings.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    settings.c_cflag &= ~(CSIZE | PARENB | CSTOPB | CRTSCTS | CBAUD);
+    settings.c_cflag |= CS8 | CREAD | CLOCAL | BOTHER;
+    settings.c_ispeed = boardBaud;
+    settings.c_ospeed = boardBaud;
+    settings.c_cc[VMIN] = 1;
+    settings.c_cc[VTIME] = 0;
+    if (ioctl(board->fd, TCSETS2, &settings) != 0)
+    {
+        perror(path);
+        return false;
+    }
+    ioctl(board->fd, TCFLSH, TCIOFLUSH); //what the board sent before is not an answer
+    return true;
+}
+
+static void readBoard(unsigned index)
+{
+    fleetBoard *board = &boards[index];
+    char data[readSize];
+    ssize_t count = board->fd < 0 ? 0 : read(board->fd, data, sizeof(data));
+
+    if (count < 0 && (errno == EAGAIN || errno == EINTR))
+    {
+        return;
+    }
+    if (count <= 0)
+    {
+        if (board->fd >= 0)
+        {
+            dropBoard(index, "port closed");
+        }
+        return;
+    }
+    board->bytesIn += count;
+    for (ssize_t i = 0; i < count; i++)
+    {
+        if (data[i] == '\r')
+        {
+            continue;
+        }
+        if (data[i] != '\n' && board->lineLength < lineSize - 1)
+        {
+            board->line[board->lineLength++] = data[i];
+            continue;
+        }
+        if (data[i] != '\n') //a longer line is split
+        {
+            i--;
+        }
+        board->line[board->lineLength] = '\0';
+        board->lineLength = 0;
+        fprintf(logFile, "%.3f b%u %s\n", now() - startTime, index, board->line);
+        readFingerprint(index);
+        bool last = strcmp(board->line, "done") == 0 || strcmp(board->line, "ok") == 0;
+        if (board->busy == true && (last == true || strcmp(board->line, "?") == 0))
+        {
+            endJob(index, last == true ? statusOk : statusUnknown);
+        }
+        else if (board->busy == false && strcmp(board->line, "done") == 0)
+        {
+            fprintf(logFile, "%.3f b%u reset by the button\n", now() - startTime, index);
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The same chip read by two boards is one chip, the set is shared by the whole fleet.
+//////////////////////////////////////////////////////////////////////////
+static void readFingerprint(unsigned index)
+{
+    fleetBoard *board = &boards[index];
+    unsigned chip = 0;
+    unsigned crc = 0;
+    char end = 0;
+
+    if (sscanf(board->line, "chip %u crc %4x%c", &chip, &crc, &end) != 2)
+    {
+        return;
+    }
+    bool seen = (seenChips[crc / 8] & (1 << crc % 8)) != 0;
+    seenChips[crc / 8] |= 1 << crc % 8;
+    board->chipsRead++;
+    board->chipsNew += !seen;
+    fprintf(logFile, "%.3f b%u chip %u %04X %s\n", now() - startTime, index, chip, crc, seen ? "seen" : "new");
+}
+
+static bool loadSeen(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL && errno == ENOENT)
+    {
+        return true;
+    }
+    if (file == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    bool loaded = fread(seenChips, sizeof(seenChips), 1, file) == 1;
+    fclose(file);
+    if (!loaded)
+    {
+        fprintf(stderr, "%s: not a set of %u fingerprints\n", path, fingerprintsCount);
+    }
+    return loaded;
+}
+
+static bool saveSeen(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    bool saved = file != NULL && fwrite(seenChips, sizeof(seenChips), 1, file) == 1;
+
+    if (file != NULL && fclose(file) != 0)
+    {
+        saved = false;
+    }
+    if (!saved)
+    {
+        perror(path);
+    }
+    return saved;
+}
+
+static void sendJobs(void)
+{
+    for (unsigned i = 0; i < boardsCount; i++)
+    {
+        fleetBoard *board = &boards[i];
+
+        if (board->fd < 0 || board->busy == true || board->queueCount == 0)
+        {
+            continue;
+        }
+        uint8_t job = board->queue[board->queueHead];
+        ssize_t written = write(board->fd, &jobCommands[job], 1);
+        if (written < 0 && errno == EAGAIN)
+        {
+            continue; //the output buffer is full, tried again in the next pass
+        }
+        if (written != 1)
+        {
+            dropBoard(i, "write failed");
+            continue;
+        }
+        board->queueHead = (board->queueHead + 1) % queueSize;
+        board->queueCount--;
+        board->busy = true;
+        board->job = job;
+        board->sent = now();
+        board->deadline = board->sent + (job == jobReset ? resetTimeout : commandTimeout);
+        if (job == jobReset && board->firstSent == 0.0)
+        {
+            board->firstSent = board->sent;
+        }
+    }
+}
+
+static void endJob(unsigned index, uint8_t status)
+{
+    fleetBoard *board = &boards[index];
+    jobMetrics *metrics = &board->metrics[board->job];
+    double latency = (now() - board->sent) * 1000.0;
+
+    board->busy = false;
+    metrics->count[status]++;
+    fprintf(logFile, "%.3f b%u %s %s %.1f ms\n", now() - startTime, index, jobNames[board->job], statusNames[status], latency);
+    if (status == statusTimeout || status == statusLost)
+    {
+        return;
+    }
+    if (metrics->latenciesCount == metrics->latenciesSize)
+    {
+        size_t size = metrics->latenciesSize == 0 ? 64 : metrics->latenciesSize * 2;
+        double *latencies = realloc(metrics->latencies, size * sizeof(double));
+
+        if (latencies == NULL)
+        {
+            return;
+        }
+        metrics->latencies = latencies;
+        metrics->latenciesSize = size;
+    }
+    metrics->latencies[metrics->latenciesCount++] = latency;
+    if (board->job == jobReset)
+    {
+        board->lastDone = now();
+    }
+}
+
+static void dropBoard(unsigned index, const char *reason)
+{
+    fleetBoard *board = &boards[index];
+
+    fprintf(logFile, "%.3f b%u given up, %s\n", now() - startTime, index, reason);
+    fprintf(stderr, "board %u (%s) given up, %s\n", index, board->path, reason);
+    if (board->busy == true)
+    {
+        endJob(index, statusLost);
+    }
+    for (; board->queueCount != 0; board->queueCount--)
+    {
+        board->metrics[board->queue[board->queueHead]].count[statusLost]++;
+        board->queueHead = (board->queueHead + 1) % queueSize;
+    }
+    close(board->fd); //closing removes it from the epoll set too
+    board->fd = -1;
+}
+
+static bool readJobs(int poll, bool *inputOpen)
+{
+    static char text[lineSize];
+    static unsigned length = 0;
+    char data[readSize];
+    ssize_t count = read(STDIN_FILENO, data, sizeof(data));
+    bool valid = true;
+
+    if (count < 0 && (errno == EAGAIN || errno == EINTR))
+    {
+        return true;
+    }
+    if (count <= 0)
+    {
+        *inputOpen = false;
+        epoll_ctl(poll, EPOLL_CTL_DEL, STDIN_FILENO, NULL);
+        text[length] = '\0';
+        return length == 0 || addJobs(text);
+    }
+    for (ssize_t i = 0; i < count; i++)
+    {
+        if (data[i] != '\n')
+        {
+            length += length < lineSize - 1;
+            text[length - 1] = data[i];
+            continue;
+        }
+        text[length] = '\0';
+        length = 0;
+        valid = addJobs(text) && valid;
+    }
+    return valid;
+}
+
+static bool addJobs(const char *line)
+{
+    char target[16] = "";
+    char name[16] = "";
+    unsigned long repeats = 1;
+    int fields = sscanf(line, "%15s %15s %lu", target, name, &repeats);
+    unsigned first = 0;
+    unsigned last = boardsCount;
+    uint8_t job = 0;
+
+    if (fields <= 0)
+    {
+        return true; //empty line
+    }
+    if (fields == 1 && strcmp(target, "report") == 0)
+    {
+        report(stdout);
+        return true;
+    }
+    while (job < jobsCount && strcmp(name, jobNames[job]) != 0)
+    {
+        job++;
+    }
+    if (strcmp(target, "all") != 0)
+    {
+        char *end = NULL;
+
+        first = (unsigned)strtoul(target, &end, 10);
+        last = first + 1;
+        if (*end != '\0' || first >= boardsCount)
+        {
+            return false;
+        }
+    }
+    if (fields < 2 || job == jobsCount || repeats == 0)
+    {
+        return false;
+    }
+    for (unsigned i = first; i < last; i++)
+    {
+        fleetBoard *board = &boards[i];
+
+        for (unsigned long j = 0; j < repeats && board->fd >= 0; j++)
+        {
+            if (board->queueCount == queueSize)
+            {
+                fprintf(stderr, "queue of board %u is full\n", i);
+                break;
+            }
+            board->queue[(board->queueHead + board->queueCount++) % queueSize] = job;
+        }
+    }
+    return true;
+}
+
+static double nextDeadline(void)
+{
+    double deadline = 0.0;
+
+    for (unsigned i = 0; i < boardsCount; i++)
+    {
+        if (boards[i].fd >= 0 && boards[i].busy == true && (deadline == 0.0 || boards[i].deadline < deadline))
+        {
+            deadline = boards[i].deadline;
+        }
+    }
+    return deadline;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Latency is from sending the command to the last line of the answer, for a reset it includes the LED display.
+//////////////////////////////////////////////////////////////////////////
+static void report(FILE *file)
+{
+    double resetsPerMinute = 0.0;
+    uint64_t chipsRead = 0;
+    uint64_t chipsNew = 0;
+
+    fprintf(file, "\nboard job         ok  unknown  timeout  lost     min ms     p50 ms     p95 ms     max ms\n");
+    for (unsigned i = 0; i < boardsCount; i++)
+    {
+        fleetBoard *board = &boards[i];
+
+        for (uint8_t job = 0; job < jobsCount; job++)
+        {
+            jobMetrics *metrics = &board->metrics[job];
+            size_t count = metrics->latenciesCount;
+
+            if (count == 0 && metrics->count[statusTimeout] == 0 && metrics->count[statusLost] == 0)
+            {
+                continue;
+            }
+            qsort(metrics->latencies, count, sizeof(double), compareLatencies);
+            fprintf(file, "b%-4u %-7s %7llu %8llu %8llu %5llu", i, jobNames[job], (unsigned long long)metrics->count[statusOk],
+                    (unsigned long long)metrics->count[statusUnknown], (unsigned long long)metrics->count[statusTimeout],
+                    (unsigned long long)metrics->count[statusLost]);
+            if (count != 0)
+            {
+                fprintf(file, " %10.1f %10.1f %10.1f %10.1f", metrics->latencies[0], metrics->latencies[(count - 1) / 2],
+                        metrics->latencies[(count * 95 + 99) / 100 - 1], metrics->latencies[count - 1]);
+            }
+            fprintf(file, "\n");
+        }
+        if (board->metrics[jobReset].count[statusOk] != 0 && board->lastDone > board->firstSent)
+        {
+            double rate = board->metrics[jobReset].count[statusOk] * 60.0 / (board->lastDone - board->firstSent);
+
+            fprintf(file, "b%-4u %.1f resets per minute, %llu bytes received%s\n", i, rate, (unsigned long long)board->bytesIn,
+                    board->fd < 0 ? ", given up" : "");
+            resetsPerMinute += rate;
+        }
+        if (board->chipsRead != 0)
+        {
+            fprintf(file, "b%-4u %llu chips read, %llu new\n", i, (unsigned long long)board->chipsRead, (unsigned long long)board->chipsNew);
+            chipsRead += board->chipsRead;
+            chipsNew += board->chipsNew;
+        }
+    }
+    fprintf(file, "fleet: %.1f resets per minute, %llu chips read, %llu new\n", resetsPerMinute, (unsigned long long)chipsRead,
+            (unsigned long long)chipsNew);
+    fflush(file);
+}
+
+static int compareLatencies(const void *a, const void *b)
+{
+    double first = *(const double *)a;
+    double second = *(const double *)b;
+
+    return (first > second) - (first < second);
+}
+
+static double now(void)
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
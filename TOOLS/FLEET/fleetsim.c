@@ -0,0 +1,220 @@
+/*
+* fleetsim.c
+*
+* Stand-ins of resetter boards for fleet.c. Every board is a pseudo-terminal served by its own process, which loads
+* the soak library (TOOLS/SOAK) and answers the SERIAL_CONTROL commands like a board built with it: a reset runs the next
+* instance of the simulation on the board type of the stand-in and answers after its time to the first result, scaled.
+* The simulated boards have no SRAM_REPORT and CHIP_BACKUP, so they answer "?" to those commands.
+* The paths of the pseudo-terminals are printed one per line, then the stand-ins run until fleetsim is stopped.
+*
+* Build: cc -std=gnu99 -O2 -o fleetsim fleetsim.c -ldl (and soakboard.so as described in TOOLS/SOAK/soak.c)
+* Usage: fleetsim [-n boards] [-b dx4050,sp112,sg2100n] [-x time scale] [-w slow board] [-l library]
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "../SOAK/soak.h"
+
+#define maxStandIns 128
+#define defaultStandIns 4
+#define defaultScale 0.1 //simulated time is shortened ten times
+#define slowFactor 20.0 //the slow board takes this much longer
+#define answerSize 256
+
+static const char *const boardNames[boardsCount] = soakBoardNames;
+static const char *const injectNames[injectsCount] = soakInjectNames;
+static const char *const outcomeNames[outcomesCount] = soakOutcomeNames;
+static pid_t standIns[maxStandIns];
+static unsigned standInsCount = 0;
+
+static void serve(unsigned, unsigned, uint8_t, double, const char *, int); //answers the commands of one stand-in, never returns
+static void answer(int, const char *);
+static void waitMs(double);
+static void stopAll(int);
+
+int main(int argc, char *argv[])
+{
+    unsigned count = defaultStandIns;
+    unsigned slow = maxStandIns; //no slow board
+    unsigned mask = soakAllBoards;
+    double scale = defaultScale;
+    const char *libraryPath = "../SOAK/soakboard.so";
+    uint8_t types[boardsCount];
+    unsigned typesCount = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0 && atoi(argv[i + 1]) <= maxStandIns)
+        {
+            count = atoi(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "-x") == 0 && i + 1 < argc && atof(argv[i + 1]) >= 0.0)
+        {
+            scale = atof(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+        {
+            slow = atoi(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+        {
+            libraryPath = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+        {
+            mask = 0;
+            for (uint8_t board = 0; board < boardsCount; board++)
+            {
+                mask |= strstr(argv[i + 1], boardNames[board]) != NULL ? 1 << board : 0;
+            }
+            i++;
+            if (mask != 0)
+            {
+                continue;
+            }
+        }
+        fprintf(stderr, "usage: fleetsim [-n boards] [-b dx4050,sp112,sg2100n] [-x time scale] [-w slow board] [-l library]\n");
+        return 2;
+    }
+    for (uint8_t board = 0; board < boardsCount; board++)
+    {
+        if (mask & (1 << board))
+        {
+            types[typesCount++] = board;
+        }
+    }
+
+    signal(SIGINT, stopAll);
+    signal(SIGTERM, stopAll);
+    for (unsigned i = 0; i < count; i++)
+    {
+        int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+        if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+        {
+            perror("pseudo-terminal");
+            stopAll(0);
+        }
+        printf("%s\n", ptsname(master));
+        fflush(stdout);
+        pid_t child = fork();
+        if (child == 0)
+        {
+            serve(i, count, types[i % typesCount], i == slow ? scale * slowFactor : scale, libraryPath, master);
+        }
+        close(master);
+        if (child > 0)
+        {
+            standIns[standInsCount++] = child;
+        }
+    }
+    while (wait(NULL) > 0);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The slave side is kept open and raw, so the master never reads an end of file between two users of the port
+//and the bytes of the fleet are not echoed back. Seeds of the stand-ins never meet.
+//////////////////////////////////////////////////////////////////////////
+static void serve(unsigned index, unsigned count, uint8_t board, double scale, const char *libraryPath, int master)
+{
+    void *library = dlopen(libraryPath, RTLD_NOW | RTLD_LOCAL);
+    soakInitFunction init = library != NULL ? (soakInitFunction)dlsym(library, "soakInit") : NULL;
+    soakRunFunction run = library != NULL ? (soakRunFunction)dlsym(library, "soakRun") : NULL;
+    soakScenario scenario = {1 << board, soakAllInjects, false};
+    int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    struct termios settings;
+    uint64_t seed = index;
+    unsigned resets = 0;
+
+    signal(SIGINT, SIG_DFL); //stopped by fleetsim
+    signal(SIGTERM, SIG_DFL);
+    if (init == NULL || run == NULL || init() == false || slave < 0)
+    {
+        fprintf(stderr, "stand-in %u: %s\n", index, library == NULL ? dlerror() : "can't start");
+        _exit(1);
+    }
+    tcgetattr(slave, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(slave, TCSANOW, &settings);
+
+    while (true)
+    {
+        char command = 0;
+        char text[answerSize];
+        soakResult result;
+
+        if (read(master, &command, 1) != 1)
+        {
+            _exit(0);
+        }
+        switch (command)
+        {
+            case '\r':
+            case '\n':
+                break;
+
+            case 'r': //controlReset
+                run(seed, &scenario, false, &result);
+                seed += count;
+                resets++;
+                waitMs(result.latency * scale);
+                snprintf(text, sizeof(text), "sim %s %s %s%s%s\r\ndone\r\n", boardNames[result.board], injectNames[result.inject],
+                         outcomeNames[result.outcome], result.failure != failureNone ? ", " : "", result.text);
+                answer(master, text);
+                break;
+
+            case 's': //controlStats
+                snprintf(text, sizeof(text), "resets %u retries 0\r\nok\r\n", resets);
+                answer(master, text);
+                break;
+
+            default:
+                answer(master, "?\r\n");
+                break;
+        }
+    }
+}
+
+static void answer(int master, const char *text)
+{
+    size_t length = strlen(text);
+
+    if (write(master, text, length) != (ssize_t)length)
+    {
+        _exit(0);
+    }
+}
+
+static void waitMs(double ms)
+{
+    struct timespec time = {(time_t)(ms / 1000.0), (long)((ms - (time_t)(ms / 1000.0) * 1000.0) * 1e6)};
+
+    nanosleep(&time, NULL);
+}
+
+static void stopAll(int signalNumber)
+{
+    for (unsigned i = 0; i < standInsCount; i++)
+    {
+        kill(standIns[i], SIGTERM);
+    }
+    _exit(signalNumber == 0 ? 1 : 0);
+}
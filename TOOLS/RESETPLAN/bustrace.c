@@ -0,0 +1,687 @@
+/*
+* bustrace.c
+*
+* Bus trace model of one reset. The traffic of the resetter is rebuilt from the reset plan and the delays
+* of the firmware: SCL and SDA of the TWI with acknowledge polling for RICOH chips, EN, CLK and DATA
+* of the DX4050 engine for Epson chips. It can be written as a VCD file that GTKWave opens and it is
+* analysed: duration of every transaction, idle gaps, clock periods, setup and hold times against
+* the limits of the chip and how much of the reset the bus really carries data.
+* This is a model, not a capture, real edges are shifted by interrupts and by the TWI hardware.
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "resetplan.h"
+
+#define clockLine 0 //SCL or CLK
+#define dataLine 1 //SDA or DATA
+#define enableLine 2 //EN, only the Epson bus
+#define linesCount 3
+#define maxPeriods 16 //different clock periods counted
+#define resetGap 1000.0 //us between resets of two profiles in the VCD file
+#define textSize 64
+
+//DX4050 protocol, see DX4050_CHIP_RESETTER.c, the resetted chip is black
+#define epsonPacketSize 10
+#define epsonWriteAddr 0x3F
+#define epsonAck 0x0C
+#define epsonChips 4
+
+typedef struct
+{
+    FILE *vcd;
+    char id; //VCD identifier of the clock line, the data and EN lines use the next ones
+    bool i2c;
+    bool print; //print every transaction
+    double now; //us
+    double origin; //us, start of the reset
+    unsigned long long dumped; //ns of the last time stamp written to the VCD file
+    bool level[linesCount];
+    double clockRise, clockFall, dataChange, start, stop; //us, negative if not seen in this transaction
+    bool dataChanged; //data changed since the clock went low
+    double observed[limitsCount]; //shortest time seen, negative if never measured
+    double period[maxPeriods];
+    unsigned long periodCount[maxPeriods];
+    unsigned periodsCount;
+    unsigned long otherPeriods; //periods that didn't fit in the table
+    double transactionStart;
+    double transactionEnd; //negative before the first transaction
+    double transfers; //us of transactions with data
+    double payload; //us of data bytes in these transactions
+    double waits; //us of byte write waits inside transactions
+    double polling; //us of acknowledge polling
+    unsigned polls;
+    double idle; //us between transactions
+    unsigned gaps;
+    double shortestGap, longestGap;
+} busTrace;
+
+static const char *const limitLabels[limitsCount] = {"clock high", "clock low", "data setup", "data hold", "START setup", "START hold", "STOP setup", "bus free"};
+//standard mode I2C, met by the 24C02 compatible EEPROMs of RICOH chips at 100 kHz
+static const double i2cLimits[limitsCount] = {4.0, 4.7, 0.25, 0.0, 4.7, 4.0, 4.0, 4.7};
+static const unsigned char epsonHeader[epsonPacketSize] = {6, 0, 17, 96, 1, 6, 0, 17, 96, 0};
+static const unsigned char epsonTrailer[epsonPacketSize] = {6, 0, 1, 96, 1, 6, 0, 17, 96, 0};
+static const unsigned char epsonReadAddr[epsonChips] = {0x27, 0xA7, 0xE7, 0x67}; //black, magenta, yellow, cyan
+static const char *const epsonColors[epsonChips] = {"black", "magenta", "yellow", "cyan"};
+
+static void wait(busTrace *, double);
+static void setLine(busTrace *, unsigned, bool);
+static void measureClock(busTrace *, bool);
+static void measureData(busTrace *, bool);
+static void observe(busTrace *, unsigned, double);
+static void addPeriod(busTrace *, double);
+static void beginTransaction(busTrace *);
+static void endTransaction(busTrace *, const chipMap *, bool, const char *);
+static void i2cStart(busTrace *, const chipMap *);
+static void i2cStop(busTrace *, const chipMap *);
+static void i2cBit(busTrace *, const chipMap *, bool);
+static void i2cByte(busTrace *, const chipMap *, unsigned char, bool, bool);
+static void i2cRead(busTrace *, const chipMap *, unsigned, unsigned, const char *);
+static void i2cPoll(busTrace *, const chipMap *, double);
+static void traceI2c(busTrace *, const chipMap *, const resetPlan *);
+static void epsonPulse(busTrace *, const chipMap *);
+static void epsonBits(busTrace *, const chipMap *, unsigned char, unsigned, double);
+static void epsonByte(busTrace *, const chipMap *, unsigned char, double, double, bool);
+static void epsonEnd(busTrace *, const chipMap *, const char *);
+static void epsonRead(busTrace *, const chipMap *, unsigned, unsigned, const char *);
+static void traceEpson(busTrace *, const chipMap *, const resetPlan *);
+static void printAnalysis(const busTrace *, const chipMap *);
+
+//////////////////////////////////////////////////////////////////////////
+//Standard mode limits are used for I2C chips when the map doesn't give them, the Epson chip has no known limits.
+//The gap between two transactions is about one bit when not given, the Epson bus needs all delays of the firmware.
+//////////////////////////////////////////////////////////////////////////
+bool defaultTiming(chipMap *map)
+{
+    for (unsigned i = 0; i < limitsCount; i++)
+    {
+        if (map->limit[i] < 0 && map->bus == busI2c)
+        {
+            map->limit[i] = i2cLimits[i];
+        }
+    }
+    if (map->timing[timingGap] < 0)
+    {
+        map->timing[timingGap] = 1000000.0 / map->clock;
+    }
+    for (unsigned i = timingGap + 1; i < timingsCount && map->bus == busEpson; i++)
+    {
+        if (map->timing[i] < 0)
+        {
+            fprintf(stderr, "%s: timing %s is needed for the Epson bus\n", map->file, timingNames[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//All profiles are written to one VCD file one after another, every profile has its own scope.
+//////////////////////////////////////////////////////////////////////////
+bool traceResets(const char *file, bool analyse, const chipMap maps[], const resetPlan plans[], unsigned profilesCount)
+{
+    FILE *vcd = NULL;
+    double now = 0.0;
+    unsigned long long dumped = 0;
+
+    if (file != NULL)
+    {
+        vcd = fopen(file, "w");
+        if (vcd == NULL)
+        {
+            perror(file);
+            return false;
+        }
+        fprintf(vcd, "$version resetplan bus trace model $end\n$timescale 1ns $end\n");
+        for (unsigned i = 0; i < profilesCount; i++)
+        {
+            char id = '!' + i * linesCount;
+            bool i2c = maps[i].bus == busI2c;
+            fprintf(vcd, "$scope module %s $end\n", maps[i].name);
+            fprintf(vcd, "$var wire 1 %c %s $end\n$var wire 1 %c %s $end\n", id, i2c ? "SCL" : "CLK", id + 1, i2c ? "SDA" : "DATA");
+            if (!i2c)
+            {
+                fprintf(vcd, "$var wire 1 %c EN $end\n", id + 2);
+            }
+            fprintf(vcd, "$upscope $end\n");
+        }
+        fprintf(vcd, "$enddefinitions $end\n#0\n$dumpvars\n");
+        for (unsigned i = 0; i < profilesCount; i++) //I2C lines are pulled up, Epson lines are driven low
+        {
+            char id = '!' + i * linesCount;
+            bool i2c = maps[i].bus == busI2c;
+            fprintf(vcd, "%d%c\n%d%c\n", i2c, id, i2c, id + 1);
+            if (!i2c)
+            {
+                fprintf(vcd, "0%c\n", id + 2);
+            }
+        }
+        fprintf(vcd, "$end\n");
+    }
+
+    for (unsigned i = 0; i < profilesCount; i++)
+    {
+        busTrace trace;
+
+        memset(&trace, 0, sizeof(busTrace));
+        trace.vcd = vcd;
+        trace.id = '!' + i * linesCount;
+        trace.i2c = maps[i].bus == busI2c;
+        trace.print = analyse;
+        trace.now = now;
+        trace.origin = now;
+        trace.dumped = dumped;
+        trace.level[clockLine] = trace.i2c;
+        trace.level[dataLine] = trace.i2c;
+        trace.clockRise = trace.clockFall = trace.start = trace.stop = trace.transactionEnd = -1.0;
+        for (unsigned l = 0; l < limitsCount; l++)
+        {
+            trace.observed[l] = -1.0;
+        }
+
+        if (analyse)
+        {
+            printf("%s bus trace of one reset%s:\n", maps[i].name, trace.i2c ? ", every region differs from the reset data" : "");
+        }
+        if (trace.i2c)
+        {
+            traceI2c(&trace, &maps[i], &plans[i]);
+        }
+        else
+        {
+            traceEpson(&trace, &maps[i], &plans[i]);
+        }
+        if (analyse)
+        {
+            printAnalysis(&trace, &maps[i]);
+        }
+        now = trace.now + resetGap;
+        dumped = trace.dumped;
+    }
+
+    if (vcd != NULL)
+    {
+        fprintf(vcd, "#%llu\n", (unsigned long long)(now * 1000.0 + 0.5));
+        if (fclose(vcd) != 0)
+        {
+            perror(file);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void wait(busTrace *trace, double time)
+{
+    trace->now += time;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Changes the level of the line, writes the edge to the VCD file and measures it.
+//////////////////////////////////////////////////////////////////////////
+static void setLine(busTrace *trace, unsigned line, bool level)
+{
+    if (trace->level[line] == level)
+    {
+        return;
+    }
+    trace->level[line] = level;
+    if (trace->vcd != NULL)
+    {
+        unsigned long long time = (unsigned long long)(trace->now * 1000.0 + 0.5);
+        if (time != trace->dumped)
+        {
+            fprintf(trace->vcd, "#%llu\n", time);
+            trace->dumped = time;
+        }
+        fprintf(trace->vcd, "%d%c\n", level, trace->id + line);
+    }
+    if (line == clockLine)
+    {
+        measureClock(trace, level);
+    }
+    else if (line == dataLine)
+    {
+        measureData(trace, level);
+    }
+}
+
+static void measureClock(busTrace *trace, bool level)
+{
+    if (level)
+    {
+        if (trace->clockRise >= 0)
+        {
+            addPeriod(trace, trace->now - trace->clockRise);
+        }
+        if (trace->clockFall >= 0)
+        {
+            observe(trace, limitLow, trace->now - trace->clockFall);
+        }
+        if (trace->dataChanged)
+        {
+            observe(trace, limitSetup, trace->now - trace->dataChange);
+        }
+        trace->clockRise = trace->now;
+        return;
+    }
+    if (trace->clockRise >= 0)
+    {
+        observe(trace, limitHigh, trace->now - trace->clockRise);
+    }
+    if (trace->i2c && trace->start > trace->clockRise) //first fall after START
+    {
+        observe(trace, limitStartHold, trace->now - trace->start);
+    }
+    trace->clockFall = trace->now;
+    trace->dataChanged = false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Data changed while the clock is high is START or STOP on I2C, otherwise the first change after the falling clock gives the hold time.
+//////////////////////////////////////////////////////////////////////////
+static void measureData(busTrace *trace, bool level)
+{
+    if (trace->level[clockLine] && trace->i2c)
+    {
+        if (level) //STOP
+        {
+            observe(trace, limitStopSetup, trace->now - trace->clockRise);
+            trace->stop = trace->now;
+        }
+        else //START
+        {
+            if (trace->clockRise >= 0) //repeated START
+            {
+                observe(trace, limitStartSetup, trace->now - trace->clockRise);
+            }
+            else if (trace->stop >= 0)
+            {
+                observe(trace, limitBusFree, trace->now - trace->stop);
+            }
+            trace->start = trace->now;
+        }
+        return;
+    }
+    if (!trace->dataChanged && trace->clockFall >= 0)
+    {
+        observe(trace, limitHold, trace->now - trace->clockFall);
+    }
+    trace->dataChanged = true;
+    trace->dataChange = trace->now;
+}
+
+static void observe(busTrace *trace, unsigned limit, double time)
+{
+    if (trace->observed[limit] < 0 || time < trace->observed[limit])
+    {
+        trace->observed[limit] = time;
+    }
+}
+
+static void addPeriod(busTrace *trace, double period)
+{
+    period = (unsigned long)(period * 10.0 + 0.5) / 10.0; //0.1us resolution
+
+    for (unsigned i = 0; i < trace->periodsCount; i++)
+    {
+        if (trace->period[i] > period - 0.05 && trace->period[i] < period + 0.05)
+        {
+            trace->periodCount[i]++;
+            return;
+        }
+    }
+    if (trace->periodsCount == maxPeriods)
+    {
+        trace->otherPeriods++;
+        return;
+    }
+    trace->period[trace->periodsCount] = period;
+    trace->periodCount[trace->periodsCount++] = 1;
+}
+
+static void beginTransaction(busTrace *trace)
+{
+    if (trace->transactionEnd >= 0)
+    {
+        double gap = trace->now - trace->transactionEnd;
+        if (trace->gaps == 0 || gap < trace->shortestGap)
+        {
+            trace->shortestGap = gap;
+        }
+        if (gap > trace->longestGap)
+        {
+            trace->longestGap = gap;
+        }
+        trace->idle += gap;
+        trace->gaps++;
+    }
+    trace->transactionStart = trace->now;
+    trace->clockRise = trace->clockFall = -1.0; //periods and times are measured only inside transactions
+    trace->dataChanged = false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Counts the transaction, prints it if it carries data and waits for the software of the resetter before the next one.
+//////////////////////////////////////////////////////////////////////////
+static void endTransaction(busTrace *trace, const chipMap *map, bool poll, const char *text)
+{
+    double duration = trace->now - trace->transactionStart;
+
+    if (poll)
+    {
+        trace->polling += duration;
+        trace->polls++;
+    }
+    else
+    {
+        trace->transfers += duration;
+        if (trace->print)
+        {
+            printf("    %9.3f ms  %-28s %9.1f us\n", (trace->transactionStart - trace->origin) / 1000.0, text, duration);
+        }
+    }
+    trace->transactionEnd = trace->now;
+    wait(trace, map->timing[timingGap]);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//SCL low and high take half of the period, SDA changes in the middle of SCL low.
+//////////////////////////////////////////////////////////////////////////
+static void i2cStart(busTrace *trace, const chipMap *map)
+{
+    double half = 500000.0 / map->clock;
+
+    if (!trace->level[clockLine]) //repeated START, SDA is released while SCL is low
+    {
+        wait(trace, half / 2);
+        setLine(trace, dataLine, true);
+        wait(trace, half / 2);
+        setLine(trace, clockLine, true);
+        wait(trace, half);
+    }
+    setLine(trace, dataLine, false);
+    wait(trace, half);
+    setLine(trace, clockLine, false);
+}
+
+static void i2cStop(busTrace *trace, const chipMap *map)
+{
+    double half = 500000.0 / map->clock;
+
+    wait(trace, half / 2);
+    setLine(trace, dataLine, false);
+    wait(trace, half / 2);
+    setLine(trace, clockLine, true);
+    wait(trace, half);
+    setLine(trace, dataLine, true);
+}
+
+static void i2cBit(busTrace *trace, const chipMap *map, bool bit)
+{
+    double half = 500000.0 / map->clock;
+
+    wait(trace, half / 2);
+    setLine(trace, dataLine, bit);
+    wait(trace, half / 2);
+    setLine(trace, clockLine, true);
+    wait(trace, half);
+    setLine(trace, clockLine, false);
+}
+
+//eight bits MSB first and the acknowledge bit
+static void i2cByte(busTrace *trace, const chipMap *map, unsigned char value, bool ack, bool payload)
+{
+    double start = trace->now;
+
+    for (unsigned char bit = 0x80; bit != 0; bit >>= 1)
+    {
+        i2cBit(trace, map, (value & bit) != 0);
+    }
+    i2cBit(trace, map, !ack);
+    if (payload)
+    {
+        trace->payload += trace->now - start;
+    }
+}
+
+static void i2cRead(busTrace *trace, const chipMap *map, unsigned start, unsigned size, const char *text)
+{
+    char line[textSize];
+
+    beginTransaction(trace);
+    i2cStart(trace, map);
+    i2cByte(trace, map, map->address, true, false);
+    i2cByte(trace, map, start, true, false);
+    i2cStart(trace, map);
+    i2cByte(trace, map, map->address | 1, true, false);
+    for (unsigned i = 0; i < size; i++) //the last byte is not acknowledged
+    {
+        i2cByte(trace, map, map->kind[start + i] == cellSet ? map->value[start + i] : 0xFF, i < size - 1, true);
+    }
+    i2cStop(trace, map);
+    snprintf(line, sizeof(line), "%s 0x%02X %u bytes", text, start, size);
+    endTransaction(trace, map, false, line);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//i2c_start_wait sends START and the address until the chip answers, it doesn't answer until the write cycle is over.
+//////////////////////////////////////////////////////////////////////////
+static void i2cPoll(busTrace *trace, const chipMap *map, double writeEnd)
+{
+    double start = trace->now;
+    unsigned polls = 0;
+
+    while (trace->now - writeEnd < map->writeCycle * 1000.0)
+    {
+        beginTransaction(trace);
+        i2cStart(trace, map);
+        i2cByte(trace, map, map->address, false, false);
+        i2cStop(trace, map);
+        endTransaction(trace, map, true, NULL);
+        polls++;
+    }
+    if (trace->print && polls != 0)
+    {
+        char line[textSize];
+        snprintf(line, sizeof(line), "acknowledge polling, %u polls", polls);
+        printf("    %9.3f ms  %-28s %9.1f us\n", (start - trace->origin) / 1000.0, line, trace->now - start);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The RICOH firmware reads the chip type and all regions, writes the regions that differ and reads them back.
+//////////////////////////////////////////////////////////////////////////
+static void traceI2c(busTrace *trace, const chipMap *map, const resetPlan *plan)
+{
+    double writeEnd = -1.0;
+    char line[textSize];
+
+    i2cRead(trace, map, 0x00, 2, "read type");
+    i2cRead(trace, map, plan->verifyStart, plan->verifySize, "read");
+    for (unsigned w = 0; w < plan->writesCount; w++)
+    {
+        const pageWrite *write = &plan->writes[w];
+        if (writeEnd >= 0)
+        {
+            i2cPoll(trace, map, writeEnd);
+        }
+        beginTransaction(trace);
+        i2cStart(trace, map);
+        i2cByte(trace, map, map->address, true, false);
+        i2cByte(trace, map, write->start, true, false);
+        for (unsigned i = 0; i < write->size; i++)
+        {
+            i2cByte(trace, map, write->data[i], true, true);
+        }
+        i2cStop(trace, map);
+        writeEnd = trace->now;
+        snprintf(line, sizeof(line), "write 0x%02X %u bytes", write->start, write->size);
+        endTransaction(trace, map, false, line);
+    }
+    if (writeEnd >= 0)
+    {
+        i2cPoll(trace, map, writeEnd);
+    }
+    i2cRead(trace, map, plan->verifyStart, plan->verifySize, "verify");
+}
+
+//EN pulse before every transmission
+static void epsonPulse(busTrace *trace, const chipMap *map)
+{
+    setLine(trace, enableLine, true);
+    wait(trace, map->timing[timingEnPulse]);
+    setLine(trace, enableLine, false);
+    wait(trace, map->timing[timingEnLow]);
+    setLine(trace, enableLine, true);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The firmware sets CLK low and changes DATA at once, a few CPU cycles (datadelay) later, then waits the rest of CLK low
+//and keeps CLK high, the last bit leaves CLK high.
+//////////////////////////////////////////////////////////////////////////
+static void epsonBits(busTrace *trace, const chipMap *map, unsigned char value, unsigned bits, double lowTime)
+{
+    for (unsigned char bit = 1 << (bits - 1); bit != 0; bit >>= 1)
+    {
+        setLine(trace, clockLine, false);
+        wait(trace, map->timing[timingDataDelay]);
+        setLine(trace, dataLine, (value & bit) != 0);
+        wait(trace, lowTime - map->timing[timingDataDelay]);
+        setLine(trace, clockLine, true);
+        wait(trace, map->timing[timingClkHigh]);
+    }
+}
+
+//after a written byte the chip needs afterTime with CLK high to store it
+static void epsonByte(busTrace *trace, const chipMap *map, unsigned char value, double lowTime, double afterTime, bool payload)
+{
+    double start = trace->now;
+
+    epsonBits(trace, map, value, 8, lowTime);
+    if (payload)
+    {
+        trace->payload += trace->now - start;
+    }
+    wait(trace, afterTime);
+    trace->waits += afterTime;
+    setLine(trace, clockLine, false);
+    wait(trace, map->timing[timingDataDelay]);
+    setLine(trace, dataLine, false);
+}
+
+static void epsonEnd(busTrace *trace, const chipMap *map, const char *text)
+{
+    setLine(trace, clockLine, false);
+    setLine(trace, enableLine, false);
+    setLine(trace, dataLine, false);
+    endTransaction(trace, map, false, text);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Read address nibble from the resetter, "ACK" nibble and data bytes from the chip.
+//////////////////////////////////////////////////////////////////////////
+static void epsonRead(busTrace *trace, const chipMap *map, unsigned chip, unsigned size, const char *text)
+{
+    beginTransaction(trace);
+    epsonPulse(trace, map);
+    epsonBits(trace, map, epsonReadAddr[chip] >> 4, 4, map->timing[timingClkLow]);
+    epsonBits(trace, map, chip == 0 ? epsonAck : 0x00, 4, map->timing[timingClkLow]);
+    for (unsigned i = 0; i < size; i++)
+    {
+        epsonByte(trace, map, map->kind[i] == cellSet ? map->value[i] : 0x00, map->timing[timingClkLow], 0.0, true);
+    }
+    epsonEnd(trace, map, text);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The DX4050 engine sends the header, probes all colors, reads the black chip, writes and verifies the ink counter
+//and sends the trailer.
+//////////////////////////////////////////////////////////////////////////
+static void traceEpson(busTrace *trace, const chipMap *map, const resetPlan *plan)
+{
+    char line[textSize];
+
+    beginTransaction(trace);
+    epsonPulse(trace, map);
+    for (unsigned i = 0; i < epsonPacketSize; i++)
+    {
+        epsonByte(trace, map, epsonHeader[i], map->timing[timingClkLow], 0.0, false);
+    }
+    epsonEnd(trace, map, "header packet");
+    for (unsigned chip = 0; chip < epsonChips; chip++)
+    {
+        snprintf(line, sizeof(line), "probe %s", epsonColors[chip]);
+        epsonRead(trace, map, chip, 0, line);
+    }
+    snprintf(line, sizeof(line), "read %u bytes", map->size - 1);
+    epsonRead(trace, map, 0, map->size - 1, line);
+    for (unsigned w = 0; w < plan->writesCount; w++)
+    {
+        const pageWrite *write = &plan->writes[w];
+        beginTransaction(trace);
+        epsonPulse(trace, map);
+        epsonByte(trace, map, epsonWriteAddr, map->timing[timingClkWrite], 0.0, false);
+        for (unsigned i = 0; i < write->size; i++)
+        {
+            epsonByte(trace, map, write->data[i], map->timing[timingClkWrite], map->timing[timingByteWrite], true);
+        }
+        snprintf(line, sizeof(line), "write %u bytes", write->size);
+        epsonEnd(trace, map, line);
+    }
+    snprintf(line, sizeof(line), "verify %u bytes", plan->verifySize);
+    epsonRead(trace, map, 0, plan->verifySize, line);
+    beginTransaction(trace);
+    epsonPulse(trace, map);
+    for (unsigned i = 0; i < epsonPacketSize; i++)
+    {
+        epsonByte(trace, map, epsonTrailer[i], map->timing[timingClkLow], 0.0, false);
+    }
+    epsonEnd(trace, map, "trailer packet");
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Splits the reset time into data bytes, protocol overhead (START, STOP, addresses, EN pulses, packets),
+//byte write waits, acknowledge polling and idle time between transactions. Shortest times are compared with the limits of the chip.
+//////////////////////////////////////////////////////////////////////////
+static void printAnalysis(const busTrace *trace, const chipMap *map)
+{
+    double total = trace->transactionEnd - trace->origin;
+    double busy = trace->transfers + trace->polling;
+
+    printf("    reset %.2f ms, bus busy %.2f ms (%.0f%%)\n", total / 1000.0, busy / 1000.0, total > 0 ? busy * 100.0 / total : 0.0);
+    printf("    data bytes %.2f ms, protocol overhead %.2f ms, byte write waits %.2f ms, acknowledge polling %.2f ms in %u polls\n",
+           trace->payload / 1000.0, (trace->transfers - trace->payload - trace->waits) / 1000.0, trace->waits / 1000.0, trace->polling / 1000.0,
+           trace->polls);
+    printf("    idle %.2f ms in %u gaps", trace->idle / 1000.0, trace->gaps);
+    if (trace->gaps != 0)
+    {
+        printf(", shortest %.1f us, longest %.1f us", trace->shortestGap, trace->longestGap);
+    }
+    printf("\n    clock periods:");
+    for (unsigned i = 0; i < trace->periodsCount; i++)
+    {
+        printf(" %.1f us x%lu%s", trace->period[i], trace->periodCount[i], i + 1 < trace->periodsCount ? "," : "");
+    }
+    if (trace->otherPeriods != 0)
+    {
+        printf(", %lu other", trace->otherPeriods);
+    }
+    printf("\n");
+    for (unsigned i = 0; i < limitsCount; i++)
+    {
+        if (trace->observed[i] < 0)
+        {
+            continue;
+        }
+        printf("    %-12s %8.2f us", limitLabels[i], trace->observed[i]);
+        if (map->limit[i] >= 0)
+        {
+            printf(", limit %.2f us, margin %+.2f us%s", map->limit[i], trace->observed[i] - map->limit[i], trace->observed[i] < map->limit[i] ? ", VIOLATED" : "");
+        }
+        printf("\n");
+    }
+}
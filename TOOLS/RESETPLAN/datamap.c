@@ -0,0 +1,314 @@
+/*
+* datamap.c
+*
+* Parser of the data maps (*.map) used by the plan compiler (resetplan.c) and the dump decoder (TOOLS/CHIPDUMP).
+*
+* Data map syntax, one directive per line, # starts a comment:
+*   chip NAME                  name of the profile, used as prefix of generated identifiers
+*   size BYTES                 size of the chip EEPROM
+*   page BYTES                 page size, a page write can't cross the page boundary
+*   clock HZ                   SCL clock used for the time prediction
+*   writecycle MS              write cycle time of the chip
+*   endurance CYCLES           write cycles of one page guaranteed by the chip maker, used for the lifetime
+*   bus i2c|epson              bus of the chip, i2c by default, Epson chips are written by the DX4050 engine
+*   address ADDR               I2C address of the chip, used in the bus trace
+*   timing NAME US             delay of the resetter: gap between transactions and for the Epson bus
+*                              clkhigh, clklow, clkwrite, enpulse, enlow, bytewrite and datadelay
+*   limit NAME US              minimum time of the chip: thigh, tlow, tsu, thd, tsusta, thdsta, tsusto, tbuf,
+*                              I2C chips have standard mode limits by default
+*   set NAME START SIZE V... [last]
+*                              field written by the reset, one value fills the whole field,
+*                              fields marked "last" are written after all others
+*   copy NAME START SIZE [last]
+*                              field read from the chip and written back unchanged, such maps
+*                              can be used for the wear count but not for a header
+*   dontcare START SIZE        bytes that may be overwritten with any value
+*   used START SIZE            bytes changed by the printer, they differ from the reset data at every reset,
+*                              other fields hold the reset data already after the first reset
+*   check NAME START SIZE V... [LABEL]
+*                              bytes the resetter compares to recognise the chip, they are never written,
+*                              lines with the same name are alternatives and the label names the one that matches
+*   serial START SIZE          serial number of the chip, its bytes the reset doesn't write are the identity
+*                              of the chip in the health table of the firmware
+* Bytes that are not listed keep their values and are never written.
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "resetplan.h"
+
+#define lineSize 512
+
+const char *const timingNames[timingsCount] = {"gap", "clkhigh", "clklow", "clkwrite", "enpulse", "enlow", "bytewrite", "datadelay"};
+const char *const limitNames[limitsCount] = {"thigh", "tlow", "tsu", "thd", "tsusta", "thdsta", "tsusto", "tbuf"};
+
+bool parseNumber(const char *text, unsigned long *number)
+{
+    char *end = NULL;
+
+    *number = strtoul(text, &end, 0);
+    return end != text && *end == '\0';
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Reads one data map, prints an error with the file name and line number if something is wrong.
+//////////////////////////////////////////////////////////////////////////
+bool parseMap(const char *file, chipMap *map)
+{
+    FILE *input = fopen(file, "r");
+    char line[lineSize];
+    unsigned lineNumber = 0;
+
+    if (input == NULL)
+    {
+        perror(file);
+        return false;
+    }
+    memset(map, 0, sizeof(chipMap));
+    map->file = file;
+    map->size = 128;
+    map->page = 8;
+    map->clock = 100000;
+    map->writeCycle = 5.0;
+    map->endurance = 1000000;
+    map->address = 0xA0;
+    for (unsigned i = 0; i < timingsCount; i++)
+    {
+        map->timing[i] = -1.0;
+    }
+    for (unsigned i = 0; i < limitsCount; i++)
+    {
+        map->limit[i] = -1.0;
+    }
+
+    while (fgets(line, sizeof(line), input) != NULL)
+    {
+        char *tokens[maxChipSize + 8];
+        unsigned count = 0;
+        unsigned long numbers[3] = {0};
+
+        lineNumber++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        for (char *token = strtok(line, " \t"); token != NULL && count < maxChipSize + 8; token = strtok(NULL, " \t"))
+        {
+            tokens[count++] = token;
+        }
+        if (count == 0)
+        {
+            continue;
+        }
+
+        if (strcmp(tokens[0], "chip") == 0 && count == 2 && strlen(tokens[1]) < nameSize)
+        {
+            strcpy(map->name, tokens[1]);
+            for (const char *c = map->name; *c != '\0'; c++)
+            {
+                if (!isalnum((unsigned char)*c) && *c != '_')
+                {
+                    goto error;
+                }
+            }
+        }
+        else if ((strcmp(tokens[0], "size") == 0 || strcmp(tokens[0], "page") == 0 || strcmp(tokens[0], "clock") == 0
+                  || strcmp(tokens[0], "endurance") == 0) && count == 2)
+        {
+            if (!parseNumber(tokens[1], &numbers[0]) || numbers[0] == 0)
+            {
+                goto error;
+            }
+            if (tokens[0][0] == 's')
+            {
+                if (numbers[0] > maxChipSize)
+                {
+                    goto error;
+                }
+                map->size = numbers[0];
+            }
+            else if (tokens[0][0] == 'p')
+            {
+                map->page = numbers[0];
+            }
+            else if (tokens[0][0] == 'e')
+            {
+                map->endurance = numbers[0];
+            }
+            else
+            {
+                map->clock = numbers[0];
+            }
+        }
+        else if (strcmp(tokens[0], "writecycle") == 0 && count == 2)
+        {
+            map->writeCycle = atof(tokens[1]);
+        }
+        else if (strcmp(tokens[0], "bus") == 0 && count == 2 && (strcmp(tokens[1], "i2c") == 0 || strcmp(tokens[1], "epson") == 0))
+        {
+            map->bus = tokens[1][0] == 'i' ? busI2c : busEpson;
+        }
+        else if (strcmp(tokens[0], "address") == 0 && count == 2)
+        {
+            if (!parseNumber(tokens[1], &numbers[0]) || numbers[0] > 0xFE || (numbers[0] & 1) != 0)
+            {
+                goto error;
+            }
+            map->address = numbers[0];
+        }
+        else if ((strcmp(tokens[0], "timing") == 0 || strcmp(tokens[0], "limit") == 0) && count == 3)
+        {
+            bool timing = tokens[0][0] == 't';
+            const char *const *names = timing ? timingNames : limitNames;
+            unsigned namesCount = timing ? timingsCount : limitsCount;
+            unsigned i = 0;
+
+            while (i < namesCount && strcmp(tokens[1], names[i]) != 0)
+            {
+                i++;
+            }
+            if (i == namesCount || atof(tokens[2]) < 0)
+            {
+                goto error;
+            }
+            (timing ? map->timing : map->limit)[i] = atof(tokens[2]);
+        }
+        else if (strcmp(tokens[0], "set") == 0 && count >= 5)
+        {
+            bool last = strcmp(tokens[count - 1], "last") == 0;
+            unsigned valuesCount = count - 4 - (last ? 1 : 0);
+            chipField *field = &map->fields[map->fieldsCount];
+
+            if (map->fieldsCount == maxFields || strlen(tokens[1]) >= nameSize
+                || !parseNumber(tokens[2], &numbers[0]) || !parseNumber(tokens[3], &numbers[1])
+                || numbers[1] == 0 || numbers[0] + numbers[1] > map->size
+                || (valuesCount != 1 && valuesCount != numbers[1]))
+            {
+                goto error;
+            }
+            for (unsigned i = 0; i < numbers[1]; i++)
+            {
+                unsigned cell = numbers[0] + i;
+                if (map->kind[cell] == cellSet || map->kind[cell] == cellCopy || !parseNumber(tokens[4 + (valuesCount == 1 ? 0 : i)], &numbers[2]) || numbers[2] > 0xFF)
+                {
+                    goto error;
+                }
+                map->kind[cell] = cellSet;
+                map->value[cell] = numbers[2];
+                map->last[cell] = last;
+            }
+            strcpy(field->name, tokens[1]);
+            field->start = numbers[0];
+            field->size = numbers[1];
+            field->last = last;
+            map->fieldsCount++;
+        }
+        else if (strcmp(tokens[0], "copy") == 0 && (count == 4 || (count == 5 && strcmp(tokens[4], "last") == 0)))
+        {
+            chipField *field = &map->fields[map->fieldsCount];
+
+            if (map->fieldsCount == maxFields || strlen(tokens[1]) >= nameSize
+                || !parseNumber(tokens[2], &numbers[0]) || !parseNumber(tokens[3], &numbers[1])
+                || numbers[1] == 0 || numbers[0] + numbers[1] > map->size)
+            {
+                goto error;
+            }
+            for (unsigned i = 0; i < numbers[1]; i++)
+            {
+                if (map->kind[numbers[0] + i] == cellSet || map->kind[numbers[0] + i] == cellCopy)
+                {
+                    goto error;
+                }
+                map->kind[numbers[0] + i] = cellCopy;
+                map->last[numbers[0] + i] = count == 5;
+            }
+            strcpy(field->name, tokens[1]);
+            field->start = numbers[0];
+            field->size = numbers[1];
+            field->last = count == 5;
+            map->fieldsCount++;
+        }
+        else if (strcmp(tokens[0], "used") == 0 && count == 3)
+        {
+            if (!parseNumber(tokens[1], &numbers[0]) || !parseNumber(tokens[2], &numbers[1]) || numbers[0] + numbers[1] > map->size)
+            {
+                goto error;
+            }
+            for (unsigned i = 0; i < numbers[1]; i++)
+            {
+                map->used[numbers[0] + i] = true;
+            }
+        }
+        else if (strcmp(tokens[0], "check") == 0 && count >= 5)
+        {
+            bool labelled = !parseNumber(tokens[count - 1], &numbers[2]);
+            unsigned valuesCount = count - 4 - (labelled ? 1 : 0);
+            chipCheck *check = &map->checks[map->checksCount];
+
+            if (map->checksCount == maxChecks || strlen(tokens[1]) >= nameSize || (labelled && strlen(tokens[count - 1]) >= nameSize)
+                || !parseNumber(tokens[2], &numbers[0]) || !parseNumber(tokens[3], &numbers[1])
+                || numbers[1] == 0 || numbers[1] > maxCheckSize || numbers[0] + numbers[1] > map->size
+                || (valuesCount != 1 && valuesCount != numbers[1]))
+            {
+                goto error;
+            }
+            for (unsigned i = 0; i < numbers[1]; i++)
+            {
+                if (!parseNumber(tokens[4 + (valuesCount == 1 ? 0 : i)], &numbers[2]) || numbers[2] > 0xFF)
+                {
+                    goto error;
+                }
+                check->value[i] = numbers[2];
+            }
+            strcpy(check->name, tokens[1]);
+            strcpy(check->label, labelled ? tokens[count - 1] : "");
+            check->start = numbers[0];
+            check->size = numbers[1];
+            map->checksCount++;
+        }
+        else if (strcmp(tokens[0], "serial") == 0 && count == 3)
+        {
+            if (map->serialSize != 0 || !parseNumber(tokens[1], &numbers[0]) || !parseNumber(tokens[2], &numbers[1])
+                || numbers[1] == 0 || numbers[0] + numbers[1] > map->size)
+            {
+                goto error;
+            }
+            map->serialStart = numbers[0];
+            map->serialSize = numbers[1];
+        }
+        else if (strcmp(tokens[0], "dontcare") == 0 && count == 3)
+        {
+            if (!parseNumber(tokens[1], &numbers[0]) || !parseNumber(tokens[2], &numbers[1]) || numbers[0] + numbers[1] > map->size)
+            {
+                goto error;
+            }
+            for (unsigned i = 0; i < numbers[1]; i++)
+            {
+                if (map->kind[numbers[0] + i] == cellSet || map->kind[numbers[0] + i] == cellCopy)
+                {
+                    goto error;
+                }
+                map->kind[numbers[0] + i] = cellDontCare;
+            }
+        }
+        else
+        {
+            goto error;
+        }
+    }
+    fclose(input);
+    if (map->name[0] == '\0' || map->fieldsCount == 0)
+    {
+        fprintf(stderr, "%s: chip name and at least one field are needed\n", file);
+        return false;
+    }
+    return true;
+
+error:
+    fprintf(stderr, "%s:%u: wrong directive\n", file, lineNumber);
+    fclose(input);
+    return false;
+}
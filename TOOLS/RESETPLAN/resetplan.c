@@ -0,0 +1,552 @@
+/*
+* resetplan.c
+*
+* Reset plan compiler. Reads data maps of RICOH chips (*.map) and generates a header with
+* page writes for the firmware, bytes of a field that fit in one page are written at once
+* and fields in the same page are merged when only don't-care bytes are between them.
+* All written bytes are verified with one sequential read.
+* Predicted bus time of every profile is printed, so plans can be compared before flashing.
+* With -w the wear of the chip EEPROM after the given number of resets is counted for the field by field
+* writes, the plan and the plan with unchanged regions skipped (as the firmware does), so changes
+* of the write strategy can be judged on the cartridge lifetime too.
+* With -v and -t the bus traffic of one reset is modelled (bustrace.c), -v writes it as a VCD file
+* and -t prints every transaction, idle gaps, clock periods and setup and hold margins.
+*
+* Build: cc -std=c99 -O2 -o resetplan resetplan.c datamap.c bustrace.c
+* Usage: resetplan [-o PLAN.h] [-w RESETS] [-v TRACE.vcd] [-t] file.map...
+*
+* The syntax of the data maps is described in datamap.c.
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "resetplan.h"
+
+#define lineSize 512
+#define strategiesCount 3
+#define heatmapWidth 16 //cells in one line of the heatmap
+
+typedef struct
+{
+    unsigned long cell[maxChipSize]; //writes of every byte
+    unsigned long page[maxChipSize]; //write cycles of every page, a page is erased and programmed as a whole
+    unsigned worstCell;
+    unsigned worstPage;
+} wearCount;
+
+static chipMap maps[maxProfiles];
+static resetPlan plans[maxProfiles];
+
+static void planWrites(const chipMap *, resetPlan *);
+static void planFields(const chipMap *, resetPlan *);
+static void addWrite(const chipMap *, resetPlan *, unsigned, unsigned);
+static void computeTime(const chipMap *, resetPlan *);
+static double writeTime(const chipMap *, unsigned);
+static double readTime(const chipMap *, unsigned);
+static void printReport(const chipMap *, const resetPlan *, const resetPlan *);
+static void countWear(const chipMap *, const resetPlan *, bool, unsigned long, wearCount *);
+static void printWear(const chipMap *, const resetPlan *, const resetPlan *, unsigned long);
+static void printHeatmap(const chipMap *, const wearCount *);
+static bool writeHeader(const char *, unsigned);
+static unsigned keptSerial(const chipMap *, const resetPlan *); //returns the number of bytes of the serial number outside of the page writes
+static unsigned short crcUpdate(unsigned short, unsigned char);
+
+int main(int argc, char *argv[])
+{
+    const char *output = NULL;
+    const char *trace = NULL;
+    bool analyse = false;
+    unsigned long resets = 0;
+    unsigned profilesCount = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "-v") == 0 && i + 1 < argc)
+        {
+            trace = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "-t") == 0)
+        {
+            analyse = true;
+            continue;
+        }
+        if (strcmp(argv[i], "-w") == 0 && i + 1 < argc && parseNumber(argv[i + 1], &resets) && resets != 0)
+        {
+            i++;
+            continue;
+        }
+        if (argv[i][0] == '-' || profilesCount == maxProfiles)
+        {
+            fprintf(stderr, "usage: resetplan [-o PLAN.h] [-w RESETS] [-v TRACE.vcd] [-t] file.map...\n");
+            return 2;
+        }
+        if (!parseMap(argv[i], &maps[profilesCount]) || !defaultTiming(&maps[profilesCount]))
+        {
+            return 1;
+        }
+        profilesCount++;
+    }
+    if (profilesCount == 0)
+    {
+        fprintf(stderr, "usage: resetplan [-o PLAN.h] [-w RESETS] [-v TRACE.vcd] [-t] file.map...\n");
+        return 2;
+    }
+
+    for (unsigned i = 0; i < profilesCount; i++)
+    {
+        resetPlan fieldPlan;
+
+        planWrites(&maps[i], &plans[i]);
+        planFields(&maps[i], &fieldPlan);
+        printReport(&maps[i], &plans[i], &fieldPlan);
+        if (resets != 0)
+        {
+            printWear(&maps[i], &plans[i], &fieldPlan, resets);
+        }
+    }
+    if ((trace != NULL || analyse) && !traceResets(trace, analyse, maps, plans, profilesCount))
+    {
+        return 1;
+    }
+    if (output != NULL && !writeHeader(output, profilesCount))
+    {
+        return 1;
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Finds the smallest set of page writes. Every run of written bytes in a page is one write,
+//two runs are merged when only don't-care bytes are between them and it takes less time than
+//a separate write with its own write cycle. Fields marked "last" are planned after all others.
+//////////////////////////////////////////////////////////////////////////
+static void planWrites(const chipMap *map, resetPlan *plan)
+{
+    memset(plan, 0, sizeof(resetPlan));
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (unsigned pageStart = 0; pageStart < map->size; pageStart += map->page)
+        {
+            unsigned pageEnd = pageStart + map->page < map->size ? pageStart + map->page : map->size;
+            int runStart = -1;
+            unsigned runEnd = 0; //one after the last written byte of the run
+
+            for (unsigned cell = pageStart; cell < pageEnd; cell++)
+            {
+                if ((map->kind[cell] != cellSet && map->kind[cell] != cellCopy) || map->last[cell] != (pass == 1))
+                {
+                    continue;
+                }
+                if (runStart >= 0 && cell != runEnd)
+                {
+                    bool onlyDontCare = true;
+                    for (unsigned gap = runEnd; gap < cell; gap++)
+                    {
+                        onlyDontCare = onlyDontCare && map->kind[gap] == cellDontCare;
+                    }
+                    //filling the gap makes the write longer, a separate write adds its own overhead and write cycle
+                    if (!onlyDontCare || writeTime(map, cell - runEnd) - writeTime(map, 0) >= writeTime(map, 0) + map->writeCycle * 1000.0)
+                    {
+                        addWrite(map, plan, runStart, runEnd - runStart);
+                        runStart = -1;
+                    }
+                }
+                if (runStart < 0)
+                {
+                    runStart = cell;
+                }
+                runEnd = cell + 1;
+            }
+            if (runStart >= 0)
+            {
+                addWrite(map, plan, runStart, runEnd - runStart);
+            }
+        }
+    }
+    plan->verifyReads = 1;
+    computeTime(map, plan);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Plan with every field written on its own and read back on its own, as the hand written firmware did.
+//////////////////////////////////////////////////////////////////////////
+static void planFields(const chipMap *map, resetPlan *plan)
+{
+    memset(plan, 0, sizeof(resetPlan));
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (unsigned i = 0; i < map->fieldsCount; i++)
+        {
+            const chipField *field = &map->fields[i];
+            if (field->last != (pass == 1))
+            {
+                continue;
+            }
+            for (unsigned offset = 0; offset < field->size;)
+            {
+                unsigned address = field->start + offset;
+                unsigned size = map->page - address % map->page;
+                if (size > field->size - offset)
+                {
+                    size = field->size - offset;
+                }
+                addWrite(map, plan, address, size);
+                offset += size;
+            }
+        }
+    }
+    plan->verifyReads = map->fieldsCount;
+    computeTime(map, plan);
+}
+
+static void addWrite(const chipMap *map, resetPlan *plan, unsigned start, unsigned size)
+{
+    pageWrite *write = &plan->writes[plan->writesCount++];
+    unsigned char filler = map->value[start];
+
+    write->start = start;
+    write->size = size;
+    for (unsigned i = 0; i < size; i++)
+    {
+        if (map->kind[start + i] == cellSet)
+        {
+            filler = map->value[start + i];
+        }
+        write->data[i] = filler; //don't-care bytes repeat the previous value, so uniform writes stay uniform, copied bytes are not known here
+    }
+    plan->bytes += size;
+}
+
+static void computeTime(const chipMap *map, resetPlan *plan)
+{
+    unsigned first = map->size;
+    unsigned end = 0;
+
+    for (unsigned i = 0; i < plan->writesCount; i++)
+    {
+        const pageWrite *write = &plan->writes[i];
+        plan->busTime += writeTime(map, write->size);
+        plan->cycleTime += map->writeCycle * 1000.0;
+        if (write->start < first)
+        {
+            first = write->start;
+        }
+        if (write->start + write->size > end)
+        {
+            end = write->start + write->size;
+        }
+    }
+    plan->verifyStart = first;
+    plan->verifySize = end - first;
+    if (plan->verifyReads == 1)
+    {
+        plan->busTime += readTime(map, plan->verifySize);
+    }
+    else
+    {
+        for (unsigned i = 0; i < map->fieldsCount; i++)
+        {
+            plan->busTime += readTime(map, map->fields[i].size);
+        }
+    }
+}
+
+//START, address, word address, data bytes and STOP, 9 bits per byte with ACK
+static double writeTime(const chipMap *map, unsigned bytes)
+{
+    return (20.0 + 9.0 * bytes) * 1000000.0 / map->clock;
+}
+
+//START, address, word address, repeated START, address, data bytes and STOP
+static double readTime(const chipMap *map, unsigned bytes)
+{
+    return (29.0 + 9.0 * bytes) * 1000000.0 / map->clock;
+}
+
+static void printReport(const chipMap *map, const resetPlan *plan, const resetPlan *fieldPlan)
+{
+    printf("%s (%s): %u page writes, %u bytes, verify 0x%02X-0x%02X in one read\n", map->name, map->file, plan->writesCount, plan->bytes,
+           plan->verifyStart, plan->verifyStart + plan->verifySize - 1);
+    printf("    predicted %.1f ms at %lu kHz (bus %.1f ms, write cycles %.1f ms)\n", (plan->busTime + plan->cycleTime) / 1000.0, map->clock / 1000,
+           plan->busTime / 1000.0, plan->cycleTime / 1000.0);
+    printf("    field by field: %u page writes, %u reads, %.1f ms\n", fieldPlan->writesCount, fieldPlan->verifyReads,
+           (fieldPlan->busTime + fieldPlan->cycleTime) / 1000.0);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Counts writes of every byte and page after the given number of resets. The first reset finds all written fields
+//different from the reset data, every next one only the bytes changed by the printer. With skipUnchanged
+//a write is left out when none of its bytes differ, as the firmware does after reading the chip.
+//////////////////////////////////////////////////////////////////////////
+static void countWear(const chipMap *map, const resetPlan *plan, bool skipUnchanged, unsigned long resets, wearCount *wear)
+{
+    memset(wear, 0, sizeof(wearCount));
+    for (unsigned long reset = 0; reset < resets; reset++)
+    {
+        for (unsigned w = 0; w < plan->writesCount; w++)
+        {
+            const pageWrite *write = &plan->writes[w];
+            bool changed = false;
+            for (unsigned i = 0; i < write->size; i++)
+            {
+                unsigned cell = write->start + i;
+                changed = changed || (map->kind[cell] == cellSet && (reset == 0 || map->used[cell]));
+            }
+            if (skipUnchanged && !changed)
+            {
+                continue;
+            }
+            for (unsigned i = 0; i < write->size; i++)
+            {
+                wear->cell[write->start + i]++;
+            }
+            wear->page[write->start / map->page]++;
+        }
+    }
+    for (unsigned cell = 0; cell < map->size; cell++)
+    {
+        if (wear->cell[cell] > wear->cell[wear->worstCell])
+        {
+            wear->worstCell = cell;
+        }
+        if (wear->page[cell] > wear->page[wear->worstPage])
+        {
+            wear->worstPage = cell;
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Prints worst byte and page of every write strategy and the heatmap of the strategy used by the firmware.
+//The lifetime is the number of resets after which the most written page reaches the endurance of the chip.
+//////////////////////////////////////////////////////////////////////////
+static void printWear(const chipMap *map, const resetPlan *plan, const resetPlan *fieldPlan, unsigned long resets)
+{
+    static const char *names[strategiesCount] = {"field by field", "plan", "plan, skip unchanged"};
+    const resetPlan *strategyPlans[strategiesCount] = {fieldPlan, plan, plan};
+    wearCount wear[strategiesCount];
+
+    printf("    wear after %lu resets, endurance %lu cycles:\n", resets, map->endurance);
+    for (unsigned i = 0; i < strategiesCount; i++)
+    {
+        countWear(map, strategyPlans[i], i == 2, resets, &wear[i]);
+        unsigned long pageWrites = wear[i].page[wear[i].worstPage];
+        printf("    %-20s worst byte 0x%02X %lu writes, worst page 0x%02X %lu cycles", names[i], wear[i].worstCell, wear[i].cell[wear[i].worstCell],
+               wear[i].worstPage * map->page, pageWrites);
+        if (pageWrites != 0)
+        {
+            printf(", lifetime %.0f resets", (double)map->endurance * resets / pageWrites);
+        }
+        printf("\n");
+    }
+    printf("    writes of every byte with unchanged regions skipped, 0-9 of the worst byte, . never written:\n");
+    printHeatmap(map, &wear[2]);
+}
+
+static void printHeatmap(const chipMap *map, const wearCount *wear)
+{
+    unsigned long worst = wear->cell[wear->worstCell];
+
+    for (unsigned row = 0; row < map->size; row += heatmapWidth)
+    {
+        printf("    0x%02X ", row);
+        for (unsigned cell = row; cell < row + heatmapWidth && cell < map->size; cell++)
+        {
+            putchar(wear->cell[cell] == 0 ? '.' : (char)('0' + (wear->cell[cell] * 9 + worst - 1) / worst));
+        }
+        printf("  pages");
+        for (unsigned page = (row + map->page - 1) / map->page; page * map->page < row + heatmapWidth && page * map->page < map->size; page++)
+        {
+            printf(" %lu", wear->page[page]);
+        }
+        printf("\n");
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Writes the header with regions for the firmware, it must be included after the resetRegion typedef.
+//////////////////////////////////////////////////////////////////////////
+static bool writeHeader(const char *file, unsigned profilesCount)
+{
+    FILE *output = NULL;
+    const char *baseName = strrchr(file, '/') != NULL ? strrchr(file, '/') + 1 : file;
+    char guard[lineSize];
+    unsigned length = 0;
+
+    for (unsigned i = 0; i < profilesCount; i++)
+    {
+        for (unsigned cell = 0; cell < maps[i].size; cell++)
+        {
+            if (maps[i].kind[cell] == cellCopy || maps[i].bus != busI2c)
+            {
+                fprintf(stderr, "%s: only I2C chips without copied fields can be written to a header\n", maps[i].file);
+                return false;
+            }
+        }
+        if (maps[i].serialSize != 0 && keptSerial(&maps[i], &plans[i]) == 0)
+        {
+            fprintf(stderr, "%s: every byte of the serial number is written by the reset\n", maps[i].file);
+            return false;
+        }
+    }
+    output = fopen(file, "w");
+    if (output == NULL)
+    {
+        perror(file);
+        return false;
+    }
+    for (const char *c = baseName; *c != '\0' && length < sizeof(guard) - 1; c++)
+    {
+        guard[length++] = isalnum((unsigned char)*c) ? toupper((unsigned char)*c) : '_';
+    }
+    guard[length] = '\0';
+
+    fprintf(output, "/*\n* %s\n*\n* Generated by TOOLS/RESETPLAN/resetplan from", baseName);
+    for (unsigned i = 0; i < profilesCount; i++)
+    {
+        const char *mapName = strrchr(maps[i].file, '/') != NULL ? strrchr(maps[i].file, '/') + 1 : maps[i].file;
+        fprintf(output, " %s", mapName);
+    }
+    fprintf(output, ", do not edit.\n* Include it after the resetRegion typedef.\n*\n");
+    for (unsigned i = 0; i < profilesCount; i++)
+    {
+        fprintf(output, "* %s: %u page writes, verify 0x%02X-0x%02X in one read, predicted %.1f ms at %lu kHz\n", maps[i].name, plans[i].writesCount,
+                plans[i].verifyStart, plans[i].verifyStart + plans[i].verifySize - 1, (plans[i].busTime + plans[i].cycleTime) / 1000.0,
+                maps[i].clock / 1000);
+    }
+    fprintf(output, "*\n*/\n\n#ifndef %s\n#define %s\n", guard, guard);
+
+    for (unsigned i = 0; i < profilesCount; i++)
+    {
+        const chipMap *map = &maps[i];
+        const resetPlan *plan = &plans[i];
+        unsigned dataOffset[maxWrites];
+        unsigned dataSize = 0;
+        unsigned char order[maxWrites];
+
+        fprintf(output, "\n#define %sRegionsCount %u\n", map->name, plan->writesCount);
+        fprintf(output, "#define %sVerifyStart 0x%02X\n", map->name, plan->verifyStart);
+        fprintf(output, "#define %sVerifySize %u\n", map->name, plan->verifySize);
+        fprintf(output, "#define %sWriteCycle %u //ms, i2c_start_wait() waits for a page write with a margin\n", map->name, (unsigned)(map->writeCycle + 0.999));
+        if (map->serialSize != 0)
+        {
+            fprintf(output, "#define %sSerialStart 0x%02X //serial number, %u of its %u bytes are outside of the regions, they are the identity of the chip\n", map->name,
+                    map->serialStart, keptSerial(map, plan), map->serialSize);
+            fprintf(output, "#define %sSerialSize %u\n", map->name, map->serialSize);
+        }
+
+        for (unsigned w = 0; w < plan->writesCount; w++) //writes with different bytes are kept in the data array, uniform ones use the fill value
+        {
+            const pageWrite *write = &plan->writes[w];
+            bool uniform = true;
+            for (unsigned b = 1; b < write->size; b++)
+            {
+                uniform = uniform && write->data[b] == write->data[0];
+            }
+            dataOffset[w] = uniform ? ~0u : dataSize;
+            dataSize += uniform ? 0 : write->size;
+        }
+        if (dataSize != 0)
+        {
+            unsigned printed = 0;
+            fprintf(output, "static const uint8_t %sData[%u] = {", map->name, dataSize);
+            for (unsigned w = 0; w < plan->writesCount; w++)
+            {
+                for (unsigned b = 0; dataOffset[w] != ~0u && b < plan->writes[w].size; b++)
+                {
+                    fprintf(output, "%s%u", printed == 0 ? "" : printed % 16 == 0 ? ",\n    " : ", ", plan->writes[w].data[b]);
+                    printed++;
+                }
+            }
+            fprintf(output, "};\n");
+        }
+
+        fprintf(output, "//data written to the chip in order of writing, every region is one page write\n");
+        fprintf(output, "static const resetRegion %sRegions[%sRegionsCount] = {\n", map->name, map->name);
+        for (unsigned w = 0; w < plan->writesCount; w++)
+        {
+            const pageWrite *write = &plan->writes[w];
+            fprintf(output, "%s    {0x%02X, %u, ", w == 0 ? "" : ",\n", write->start, write->size);
+            if (dataOffset[w] == ~0u)
+            {
+                fprintf(output, "NULL, 0x%02X}", write->data[0]);
+            }
+            else
+            {
+                fprintf(output, "&%sData[%u], 0}", map->name, dataOffset[w]);
+            }
+        }
+        fprintf(output, "\n};\n");
+
+        for (unsigned w = 0; w < plan->writesCount; w++)
+        {
+            order[w] = w;
+        }
+        for (unsigned a = 1; a < plan->writesCount; a++) //insertion sort by address
+        {
+            for (unsigned b = a; b > 0 && plan->writes[order[b]].start < plan->writes[order[b - 1]].start; b--)
+            {
+                unsigned char swap = order[b];
+                order[b] = order[b - 1];
+                order[b - 1] = swap;
+            }
+        }
+        unsigned short crc = 0xFFFF;
+        for (unsigned w = 0; w < plan->writesCount; w++)
+        {
+            for (unsigned b = 0; b < plan->writes[order[w]].size; b++)
+            {
+                crc = crcUpdate(crc, plan->writes[order[w]].data[b]);
+            }
+        }
+        fprintf(output, "//CRC16 of the data of all regions in order of addresses, the chip is resetted when the verify read gives the same\n");
+        fprintf(output, "#define %sResetCrc 0x%04X\n", map->name, crc);
+        fprintf(output, "//regions in order of addresses, used by the verify read\n");
+        fprintf(output, "static const uint8_t %sVerifyOrder[%sRegionsCount] = {", map->name, map->name);
+        for (unsigned w = 0; w < plan->writesCount; w++)
+        {
+            fprintf(output, "%s%u", w == 0 ? "" : ", ", order[w]);
+        }
+        fprintf(output, "};\n");
+    }
+    fprintf(output, "\n#endif\n");
+    return fclose(output) == 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//CRC16 as _crc_ccitt_update of avr-libc (polynomial 0x8408 reflected, the firmware starts with 0xFFFF).
+//////////////////////////////////////////////////////////////////////////
+static unsigned keptSerial(const chipMap *map, const resetPlan *plan)
+{
+    unsigned kept = 0;
+
+    for (unsigned cell = map->serialStart; cell < map->serialStart + map->serialSize; cell++)
+    {
+        bool written = false;
+        for (unsigned w = 0; w < plan->writesCount; w++)
+        {
+            written = written || (cell >= plan->writes[w].start && cell < plan->writes[w].start + plan->writes[w].size);
+        }
+        kept += written ? 0 : 1;
+    }
+    return kept;
+}
+
+static unsigned short crcUpdate(unsigned short crc, unsigned char data)
+{
+    data ^= crc & 0xFF;
+    data ^= data << 4;
+    return ((unsigned short)data << 8 | crc >> 8) ^ (unsigned char)(data >> 4) ^ ((unsigned short)data << 3);
+}
@@ -0,0 +1,100 @@
+/*
+* resetplan.h
+*
+* Data map and reset plan shared by the map parser (datamap.c), the plan compiler (resetplan.c), the bus trace model (bustrace.c)
+* and the dump decoder (TOOLS/CHIPDUMP).
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef RESETPLAN_H
+#define RESETPLAN_H
+
+#include <stdbool.h>
+
+#define maxChipSize 256
+#define maxFields 64
+#define maxWrites 128
+#define maxProfiles 8
+#define maxChecks 16
+#define maxCheckSize 8
+#define nameSize 32
+
+enum cellKind { cellKeep, cellSet, cellCopy, cellDontCare };
+enum busKind { busI2c, busEpson };
+//delays of the resetter in us, set by "timing" lines of the map
+enum busTiming { timingGap, timingClkHigh, timingClkLow, timingClkWrite, timingEnPulse, timingEnLow, timingByteWrite, timingDataDelay, timingsCount };
+//minimum times of the chip in us, set by "limit" lines of the map
+enum busLimit { limitHigh, limitLow, limitSetup, limitHold, limitStartSetup, limitStartHold, limitStopSetup, limitBusFree, limitsCount };
+
+typedef struct
+{
+    char name[nameSize];
+    unsigned start;
+    unsigned size;
+    bool last; //written after all other fields
+} chipField;
+
+typedef struct
+{
+    char name[nameSize];
+    char label[nameSize]; //empty if the map gives none
+    unsigned start;
+    unsigned size;
+    unsigned char value[maxCheckSize];
+} chipCheck;
+
+typedef struct
+{
+    char name[nameSize];
+    const char *file;
+    unsigned size;
+    unsigned page;
+    unsigned long clock; //Hz
+    double writeCycle; //ms
+    unsigned long endurance; //write cycles of one page
+    unsigned char bus; //busKind
+    unsigned char address; //I2C address of the chip
+    double timing[timingsCount]; //us, negative if not given
+    double limit[limitsCount]; //us, negative if the chip has no limit
+    unsigned char kind[maxChipSize];
+    unsigned char value[maxChipSize];
+    bool last[maxChipSize];
+    bool used[maxChipSize]; //changed by the printer between resets
+    chipField fields[maxFields];
+    unsigned fieldsCount;
+    chipCheck checks[maxChecks]; //bytes compared by the resetter, never written
+    unsigned checksCount;
+    unsigned serialStart; //serial number of the chip
+    unsigned serialSize; //0 if the map has none
+} chipMap;
+
+typedef struct
+{
+    unsigned start;
+    unsigned size;
+    unsigned char data[maxChipSize]; //only size bytes are used
+} pageWrite;
+
+typedef struct
+{
+    pageWrite writes[maxWrites];
+    unsigned writesCount;
+    unsigned bytes; //all written bytes, with don't-care fillers
+    unsigned verifyStart;
+    unsigned verifySize;
+    unsigned verifyReads; //sequential reads needed to verify the plan
+    double busTime; //us, without write cycles
+    double cycleTime; //us, write cycles
+} resetPlan;
+
+extern const char *const timingNames[timingsCount];
+extern const char *const limitNames[limitsCount];
+
+bool parseMap(const char *, chipMap *); //reads one data map, prints the file and line of an error
+bool parseNumber(const char *, unsigned long *); //decimal, hexadecimal with 0x or octal, returns false if the whole text isn't a number
+bool defaultTiming(chipMap *); //sets timing and limits not given in the map, returns false if a delay needed by the bus is missing
+bool traceResets(const char *, bool, const chipMap[], const resetPlan[], unsigned); //writes the VCD file (if not NULL) and prints the analysis of one reset of every profile
+
+#endif
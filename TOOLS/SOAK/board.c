@@ -0,0 +1,1085 @@
+/*
+* board.c
+*
+* One instance of the soak harness: a random board with random chips is powered on, the reset engine of the firmware
+* resets the chips with a fault injected, the chips are put back and a second reset runs without faults.
+* Results are read from the LEDs like a user would read them and checked against the chips:
+* bytes outside of the reset plan must keep their values, a chip shown as resetted must hold the reset data,
+* a chip of a wrong type must not be written and the second reset must recover every chip that is within the timing
+* the firmware expects. The whole RAM of the library is restored from the power-on snapshot before every instance,
+* after a power loss without the EEPROM sections.
+* A replayed instance runs its resets on a painted stack and traces the deepest stack of every reset, like SRAM_REPORT
+* of the firmware does. The bytes are of the host, not of the AVR, and include the tracing of the harness.
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#define _GNU_SOURCE
+#include <link.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include <avr/io.h>
+#include "board.h"
+#include "../../COMMON/FIRMWARE/i2cmaster.h"
+#include "../../EPSON/DX4050/FIRMWARE/DX4050_CHIP_RESETTER.h"
+#include "../../RICOH/SP112/FIRMWARE/SP112_CHIP_RESETTER.h"
+#include "../../RICOH/SG2100N/FIRMWARE/SG2100N_CHIP_RESETTER.h"
+#include "../../COMMON/FIRMWARE/timing.h"
+
+typedef struct
+{
+    uint8_t start; //address of the first byte
+    uint8_t size; //number of bytes
+    const uint8_t *values; //data to write, NULL if all bytes have the fill value
+    uint8_t fill; //value of all bytes of the region without data
+} resetRegion;
+
+#include "../../RICOH/SP112/FIRMWARE/SP112_RESET_PLAN.h"
+#include "../../RICOH/SG2100N/FIRMWARE/SG2100N_RESET_PLAN.h"
+
+#define dx4050ChipSize 32
+#define dx4050ColorsCount 4
+#define dx4050WriteSize 4 //bytes 0-2 are written with their own values, byte 3 is the ink counter
+#define sp112ChipAddress 0xA6
+#define sp112ChipSize 128
+#define sg2100nChipsCount 5
+#define gelChipSize 128
+#define wasteChipSize 256
+#define chipPage 8
+#define longLight 900000.0 //us, shorter lights are blinks
+#define blinkGap 300000.0 //us, longer pause ends a group of blinks
+#define slotSlack 50000.0 //us, a result starts this close to the start of its socket slot, the display ends this close to the end of the reset
+#define socketSlot 1750000.0 //us, dark socket without a chip and the pause after it
+#define socketPause 750000.0
+#define removedPause 250000.0 //us, the SP112 waits after the last of 4 or 5 blinks
+#define timeBetweenResets 2000000.0 //us, the user puts the chips back
+#define paintedStackSize 262144 //bytes of the stack of a replayed reset
+#define stackPaint 0xC5
+
+typedef struct
+{
+    double start;
+    double end;
+    uint8_t value;
+} ledSegment;
+
+simWorld *world = NULL;
+
+static const char *const outcomeNames[outcomesCount] = soakOutcomeNames;
+static const char *const boardNames[boardsCount] = soakBoardNames;
+static const char *const injectNames[injectsCount] = soakInjectNames;
+static const uint8_t dx4050Ids[dx4050ColorsCount] = {0x2, 0xA, 0xE, 0x6}; //black, magenta, yellow, cyan
+static const uint8_t dx4050ColorBytes[dx4050ColorsCount] = {195, 67, 131, 3}; //chip byte 11
+static const uint8_t dx4050ModelBytes[dx4050ColorsCount] = {101, 103, 102, 104}; //chip byte 12
+static const uint8_t dx4050Trailer[3] = {12, 98, 39}; //chip bytes 20-22
+static const uint8_t dx4050Leds[dx4050ColorsCount] = {7, 4, 5, 2};
+static const uint8_t sg2100nAddresses[sg2100nChipsCount] = {0xA2, 0xA4, 0xA6, 0xA0, 0xA8}; //C M Y B W
+static const uint8_t sg2100nLeds[sg2100nChipsCount] = {2, 4, 5, 7, 1};
+static const uint8_t plausibleEeprom[] = {0, 1, 2, 3, 5, 8, 12, 17, 0xA0, 0xA2, 0xA4, 0xA6, 0xA8}; //profiles, addresses and page counts
+static unsigned char *ramStart = NULL; //writable segment of the library without RELRO
+static size_t ramSize = 0;
+static unsigned char *ramImage = NULL; //power-on snapshot of the segment
+static unsigned char *paintedStack = NULL;
+static ucontext_t boardContext;
+static ucontext_t resetContext;
+static int paintedReason; //jumpReason of the reset on the painted stack
+extern unsigned char __start_soakeeprom[];
+extern unsigned char __stop_soakeeprom[];
+
+static int findRam(struct dl_phdr_info *, size_t, void *); //finds the writable segment holding the statics of this library
+static void powerOn(bool); //restores the snapshot, argument is true if the internal EEPROM keeps its content
+static void startBoard(void); //what main() of the board does before it waits for the button
+static void makeScenario(const soakScenario *);
+static simChip *addChip(uint8_t, uint8_t, unsigned, uint8_t);
+static void prepareRegions(simChip *, const resetRegion *, unsigned);
+static void makeDx4050(void);
+static void makeSp112(bool); //argument is true if the board always has the multiplexer
+static void makeSg2100n(void);
+static void fillEeprom(void);
+static void swapTwin(void); //puts a cartridge of the same model with another serial number in place of the worn chip
+static void useChip(void); //the printer changes a byte of the worn chip the reset doesn't write
+static void restoreChips(soakResult *); //the board undoes the first reset from its backups
+static int runRestore(void); //returns the jumpReason that ended the restore
+static int runReset(void); //returns the jumpReason that ended the reset
+static int paintedReset(void); //runReset() on the painted stack, traces the deepest stack
+static void paintedEntry(void);
+static unsigned ledSegments(ledSegment[], double); //lights of the LED log, argument is the end of the log
+static uint8_t readResult(const ledSegment[], unsigned, unsigned *, uint8_t *); //one long light or a group of blinks, returns its soakOutcome or outcomesCount
+static bool decodeLeds(uint8_t[]); //results of all chips, returns false if the LEDs can't be read
+static bool decodeDx4050(const ledSegment[], unsigned, uint8_t[]);
+static bool decodeSp112(const ledSegment[], unsigned, uint8_t[]);
+static bool decodeSg2100n(const ledSegment[], unsigned, uint8_t[]);
+static bool readSockets(const ledSegment[], unsigned, double, uint8_t[]); //reads all multiplexer sockets from the given start of the display
+static int chipWithLed(uint8_t);
+static void checkChips(unsigned, const uint8_t[], soakResult *);
+static void fail(soakResult *, uint8_t, const char *, ...);
+
+bool soakInit(void)
+{
+    world = calloc(1, sizeof(simWorld));
+    if (world == NULL)
+    {
+        return false;
+    }
+    dl_iterate_phdr(findRam, NULL);
+    if (ramStart == NULL || __start_soakeeprom < ramStart || __stop_soakeeprom > ramStart + ramSize)
+    {
+        return false;
+    }
+    ramImage = malloc(ramSize);
+    paintedStack = malloc(paintedStackSize);
+    if (ramImage == NULL || paintedStack == NULL)
+    {
+        return false;
+    }
+    memcpy(ramImage, ramStart, ramSize); //world and ramImage are already set, so they survive the restore
+    return true;
+}
+
+void soakRun(uint64_t seed, const soakScenario *scenario, bool verbose, soakResult *result)
+{
+    powerOn(false);
+    memset(world, 0, sizeof(simWorld));
+    memset(result, 0, sizeof(soakResult));
+    world->random = seed;
+    world->verbose = verbose;
+    makeScenario(scenario);
+    result->board = world->board;
+    result->inject = world->inject;
+    result->outcome = outcomeNone;
+    trace("%s with %u chips, %s on chip %d", boardNames[world->board], world->chipsCount, injectNames[world->inject], world->faultChip);
+    hostPowerOn();
+    startBoard();
+
+    for (unsigned reset = 0; reset < 2 && result->failure == failureNone; reset++)
+    {
+        uint8_t reported[maxChips];
+        int reason = jumpNone;
+
+        world->armed = (reset == 0);
+        world->busBytes = 0;
+        world->ledCount = 0;
+        world->resetStart = world->now;
+        if (reset == 0 && world->eventTime >= 0.0)
+        {
+            world->eventTime += world->resetStart; //drawn from the start of the reset, the board was powered on before it
+        }
+        trace("reset %u", reset + 1);
+        reason = verbose ? paintedReset() : runReset(); //painting costs time, only replays are measured
+        if (reason == jumpHang)
+        {
+            fail(result, failureHang, "reset %u didn't finish in %.0f s", reset + 1, hangLimit / 1000000.0);
+            break;
+        }
+        if (reason == jumpPowerLoss)
+        {
+            chipsPowerLoss();
+            hostPowerLoss();
+            powerOn(true);
+            hostPowerOn();
+            startBoard();
+            memset(reported, outcomeNone, sizeof(reported));
+        }
+        else if (decodeLeds(reported) == false)
+        {
+            fail(result, failureLeds, "LEDs of reset %u can't be read", reset + 1);
+            break;
+        }
+        if (reset == 0)
+        {
+            double first = world->now;
+
+            for (unsigned i = 0; i < world->ledCount; i++)
+            {
+                if (world->ledValue[i] != 0)
+                {
+                    first = world->ledTime[i];
+                    break;
+                }
+            }
+            result->latency = (first - world->resetStart) / 1000.0;
+            if (reason != jumpPowerLoss)
+            {
+                result->outcome = world->faultChip != noChip ? reported[world->faultChip] : outcomeNotFound;
+            }
+        }
+        checkChips(reset, reported, result);
+
+        for (unsigned i = 0; i < world->chipsCount; i++)
+        {
+            world->chips[i].present = true; //chips are put back in their sockets
+            world->chips[i].worn = reported[i] == outcomeWorn;
+        }
+        if (world->inject == injectTwin && world->faultChip != noChip)
+        {
+            swapTwin();
+        }
+        else if (world->inject == injectLongWrite && world->board != boardDx4050 && world->faultChip != noChip && world->chips[world->faultChip].worn)
+        {
+            useChip();
+        }
+        else if (world->inject == injectRestore && reset == 0)
+        {
+            restoreChips(result);
+        }
+        world->armed = false;
+        world->eventTime = -1.0; //a removal or power loss after the end of the first reset doesn't happen
+        world->stuck = false;
+        world->now += timeBetweenResets;
+    }
+    if (verbose)
+    {
+        trace("%s", result->failure == failureNone ? "passed" : result->text);
+    }
+}
+
+void trace(const char *format, ...)
+{
+    va_list arguments;
+
+    if (world->verbose == false)
+    {
+        return;
+    }
+    printf("%12.3f ms  ", world->now / 1000.0);
+    va_start(arguments, format);
+    vprintf(format, arguments);
+    va_end(arguments);
+    putchar('\n');
+}
+
+//////////////////////////////////////////////////////////////////////////
+//SplitMix64, every instance is one stream that starts at its seed, so a replay of the seed runs the same instance.
+//////////////////////////////////////////////////////////////////////////
+uint32_t simRandom(void)
+{
+    uint64_t z = (world->random += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+double simRange(double low, double high)
+{
+    return low + (high - low) * (simRandom() / 4294967296.0);
+}
+
+static int findRam(struct dl_phdr_info *info, size_t size, void *data)
+{
+    uintptr_t marker = (uintptr_t)&ramStart;
+    uintptr_t start = 0;
+    uintptr_t end = 0;
+    uintptr_t relro = 0;
+
+    for (unsigned i = 0; i < info->dlpi_phnum; i++)
+    {
+        const ElfW(Phdr) *header = &info->dlpi_phdr[i];
+        uintptr_t first = info->dlpi_addr + header->p_vaddr;
+
+        if (header->p_type == PT_LOAD && (header->p_flags & PF_W) && marker >= first && marker < first + header->p_memsz)
+        {
+            start = first;
+            end = first + header->p_memsz;
+        }
+        if (header->p_type == PT_GNU_RELRO)
+        {
+            relro = first + header->p_memsz;
+        }
+    }
+    if (start == 0)
+    {
+        return 0; //another object
+    }
+    if (relro > start && relro < end)
+    {
+        start = relro; //read-only after relocation
+    }
+    ramStart = (unsigned char *)start;
+    ramSize = end - start;
+    return 1;
+}
+
+static void powerOn(bool keepEeprom)
+{
+    if (keepEeprom == false)
+    {
+        memcpy(ramStart, ramImage, ramSize);
+        return;
+    }
+
+    size_t before = __start_soakeeprom - ramStart;
+    size_t after = __stop_soakeeprom - ramStart;
+
+    memcpy(ramStart, ramImage, before);
+    memcpy(ramStart + after, ramImage + after, ramSize - after);
+}
+
+static void startBoard(void)
+{
+    timingInit();
+    switch (world->board)
+    {
+        case boardDx4050:
+            DDRB = 0x7;
+            DDRC = 0xE;
+            PORTB = 0xF8;
+            PORTC = 0x30;
+            break;
+
+        case boardSp112:
+            DDRB |= (1 << PINB0);
+            PORTB = 0xFE;
+            PORTC = 0x3F;
+            PORTD = 0xFB;
+            i2c_init();
+            break;
+
+        case boardSg2100n:
+            DDRB = 0x07;
+            PORTB = 0xF8;
+            PORTC = 0x3F;
+            PORTD = 0xFB;
+            i2c_init();
+            break;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Faults on the bus hit a random byte of the reset, the removal and the power loss a random time of it. Estimated counts of bytes
+//and times include the ACK polling of the write cycles, a fault after the end of the reset just isn't injected.
+//////////////////////////////////////////////////////////////////////////
+static void makeScenario(const soakScenario *scenario)
+{
+    uint8_t allowed[boardsCount];
+    uint8_t injects[injectsCount];
+    unsigned allowedCount = 0;
+    unsigned injectsAllowed = 0;
+    unsigned busBytes = 0;
+    double duration = 0.0;
+
+    for (unsigned board = 0; board < boardsCount; board++)
+    {
+        if (scenario->boards & (1 << board))
+        {
+            allowed[allowedCount++] = board;
+        }
+    }
+    for (unsigned inject = 0; inject < injectsCount; inject++)
+    {
+        if (scenario->injects & (1 << inject))
+        {
+            injects[injectsAllowed++] = inject;
+        }
+    }
+    world->board = allowed[simRandom() % allowedCount];
+    world->inject = injects[simRandom() % injectsAllowed];
+    if (world->inject == injectTwin && world->board == boardDx4050)
+    {
+        world->inject = injectNone; //the Epson chips have no serial number, their identity is the ID bytes
+    }
+    if (world->inject == injectRestore && world->board == boardDx4050)
+    {
+        world->inject = injectNone; //the DX4050 board keeps no backups
+    }
+    world->faultBit = simRandom() % 8;
+    world->faultChip = noChip;
+    world->epsonChip = noChip;
+    world->eventTime = -1.0;
+
+    switch (world->board)
+    {
+        case boardDx4050:
+            makeDx4050();
+            busBytes = 20 + 50 * world->chipsCount;
+            duration = 10000.0 + 45000.0 * world->chipsCount;
+            break;
+
+        case boardSp112:
+            makeSp112(scenario->muxAlways);
+            busBytes = 20 + 1000 * world->chipsCount;
+            duration = 20000.0 + 120000.0 * world->chipsCount;
+            break;
+
+        case boardSg2100n:
+            makeSg2100n();
+            busBytes = world->chipsCount > 0 ? world->chips[0].size * 8 : 10;
+            duration = world->chipsCount > 0 ? world->chips[0].size * 1200.0 : 1000.0;
+            break;
+    }
+    if (world->chipsCount > 0)
+    {
+        world->faultChip = simRandom() % world->chipsCount;
+    }
+    world->faultByte = simRandom() % busBytes;
+    if (world->inject == injectLongWrite)
+    {
+        world->longWrite = world->board == boardDx4050 ? simRange(6200.0, 12000.0) : simRange(6000.0, 40000.0);
+    }
+    if (world->inject == injectTwin && world->faultChip != noChip)
+    {
+        simChip *chip = &world->chips[world->faultChip];
+
+        world->longWrite = simRange(12000.0, 40000.0); //over the 10ms a page of healthSlowLoad, with more SP112 sockets it may be less than a pass
+        for (unsigned address = 0; address < chip->size; address++)
+        {
+            if (chip->written[address])
+            {
+                chip->memory[address] = ~chip->expected[address]; //every region is written, so the load is timed
+            }
+        }
+    }
+    if ((world->inject == injectLongWrite || world->inject == injectTwin) && world->faultChip != noChip)
+    {
+        world->chips[world->faultChip].slow = true;
+    }
+    if (world->inject == injectRemoval || world->inject == injectPowerLoss)
+    {
+        world->eventTime = simRange(0.0, duration);
+    }
+    for (unsigned i = 0; i < world->chipsCount; i++)
+    {
+        memcpy(world->chips[i].original, world->chips[i].memory, maxChipSize);
+    }
+    fillEeprom();
+}
+
+static simChip *addChip(uint8_t address, uint8_t channel, unsigned size, uint8_t led)
+{
+    simChip *chip = &world->chips[world->chipsCount++];
+
+    chip->present = true;
+    chip->inSpec = true;
+    chip->address = address;
+    chip->channel = channel;
+    chip->led = led;
+    chip->size = size;
+    chip->page = chipPage;
+    chip->writeCycle = simRange(1500.0, 5000.0);
+    for (unsigned i = 0; i < size; i++)
+    {
+        chip->memory[i] = simRandom();
+    }
+    return chip;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Marks the bytes of the reset plan, every third chip was resetted before and only some bytes were changed by the printer since.
+//////////////////////////////////////////////////////////////////////////
+static void prepareRegions(simChip *chip, const resetRegion *regions, unsigned count)
+{
+    bool resettedBefore = simRandom() % 3 == 0;
+
+    memcpy(chip->expected, chip->memory, maxChipSize);
+    for (unsigned i = 0; i < count; i++)
+    {
+        for (unsigned j = 0; j < regions[i].size; j++)
+        {
+            uint8_t address = regions[i].start + j;
+
+            chip->expected[address] = regions[i].values != NULL ? regions[i].values[j] : regions[i].fill;
+            chip->written[address] = true;
+            if (resettedBefore)
+            {
+                chip->memory[address] = chip->expected[address];
+            }
+        }
+    }
+    for (unsigned changes = resettedBefore ? 1 + simRandom() % 4 : 0; changes > 0; changes--)
+    {
+        const resetRegion *region = &regions[simRandom() % count];
+        chip->memory[region->start + simRandom() % region->size] = simRandom();
+    }
+    if (chip->wrongType)
+    {
+        memset(chip->written, 0, sizeof(chip->written));
+        memcpy(chip->expected, chip->memory, maxChipSize);
+    }
+}
+
+static void makeDx4050(void)
+{
+    unsigned colors = simRandom() % 16; //all combinations of cartridges in the jig, 0 is an empty jig
+
+    for (unsigned color = 0; color < dx4050ColorsCount; color++)
+    {
+        if ((colors & (1 << color)) == 0)
+        {
+            continue;
+        }
+        simChip *chip = addChip(dx4050Ids[color], noChannel, dx4050ChipSize, dx4050Leds[color]);
+        chip->memory[11] = dx4050ColorBytes[color];
+        chip->memory[12] = dx4050ModelBytes[color];
+        memcpy(&chip->memory[20], dx4050Trailer, sizeof(dx4050Trailer));
+        if (simRandom() % 20 == 0)
+        {
+            chip->wrongType = true;
+            chip->memory[11] ^= 1 + simRandom() % 255;
+        }
+        chip->writeCycle = simRange(2500.0, 5800.0);
+        if (simRandom() % 25 == 0)
+        {
+            chip->writeCycle = simRange(6200.0, 8000.0); //slower than the 6ms the firmware waits
+            chip->inSpec = false;
+            chip->slow = true;
+        }
+        memcpy(chip->expected, chip->memory, maxChipSize);
+        if (chip->wrongType == false)
+        {
+            chip->expected[dx4050WriteSize - 1] = 0;
+            memset(chip->written, true, dx4050WriteSize);
+        }
+    }
+}
+
+static void makeSp112(bool muxAlways)
+{
+    world->muxPresent = simRandom() % 2 == 1 || muxAlways; //the random number is taken anyway, so the seeds give the same chips
+
+    for (unsigned socket = 0; socket < (world->muxPresent ? maxChips : 1); socket++)
+    {
+        unsigned kind = simRandom() % 100;
+
+        if (kind >= (world->muxPresent ? 65 : 97))
+        {
+            continue; //empty socket
+        }
+        simChip *chip = addChip(sp112ChipAddress, world->muxPresent ? socket : noChannel, sp112ChipSize, 1);
+        chip->memory[0] = 32;
+        chip->memory[1] = 0;
+        if (kind % 20 == 0)
+        {
+            chip->wrongType = true;
+            chip->memory[0] = 33 + simRandom() % 200;
+        }
+        prepareRegions(chip, sp112Regions, sp112RegionsCount);
+    }
+}
+
+static void makeSg2100n(void)
+{
+    if (simRandom() % 33 == 0)
+    {
+        return; //no chip
+    }
+    unsigned index = simRandom() % sg2100nChipsCount;
+    bool waste = (index == sg2100nChipsCount - 1);
+    simChip *chip = addChip(sg2100nAddresses[index], noChannel, waste ? wasteChipSize : gelChipSize, sg2100nLeds[index]);
+
+    chip->memory[0] = 227;
+    chip->memory[1] = waste ? 1 : 18;
+    if (simRandom() % 20 == 0)
+    {
+        chip->wrongType = true;
+        chip->memory[1] = 2 + simRandom() % 16;
+    }
+    prepareRegions(chip, waste ? wasteRegions : gelRegions, waste ? wasteRegionsCount : gelRegionsCount);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//A new board has erased EEPROM, a used one a journal of some earlier reset, or anything when it was used by other firmware.
+//////////////////////////////////////////////////////////////////////////
+static void fillEeprom(void)
+{
+    unsigned kind = simRandom() % 10;
+
+    for (unsigned char *byte = __start_soakeeprom; byte < __stop_soakeeprom; byte++)
+    {
+        if (kind < 8)
+        {
+            *byte = 0xFF;
+        }
+        else if (kind == 8)
+        {
+            *byte = simRandom();
+        }
+        else
+        {
+            *byte = plausibleEeprom[simRandom() % sizeof(plausibleEeprom)];
+        }
+    }
+}
+
+static int runReset(void)
+{
+    int reason = setjmp(world->jump);
+    uint8_t found = 0;
+
+    if (reason != jumpNone)
+    {
+        return reason;
+    }
+    timingButton(); //what the INT0 interrupt does, it may already take the time of the power loss
+    world->notFound = false;
+    switch (world->board)
+    {
+        case boardDx4050:
+            found = dx4050FindChips();
+            if (found == 0)
+            {
+                world->notFound = true; //main() blinks white once
+                break;
+            }
+            dx4050ResetChips(found);
+            break;
+
+        case boardSp112:
+            sp112ResetChips();
+            break;
+
+        case boardSg2100n:
+            found = sg2100nFindChip();
+            if (found == 0)
+            {
+                world->notFound = true;
+                break;
+            }
+            sg2100nResetChip(found);
+            break;
+    }
+    hostSync();
+    timingReport(); //printed only when the instance is replayed
+    return jumpNone;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The stack grows down, the lowest byte that isn't paint is the deepest the reset got. The jumps of a hang or
+//a power loss stay on the painted stack, setjmp() is called by runReset() on it.
+//////////////////////////////////////////////////////////////////////////
+static int paintedReset(void)
+{
+    size_t unused = 0;
+
+    memset(paintedStack, stackPaint, paintedStackSize);
+    getcontext(&resetContext);
+    resetContext.uc_stack.ss_sp = paintedStack;
+    resetContext.uc_stack.ss_size = paintedStackSize;
+    resetContext.uc_link = &boardContext;
+    makecontext(&resetContext, paintedEntry, 0);
+    swapcontext(&boardContext, &resetContext);
+    while (unused < paintedStackSize && paintedStack[unused] == stackPaint)
+    {
+        unused++;
+    }
+    trace("stack peak %zu bytes of the host", paintedStackSize - unused);
+    return paintedReason;
+}
+
+static void paintedEntry(void)
+{
+    paintedReason = runReset();
+}
+
+static unsigned ledSegments(ledSegment segments[], double end)
+{
+    unsigned count = 0;
+
+    for (unsigned i = 0; i < world->ledCount; i++)
+    {
+        if (count > 0 && segments[count - 1].end < 0.0)
+        {
+            segments[count - 1].end = world->ledTime[i];
+        }
+        if (world->ledValue[i] != 0)
+        {
+            segments[count].start = world->ledTime[i];
+            segments[count].end = -1.0;
+            segments[count].value = world->ledValue[i];
+            count++;
+        }
+    }
+    if (count > 0 && segments[count - 1].end < 0.0)
+    {
+        segments[count - 1].end = end;
+    }
+    return count;
+}
+
+static uint8_t readResult(const ledSegment segments[], unsigned count, unsigned *next, uint8_t *color)
+{
+    unsigned blinks = 0;
+
+    *color = segments[*next].value;
+    if (segments[*next].end - segments[*next].start >= longLight)
+    {
+        (*next)++;
+        return outcomeReset;
+    }
+    while (*next < count && segments[*next].value == *color && segments[*next].end - segments[*next].start < longLight
+        && (blinks == 0 || segments[*next].start - segments[*next - 1].end <= blinkGap))
+    {
+        blinks++;
+        (*next)++;
+    }
+    switch (blinks)
+    {
+        case 1:
+            return outcomeNotFound;
+        case 2:
+            return outcomeWrongData;
+        case 3:
+            return outcomeNotReset;
+        case 4:
+            return outcomeRemoved;
+        case 5:
+            return outcomeWorn;
+    }
+    return outcomesCount;
+}
+
+static bool decodeLeds(uint8_t reported[])
+{
+    ledSegment segments[maxLedChanges];
+    unsigned count = ledSegments(segments, world->now);
+
+    memset(reported, outcomeNone, maxChips);
+    if (world->notFound)
+    {
+        memset(reported, outcomeNotFound, maxChips);
+        return count == 0;
+    }
+    switch (world->board)
+    {
+        case boardDx4050:
+            return decodeDx4050(segments, count, reported);
+
+        case boardSp112:
+            return decodeSp112(segments, count, reported);
+
+        case boardSg2100n:
+            return decodeSg2100n(segments, count, reported);
+    }
+    return false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Chips are shown in order black, magenta, yellow, cyan. Errors of one found chip are white blinks, with more chips they have
+//the color of the chip, so a white error group belongs to the black chip if it has no other result, else to the chip with the fault.
+//////////////////////////////////////////////////////////////////////////
+static bool decodeDx4050(const ledSegment segments[], unsigned count, uint8_t reported[])
+{
+    unsigned next = 0;
+
+    while (next < count)
+    {
+        uint8_t color = 0;
+        uint8_t outcome = readResult(segments, count, &next, &color);
+        int chip = chipWithLed(color);
+
+        if (outcome == outcomesCount || (outcome == outcomeReset && chip == noChip))
+        {
+            return false;
+        }
+        if (outcome != outcomeReset && color == dx4050Leds[0] && (chip == noChip || reported[chip] != outcomeNone))
+        {
+            chip = world->faultChip;
+        }
+        if (chip != noChip)
+        {
+            reported[chip] = outcome;
+        }
+    }
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Without the multiplexer the only socket is shown, no chip as other error. With the multiplexer every socket has a slot
+//that starts when the previous one ends, an empty socket is dark and the last slot ends with the reset. The display starts
+//some empty slots before the first light, only one number of them ends the last slot at the end of the reset.
+//////////////////////////////////////////////////////////////////////////
+static bool decodeSp112(const ledSegment segments[], unsigned count, uint8_t reported[])
+{
+    unsigned next = 0;
+    uint8_t color = 0;
+
+    if (world->muxPresent == false)
+    {
+        if (count == 0)
+        {
+            return false;
+        }
+        uint8_t outcome = readResult(segments, count, &next, &color);
+        if (outcome == outcomesCount || next != count)
+        {
+            return false;
+        }
+        if (world->chipsCount > 0)
+        {
+            reported[0] = outcome;
+        }
+        return true;
+    }
+    for (unsigned darkSlots = 0; darkSlots <= maxChips; darkSlots++) //all sockets are dark when none has a chip
+    {
+        double start = (count > 0 ? segments[0].start : world->now) - darkSlots * socketSlot;
+        if (readSockets(segments, count, start, reported))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool readSockets(const ledSegment segments[], unsigned count, double slot, uint8_t reported[])
+{
+    unsigned next = 0;
+    uint8_t color = 0;
+
+    for (unsigned socket = 0; socket < maxChips; socket++)
+    {
+        uint8_t outcome = outcomeNotFound;
+
+        if (next < count && segments[next].start < slot + slotSlack)
+        {
+            outcome = readResult(segments, count, &next, &color);
+            if (outcome == outcomesCount || outcome == outcomeNotFound)
+            {
+                return false;
+            }
+            slot = segments[next - 1].end + (outcome == outcomeRemoved || outcome == outcomeWorn ? removedPause : 0.0) + socketPause;
+        }
+        else
+        {
+            slot += socketSlot;
+        }
+        for (unsigned i = 0; i < world->chipsCount; i++)
+        {
+            if (world->chips[i].channel == socket)
+            {
+                reported[i] = outcome;
+            }
+        }
+    }
+    return next == count && slot > world->now - slotSlack && slot < world->now + slotSlack;
+}
+
+static bool decodeSg2100n(const ledSegment segments[], unsigned count, uint8_t reported[])
+{
+    unsigned next = 0;
+    uint8_t color = 0;
+
+    if (count == 0 || world->chipsCount == 0)
+    {
+        return false;
+    }
+    uint8_t outcome = readResult(segments, count, &next, &color);
+    if (outcome == outcomesCount || next != count || (outcome == outcomeReset && color != world->chips[0].led))
+    {
+        return false;
+    }
+    reported[0] = outcome;
+    return true;
+}
+
+static int chipWithLed(uint8_t led)
+{
+    for (unsigned i = 0; i < world->chipsCount; i++)
+    {
+        if (world->chips[i].led == led)
+        {
+            return i;
+        }
+    }
+    return noChip;
+}
+
+static void checkChips(unsigned reset, const uint8_t reported[], soakResult *result)
+{
+    for (unsigned i = 0; i < world->chipsCount; i++)
+    {
+        const simChip *chip = &world->chips[i];
+
+        for (unsigned address = 0; address < chip->size; address++)
+        {
+            if (chip->memory[address] != chip->original[address] && (chip->wrongType || chip->written[address] == false))
+            {
+                fail(result, chip->wrongType ? failureWrongType : failureKeep, "reset %u: chip %u byte 0x%02X changed from 0x%02X to 0x%02X",
+                    reset + 1, i, address, chip->original[address], chip->memory[address]);
+                return;
+            }
+        }
+        if (reported[i] == outcomeReset || reported[i] == outcomeWorn) //a worn chip is resetted too
+        {
+            if (chip->wrongType)
+            {
+                fail(result, failureWrongType, "reset %u: chip %u of a wrong type shown as resetted", reset + 1, i);
+                return;
+            }
+            for (unsigned address = 0; address < chip->size; address++)
+            {
+                if (chip->written[address] && chip->memory[address] != chip->expected[address])
+                {
+                    fail(result, failureSilent, "reset %u: chip %u shown as resetted, byte 0x%02X is 0x%02X instead of 0x%02X",
+                        reset + 1, i, address, chip->memory[address], chip->expected[address]);
+                    return;
+                }
+            }
+            if (reported[i] == outcomeWorn && chip->slow == false)
+            {
+                fail(result, failureWorn, "reset %u: chip %u shown as worn, its writes were never slow", reset + 1, i);
+                return;
+            }
+        }
+        else if (reset == 1 && chip->wrongType == false && chip->inSpec)
+        {
+            fail(result, failureRecovery, "reset 2: chip %u shown as %s", i, outcomeNames[reported[i]]);
+            return;
+        }
+        if (reset == 1 && chip->worn && reported[i] == outcomeReset)
+        {
+            fail(result, failureWorn, "reset 2: chip %u shown as worn by reset 1 shown as resetted", i);
+            return;
+        }
+        if (reset == 0 && world->inject == injectTwin && (int)i == world->faultChip && reported[i] == outcomeReset && world->chipsCount == 1)
+        {
+            fail(result, failureWorn, "reset 1: chip %u with slow writes shown as resetted, not as worn", i);
+            return;
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The worn chip is thrown out and a used cartridge of the same model is put in its socket. It differs only in the bytes of
+//the serial number the reset doesn't write, so it must get its own record in the health table and must not be shown as worn.
+//////////////////////////////////////////////////////////////////////////
+static void swapTwin(void)
+{
+    simChip *chip = &world->chips[world->faultChip];
+    unsigned start = sp112SerialStart;
+    unsigned size = sp112SerialSize;
+    bool changed = false;
+
+    if (world->board == boardSg2100n)
+    {
+        start = chip->size == wasteChipSize ? wasteSerialStart : gelSerialStart;
+        size = chip->size == wasteChipSize ? wasteSerialSize : gelSerialSize;
+    }
+    memcpy(chip->memory, chip->original, maxChipSize);
+    for (unsigned address = start; address < start + size; address++)
+    {
+        if (chip->written[address] == false)
+        {
+            chip->memory[address] ^= changed ? simRandom() : 1 + simRandom() % 255; //at least one digit differs
+            chip->expected[address] = chip->memory[address];
+            changed = true;
+        }
+    }
+    memcpy(chip->original, chip->memory, maxChipSize);
+    memset(chip->programming, 0, sizeof(chip->programming));
+    chip->state = stateIdle;
+    chip->busyUntil = 0.0;
+    chip->writeCycle = simRange(1500.0, 5000.0);
+    chip->slow = false;
+    chip->worn = false;
+    trace("chip %d swapped for a twin", world->faultChip);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//The worn chip goes back to the printer, which changes the last byte before the serial number the reset doesn't write, like
+//the refill count of the gel chips. The serial number is the same, so the chip must keep its record and stay worn.
+//////////////////////////////////////////////////////////////////////////
+static void useChip(void)
+{
+    simChip *chip = &world->chips[world->faultChip];
+    unsigned start = sp112SerialStart;
+
+    if (world->board == boardSg2100n)
+    {
+        start = chip->size == wasteChipSize ? wasteSerialStart : gelSerialStart;
+    }
+    for (unsigned address = start - 1; address >= 2; address--) //the type bytes stay
+    {
+        if (chip->written[address] == false)
+        {
+            chip->memory[address]++;
+            chip->original[address] = chip->memory[address];
+            chip->expected[address] = chip->memory[address];
+            trace("chip %d used, byte 0x%02X is 0x%02X", world->faultChip, address, chip->memory[address]);
+            return;
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Only a chip that packs into backupMaxData bytes has a record, so a chip must hold all of its bytes from before the first
+//reset or stay as it was. A mix of both is a restore that wrote the wrong record or stopped in the middle.
+//////////////////////////////////////////////////////////////////////////
+static void restoreChips(soakResult *result)
+{
+    uint8_t before[maxChips][maxChipSize];
+
+    for (unsigned i = 0; i < world->chipsCount; i++)
+    {
+        memcpy(before[i], world->chips[i].memory, maxChipSize);
+    }
+    trace("restore");
+    world->resetStart = world->now;
+    if (runRestore() == jumpHang)
+    {
+        fail(result, failureHang, "restore didn't finish in %.0f s", hangLimit / 1000000.0);
+        return;
+    }
+    for (unsigned i = 0; i < world->chipsCount; i++)
+    {
+        const simChip *chip = &world->chips[i];
+
+        if (memcmp(chip->memory, chip->original, chip->size) == 0 && memcmp(chip->memory, before[i], chip->size) != 0)
+        {
+            trace("chip %u restored", i);
+        }
+        else if (memcmp(chip->memory, before[i], chip->size) != 0)
+        {
+            for (unsigned address = 0; address < chip->size; address++)
+            {
+                if (chip->memory[address] != chip->original[address] && chip->memory[address] != before[i][address])
+                {
+                    fail(result, failureRestore, "restore: chip %u byte 0x%02X is 0x%02X, neither 0x%02X before nor 0x%02X after the reset",
+                        i, address, chip->memory[address], chip->original[address], before[i][address]);
+                    return;
+                }
+            }
+            fail(result, failureRestore, "restore: chip %u holds a mix of its bytes before and after the reset", i);
+            return;
+        }
+    }
+}
+
+static int runRestore(void)
+{
+    int reason = setjmp(world->jump);
+
+    if (reason != jumpNone)
+    {
+        return reason;
+    }
+    switch (world->board)
+    {
+        case boardSp112:
+            sp112RestoreChips();
+            break;
+
+        case boardSg2100n:
+            sg2100nRestoreChip();
+            break;
+    }
+    hostSync();
+    return jumpNone;
+}
+
+static void fail(soakResult *result, uint8_t failure, const char *format, ...)
+{
+    va_list arguments;
+
+    if (result->failure != failureNone)
+    {
+        return;
+    }
+    result->failure = failure;
+    va_start(arguments, format);
+    vsnprintf(result->text, soakTextSize, format, arguments);
+    va_end(arguments);
+}
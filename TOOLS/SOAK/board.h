@@ -0,0 +1,123 @@
+/*
+* board.h
+*
+* Simulated board of the soak harness: scenario and checks (board.c), AVR registers, delays and
+* internal EEPROM (host.c) and the cartridge chips on the I2C and Epson buses (chips.c).
+* State that survives a power loss of the board is kept in the world, everything else is restored
+* from the power-on snapshot of the library.
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "soak.h"
+
+#ifndef F_CPU
+#define F_CPU 8000000UL //must be the same as in the firmware
+#endif
+
+#define maxChips 8 //SP112 multiplexer sockets
+#define maxChipSize 256
+#define maxLedChanges 256
+#define noChannel 0xFF //chip connected without the multiplexer
+#define noChip -1
+#define muxAddress 0xE0
+#define accessCycles 4 //CPU cycles of the code around one register access, advances the time of busy loops
+#define eepromWriteTime 3400.0 //us, byte write of the internal EEPROM
+#define hangLimit 60000000.0 //us of one reset, the longest LED display of 8 sockets takes 22 s
+
+enum jumpReason { jumpNone, jumpHang, jumpPowerLoss };
+enum chipState { stateIdle, stateWordAddress, stateWriting, stateReading };
+
+typedef struct
+{
+    bool present;
+    bool wrongType; //type bytes don't match the firmware, the chip must not be written
+    bool inSpec; //timing of the chip is within what the firmware expects, so a reset without faults must succeed
+    bool slow; //writes of the chip were slow, the health table of the firmware may keep it as worn
+    bool worn; //shown as worn by the first reset, a worn chip stays worn
+    uint8_t address; //I2C address, for Epson chips the first nibble of the read address
+    uint8_t channel; //multiplexer channel or noChannel
+    uint8_t led; //LED color of the chip after a reset
+    unsigned size;
+    unsigned page;
+    double writeCycle; //us, I2C write cycle or programming of one Epson byte
+    uint8_t memory[maxChipSize];
+    uint8_t original[maxChipSize]; //before the first reset
+    uint8_t expected[maxChipSize]; //after a successful reset
+    bool written[maxChipSize]; //byte is written by a reset, the others must keep their values
+    uint8_t state; //chipState of the I2C transaction
+    uint8_t pointer; //address of the next byte
+    uint8_t latch[maxChipSize]; //page buffer of the I2C write
+    bool latched[maxChipSize];
+    bool programming[maxChipSize]; //written in the current write cycle, broken by a power loss before busyUntil
+    double busyUntil; //us
+} simChip;
+
+typedef struct
+{
+    uint64_t random;
+    bool verbose;
+    jmp_buf jump; //back to the board when the firmware hangs or the power is lost
+    double now; //us since the start of the instance
+    double resetStart;
+    double eventTime; //us of the removal or power loss, negative if there is none
+    uint8_t board;
+    uint8_t inject;
+    bool armed; //faults are injected, only in the first reset
+    bool notFound; //the engine found no chip, main() of the board blinks once
+    unsigned faultByte; //bus byte of the NACK, stuck line or bit flip
+    uint8_t faultBit;
+    int faultChip;
+    double longWrite; //us, write cycle of the chip with the long write fault
+    unsigned busBytes; //bytes on the chip bus since the start of the reset
+    bool stuck; //a chip holds the data line low
+    uint8_t stuckClocks; //clocks until an I2C chip releases SDA
+    bool muxPresent;
+    uint8_t muxChannels;
+    bool muxAddressed;
+    simChip chips[maxChips];
+    unsigned chipsCount;
+    unsigned epsonBit; //clock of the Epson frame
+    uint8_t epsonNibble;
+    uint8_t epsonShift;
+    int epsonChip; //addressed chip or noChip
+    bool epsonWrite;
+    uint8_t epsonFault; //fault of the current Epson byte
+    unsigned ledCount;
+    double ledTime[maxLedChanges];
+    uint8_t ledValue[maxLedChanges];
+} simWorld;
+
+extern simWorld *world;
+
+void trace(const char *, ...); //prints a line with the time when the instance is replayed
+uint32_t simRandom(void);
+double simRange(double, double);
+
+void hostPowerOn(void); //sets the registers of a board that was just powered on
+void hostSync(void); //lets the simulation catch up with the firmware
+void hostAdvance(double); //advances the time, fires the removal or power loss, stops a hung firmware
+void hostPowerLoss(void); //a byte being written to the internal EEPROM gets a random value
+
+bool i2cStart(void); //START or repeated START, returns false if the bus is held by a stuck chip
+void i2cStop(void);
+bool i2cAddress(uint8_t); //returns true if the address is acknowledged
+bool i2cWrite(uint8_t); //returns true if the byte is acknowledged
+uint8_t i2cRead(bool); //argument is the acknowledge of the master
+bool i2cHoldsSda(void);
+void i2cClock(void); //SCL pulse of the bus recovery
+void epsonEnable(bool);
+void epsonClock(bool); //rising CLK edge, argument is the level of DATA
+int epsonOutput(void); //level driven by a chip on DATA, -1 if nobody drives it
+bool epsonGrounded(void); //a cartridge connects gndDet to the ground
+void chipsRemove(int); //the cartridge is pulled out, a write cycle in progress leaves random bytes
+void chipsPowerLoss(void);
+
+#endif
@@ -0,0 +1,430 @@
+/*
+* chips.c
+*
+* Cartridge chips of the soak harness. RICOH chips are I2C EEPROMs with a page buffer that is programmed after STOP,
+* during the write cycle they don't acknowledge their address. SP112 sockets can be behind a TCA9548A multiplexer.
+* Epson chips share the EN, CLK and DATA lines, a frame starts with EN going high and its first nibble is the chip ID
+* with the write bit. A read frame goes on with the "ACK" nibble and the data of the chip, a write frame with the 0xF nibble
+* and bytes that are programmed one by one, a CLK edge before the byte is programmed breaks it.
+* Faults of the first reset are injected here, their position is counted in bytes on the bus.
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#include <string.h>
+#include "board.h"
+
+#define epsonAck 0x0C
+
+static const char *const injectNames[injectsCount] = soakInjectNames;
+
+static uint8_t busFault(void); //counts a byte on the bus, returns the fault injected in it
+static bool reachable(const simChip *); //the chip is in its socket and its multiplexer channel is connected
+static void breakWriteCycle(simChip *); //bytes of an unfinished write cycle get random values
+static void addressEpsonChip(void);
+static void programEpsonByte(simChip *, unsigned, uint8_t);
+
+bool i2cStart(void)
+{
+    if (world->stuck)
+    {
+        return false;
+    }
+    for (unsigned i = 0; i < world->chipsCount; i++)
+    {
+        world->chips[i].state = stateIdle; //a started page write is discarded
+        memset(world->chips[i].latched, 0, sizeof(world->chips[i].latched));
+    }
+    world->muxAddressed = false;
+    trace("S");
+    return true;
+}
+
+void i2cStop(void)
+{
+    for (unsigned i = 0; i < world->chipsCount; i++)
+    {
+        simChip *chip = &world->chips[i];
+        unsigned count = 0;
+
+        if (chip->state == stateWriting)
+        {
+            memset(chip->programming, 0, sizeof(chip->programming));
+            for (unsigned address = 0; address < chip->size; address++)
+            {
+                if (chip->latched[address])
+                {
+                    chip->memory[address] = chip->latch[address];
+                    chip->programming[address] = true;
+                    chip->latched[address] = false;
+                    count++;
+                }
+            }
+        }
+        if (count > 0)
+        {
+            bool longWrite = world->armed && (world->inject == injectLongWrite || world->inject == injectTwin) && world->faultChip == (int)i;
+            chip->busyUntil = world->now + (longWrite ? world->longWrite : chip->writeCycle);
+            trace("chip %u programs %u bytes", i, count);
+        }
+        chip->state = stateIdle;
+    }
+    world->muxAddressed = false;
+    trace("P");
+}
+
+bool i2cAddress(uint8_t address)
+{
+    uint8_t fault = busFault();
+    bool ack = false;
+
+    if (world->muxPresent && (address & 0xFE) == muxAddress)
+    {
+        world->muxAddressed = true;
+        ack = true;
+    }
+    for (unsigned i = 0; i < world->chipsCount; i++)
+    {
+        simChip *chip = &world->chips[i];
+
+        chip->state = stateIdle;
+        if (reachable(chip) && chip->address == (address & 0xFE) && world->now >= chip->busyUntil)
+        {
+            chip->state = (address & 1) ? stateReading : stateWordAddress;
+            ack = true;
+        }
+    }
+    if (fault == injectNack)
+    {
+        for (unsigned i = 0; i < world->chipsCount; i++)
+        {
+            world->chips[i].state = stateIdle;
+        }
+        world->muxAddressed = false;
+        ack = false;
+    }
+    trace("%02X %s", address, ack ? "ack" : "nack");
+    return ack;
+}
+
+bool i2cWrite(uint8_t value)
+{
+    uint8_t fault = busFault();
+    bool ack = false;
+
+    if (fault == injectNack)
+    {
+        trace("%02X nack", value);
+        return false; //the byte is lost
+    }
+    if (fault == injectBitFlip)
+    {
+        value ^= (1 << world->faultBit);
+    }
+    if (world->muxAddressed)
+    {
+        world->muxChannels = value;
+        ack = true;
+    }
+    for (unsigned i = 0; i < world->chipsCount; i++)
+    {
+        simChip *chip = &world->chips[i];
+
+        if (chip->state == stateWordAddress)
+        {
+            chip->pointer = value % chip->size;
+            chip->state = stateWriting;
+            ack = true;
+        }
+        else if (chip->state == stateWriting)
+        {
+            unsigned pageStart = chip->pointer - chip->pointer % chip->page;
+
+            chip->latch[chip->pointer] = value;
+            chip->latched[chip->pointer] = true;
+            chip->pointer = pageStart + (chip->pointer + 1) % chip->page; //the address wraps within the page
+            ack = true;
+        }
+    }
+    trace("%02X %s", value, ack ? "ack" : "nack");
+    return ack;
+}
+
+uint8_t i2cRead(bool ack)
+{
+    uint8_t fault = busFault();
+    uint8_t value = 0xFF; //nobody pulls SDA low
+
+    for (unsigned i = 0; i < world->chipsCount; i++)
+    {
+        simChip *chip = &world->chips[i];
+
+        if (chip->state == stateReading && reachable(chip))
+        {
+            value &= chip->memory[chip->pointer];
+            chip->pointer = (chip->pointer + 1) % chip->size;
+            if (ack == false)
+            {
+                chip->state = stateIdle;
+            }
+        }
+    }
+    if (fault == injectNack)
+    {
+        value = 0xFF; //the chip didn't drive the byte
+    }
+    else if (fault == injectBitFlip)
+    {
+        value ^= (1 << world->faultBit);
+    }
+    trace("read %02X", value);
+    return value;
+}
+
+bool i2cHoldsSda(void)
+{
+    return world->stuck && world->board != boardDx4050;
+}
+
+void i2cClock(void)
+{
+    if (i2cHoldsSda() && --world->stuckClocks == 0)
+    {
+        world->stuck = false;
+        trace("SDA released");
+    }
+}
+
+void epsonEnable(bool level)
+{
+    world->epsonBit = 0;
+    world->epsonNibble = 0;
+    world->epsonShift = 0;
+    world->epsonChip = noChip;
+    world->epsonFault = injectNone;
+    if (level == false && world->board == boardDx4050)
+    {
+        world->stuck = false; //the chip lets DATA go at the end of the frame
+    }
+}
+
+void epsonClock(bool data)
+{
+    unsigned bit = world->epsonBit++;
+
+    if (bit % 8 == 0)
+    {
+        world->epsonFault = busFault();
+    }
+    if (bit < 4)
+    {
+        world->epsonNibble = (world->epsonNibble << 1) | data;
+        if (bit == 3)
+        {
+            addressEpsonChip();
+        }
+        return;
+    }
+    if (world->epsonChip == noChip || world->epsonWrite == false)
+    {
+        return;
+    }
+    simChip *chip = &world->chips[world->epsonChip];
+    breakWriteCycle(chip); //the edge came before the previous byte was programmed
+    if (bit < 8)
+    {
+        return; //the 0xF nibble
+    }
+    world->epsonShift = (world->epsonShift << 1) | data;
+    if (bit % 8 == 7)
+    {
+        programEpsonByte(chip, (bit - 8) / 8, world->epsonShift);
+    }
+}
+
+int epsonOutput(void)
+{
+    if (world->board != boardDx4050)
+    {
+        return -1;
+    }
+    if (world->stuck)
+    {
+        return 0;
+    }
+    if (world->epsonChip == noChip || world->epsonWrite || world->epsonBit <= 4 || world->epsonFault == injectNack)
+    {
+        return -1;
+    }
+
+    const simChip *chip = &world->chips[world->epsonChip];
+    unsigned bit = world->epsonBit - 1; //bit of the last rising edge
+    unsigned position = 0;
+    uint8_t value = 0;
+
+    if (chip->present == false)
+    {
+        return -1;
+    }
+    if (bit < 8)
+    {
+        value = epsonAck;
+        position = 7 - bit;
+    }
+    else
+    {
+        unsigned address = (bit - 8) / 8;
+
+        value = address < chip->size ? chip->memory[address] : 0xFF;
+        if (address < chip->size && chip->programming[address] && world->now < chip->busyUntil)
+        {
+            value = simRandom(); //the byte is not programmed yet
+        }
+        position = 7 - (bit - 8) % 8;
+    }
+    if (world->epsonFault == injectBitFlip)
+    {
+        value ^= (1 << world->faultBit);
+    }
+    return (value >> position) & 1;
+}
+
+bool epsonGrounded(void)
+{
+    if (world->board != boardDx4050)
+    {
+        return false;
+    }
+    for (unsigned i = 0; i < world->chipsCount; i++)
+    {
+        if (world->chips[i].present)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void chipsRemove(int index)
+{
+    if (index == noChip)
+    {
+        return;
+    }
+
+    simChip *chip = &world->chips[index];
+
+    breakWriteCycle(chip);
+    chip->present = false;
+    chip->state = stateIdle;
+    if (world->epsonChip == index)
+    {
+        world->epsonChip = noChip;
+    }
+    trace("chip %d removed", index);
+}
+
+void chipsPowerLoss(void)
+{
+    for (unsigned i = 0; i < world->chipsCount; i++)
+    {
+        breakWriteCycle(&world->chips[i]);
+        world->chips[i].state = stateIdle;
+        memset(world->chips[i].latched, 0, sizeof(world->chips[i].latched));
+    }
+    world->stuck = false;
+    world->epsonChip = noChip;
+    world->muxChannels = 0;
+    world->muxAddressed = false;
+}
+
+static uint8_t busFault(void)
+{
+    unsigned byte = world->busBytes++;
+
+    if (world->armed == false || byte != world->faultByte)
+    {
+        return injectNone;
+    }
+    if (world->inject != injectNack && world->inject != injectStuck && world->inject != injectBitFlip)
+    {
+        return injectNone;
+    }
+    if (world->inject == injectStuck)
+    {
+        world->stuck = true;
+        world->stuckClocks = 1 + simRandom() % 9;
+    }
+    trace("%s at bus byte %u", injectNames[world->inject], byte);
+    return world->inject;
+}
+
+static bool reachable(const simChip *chip)
+{
+    return chip->present && (chip->channel == noChannel || (world->muxChannels & (1 << chip->channel)));
+}
+
+static void breakWriteCycle(simChip *chip)
+{
+    if (world->now >= chip->busyUntil)
+    {
+        return;
+    }
+    for (unsigned address = 0; address < chip->size; address++)
+    {
+        if (chip->programming[address])
+        {
+            chip->memory[address] = simRandom();
+        }
+    }
+    chip->busyUntil = 0.0;
+    trace("write cycle of chip %d broken", (int)(chip - world->chips));
+}
+
+static void addressEpsonChip(void)
+{
+    uint8_t nibble = world->epsonNibble & 0x0F;
+
+    world->epsonWrite = nibble & 1;
+    for (unsigned i = 0; i < world->chipsCount; i++)
+    {
+        if (world->chips[i].present && world->chips[i].address == (nibble & 0x0E))
+        {
+            world->epsonChip = i;
+        }
+    }
+    if (world->epsonFault == injectNack)
+    {
+        world->epsonChip = noChip; //the chip missed its ID
+    }
+    if (world->epsonChip != noChip)
+    {
+        trace("chip %d %s", world->epsonChip, world->epsonWrite ? "write" : "read");
+    }
+}
+
+static void programEpsonByte(simChip *chip, unsigned address, uint8_t value)
+{
+    if (chip->present == false || address >= chip->size)
+    {
+        return;
+    }
+    if (world->epsonFault == injectNack)
+    {
+        trace("byte %u ignored", address);
+        return;
+    }
+    if (world->epsonFault == injectBitFlip)
+    {
+        value ^= (1 << world->faultBit);
+    }
+
+    bool longWrite = world->armed && (world->inject == injectLongWrite || world->inject == injectTwin) && world->faultChip == (int)(chip - world->chips);
+
+    memset(chip->programming, 0, sizeof(chip->programming));
+    chip->memory[address] = value;
+    chip->programming[address] = true;
+    chip->busyUntil = world->now + (longWrite ? world->longWrite : chip->writeCycle);
+    trace("chip %d byte %u = %02X", (int)(chip - world->chips), address, value);
+}
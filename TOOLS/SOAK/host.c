@@ -0,0 +1,459 @@
+/*
+* host.c
+*
+* AVR side of the simulated board. The firmware reads and writes registers through soakRegister(), which first
+* advances the time by a few CPU cycles and then looks at what the firmware changed since the previous access:
+* a command written to TWCR is carried out on the I2C bus at once, changes of EN, CLK and DATA go to the Epson chips,
+* SDA and SCL driven by the bus recovery go to the I2C chips and PORTB is recorded as the LED state.
+* A change of gndDet calls the pin change interrupt of the DX4050 engine when it is enabled.
+* Timer1 counts the simulated time and the UART of the timing probes prints to stdout when the instance is replayed.
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <util/delay.h>
+#include <util/twi.h>
+#include "board.h"
+#include "../../COMMON/FIRMWARE/uart.h"
+#include "../../COMMON/FIRMWARE/timing.h"
+
+#define gndDetBit 0
+#define enBit 1
+#define clkBit 2
+#define dataBit 3
+#define sdaBit 4
+#define sclBit 5
+#define ledMask 0x07 //LEDs are on PB0-PB2
+
+enum twiPhase { phaseAddress, phaseWrite, phaseRead };
+
+static uint8_t registers[registersCount];
+static const uint8_t drivenRegisters[] = {regPortB, regDdrB, regPortC, regDdrC, regTwcr}; //registers that change the pins or start the TWI
+static uint8_t drivenValues[sizeof(drivenRegisters)]; //as they were at the last catch up
+static uint8_t twcrLeft = 0; //TWCR as the simulated TWI left it, any other value was written by the firmware
+static bool twiOwned = false; //START was sent and STOP not yet
+static uint8_t twiPhase = phaseAddress;
+static bool syncing = false; //the ISR called during the catch up reads registers without another catch up
+static bool enLine = false;
+static bool clkLine = false;
+static bool sdaLine = true;
+static bool sclLine = true;
+static bool grounded = false; //gndDet level seen by the pin change interrupt
+static uint8_t ledLast = 0;
+static double eepromReady = 0.0; //us, end of the internal EEPROM write
+static uint8_t *eepromPending = NULL;
+
+void PCINT1_vect(void); //gndDet interrupt of the DX4050 engine
+
+static void twiCommand(uint8_t); //carries out the command the firmware wrote to TWCR
+static void twiLeave(uint8_t); //sets TWCR after the command, the TWWC bit marks values left by the TWI
+static double sclPeriod(void);
+static void updateLeds(void);
+static void updateEpson(void);
+static void updateI2cPins(void);
+static void updatePins(void);
+static bool dataLevel(void); //level of the Epson DATA line
+static void eepromWait(void);
+static bool pinsChanged(void); //a catch up is needed, busy loops of the firmware mostly only read registers
+
+volatile uint8_t *soakRegister(unsigned reg)
+{
+    if (syncing == false)
+    {
+        hostAdvance(accessCycles * 1000000.0 / F_CPU);
+        if (pinsChanged())
+        {
+            hostSync();
+        }
+    }
+    return &registers[reg];
+}
+
+uint16_t soakTimer1(void)
+{
+    static const unsigned prescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0}; //external clock is not used
+    unsigned prescaler = prescalers[registers[regTccr1b] & 0x07];
+
+    hostAdvance(timingStampCycles * 1000000.0 / F_CPU); //only the timing probes read TCNT1, the whole stamp is charged here
+    if (prescaler == 0)
+    {
+        return 0;
+    }
+    return (uint16_t)(uint64_t)(world->now * (F_CPU / 1000000.0) / prescaler);
+}
+
+void hostPowerOn(void)
+{
+    registers[regTwsr] = TW_NO_INFO;
+    registers[regPinD] = 0xFF; //the button is not pressed
+    grounded = epsonGrounded();
+    updatePins();
+}
+
+void hostSync(void)
+{
+    syncing = true;
+    if (registers[regTwcr] != twcrLeft)
+    {
+        twiCommand(registers[regTwcr]);
+    }
+    updateLeds();
+    updateEpson();
+    updateI2cPins();
+    updatePins();
+    if (epsonGrounded() != grounded)
+    {
+        grounded = !grounded;
+        registers[regPcifr] |= (1 << PCIF1);
+        if ((registers[regPcicr] & (1 << PCIE1)) && (registers[regPcmsk1] & (1 << PCINT8)))
+        {
+            registers[regPcifr] &= ~(1 << PCIF1);
+            PCINT1_vect();
+        }
+    }
+    for (unsigned i = 0; i < sizeof(drivenRegisters); i++)
+    {
+        drivenValues[i] = registers[drivenRegisters[i]];
+    }
+    syncing = false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Advances the time. The removal or power loss of the scenario happens at its exact time, even in the middle of a long delay,
+//so a write cycle that is in progress then is broken. It can't happen before the first reset is armed, runReset() has no
+//jump buffer before it. A reset that takes longer than hangLimit is stopped.
+//////////////////////////////////////////////////////////////////////////
+void hostAdvance(double time)
+{
+    double end = world->now + time;
+
+    if (world->armed && world->eventTime >= 0.0 && end >= world->eventTime)
+    {
+        world->now = world->eventTime;
+        world->eventTime = -1.0;
+        if (world->inject == injectPowerLoss)
+        {
+            trace("power lost");
+            longjmp(world->jump, jumpPowerLoss);
+        }
+        chipsRemove(world->faultChip);
+    }
+    world->now = end;
+    if (world->now - world->resetStart > hangLimit)
+    {
+        longjmp(world->jump, jumpHang);
+    }
+}
+
+void hostPowerLoss(void)
+{
+    if (eepromPending != NULL && world->now < eepromReady)
+    {
+        *eepromPending = simRandom();
+        trace("EEPROM write broken");
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//A command starts when the firmware writes TWCR with TWINT set. A chip holding SDA low stops the TWI, it never finishes
+//the command then and i2c_wait() has to give up.
+//////////////////////////////////////////////////////////////////////////
+static void twiCommand(uint8_t command)
+{
+    uint8_t status = TW_NO_INFO;
+
+    if ((command & (1 << TWEN)) == 0 || (command & (1 << TWINT)) == 0)
+    {
+        if ((command & (1 << TWEN)) == 0)
+        {
+            twiOwned = false;
+        }
+        twiLeave(command);
+        return;
+    }
+    if (i2cHoldsSda())
+    {
+        //SCL is free, so a STOP is finished by the TWI, but the chip never sees it
+        twiLeave(command & ~((1 << TWINT) | (1 << TWSTO)));
+        return;
+    }
+    if (command & (1 << TWSTA))
+    {
+        hostAdvance(sclPeriod());
+        i2cStart();
+        status = twiOwned ? TW_REP_START : TW_START;
+        twiOwned = true;
+        twiPhase = phaseAddress;
+    }
+    else if (command & (1 << TWSTO))
+    {
+        hostAdvance(sclPeriod());
+        i2cStop();
+        twiOwned = false;
+        twiLeave(command & ~((1 << TWSTO) | (1 << TWINT)));
+        return;
+    }
+    else if (twiPhase == phaseAddress)
+    {
+        bool read = registers[regTwdr] & 1;
+        bool ack = i2cAddress(registers[regTwdr]);
+        hostAdvance(9 * sclPeriod());
+        status = read ? (ack ? TW_MR_SLA_ACK : TW_MR_SLA_NACK) : (ack ? TW_MT_SLA_ACK : TW_MT_SLA_NACK);
+        twiPhase = read ? phaseRead : phaseWrite;
+    }
+    else if (twiPhase == phaseWrite)
+    {
+        bool ack = i2cWrite(registers[regTwdr]);
+        hostAdvance(9 * sclPeriod());
+        status = ack ? TW_MT_DATA_ACK : TW_MT_DATA_NACK;
+    }
+    else
+    {
+        bool ack = command & (1 << TWEA);
+        registers[regTwdr] = i2cRead(ack);
+        hostAdvance(9 * sclPeriod());
+        status = ack ? TW_MR_DATA_ACK : TW_MR_DATA_NACK;
+    }
+    registers[regTwsr] = (registers[regTwsr] & ~TW_STATUS_MASK) | status;
+    twiLeave(command);
+}
+
+static void twiLeave(uint8_t value)
+{
+    registers[regTwcr] = value | (1 << TWWC); //the firmware never writes TWWC, so its next write always differs
+    twcrLeft = registers[regTwcr];
+}
+
+static double sclPeriod(void)
+{
+    return (16.0 + 2.0 * registers[regTwbr] * (1 << (2 * (registers[regTwsr] & 0x03)))) * 1000000.0 / F_CPU;
+}
+
+static void updateLeds(void)
+{
+    uint8_t led = registers[regPortB] & registers[regDdrB] & ledMask;
+
+    if (led == ledLast)
+    {
+        return;
+    }
+    ledLast = led;
+    if (world->ledCount < maxLedChanges)
+    {
+        world->ledTime[world->ledCount] = world->now;
+        world->ledValue[world->ledCount] = led;
+        world->ledCount++;
+    }
+    trace("LED %u", led);
+}
+
+static void updateEpson(void)
+{
+    uint8_t out = registers[regPortC] & registers[regDdrC];
+    bool en = out & (1 << enBit);
+    bool clk = out & (1 << clkBit);
+
+    if (en != enLine)
+    {
+        enLine = en;
+        epsonEnable(en);
+    }
+    if (clk != clkLine)
+    {
+        clkLine = clk;
+        if (clk)
+        {
+            epsonClock(dataLevel());
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//SDA and SCL are driven by the pins only when the TWI is off, as in i2c_recover(). A stuck chip releases SDA after
+//some SCL pulses, it counts them on the falling edge, so the release never looks like a STOP.
+//////////////////////////////////////////////////////////////////////////
+static void updateI2cPins(void)
+{
+    bool scl = true;
+    bool sda = true;
+
+    if ((registers[regTwcr] & (1 << TWEN)) == 0)
+    {
+        scl = !((registers[regDdrC] & (1 << sclBit)) && !(registers[regPortC] & (1 << sclBit)));
+        sda = !((registers[regDdrC] & (1 << sdaBit)) && !(registers[regPortC] & (1 << sdaBit)));
+        if (sclLine && !scl)
+        {
+            i2cClock();
+        }
+        if (sclLine && scl && sda != sdaLine && !i2cHoldsSda())
+        {
+            if (sda)
+            {
+                i2cStop();
+            }
+            else
+            {
+                i2cStart();
+            }
+        }
+    }
+    sclLine = scl;
+    sdaLine = sda && !i2cHoldsSda();
+}
+
+static void updatePins(void)
+{
+    uint8_t pinC = registers[regPortC] & ((1 << enBit) | (1 << clkBit));
+
+    if (!epsonGrounded())
+    {
+        pinC |= (1 << gndDetBit); //pulled up on the board
+    }
+    if (world->board == boardDx4050 && dataLevel())
+    {
+        pinC |= (1 << dataBit);
+    }
+    if (sdaLine)
+    {
+        pinC |= (1 << sdaBit);
+    }
+    if (sclLine)
+    {
+        pinC |= (1 << sclBit);
+    }
+    registers[regPinB] = registers[regPortB];
+    registers[regPinC] = pinC;
+}
+
+//a chip pulling DATA low wins over the master, nobody drives a floating line
+static bool dataLevel(void)
+{
+    int chip = epsonOutput();
+
+    if (registers[regDdrC] & (1 << dataBit))
+    {
+        return chip != 0 && (registers[regPortC] & (1 << dataBit));
+    }
+    return chip >= 0 ? chip : (simRandom() & 1);
+}
+
+void _delay_us(double time)
+{
+    hostSync();
+    hostAdvance(time);
+}
+
+void _delay_ms(double time)
+{
+    hostSync();
+    hostAdvance(time * 1000.0);
+}
+
+static bool pinsChanged(void)
+{
+    for (unsigned i = 0; i < sizeof(drivenRegisters); i++)
+    {
+        if (registers[drivenRegisters[i]] != drivenValues[i])
+        {
+            return true;
+        }
+    }
+    return epsonGrounded() != grounded; //the cartridge was removed
+}
+
+static void eepromWait(void)
+{
+    if (world->now < eepromReady)
+    {
+        hostAdvance(eepromReady - world->now);
+    }
+}
+
+uint8_t eeprom_read_byte(const uint8_t *address)
+{
+    eepromWait();
+    return *address;
+}
+
+void eeprom_write_byte(uint8_t *address, uint8_t value)
+{
+    eepromWait();
+    *address = value;
+    eepromPending = address;
+    eepromReady = world->now + eepromWriteTime;
+}
+
+void eeprom_update_byte(uint8_t *address, uint8_t value)
+{
+    if (eeprom_read_byte(address) != value)
+    {
+        eeprom_write_byte(address, value);
+    }
+}
+
+void eeprom_read_block(void *destination, const void *source, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        ((uint8_t *)destination)[i] = eeprom_read_byte((const uint8_t *)source + i);
+    }
+}
+
+void eeprom_update_block(const void *source, void *destination, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        eeprom_update_byte((uint8_t *)destination + i, ((const uint8_t *)source)[i]);
+    }
+}
+
+int eeprom_is_ready(void)
+{
+    return world->now >= eepromReady;
+}
+
+void eeprom_busy_wait(void)
+{
+    eepromWait();
+}
+
+void uartInit(void)
+{
+}
+
+void uartPutChar(char c)
+{
+    if (world->verbose && c != '\r')
+    {
+        putchar(c);
+    }
+}
+
+void uartPutString(const char *str)
+{
+    while (*str != '\0')
+    {
+        uartPutChar(*str++);
+    }
+}
+
+void uartPutNumber(uint32_t number)
+{
+    char text[12];
+
+    snprintf(text, sizeof(text), "%lu", (unsigned long)number);
+    uartPutString(text);
+}
+
+void uartPutHex(uint8_t value)
+{
+    char text[3];
+
+    snprintf(text, sizeof(text), "%02X", value);
+    uartPutString(text);
+}
@@ -0,0 +1,28 @@
+/*
+* eeprom.h
+*
+* Host version of <avr/eeprom.h> for the soak harness. EEMEM variables are kept in their own section,
+* so the simulated board can erase or fill the whole EEPROM and keep it over a power loss.
+* Writes take as long as on the ATmega328P and a power loss during a write leaves a random byte.
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef SOAK_AVR_EEPROM_H
+#define SOAK_AVR_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EEMEM __attribute__((section("soakeeprom")))
+
+uint8_t eeprom_read_byte(const uint8_t *);
+void eeprom_write_byte(uint8_t *, uint8_t);
+void eeprom_update_byte(uint8_t *, uint8_t);
+void eeprom_read_block(void *, const void *, size_t);
+void eeprom_update_block(const void *, void *, size_t);
+int eeprom_is_ready(void);
+void eeprom_busy_wait(void); //a macro in avr-libc, here it lets the simulated time run to the end of the write
+
+#endif
@@ -0,0 +1,18 @@
+/*
+* interrupt.h
+*
+* Host version of <avr/interrupt.h> for the soak harness. An ISR is a plain function,
+* the simulation calls it when the interrupt would fire (host.c).
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef SOAK_AVR_INTERRUPT_H
+#define SOAK_AVR_INTERRUPT_H
+
+#define ISR(vector) void vector(void)
+#define sei() ((void)0)
+#define cli() ((void)0)
+
+#endif
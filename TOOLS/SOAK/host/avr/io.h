@@ -0,0 +1,78 @@
+/*
+* io.h
+*
+* Host version of <avr/io.h> for the soak harness, only registers used by the reset engines are defined.
+* Every register is a byte of the simulated board, an access first lets the simulation catch up
+* with what the firmware wrote since the previous access (host.c).
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef SOAK_AVR_IO_H
+#define SOAK_AVR_IO_H
+
+#include <stdint.h>
+#include <avr/sfr_defs.h>
+
+enum soakRegister { regPinB, regDdrB, regPortB, regPinC, regDdrC, regPortC, regPinD, regDdrD, regPortD,
+                    regEicra, regEimsk, regEifr, regPcicr, regPcifr, regPcmsk1, regTwbr, regTwsr, regTwdr, regTwcr, regTwar, regTccr1a, regTccr1b, registersCount };
+
+volatile uint8_t *soakRegister(unsigned); //returns the register after the simulation caught up with the firmware
+uint16_t soakTimer1(void); //counter of Timer1 computed from the simulated time, it can only be read
+
+#define PINB (*soakRegister(regPinB))
+#define DDRB (*soakRegister(regDdrB))
+#define PORTB (*soakRegister(regPortB))
+#define PINC (*soakRegister(regPinC))
+#define DDRC (*soakRegister(regDdrC))
+#define PORTC (*soakRegister(regPortC))
+#define PIND (*soakRegister(regPinD))
+#define DDRD (*soakRegister(regDdrD))
+#define PORTD (*soakRegister(regPortD))
+#define EICRA (*soakRegister(regEicra))
+#define EIMSK (*soakRegister(regEimsk))
+#define EIFR (*soakRegister(regEifr))
+#define PCICR (*soakRegister(regPcicr))
+#define PCIFR (*soakRegister(regPcifr))
+#define PCMSK1 (*soakRegister(regPcmsk1))
+#define TWBR (*soakRegister(regTwbr))
+#define TWSR (*soakRegister(regTwsr))
+#define TWDR (*soakRegister(regTwdr))
+#define TWCR (*soakRegister(regTwcr))
+#define TWAR (*soakRegister(regTwar))
+#define TCCR1A (*soakRegister(regTccr1a))
+#define TCCR1B (*soakRegister(regTccr1b))
+#define TCNT1 (soakTimer1())
+
+#define PINB0 0
+#define PINC0 0
+#define PINC1 1
+#define PINC2 2
+#define PINC3 3
+#define PIND2 2
+#define PC4 4
+#define PC5 5
+
+#define ISC01 1
+#define INT0 0
+#define INTF0 0
+#define PCIE1 1
+#define PCIF1 1
+#define PCINT8 0
+
+#define TWINT 7
+#define TWEA 6
+#define TWSTA 5
+#define TWSTO 4
+#define TWWC 3
+#define TWEN 2
+#define TWPS1 1
+#define TWPS0 0
+#define TWIE 0
+
+#define CS12 2
+#define CS11 1
+#define CS10 0
+
+#endif
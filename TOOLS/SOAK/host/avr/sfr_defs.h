@@ -0,0 +1,17 @@
+/*
+* sfr_defs.h
+*
+* Host version of <avr/sfr_defs.h> for the soak harness.
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef SOAK_AVR_SFR_DEFS_H
+#define SOAK_AVR_SFR_DEFS_H
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+
+#endif
@@ -0,0 +1,22 @@
+/*
+* crc16.h
+*
+* Host version of <util/crc16.h> for the soak harness, the same algorithm as the C code given in the avr-libc manual.
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef SOAK_UTIL_CRC16_H
+#define SOAK_UTIL_CRC16_H
+
+#include <stdint.h>
+
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+    data ^= (uint8_t)crc;
+    data ^= data << 4;
+    return ((uint16_t)data << 8 | crc >> 8) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3);
+}
+
+#endif
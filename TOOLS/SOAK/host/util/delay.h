@@ -0,0 +1,16 @@
+/*
+* delay.h
+*
+* Host version of <util/delay.h> for the soak harness, delays advance the simulated time (host.c).
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef SOAK_UTIL_DELAY_H
+#define SOAK_UTIL_DELAY_H
+
+void _delay_us(double);
+void _delay_ms(double);
+
+#endif
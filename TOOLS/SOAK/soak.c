@@ -0,0 +1,507 @@
+/*
+* soak.c
+*
+* Soak harness of the reset engines. Every seed is one instance of a simulated board with random chips, timing and one
+* injected fault (board.c), instances run on all cores. The firmware keeps its state in static variables, so every worker
+* loads its own copy of soakboard.so and the copy restores its RAM before every instance. Workers take chunks of seeds
+* from their own range and steal half of the largest range that is left when they run out.
+* The report shows resets per second, failures with their seeds, the worst latency of the first result on the LEDs
+* and a histogram of the results of every fault. A failing seed is replayed with -r, which prints its bus traffic.
+*
+* Build:
+*   cc -std=gnu99 -O2 -fPIC -shared -Wl,-Bsymbolic -DUNIVERSAL_RESETTER -DTIMING_PROBE -DCHIP_HEALTH -DCHIP_BACKUP -Ihost -o soakboard.so board.c host.c chips.c \
+*       ../../EPSON/DX4050/FIRMWARE/DX4050_CHIP_RESETTER.c ../../RICOH/SP112/FIRMWARE/SP112_CHIP_RESETTER.c \
+*       ../../RICOH/SG2100N/FIRMWARE/SG2100N_CHIP_RESETTER.c ../../COMMON/FIRMWARE/i2cmaster.c ../../COMMON/FIRMWARE/timing.c \
+*       ../../COMMON/FIRMWARE/health.c ../../COMMON/FIRMWARE/backup.c
+*   cc -std=c99 -O2 -pthread -o soak soak.c -ldl
+*
+* Usage: soak [-n count] [-s first seed] [-j workers] [-b dx4050,sp112,sg2100n] [-i none,nack,stuck,bitflip,longwrite,removal,powerloss,twin,restore]
+*             [-m] [-l library] [-f failures shown] [-r seed]
+*
+* -b and -i allow only some boards and faults, -m gives every SP112 board the multiplexer. The multiplexer test of the SP112
+* reset, with a chip pulled out of one of up to 8 sockets at a random moment, is: soak -b sp112 -i removal -m
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#define _POSIX_C_SOURCE 200809L
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "soak.h"
+
+#define defaultCount 100000
+#define defaultFailuresShown 20
+#define chunkSize 16 //seeds taken at once from the own range
+#define maxWorkers 256
+#define libraryName "soakboard.so"
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    uint64_t next;
+    uint64_t end;
+} seedRange;
+
+typedef struct
+{
+    uint64_t seed;
+    soakResult result;
+} soakFailureRecord;
+
+typedef struct
+{
+    unsigned index;
+    void *library;
+    soakRunFunction run;
+    uint64_t instances;
+    uint64_t histogram[boardsCount][injectsCount][outcomesCount];
+    uint64_t failures[failuresCount];
+    uint64_t boardInstances[boardsCount];
+    double latencySum[boardsCount];
+    double latencyWorst[boardsCount];
+    uint64_t latencySeed[boardsCount];
+    soakFailureRecord *failed; //first failures of this worker
+    unsigned failedCount;
+} soakWorker;
+
+static const char *const boardNames[boardsCount] = soakBoardNames;
+static const char *const injectNames[injectsCount] = soakInjectNames;
+static const char *const outcomeNames[outcomesCount] = soakOutcomeNames;
+static const char *const failureNames[failuresCount] = soakFailureNames;
+static seedRange ranges[maxWorkers];
+static unsigned workersCount = 0;
+static soakScenario scenario = {soakAllBoards, soakAllInjects, false};
+static unsigned failuresShown = defaultFailuresShown;
+static const char *libraryPath = NULL;
+static uint64_t done = 0; //instances finished by all workers, only for the progress
+static pthread_mutex_t doneLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *loadBoard(soakInitFunction *, soakRunFunction *); //loads a private copy of the library
+static void *workerThread(void *);
+static bool takeSeeds(unsigned, uint64_t *, uint64_t *); //chunk of the own range or half of the largest range of the others
+static void record(soakWorker *, uint64_t, const soakResult *);
+static void report(soakWorker[], double, uint64_t);
+static unsigned parseNames(const char *, const char *const[], unsigned, const char *); //returns the mask of the names in the list, 0 if one is unknown
+static double seconds(void);
+static void usage(const char *);
+
+int main(int argc, char *argv[])
+{
+    uint64_t count = defaultCount;
+    uint64_t first = 1;
+    uint64_t replaySeed = 0;
+    bool replay = false;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int option = 0;
+
+    workersCount = cores > 0 ? (unsigned)cores : 1;
+    while ((option = getopt(argc, argv, "n:s:j:b:i:ml:f:r:")) != -1)
+    {
+        switch (option)
+        {
+            case 'n':
+                count = strtoull(optarg, NULL, 0);
+                break;
+            case 's':
+                first = strtoull(optarg, NULL, 0);
+                break;
+            case 'j':
+                workersCount = strtoul(optarg, NULL, 0);
+                break;
+            case 'b':
+                scenario.boards = parseNames(optarg, boardNames, boardsCount, "board");
+                break;
+            case 'i':
+                scenario.injects = parseNames(optarg, injectNames, injectsCount, "fault");
+                break;
+            case 'm':
+                scenario.muxAlways = true;
+                break;
+            case 'l':
+                libraryPath = optarg;
+                break;
+            case 'f':
+                failuresShown = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                replaySeed = strtoull(optarg, NULL, 0);
+                replay = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (scenario.boards == 0 || scenario.injects == 0 || workersCount == 0 || workersCount > maxWorkers || count == 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    if (libraryPath == NULL) //next to the harness
+    {
+        static char path[4096];
+        const char *slash = strrchr(argv[0], '/');
+        snprintf(path, sizeof(path), "%.*s%s", slash != NULL ? (int)(slash - argv[0] + 1) : 0, argv[0], libraryName);
+        libraryPath = path;
+    }
+
+    if (replay)
+    {
+        soakInitFunction init = NULL;
+        soakRunFunction run = NULL;
+        soakResult result;
+
+        if (loadBoard(&init, &run) == NULL || init() == false)
+        {
+            fprintf(stderr, "can't load %s\n", libraryPath);
+            return 2;
+        }
+        run(replaySeed, &scenario, true, &result);
+        printf("seed %" PRIu64 ": %s %s, %s, first result after %.1f ms: %s\n", replaySeed, boardNames[result.board],
+            injectNames[result.inject], outcomeNames[result.outcome], result.latency, result.failure == failureNone ? "passed" : failureNames[result.failure]);
+        return result.failure == failureNone ? 0 : 1;
+    }
+
+    soakWorker *workers = calloc(workersCount, sizeof(soakWorker));
+    pthread_t threads[maxWorkers];
+    uint64_t share = count / workersCount;
+    double start = 0.0;
+
+    if (workers == NULL)
+    {
+        return 2;
+    }
+    for (unsigned i = 0; i < workersCount; i++)
+    {
+        soakInitFunction init = NULL;
+
+        pthread_mutex_init(&ranges[i].lock, NULL);
+        ranges[i].next = first + i * share;
+        ranges[i].end = (i == workersCount - 1) ? first + count : first + (i + 1) * share;
+        workers[i].index = i;
+        workers[i].failed = calloc(failuresShown + 1, sizeof(soakFailureRecord));
+        workers[i].library = loadBoard(&init, &workers[i].run);
+        if (workers[i].library == NULL || workers[i].failed == NULL || init() == false)
+        {
+            fprintf(stderr, "can't load %s\n", libraryPath);
+            return 2;
+        }
+    }
+    start = seconds();
+    for (unsigned i = 0; i < workersCount; i++)
+    {
+        pthread_create(&threads[i], NULL, workerThread, &workers[i]);
+    }
+    for (unsigned i = 0; i < workersCount; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    if (isatty(STDERR_FILENO))
+    {
+        fputc('\n', stderr);
+    }
+
+    uint64_t failures = 0;
+    report(workers, seconds() - start, count);
+    for (unsigned i = 0; i < workersCount; i++)
+    {
+        for (unsigned failure = failureHang; failure < failuresCount; failure++)
+        {
+            failures += workers[i].failures[failure];
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//dlopen() returns the same handle for the same file, so every worker gets its own temporary copy, it is unlinked at once.
+//////////////////////////////////////////////////////////////////////////
+static void *loadBoard(soakInitFunction *init, soakRunFunction *run)
+{
+    const char *directory = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+    char copyPath[4096];
+    char buffer[65536];
+    ssize_t size = 0;
+    void *library = NULL;
+    int source = open(libraryPath, O_RDONLY);
+    int copy = -1;
+
+    snprintf(copyPath, sizeof(copyPath), "%s/soakboardXXXXXX", directory);
+    copy = mkstemp(copyPath);
+    if (source < 0 || copy < 0)
+    {
+        if (source >= 0)
+        {
+            close(source);
+        }
+        if (copy >= 0)
+        {
+            close(copy);
+            unlink(copyPath);
+        }
+        return NULL;
+    }
+    while ((size = read(source, buffer, sizeof(buffer))) > 0)
+    {
+        if (write(copy, buffer, size) != size)
+        {
+            size = -1;
+            break;
+        }
+    }
+    close(source);
+    close(copy);
+    if (size == 0)
+    {
+        library = dlopen(copyPath, RTLD_NOW | RTLD_LOCAL);
+    }
+    unlink(copyPath);
+    if (library == NULL)
+    {
+        return NULL;
+    }
+    *(void **)init = dlsym(library, "soakInit");
+    *(void **)run = dlsym(library, "soakRun");
+    return (*init != NULL && *run != NULL) ? library : NULL;
+}
+
+static void *workerThread(void *argument)
+{
+    soakWorker *worker = argument;
+    uint64_t next = 0;
+    uint64_t end = 0;
+
+    while (takeSeeds(worker->index, &next, &end))
+    {
+        for (uint64_t seed = next; seed < end; seed++)
+        {
+            soakResult result;
+
+            worker->run(seed, &scenario, false, &result);
+            record(worker, seed, &result);
+        }
+        pthread_mutex_lock(&doneLock);
+        done += end - next;
+        if (isatty(STDERR_FILENO) && done % 1024 < end - next)
+        {
+            fprintf(stderr, "\r%" PRIu64 " instances", done);
+        }
+        pthread_mutex_unlock(&doneLock);
+    }
+    return NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Only one range is locked at a time. The stolen upper half becomes the own range of the thief, so others can steal from it again.
+//////////////////////////////////////////////////////////////////////////
+static bool takeSeeds(unsigned index, uint64_t *next, uint64_t *end)
+{
+    seedRange *own = &ranges[index];
+
+    while (true)
+    {
+        pthread_mutex_lock(&own->lock);
+        if (own->next < own->end)
+        {
+            *next = own->next;
+            *end = own->end - own->next > chunkSize ? own->next + chunkSize : own->end;
+            own->next = *end;
+            pthread_mutex_unlock(&own->lock);
+            return true;
+        }
+        pthread_mutex_unlock(&own->lock);
+
+        unsigned victim = index;
+        uint64_t largest = 0;
+        for (unsigned i = 0; i < workersCount; i++)
+        {
+            uint64_t left = 0;
+
+            pthread_mutex_lock(&ranges[i].lock);
+            left = ranges[i].end - ranges[i].next;
+            pthread_mutex_unlock(&ranges[i].lock);
+            if (i != index && left > largest)
+            {
+                largest = left;
+                victim = i;
+            }
+        }
+        if (largest == 0)
+        {
+            return false;
+        }
+
+        uint64_t stolenNext = 0;
+        uint64_t stolenEnd = 0;
+        pthread_mutex_lock(&ranges[victim].lock);
+        if (ranges[victim].next < ranges[victim].end)
+        {
+            stolenEnd = ranges[victim].end;
+            stolenNext = ranges[victim].next + (ranges[victim].end - ranges[victim].next) / 2;
+            ranges[victim].end = stolenNext;
+        }
+        pthread_mutex_unlock(&ranges[victim].lock);
+        if (stolenNext < stolenEnd)
+        {
+            pthread_mutex_lock(&own->lock);
+            own->next = stolenNext;
+            own->end = stolenEnd;
+            pthread_mutex_unlock(&own->lock);
+        }
+    }
+}
+
+static void record(soakWorker *worker, uint64_t seed, const soakResult *result)
+{
+    worker->instances++;
+    worker->histogram[result->board][result->inject][result->outcome]++;
+    worker->failures[result->failure]++;
+    worker->boardInstances[result->board]++;
+    worker->latencySum[result->board] += result->latency;
+    if (result->latency > worker->latencyWorst[result->board])
+    {
+        worker->latencyWorst[result->board] = result->latency;
+        worker->latencySeed[result->board] = seed;
+    }
+    if (result->failure != failureNone && worker->failedCount < failuresShown)
+    {
+        worker->failed[worker->failedCount].seed = seed;
+        worker->failed[worker->failedCount].result = *result;
+        worker->failedCount++;
+    }
+}
+
+static void report(soakWorker workers[], double time, uint64_t count)
+{
+    static soakWorker all; //sum of all workers
+    unsigned shown = 0;
+
+    for (unsigned i = 0; i < workersCount; i++)
+    {
+        all.instances += workers[i].instances;
+        for (unsigned board = 0; board < boardsCount; board++)
+        {
+            for (unsigned inject = 0; inject < injectsCount; inject++)
+            {
+                for (unsigned outcome = 0; outcome < outcomesCount; outcome++)
+                {
+                    all.histogram[board][inject][outcome] += workers[i].histogram[board][inject][outcome];
+                }
+            }
+            all.boardInstances[board] += workers[i].boardInstances[board];
+            all.latencySum[board] += workers[i].latencySum[board];
+            if (workers[i].latencyWorst[board] > all.latencyWorst[board])
+            {
+                all.latencyWorst[board] = workers[i].latencyWorst[board];
+                all.latencySeed[board] = workers[i].latencySeed[board];
+            }
+        }
+        for (unsigned failure = 0; failure < failuresCount; failure++)
+        {
+            all.failures[failure] += workers[i].failures[failure];
+        }
+    }
+
+    printf("%" PRIu64 " instances (%" PRIu64 " resets) on %u workers in %.1f s, %.0f resets/s\n", all.instances, 2 * all.instances,
+        workersCount, time, time > 0.0 ? 2 * all.instances / time : 0.0);
+    if (all.instances != count)
+    {
+        printf("warning: %" PRIu64 " instances were not run\n", count - all.instances);
+    }
+    printf("\nfirst result on the LEDs, ms   mean      worst   seed\n");
+    for (unsigned board = 0; board < boardsCount; board++)
+    {
+        if (all.boardInstances[board] > 0)
+        {
+            printf("%-26s %9.1f %10.1f   %" PRIu64 "\n", boardNames[board], all.latencySum[board] / all.boardInstances[board],
+                all.latencyWorst[board], all.latencySeed[board]);
+        }
+    }
+    for (unsigned board = 0; board < boardsCount; board++)
+    {
+        if (all.boardInstances[board] == 0)
+        {
+            continue;
+        }
+        printf("\n%-10s", boardNames[board]);
+        for (unsigned outcome = 0; outcome < outcomesCount; outcome++)
+        {
+            printf("%10s", outcomeNames[outcome]);
+        }
+        putchar('\n');
+        for (unsigned inject = 0; inject < injectsCount; inject++)
+        {
+            printf("%-10s", injectNames[inject]);
+            for (unsigned outcome = 0; outcome < outcomesCount; outcome++)
+            {
+                printf("%10" PRIu64, all.histogram[board][inject][outcome]);
+            }
+            putchar('\n');
+        }
+    }
+    printf("\nfailures:");
+    for (unsigned failure = failureHang; failure < failuresCount; failure++)
+    {
+        printf(" %s %" PRIu64, failureNames[failure], all.failures[failure]);
+    }
+    putchar('\n');
+    for (unsigned i = 0; i < workersCount; i++)
+    {
+        for (unsigned j = 0; j < workers[i].failedCount && shown < failuresShown; j++, shown++)
+        {
+            const soakFailureRecord *failed = &workers[i].failed[j];
+            printf("seed %" PRIu64 " %s %s: %s: %s\n", failed->seed, boardNames[failed->result.board], injectNames[failed->result.inject],
+                failureNames[failed->result.failure], failed->result.text);
+        }
+    }
+    if (shown > 0)
+    {
+        printf("replay a seed with -r SEED and the same -b, -i and -m\n");
+    }
+}
+
+static unsigned parseNames(const char *list, const char *const names[], unsigned count, const char *kind)
+{
+    unsigned mask = 0;
+    char copy[256];
+
+    snprintf(copy, sizeof(copy), "%s", list);
+    for (char *name = strtok(copy, ","); name != NULL; name = strtok(NULL, ","))
+    {
+        unsigned index = 0;
+
+        while (index < count && strcmp(name, names[index]) != 0)
+        {
+            index++;
+        }
+        if (index == count)
+        {
+            fprintf(stderr, "unknown %s %s\n", kind, name);
+            return 0;
+        }
+        mask |= (1 << index);
+    }
+    return mask;
+}
+
+static double seconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-n count] [-s first seed] [-j workers] [-b dx4050,sp112,sg2100n] [-i none,nack,stuck,bitflip,longwrite,removal,powerloss,twin,restore]"
+        " [-m] [-l library] [-f failures shown] [-r seed]\n", name);
+}
@@ -0,0 +1,58 @@
+/*
+* soak.h
+*
+* Interface between the soak harness (soak.c) and the simulated board (board.c). The board is built together
+* with the reset engines of the firmware into one shared library, every worker of the harness loads its own copy.
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef SOAK_H
+#define SOAK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define soakTextSize 160
+
+enum soakBoard { boardDx4050, boardSp112, boardSg2100n, boardsCount };
+//fault injected in the first reset of an instance, the second reset is always without faults, a twin is a worn RICOH chip
+//that is swapped before the second reset for a cartridge of the same model, which differs only in its serial number,
+//a restore is a first reset without faults that the RICOH board undoes from its backups before the second one
+enum soakInject { injectNone, injectNack, injectStuck, injectBitFlip, injectLongWrite, injectRemoval, injectPowerLoss, injectTwin, injectRestore, injectsCount };
+//result of the first reset shown on the LEDs for the chip with the fault
+enum soakOutcome { outcomeReset, outcomeNotFound, outcomeWrongData, outcomeNotReset, outcomeRemoved, outcomeWorn, outcomeNone, outcomesCount };
+//broken rules, the first one found is reported
+enum soakFailure { failureNone, failureHang, failureKeep, failureSilent, failureRecovery, failureWrongType, failureLeds, failureWorn, failureRestore, failuresCount };
+
+#define soakBoardNames {"dx4050", "sp112", "sg2100n"}
+#define soakInjectNames {"none", "nack", "stuck", "bitflip", "longwrite", "removal", "powerloss", "twin", "restore"}
+#define soakOutcomeNames {"reset", "notfound", "wrongdata", "notreset", "removed", "worn", "noresult"}
+#define soakFailureNames {"none", "hang", "keep", "silent", "recovery", "wrongtype", "leds", "worn", "restore"}
+
+typedef struct
+{
+    uint8_t board;
+    uint8_t inject;
+    uint8_t outcome;
+    uint8_t failure;
+    double latency; //ms from the start of the first reset to the first result on the LEDs
+    char text[soakTextSize]; //what went wrong, empty without a failure
+} soakResult;
+
+//instances a run can give, a seed gives the same instance as long as its board and fault are allowed
+typedef struct
+{
+    unsigned boards; //bit for every soakBoard allowed
+    unsigned injects; //bit for every soakInject allowed
+    bool muxAlways; //the SP112 board always has the multiplexer, else only every second one
+} soakScenario;
+
+#define soakAllBoards ((1 << boardsCount) - 1)
+#define soakAllInjects ((1 << injectsCount) - 1)
+
+typedef bool (*soakInitFunction)(void); //takes the power-on snapshot of the board, returns false if the library can't be restored
+typedef void (*soakRunFunction)(uint64_t, const soakScenario *, bool, soakResult *); //runs the instance of the seed allowed by the scenario, prints its bus traffic if verbose
+
+#endif
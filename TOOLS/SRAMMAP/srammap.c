@@ -0,0 +1,270 @@
+/*
+* srammap.c
+*
+* SRAM budget of a firmware build per module. Reads the map file written by the linker and sums
+* the .data (with the constants avr-gcc places in SRAM), .bss and .noinit input sections of every object file.
+* What is left of the SRAM is shared by the stack and the heap, the firmware has no heap, so with the stack peak
+* reported by an SRAM_REPORT build (sram.c) the margin of the build is known.
+*
+* Build: cc -std=c99 -O2 -o srammap srammap.c
+* Firmware map file: add -Wl,-Map=FIRMWARE.map to the link of the firmware
+* Usage: srammap [-r RAM BYTES] [-s STACK PEAK] FIRMWARE.map
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define lineSize 1024
+#define nameSize 128
+#define maxModules 64
+#define ramBase 0x800000UL //avr-gcc places the SRAM at this address of the map
+#define ramEnd 0x810000UL //EEPROM sections start here
+#define defaultRam 2048 //ATmega328P
+
+enum sectionKind { kindData, kindBss, kindNoinit, kindsCount, kindOther = kindsCount };
+
+typedef struct
+{
+    char name[nameSize]; //object file without its directory
+    unsigned long bytes[kindsCount];
+} moduleUsage;
+
+static const char *const kindNames[kindsCount] = {"data", "bss", "noinit"};
+static moduleUsage modules[maxModules];
+static unsigned modulesCount = 0;
+
+static bool parseMap(const char *);
+static void addSection(uint8_t, unsigned long, unsigned long, const char *);
+static uint8_t outputKind(const char *);
+static const char *baseName(const char *);
+static unsigned long moduleTotal(const moduleUsage *);
+static int compareModules(const void *, const void *);
+static bool parseNumber(const char *, unsigned long *);
+static void printReport(unsigned long, unsigned long);
+
+int main(int argc, char *argv[])
+{
+    const char *path = NULL;
+    unsigned long ram = defaultRam;
+    unsigned long stackPeak = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc && parseNumber(argv[i + 1], &ram) && ram != 0)
+        {
+            i++;
+            continue;
+        }
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc && parseNumber(argv[i + 1], &stackPeak))
+        {
+            i++;
+            continue;
+        }
+        if (argv[i][0] == '-' || path != NULL)
+        {
+            fprintf(stderr, "usage: srammap [-r RAM BYTES] [-s STACK PEAK] FIRMWARE.map\n");
+            return 2;
+        }
+        path = argv[i];
+    }
+    if (path == NULL)
+    {
+        fprintf(stderr, "usage: srammap [-r RAM BYTES] [-s STACK PEAK] FIRMWARE.map\n");
+        return 2;
+    }
+    if (!parseMap(path))
+    {
+        return 1;
+    }
+    printReport(ram, stackPeak);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Output sections start in the first column, their input sections are indented by one space. An input section with
+//a long name has its address, size and file on the next line. Lines of patterns (*(.data)) and symbols are skipped.
+//////////////////////////////////////////////////////////////////////////
+static bool parseMap(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char line[lineSize];
+    char pending[nameSize] = ""; //input section waiting for its second line
+    bool memoryMap = false;
+    uint8_t kind = kindOther;
+
+    if (file == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char name[nameSize];
+        char object[lineSize];
+        unsigned long address = 0;
+        unsigned long size = 0;
+
+        if (!memoryMap) //discarded sections and common symbols are listed before
+        {
+            memoryMap = strncmp(line, "Linker script and memory map", 28) == 0;
+            continue;
+        }
+        if (line[0] == '.')
+        {
+            sscanf(line, "%127s", name);
+            kind = outputKind(name);
+            pending[0] = '\0';
+            continue;
+        }
+        if (kind == kindOther || line[0] != ' ')
+        {
+            continue;
+        }
+        if (pending[0] != '\0')
+        {
+            if (sscanf(line, " 0x%lx 0x%lx %1023s", &address, &size, object) == 3)
+            {
+                addSection(kind, address, size, object);
+            }
+            pending[0] = '\0';
+            continue;
+        }
+        if (line[1] != '.' && strncmp(line + 1, "COMMON", 6) != 0)
+        {
+            continue;
+        }
+        int fields = sscanf(line, " %127s 0x%lx 0x%lx %1023s", name, &address, &size, object);
+
+        if (fields == 1)
+        {
+            strcpy(pending, name);
+        }
+        else if (fields == 4)
+        {
+            addSection(kind, address, size, object);
+        }
+    }
+    fclose(file);
+    if (!memoryMap)
+    {
+        fprintf(stderr, "%s: not a map file of the linker\n", path);
+        return false;
+    }
+    return true;
+}
+
+static void addSection(uint8_t kind, unsigned long address, unsigned long size, const char *object)
+{
+    const char *name = baseName(object);
+    unsigned i = 0;
+
+    if (size == 0 || address < ramBase || address >= ramEnd)
+    {
+        return;
+    }
+    while (i < modulesCount && strcmp(modules[i].name, name) != 0)
+    {
+        i++;
+    }
+    if (i == modulesCount)
+    {
+        if (modulesCount == maxModules)
+        {
+            i = maxModules - 1; //the last row collects the rest
+            strcpy(modules[i].name, "(other)");
+        }
+        else
+        {
+            snprintf(modules[i].name, nameSize, "%s", name);
+            modulesCount++;
+        }
+    }
+    modules[i].bytes[kind] += size;
+}
+
+static uint8_t outputKind(const char *name)
+{
+    for (uint8_t kind = 0; kind < kindsCount; kind++)
+    {
+        if (name[0] == '.' && strcmp(name + 1, kindNames[kind]) == 0)
+        {
+            return kind;
+        }
+    }
+    return kindOther;
+}
+
+//libc.a(strlen.o) stays as it is, only the directory is removed
+static const char *baseName(const char *path)
+{
+    const char *name = path;
+
+    for (const char *c = path; *c != '\0' && *c != '('; c++)
+    {
+        if (*c == '/' || *c == '\\')
+        {
+            name = c + 1;
+        }
+    }
+    return name;
+}
+
+static unsigned long moduleTotal(const moduleUsage *module)
+{
+    return module->bytes[kindData] + module->bytes[kindBss] + module->bytes[kindNoinit];
+}
+
+static int compareModules(const void *a, const void *b)
+{
+    unsigned long first = moduleTotal(a);
+    unsigned long second = moduleTotal(b);
+
+    return first < second ? 1 : first > second ? -1 : strcmp(((const moduleUsage *)a)->name, ((const moduleUsage *)b)->name);
+}
+
+static bool parseNumber(const char *text, unsigned long *value)
+{
+    char *end = NULL;
+
+    *value = strtoul(text, &end, 0);
+    return end != text && *end == '\0';
+}
+
+static void printReport(unsigned long ram, unsigned long stackPeak)
+{
+    unsigned long totals[kindsCount] = {0};
+    unsigned long statics = 0;
+
+    qsort(modules, modulesCount, sizeof(moduleUsage), compareModules);
+    printf("%-32s %6s %6s %6s %6s\n", "module", "data", "bss", "noinit", "total");
+    for (unsigned i = 0; i < modulesCount; i++)
+    {
+        printf("%-32s %6lu %6lu %6lu %6lu\n", modules[i].name, modules[i].bytes[kindData], modules[i].bytes[kindBss],
+               modules[i].bytes[kindNoinit], moduleTotal(&modules[i]));
+        for (uint8_t kind = 0; kind < kindsCount; kind++)
+        {
+            totals[kind] += modules[i].bytes[kind];
+        }
+    }
+    statics = totals[kindData] + totals[kindBss] + totals[kindNoinit];
+    printf("%-32s %6lu %6lu %6lu %6lu\n", "all", totals[kindData], totals[kindBss], totals[kindNoinit], statics);
+    printf("\nstatics: %lu of %lu bytes (%.1f%%)\n", statics, ram, 100.0 * statics / ram);
+    if (statics > ram)
+    {
+        printf("the statics don't fit in the SRAM\n");
+        return;
+    }
+    printf("left for the stack: %lu bytes\n", ram - statics);
+    if (stackPeak != 0)
+    {
+        long margin = (long)(ram - statics) - (long)stackPeak;
+
+        printf("stack peak: %lu bytes, margin: %ld bytes%s\n", stackPeak, margin, margin < 0 ? ", the stack overwrites the statics" : "");
+    }
+}
@@ -0,0 +1,158 @@
+/*
+* UNIVERSAL_CHIP_RESETTER.c
+*
+* One firmware for all resetters. The Epson chip is connected to PC0-PC3 like on the DX4050 board
+* and RICOH chips to SDA/SCL like on the SP112 and SG2100N boards, LEDs are on PB0-PB2.
+* Build it together with DX4050_CHIP_RESETTER.c, SP112_CHIP_RESETTER.c, SG2100N_CHIP_RESETTER.c
+* and i2cmaster.c of COMMON/FIRMWARE, with UNIVERSAL_RESETTER defined for all of them (make universal in COMMON/FIRMWARE).
+* The optional modules of the build flags are not supported, their hooks are in the main loops of the board firmwares.
+*
+* https://github.com/wcyb/cartridge_chip_resetter
+*
+*/
+
+#ifndef F_CPU
+#define F_CPU 8000000UL //8MHz internal RC, a crystal clocked board can be built with 16MHz or 20MHz
+#endif
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdbool.h>
+#include <util/delay.h>
+#include <avr/sfr_defs.h>
+#include "../../COMMON/FIRMWARE/i2cmaster.h"
+#include "../../EPSON/DX4050/FIRMWARE/DX4050_CHIP_RESETTER.h"
+#include "../../RICOH/SP112/FIRMWARE/SP112_CHIP_RESETTER.h"
+#include "../../RICOH/SG2100N/FIRMWARE/SG2100N_CHIP_RESETTER.h"
+
+#if defined(FAULT_INJECTION) || defined(SELF_BENCHMARK) || defined(TIMING_PROBE) || defined(SRAM_REPORT) || defined(SERIAL_CONTROL) \
+    || defined(CHIP_BACKUP) || defined(CHIP_HEALTH) || defined(CHIP_EMULATION)
+#error "the universal resetter has no optional modules, build the DX4050, SP112 or SG2100N firmware with them"
+#endif
+
+#define gndDet PINC0 //Epson chip connects this pin to the ground
+
+#define signaturesCount 3
+#define chipTypeSize 2
+#define i2cAddrCount 5
+
+#define sp112Chip 0 //profile of the SP112 chip in the signatures, the SG2100N chips use the profiles of their engine
+
+#define whiteLed 7
+#define offLed 0
+
+typedef struct
+{
+    uint8_t type[chipTypeSize]; //first two bytes of the chip
+    uint8_t profile; //sp112Chip or the SG2100N profile of the type, the reset engine doesn't read the type again
+} chipSignature;
+
+volatile bool startResetting = false; //if true then user pressed the button
+//known RICOH chip types, Epson chips are recognized by their ID and "ACK" in the DX4050 engine
+static const chipSignature signatures[signaturesCount] = {{{32, 0}, sp112Chip}, {{227, 18}, sg2100nGelProfile}, {{227, 1}, sg2100nWasteProfile}};
+static const uint8_t i2cAddresses[i2cAddrCount] = {0xA2, 0xA4, 0xA6, 0xA0, 0xA8}; //in order used by the SG2100N engine (C M Y B W), SP112 chip uses 0xA6
+
+static bool detectI2cChip(void); //searches for a RICOH chip and resets it if its type is known, returns false if nothing known was found
+static void blinkError(void); //1 white blink, chip not found
+
+int main(void)
+{
+    DDRB = 0x7; //LEDs
+    DDRC = 0xE; //EN, CLK and DATA of the Epson chip are outputs
+    DDRD = 0x0; //set input type for the button, the rest of pins are also inputs
+    PORTB = 0xF8;
+    PORTC = 0x30; //pull-up SDA and SCL
+    PORTD = 0xFB;
+    //----------------------------------------------
+    EICRA |= (1 << ISC01); //INT0 on falling edge
+    EIMSK |= (1 << INT0); //enable INT0
+    //----------------------------------------------
+    i2c_init(); //initialize I2C library
+    sei(); //enable interrupts
+
+    while (1)
+    {
+        if (startResetting == true)
+        {
+            EIMSK &= ~(1 << INT0); //disable INT0 for the time of resetting
+            uint8_t foundChips = 0;
+            if (bit_is_clear(PINC, gndDet)) //Epson chip is connected, check which colors answer
+            {
+                foundChips = dx4050FindChips();
+            }
+            if (foundChips != 0)
+            {
+                dx4050ResetChips(foundChips);
+            }
+            else if (detectI2cChip() == false)
+            {
+                blinkError();
+            }
+            EIMSK |= (1 << INT0); //enable INT0 again
+            EIFR |= (1 << INTF0); //clear INT0 flag, this will eliminate additional reading after release of button
+            startResetting = false; //end resetting
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//Checks all RICOH addresses, reads the type of the first chip that answers and starts the reset engine for this type.
+//////////////////////////////////////////////////////////////////////////
+static bool detectI2cChip(void)
+{
+    uint8_t chipType[chipTypeSize] = {0};
+
+    for (uint8_t addrNum = 0; addrNum < i2cAddrCount; addrNum++)
+    {
+        if (i2c_start(i2cAddresses[addrNum] + I2C_WRITE) != 0) //nothing at this address
+        {
+            continue;
+        }
+        i2c_write(0x0);
+        i2c_rep_start(i2cAddresses[addrNum] + I2C_READ);
+        chipType[0] = i2c_readAck();
+        chipType[1] = i2c_readNak();
+        if (i2c_error() != 0) //the type is not valid, the next address is tried on a recovered bus
+        {
+            i2c_recover();
+            continue;
+        }
+        i2c_stop();
+
+        for (uint8_t i = 0; i < signaturesCount; i++)
+        {
+            if (chipType[0] == signatures[i].type[0] && chipType[1] == signatures[i].type[1])
+            {
+                if (signatures[i].profile == sp112Chip)
+                {
+                    sp112ResetChips(); //SP112 chip has only one address
+                }
+                else
+                {
+                    sg2100nResetProfile(addrNum + 1, signatures[i].profile);
+                }
+                return true;
+            }
+        }
+    }
+    if (i2c_error() != 0)
+    {
+        i2c_recover();
+        return false;
+    }
+    i2c_stop();
+    return false;
+}
+
+static void blinkError(void)
+{
+    PORTB = whiteLed;
+    _delay_ms(250);
+    PORTB = offLed;
+    _delay_ms(250);
+}
+
+ISR(INT0_vect)
+{
+    startResetting = true;
+}